@@ -13,6 +13,60 @@
 #include <cstdlib>
 #include <cstring>
 
+//=================================
+// Implementation of LcdCompositor class
+//=================================
+void LcdCompositor::addFill(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool transparent, uint16_t bgColor)
+{
+    if (x1 < x0 || y1 < y0) { return; }
+    if (numFills >= MaxFills) { // no room, fill at once (still before any draw of the frame)
+        LCD_FillBackground(x0, y0, x1, y1, transparent, bgColor);
+        return;
+    }
+    fills[numFills++] = {x0, y0, x1, y1, transparent, bgColor};
+}
+
+// merge b into a if union of them is exactly a rectangle (no extra pixel to fill)
+bool LcdCompositor::tryMerge(fill_t& a, const fill_t& b)
+{
+    if (a.transparent != b.transparent || a.bgColor != b.bgColor) { return false; }
+    bool contains = a.x0 <= b.x0 && a.y0 <= b.y0 && a.x1 >= b.x1 && a.y1 >= b.y1;
+    bool contained = b.x0 <= a.x0 && b.y0 <= a.y0 && b.x1 >= a.x1 && b.y1 >= a.y1;
+    bool vertical = a.x0 == b.x0 && a.x1 == b.x1 && b.y0 <= a.y1+1 && a.y0 <= b.y1+1;
+    bool horizontal = a.y0 == b.y0 && a.y1 == b.y1 && b.x0 <= a.x1+1 && a.x0 <= b.x1+1;
+    if (!(contains || contained || vertical || horizontal)) { return false; }
+    if (b.x0 < a.x0) { a.x0 = b.x0; }
+    if (b.y0 < a.y0) { a.y0 = b.y0; }
+    if (b.x1 > a.x1) { a.x1 = b.x1; }
+    if (b.y1 > a.y1) { a.y1 = b.y1; }
+    return true;
+}
+
+void LcdCompositor::flush()
+{
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < numFills && !merged; i++) {
+            for (int j = i + 1; j < numFills; j++) {
+                if (tryMerge(fills[i], fills[j])) {
+                    fills[j] = fills[--numFills];
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < numFills; i++) {
+        const fill_t& f = fills[i];
+        LCD_FillBackground(f.x0, f.y0, f.x1, f.y1, f.transparent, f.bgColor);
+    }
+    #ifdef DEBUG_LCD_ELEMENT_BOX
+    if (numFills > 0) { printf("LcdCompositor fills: %d\r\n", numFills); }
+    #endif // DEBUG_LCD_ELEMENT_BOX
+    numFills = 0;
+}
+
 //=================================
 // Implementation of ImageBox class
 //=================================
@@ -37,8 +91,19 @@ void ImageBox::update()
 
 void ImageBox::draw()
 {
-    if (!isUpdated || image == NULL) { return; }
-    isUpdated = false;
+    if (image == NULL) { return; }
+    if (isUpdated) {
+        isUpdated = false;
+        drawLine = -1;
+        if (!_hasImage) { // image buffer could be under decoding
+            if (!bgFilled) { clear(); }
+            bgFilled = false;
+            return;
+        }
+        drawLine = 0;
+    }
+    if (drawLine < 0) { return; }
+    // push DrawLines lines per call (image is continued at next draw())
     int16_t ofs_x = 0;
     int16_t ofs_y = 0;
 
@@ -46,11 +111,14 @@ void ImageBox::draw()
         ofs_x = (width-img_w)/2;
         ofs_y = (height-img_h)/2;
     }
+    int16_t lines = (img_h - drawLine < DrawLines) ? img_h - drawLine : DrawLines;
     LCD_ShowPicture(
-        pos_x+ofs_x, pos_y+ofs_y,
-        pos_x+ofs_x+img_w-1, pos_y+ofs_y+img_h-1,
-        (u8*) image
+        pos_x+ofs_x, pos_y+ofs_y+drawLine,
+        pos_x+ofs_x+img_w-1, pos_y+ofs_y+drawLine+lines-1,
+        (u8*) &image[img_w*drawLine]
     );
+    drawLine += lines;
+    if (drawLine >= img_h) { drawLine = -1; }
 }
 
 void ImageBox::clear()
@@ -58,6 +126,19 @@ void ImageBox::clear()
     LCD_Fill(pos_x, pos_y, pos_x+width-1, pos_y+height-1, bgColor);
 }
 
+void ImageBox::collectFill(LcdCompositor& compositor)
+{
+    if (!isUpdated || image == NULL || _hasImage) { return; }
+    compositor.addFill(pos_x, pos_y, pos_x+width-1, pos_y+height-1, false, bgColor);
+    bgFilled = true;
+}
+
+// image push is pending or continued
+bool ImageBox::isDrawing()
+{
+    return drawLine >= 0 || (isUpdated && _hasImage && image != NULL);
+}
+
 void ImageBox::getImagePtr(uint16_t** img_ptr, uint16_t* width, uint16_t* height)
 {
     *img_ptr = this->image;
@@ -94,6 +175,7 @@ void ImageBox::resetImage()
 
 uint16_t ImageBox::getPixel(uint16_t x, uint16_t y, bool tiled)
 {
+    if (!_hasImage) { return bgColor; }
     uint16_t xx = (tiled) ? x % img_w : x;
     uint16_t yy = (tiled) ? y % img_h : y;
     if (xx < img_w && yy < img_h) {
@@ -144,7 +226,7 @@ void IconBox::draw()
 {
     if (!isUpdated) { return; }
     isUpdated = false;
-    clear();
+    clearOnce();
     LCD_ShowIcon(pos_x, pos_y, icon, !bgOpaque, fgColor);
 }
 
@@ -153,6 +235,24 @@ void IconBox::clear()
     LCD_FillBackground(pos_x, pos_y, pos_x+iconWidth-1, pos_y+iconHeight-1, !bgOpaque, bgColor);
 }
 
+void IconBox::collectFill(LcdCompositor& compositor)
+{
+    if (!isUpdated) { return; }
+    addClear(compositor);
+}
+
+void IconBox::addClear(LcdCompositor& compositor)
+{
+    compositor.addFill(pos_x, pos_y, pos_x+iconWidth-1, pos_y+iconHeight-1, !bgOpaque, bgColor);
+    bgFilled = true;
+}
+
+void IconBox::clearOnce()
+{
+    if (!bgFilled) { clear(); }
+    bgFilled = false;
+}
+
 void IconBox::setIcon(uint8_t* icon)
 {
     if (this->icon == icon) { return; }
@@ -160,6 +260,15 @@ void IconBox::setIcon(uint8_t* icon)
     update();
 }
 
+uint32_t textHash(const char* str, size_t len)
+{
+    uint32_t hash = TextHashBasis;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619UL;
+    }
+    return hash;
+}
+
 //=================================
 // Implementation of TextBox class
 //=================================
@@ -173,7 +282,7 @@ TextBox::TextBox(int16_t pos_x, int16_t pos_y, align_enm align, uint16_t fgColor
 
 TextBox::TextBox(int16_t pos_x, int16_t pos_y, const char* str, align_enm align, uint16_t fgColor, uint16_t bgColor, bool bgOpaque)
     : isUpdated(true), pos_x(pos_x), pos_y(pos_y), fgColor(fgColor), bgColor(bgColor),
-      x0(pos_x), y0(pos_y), w0(0), h0(0), align(align), bgOpaque(bgOpaque), drawCount(0), blink(false)
+      x0(pos_x), y0(pos_y), w0(0), h0(0), align(align), bgOpaque(bgOpaque), drawCount(0), blink(false), str("")
 {
     setText(str);
 }
@@ -200,24 +309,24 @@ void TextBox::update()
 void TextBox::draw()
 {
     if (!isUpdated && !(blink && drawCount % (BlinkInterval/2) == 0)) { drawCount++; return; }
-    int16_t x_ofs;
     isUpdated = false;
     //TextBox::clear(); // call clear() of this class
-    if (strlen(str) == 0) { return; } // not to calculate x0, y0, w0, h0 because illegal values cause clear() mulfunction
+    if (strLen == 0) { return; } // not to calculate x0, y0, w0, h0 because illegal values cause clear() mulfunction
     uint16_t w1, h1;
     int16_t x1, y1;
-    w1 = strlen(str)*8;
+    getTextRect(&x1, &w1);
     h1 = 16;
-    x_ofs = (align == LcdElementBox::AlignRight) ? -w1 : (align == LcdElementBox::AlignCenter) ? -w1/2 : 0;
-    x1 = pos_x+x_ofs;
     y1 = pos_y;
     // clear left & right wing
-    if (x0 < x1) { // left wing
-        LCD_FillBackground(x0, y1, x1-1, y1+h1-1, !bgOpaque, bgColor);
-    }
-    if (x0+w0 > x1+w1) { // right wing
-        LCD_FillBackground(x1+w1, y1, x0+w0-1, y1+h1-1, !bgOpaque, bgColor);
+    if (!wingsFilled) {
+        if (x0 < x1) { // left wing
+            LCD_FillBackground(x0, y1, x1-1, y1+h1-1, !bgOpaque, bgColor);
+        }
+        if (x0+w0 > x1+w1) { // right wing
+            LCD_FillBackground(x1+w1, y1, x0+w0-1, y1+h1-1, !bgOpaque, bgColor);
+        }
     }
+    wingsFilled = false;
     w0 = w1;
     h0 = h1;
     x0 = x1;
@@ -235,21 +344,56 @@ void TextBox::clear()
     LCD_FillBackground(x0, y0, x0+w0-1, y0+h0-1, !bgOpaque, bgColor); // clear previous rectangle
 }
 
+void TextBox::getTextRect(int16_t* x1, uint16_t* w1)
+{
+    *w1 = strLen*8;
+    int16_t x_ofs = (align == LcdElementBox::AlignRight) ? -*w1 : (align == LcdElementBox::AlignCenter) ? -*w1/2 : 0;
+    *x1 = pos_x+x_ofs;
+}
+
+void TextBox::collectFill(LcdCompositor& compositor)
+{
+    if (!isUpdated || strLen == 0) { return; }
+    int16_t x1;
+    uint16_t w1;
+    getTextRect(&x1, &w1);
+    if (x0 < x1) { // left wing
+        compositor.addFill(x0, pos_y, x1-1, pos_y+16-1, !bgOpaque, bgColor);
+    }
+    if (x0+w0 > x1+w1) { // right wing
+        compositor.addFill(x1+w1, pos_y, x0+w0-1, pos_y+16-1, !bgOpaque, bgColor);
+    }
+    wingsFilled = true;
+}
+
 void TextBox::setText(const char* str)
 {
-    if (strncmp(this->str, str, charSize) == 0) { return; }
-    memcpy(this->str, str, charSize);
+    size_t len = strnlen(str, charSize - 1);
+    if (len == strLen && memcmp(this->str, str, len) == 0) { return; }
+    memcpy(this->str, str, len);
+    this->str[len] = '\0';
+    strLen = static_cast<uint16_t>(len);
+    strHash = textHash(this->str, len);
     update();
 }
 
+bool TextBox::commitText()
+{
+    str[charSize - 1] = '\0';
+    size_t len = strlen(str);
+    uint32_t hash = textHash(str, len);
+    if (len == strLen && hash == strHash) { return false; }
+    strLen = static_cast<uint16_t>(len);
+    strHash = hash;
+    return true;
+}
+
 void TextBox::setFormatText(const char* fmt, ...)
 {
-    char str_temp[charSize];
     va_list va;
     va_start(va, fmt);
-    vsprintf(str_temp, fmt, va);
+    writeText([&](char* str, size_t size) { return vsnprintf(str, size, fmt, va) >= 0; });
     va_end(va);
-    setText(str_temp);
 }
 
 void TextBox::setInt(int value)
@@ -291,8 +435,8 @@ void IconTextBox::update()
 void IconTextBox::draw()
 {
     // For IconBox: Don't display IconBox if str of TextBox is ""
-    if (strlen(str) == 0) {
-        if (isUpdated) { iconBox.clear(); }
+    if (strLen == 0) {
+        if (isUpdated) { iconBox.clearOnce(); }
     } else {
         iconBox.draw();
     }
@@ -306,6 +450,16 @@ void IconTextBox::clear()
     TextBox::clear();
 }
 
+void IconTextBox::collectFill(LcdCompositor& compositor)
+{
+    if (strLen == 0) {
+        if (isUpdated) { iconBox.addClear(compositor); }
+    } else {
+        iconBox.collectFill(compositor);
+    }
+    TextBox::collectFill(compositor);
+}
+
 void IconTextBox::setIcon(uint8_t* icon)
 {
     iconBox.setIcon(icon);
@@ -316,7 +470,7 @@ void IconTextBox::setIcon(uint8_t* icon)
 //=================================
 ScrollTextBox::ScrollTextBox(int16_t pos_x, int16_t pos_y, uint16_t width, uint16_t height, uint16_t fgColor, uint16_t bgColor, bool bgOpaque)
     : isUpdated(true), pos_x(pos_x), pos_y(pos_y), fgColor(fgColor), bgColor(bgColor),
-      str(""), width(width), height(height), bgOpaque(bgOpaque), sft_val(0), count(0), scr_en(true)
+      str(""), strWidth(0), width(width), height(height), bgOpaque(bgOpaque), sft_val(0), count(0), scr_en(true)
 {
 }
 
@@ -348,7 +502,9 @@ void ScrollTextBox::update()
 void ScrollTextBox::draw()
 {
     if (!isUpdated && !scr_en) { return; }
-    if (isUpdated) { ScrollTextBox::clear(); }// call clear() of this class
+    if (!isUpdated && strWidth <= width) { return; } // nothing to scroll
+    if (isUpdated && !bgFilled) { ScrollTextBox::clear(); }// call clear() of this class
+    bgFilled = false;
     isUpdated = false;
     LCD_Scroll_ShowString(pos_x, pos_y, pos_x, pos_x+width-1, (u8*) str, !bgOpaque, fgColor, (u16*) &sft_val, count);
     count++;
@@ -359,6 +515,13 @@ void ScrollTextBox::clear()
     LCD_FillBackground(pos_x, pos_y, pos_x+width-1, pos_y+height-1, !bgOpaque, bgColor);
 }
 
+void ScrollTextBox::collectFill(LcdCompositor& compositor)
+{
+    if (!isUpdated) { return; }
+    compositor.addFill(pos_x, pos_y, pos_x+width-1, pos_y+height-1, !bgOpaque, bgColor);
+    bgFilled = true;
+}
+
 void ScrollTextBox::setScroll(bool scr_en)
 {
     if (this->scr_en == scr_en) { return; }
@@ -368,9 +531,40 @@ void ScrollTextBox::setScroll(bool scr_en)
 
 void ScrollTextBox::setText(const char* str)
 {
-    if (strncmp(this->str, str, charSize) == 0) { return; }
+    size_t len = strnlen(str, charSize - 1);
+    if (len == strLen && memcmp(this->str, str, len) == 0) { return; }
     update();
-    memcpy(this->str, str, charSize);
+    memcpy(this->str, str, len);
+    this->str[len] = '\0';
+    strLen = static_cast<uint16_t>(len);
+    strHash = textHash(this->str, len);
+    strWidth = measureText(this->str);
+}
+
+bool ScrollTextBox::commitText()
+{
+    str[charSize - 1] = '\0';
+    size_t len = strlen(str);
+    uint32_t hash = textHash(str, len);
+    if (len == strLen && hash == strHash) { return false; }
+    strLen = static_cast<uint16_t>(len);
+    strHash = hash;
+    strWidth = measureText(str);
+    return true;
+}
+
+// upper bound of pixel width of UTF-8 string (8 for ASCII, 16 for wider code point)
+uint16_t ScrollTextBox::measureText(const char* str)
+{
+    uint16_t w = 0;
+    for (const uint8_t* p = (const uint8_t*) str; *p != '\0' && p < (const uint8_t*) str + charSize; p++) {
+        if (*p < 0x80) {
+            w += 8;
+        } else if ((*p & 0xc0) == 0xc0) { // lead byte (continuation bytes are skipped)
+            w += 16;
+        }
+    }
+    return w;
 }
 
 //=================================
@@ -400,8 +594,8 @@ void IconScrollTextBox::update()
 void IconScrollTextBox::draw()
 {
     // For IconBox: Don't display IconBox if str of ScrollTextBox is ""
-    if (strlen(str) == 0) {
-        if (isUpdated) { iconBox.clear(); }
+    if (strLen == 0) {
+        if (isUpdated) { iconBox.clearOnce(); }
     } else {
         iconBox.draw();
     }
@@ -415,6 +609,16 @@ void IconScrollTextBox::clear()
     ScrollTextBox::clear();
 }
 
+void IconScrollTextBox::collectFill(LcdCompositor& compositor)
+{
+    if (strLen == 0) {
+        if (isUpdated) { iconBox.addClear(compositor); }
+    } else {
+        iconBox.collectFill(compositor);
+    }
+    ScrollTextBox::collectFill(compositor);
+}
+
 void IconScrollTextBox::setIcon(uint8_t* icon)
 {
     iconBox.setIcon(icon);
@@ -10,6 +10,9 @@
 
 #include "lcd_extra.h"
 
+#include <cstddef>
+#include <cstdint>
+
 //#define DEBUG_LCD_ELEMENT_BOX
 
 // Colors for LCD
@@ -29,6 +32,32 @@
 #define LCD_GRAYBLUE      0x5458
 #define LCD_DARKGRAY      0x4208
 
+// FNV-1a hash of text box string
+static constexpr uint32_t TextHashBasis = 2166136261u;
+uint32_t textHash(const char* str, size_t len);
+
+//=================================
+// Definition of LcdCompositor class
+//=================================
+// Collects background fills (clear) of LcdElementBox objects before drawing a frame,
+// merges those forming one rectangle together and fills each merged region once
+class LcdCompositor
+{
+public:
+    static constexpr int MaxFills = 24;
+    void addFill(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool transparent, uint16_t bgColor);
+    void flush();
+protected:
+    typedef struct {
+        int16_t x0, y0, x1, y1;
+        bool transparent;
+        uint16_t bgColor;
+    } fill_t;
+    fill_t fills[MaxFills];
+    int numFills = 0;
+    static bool tryMerge(fill_t& a, const fill_t& b);
+};
+
 //=================================
 // Definition of LcdElementBox interface
 //=================================
@@ -44,6 +73,8 @@ public:
     virtual void update() = 0;
     virtual void draw() = 0;
     virtual void clear() = 0;
+    virtual void collectFill(LcdCompositor& compositor) {} // hand clear of next draw() to compositor
+    virtual bool isDrawing() { return false; } // true while draw() is pending or continued in slices
 };
 
 //=================================
@@ -56,11 +87,14 @@ public:
         origin = 0, // LeftTop
         center
     } align_t;
+    static constexpr int16_t DrawLines = 16; // lines pushed to LCD per draw() to bound blocking time
     ImageBox(int16_t pos_x, int16_t pos_y, uint16_t width, uint16_t height, uint16_t bgColor = LCD_BLACK);
     void setBgColor(uint16_t bgColor);
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
+    bool isDrawing();
     void getImagePtr(uint16_t** img_ptr, uint16_t* width, uint16_t* height);
     void setImageSize(int16_t img_w, int16_t img_h);
     void setPixel(int16_t x, int16_t y, uint16_t rgb565);
@@ -69,6 +103,7 @@ public:
     bool hasImage();
 protected:
     bool isUpdated;
+    bool bgFilled = false; // cleared by LcdCompositor
     bool _hasImage;
     int16_t pos_x, pos_y;
     uint16_t width, height; // ImageBox dimension
@@ -76,6 +111,7 @@ protected:
     uint16_t* image;
     uint16_t img_w, img_h; // dimention of image stored
     align_t align;
+    int16_t drawLine = -1; // next line to push, -1: not drawing
 };
 
 //=================================
@@ -91,11 +127,15 @@ public:
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
+    void addClear(LcdCompositor& compositor);
+    void clearOnce(); // clear unless it has been done by LcdCompositor
     void setIcon(uint8_t* icon);
     static constexpr int iconWidth = 16;
     static constexpr int iconHeight = 16;
 protected:
     bool isUpdated;
+    bool bgFilled = false; // cleared by LcdCompositor
     int16_t pos_x, pos_y;
     uint16_t fgColor;
     uint16_t bgColor;
@@ -117,7 +157,10 @@ public:
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
     virtual void setText(const char* str);
+    template <typename Writer>
+    void writeText(Writer writer); // bool writer(char* str, size_t size) writes text in place into the box buffer
     void setFormatText(const char* fmt, ...);
     void setInt(int value);
     void setBlink(bool blink);
@@ -125,6 +168,7 @@ public:
 protected:
     static constexpr int BlinkInterval = 20;
     bool isUpdated;
+    bool wingsFilled = false; // left & right wings cleared by LcdCompositor
     int16_t pos_x, pos_y;
     uint16_t fgColor;
     uint16_t bgColor;
@@ -135,8 +179,19 @@ protected:
     uint32_t drawCount;
     bool blink;
     char str[charSize];
+    uint16_t strLen = 0; // length of str except '\0'
+    uint32_t strHash = TextHashBasis; // to detect change of str written in place
+    void getTextRect(int16_t* x1, uint16_t* w1);
+    bool commitText(); // returns true if str written in place differs from previous one
 };
 
+template <typename Writer>
+void TextBox::writeText(Writer writer)
+{
+    if (!writer(str, charSize)) { str[0] = '\0'; }
+    if (commitText()) { update(); }
+}
+
 //=================================
 // Definition of IconTextBox class < TextBox
 //=================================
@@ -149,6 +204,7 @@ public:
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
     void setIcon(uint8_t* icon);
 protected:
     IconBox iconBox;
@@ -167,15 +223,24 @@ public:
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
     void setScroll(bool scr_en);
     virtual void setText(const char* str);
+    template <typename Writer>
+    void writeText(Writer writer); // bool writer(char* str, size_t size) writes text in place into the box buffer
     static constexpr int charSize = 256;
 protected:
+    static uint16_t measureText(const char* str);
+    bool commitText(); // returns true if str written in place differs from previous one
     bool isUpdated;
+    bool bgFilled = false; // cleared by LcdCompositor
     int16_t pos_x, pos_y;
     uint16_t fgColor;
     uint16_t bgColor;
     char str[charSize];
+    uint16_t strLen = 0; // length of str except '\0'
+    uint32_t strHash = TextHashBasis; // to detect change of str written in place
+    uint16_t strWidth; // pixel width of str measured at setText()
     uint16_t width;
     uint16_t height;
     bool bgOpaque;
@@ -184,6 +249,13 @@ protected:
     bool scr_en;
 };
 
+template <typename Writer>
+void ScrollTextBox::writeText(Writer writer)
+{
+    if (!writer(str, charSize)) { str[0] = '\0'; }
+    if (commitText()) { update(); }
+}
+
 //=================================
 // Definition of IconScrollTextBox class < ScrollTextBox
 //=================================
@@ -196,6 +268,7 @@ public:
     void update();
     void draw();
     void clear();
+    void collectFill(LcdCompositor& compositor);
     void setIcon(uint8_t* icon);
 protected:
     IconBox iconBox;
@@ -0,0 +1,288 @@
+/*------------------------------------------------------/
+/ Inflater
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "Inflater.h"
+
+#include <cstring>
+
+static const uint16_t LEN_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LEN_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t CLEN_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+//==================================
+// Implementation of Inflater class
+//==================================
+void Inflater::init(input_func_t inputFunc, void* ctx, uint8_t* window, size_t windowSize)
+{
+    this->inputFunc = inputFunc;
+    this->ctx = ctx;
+    inPtr = nullptr;
+    inLeft = 0;
+    bitBuf = 0;
+    bitCnt = 0;
+    this->window = window;
+    windowMask = windowSize - 1;
+    windowPos = 0;
+    windowFill = 0;
+    state = Header;
+    final = false;
+    storedLeft = 0;
+    copyLen = 0;
+    copyDist = 0;
+}
+
+bool Inflater::isEnd() const
+{
+    return state == Done && copyLen == 0;
+}
+
+// fill bitBuf to n bits at least (only fills available bytes if input ends)
+bool Inflater::fillBits(int n)
+{
+    while (bitCnt < n) {
+        if (inLeft == 0) {
+            inLeft = inputFunc(ctx, &inPtr);
+            if (inLeft == 0) { return false; }
+        }
+        bitBuf |= static_cast<uint32_t>(*inPtr++) << bitCnt;
+        inLeft--;
+        bitCnt += 8;
+    }
+    return true;
+}
+
+uint32_t Inflater::getBits(int n)
+{
+    if (n == 0) { return 0; }
+    if (!fillBits(n)) {
+        state = Error;
+        return 0;
+    }
+    uint32_t val = bitBuf & ((1UL << n) - 1);
+    bitBuf >>= n;
+    bitCnt -= n;
+    return val;
+}
+
+// returns symbol, -1: error
+int Inflater::decodeSymbol(const huffman_t& h)
+{
+    fillBits(MAX_BITS);  // could be less at the end of input
+    uint16_t entry = h.fast[bitBuf & ((1 << FAST_BITS) - 1)];
+    if (entry != 0 && (entry >> 12) <= bitCnt) {
+        bitBuf >>= (entry >> 12);
+        bitCnt -= (entry >> 12);
+        return entry & 0x0fff;
+    }
+    // canonical decode bit by bit
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= MAX_BITS && len <= bitCnt; len++) {
+        code |= (bitBuf >> (len - 1)) & 1;
+        int count = h.count[len];
+        if (code - count < first) {
+            bitBuf >>= len;
+            bitCnt -= len;
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool Inflater::buildHuffman(huffman_t& h, const uint8_t* lengths, int num)
+{
+    uint16_t offs[MAX_BITS + 2];
+    memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < num; i++) {
+        h.count[lengths[i]]++;
+    }
+    h.count[0] = 0;
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) { return false; }  // over-subscribed (incomplete code is allowed)
+    }
+    offs[1] = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h.count[len];
+    }
+    for (int i = 0; i < num; i++) {
+        if (lengths[i] != 0) { h.symbol[offs[lengths[i]]++] = i; }
+    }
+    // lookup table of short codes (bit reversed as deflate packs codes from MSB)
+    memset(h.fast, 0, sizeof(h.fast));
+    int code = 0;
+    int index = 0;
+    for (int len = 1; len <= FAST_BITS; len++) {
+        for (int k = 0; k < h.count[len]; k++) {
+            int rev = 0;
+            for (int b = 0; b < len; b++) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (int j = rev; j < (1 << FAST_BITS); j += (1 << len)) {
+                h.fast[j] = (len << 12) | h.symbol[index];
+            }
+            code++;
+            index++;
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+bool Inflater::readDynamicTables()
+{
+    uint8_t lengths[NUM_LIT_SYMS + NUM_DIST_SYMS + 2];
+    int nlen = getBits(5) + 257;
+    int ndist = getBits(5) + 1;
+    int ncode = getBits(4) + 4;
+    if (state == Error || nlen > NUM_LIT_SYMS || ndist > NUM_DIST_SYMS + 2) { return false; }
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; i++) {
+        lengths[CLEN_ORDER[i]] = getBits(3);
+    }
+    if (state == Error || !buildHuffman(distCode, lengths, 19)) { return false; }  // distCode is used for code lengths temporarily
+    int i = 0;
+    while (i < nlen + ndist) {
+        int sym = decodeSymbol(distCode);
+        if (sym < 0) { return false; }
+        if (sym < 16) {
+            lengths[i++] = sym;
+            continue;
+        }
+        uint8_t len = 0;
+        int rep;
+        if (sym == 16) {
+            if (i == 0) { return false; }
+            len = lengths[i - 1];
+            rep = 3 + getBits(2);
+        } else if (sym == 17) {
+            rep = 3 + getBits(3);
+        } else {
+            rep = 11 + getBits(7);
+        }
+        if (state == Error || i + rep > nlen + ndist) { return false; }
+        while (rep-- > 0) {
+            lengths[i++] = len;
+        }
+    }
+    if (lengths[256] == 0) { return false; }  // no end of block code
+    return buildHuffman(litCode, lengths, nlen) && buildHuffman(distCode, &lengths[nlen], ndist);
+}
+
+bool Inflater::startBlock()
+{
+    if (final) {
+        state = Done;
+        return true;
+    }
+    final = getBits(1);
+    uint32_t type = getBits(2);
+    if (state == Error) { return false; }
+    if (type == 0) {
+        // stored block from next byte boundary
+        getBits(bitCnt & 7);
+        uint32_t len = getBits(16);
+        uint32_t nlen = getBits(16);
+        if (state == Error || len != (~nlen & 0xffff)) { return false; }
+        storedLeft = len;
+        state = Stored;
+    } else if (type == 1) {
+        uint8_t lengths[NUM_LIT_SYMS];
+        memset(&lengths[0], 8, 144);
+        memset(&lengths[144], 9, 112);
+        memset(&lengths[256], 7, 24);
+        memset(&lengths[280], 8, 8);
+        buildHuffman(litCode, lengths, NUM_LIT_SYMS);
+        memset(lengths, 5, NUM_DIST_SYMS);
+        buildHuffman(distCode, lengths, NUM_DIST_SYMS);
+        state = Huffman;
+    } else if (type == 2) {
+        if (!readDynamicTables()) { return false; }
+        state = Huffman;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int Inflater::read(uint8_t* dst, size_t size)
+{
+    size_t n = 0;
+    while (n < size) {
+        if (copyLen > 0) {
+            uint8_t b = window[(windowPos - copyDist) & windowMask];
+            window[windowPos++ & windowMask] = b;
+            if (windowFill <= windowMask) { windowFill++; }
+            dst[n++] = b;
+            copyLen--;
+            continue;
+        }
+        if (state == Header) {
+            if (!startBlock()) { state = Error; }
+        } else if (state == Stored) {
+            if (storedLeft == 0) {
+                state = Header;
+                continue;
+            }
+            uint8_t b = getBits(8);
+            if (state == Error) { break; }
+            window[windowPos++ & windowMask] = b;
+            if (windowFill <= windowMask) { windowFill++; }
+            dst[n++] = b;
+            storedLeft--;
+        } else if (state == Huffman) {
+            int sym = decodeSymbol(litCode);
+            if (sym < 0) {
+                state = Error;
+            } else if (sym < 256) {
+                window[windowPos++ & windowMask] = sym;
+                if (windowFill <= windowMask) { windowFill++; }
+                dst[n++] = sym;
+            } else if (sym == 256) {
+                state = Header;
+            } else {
+                sym -= 257;
+                if (sym >= 29) { state = Error; continue; }
+                int len = LEN_BASE[sym] + getBits(LEN_EXTRA[sym]);
+                int dsym = decodeSymbol(distCode);
+                if (dsym < 0 || dsym >= NUM_DIST_SYMS) { state = Error; continue; }
+                uint32_t dist = DIST_BASE[dsym] + getBits(DIST_EXTRA[dsym]);
+                if (state == Error) { continue; }
+                if (dist > windowFill) { state = Error; continue; }  // beyond window
+                copyLen = len;
+                copyDist = dist;
+            }
+        } else {
+            break;  // Done or Error
+        }
+    }
+    return (state == Error && n == 0) ? -1 : static_cast<int>(n);
+}
@@ -0,0 +1,68 @@
+/*------------------------------------------------------/
+/ Inflater
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//=================================
+// Interface of Inflater class
+//=================================
+// Streaming decoder of raw deflate data (RFC 1951) pulled by read()
+// Output history is kept in the window given by caller (power of 2, up to 32KB)
+class Inflater
+{
+public:
+    static constexpr size_t MAX_WINDOW_SIZE = 32768;
+    // set *ptr to next input bytes and return the number of them (0: no more input)
+    typedef size_t (*input_func_t)(void* ctx, const uint8_t** ptr);
+    void init(input_func_t inputFunc, void* ctx, uint8_t* window, size_t windowSize);
+    int read(uint8_t* dst, size_t size);  // returns number of bytes inflated (less than size only at end of data), -1: error
+    bool isEnd() const;
+protected:
+    static constexpr int MAX_BITS = 15;
+    static constexpr int FAST_BITS = 9;
+    static constexpr int NUM_LIT_SYMS = 288;
+    static constexpr int NUM_DIST_SYMS = 30;
+    typedef enum {
+        Header = 0,
+        Stored,
+        Huffman,
+        Done,
+        Error
+    } state_t;
+    typedef struct {
+        uint16_t count[MAX_BITS + 1];  // number of codes of each length
+        uint16_t symbol[NUM_LIT_SYMS];  // symbols ordered by code
+        uint16_t fast[1 << FAST_BITS];  // (length << 12 | symbol) for codes up to FAST_BITS, 0: decode by count
+    } huffman_t;
+    input_func_t inputFunc;
+    void* ctx;
+    const uint8_t* inPtr;
+    size_t inLeft;
+    uint32_t bitBuf;
+    int bitCnt;
+    uint8_t* window;
+    size_t windowMask;
+    size_t windowPos;
+    size_t windowFill;  // valid bytes in window
+    state_t state;
+    bool final;
+    uint32_t storedLeft;
+    uint16_t copyLen;  // pending match
+    uint16_t copyDist;
+    huffman_t litCode;
+    huffman_t distCode;
+    bool fillBits(int n);
+    uint32_t getBits(int n);
+    int decodeSymbol(const huffman_t& h);
+    static bool buildHuffman(huffman_t& h, const uint8_t* lengths, int num);
+    bool startBlock();
+    bool readDynamicTables();
+};
@@ -0,0 +1,374 @@
+/*------------------------------------------------------/
+/ PNGDecoder
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "PNGDecoder.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "file_menu_FatFs.h"
+#include "mem_budget.h"
+
+PNGDecoder PngDec;
+
+static constexpr uint32_t CHUNK_IHDR = 0x49484452;
+static constexpr uint32_t CHUNK_PLTE = 0x504c5445;
+static constexpr uint32_t CHUNK_TRNS = 0x74524e53;
+static constexpr uint32_t CHUNK_IDAT = 0x49444154;
+static constexpr uint32_t CHUNK_IEND = 0x49454e44;
+static constexpr int MAX_WIDTH = 2048;  // to bound line buffers
+
+static inline uint32_t getBe32(const uint8_t* buf)
+{
+    return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | (uint32_t) buf[3];
+}
+
+static inline uint16_t toRgb565(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+static inline uint8_t blend(uint8_t c, uint8_t a)
+{
+    return (uint8_t) (((uint16_t) c * a + 127) / 255);
+}
+
+static inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p = (int) a + b - c;
+    int pa = (p > a) ? p - a : a - p;
+    int pb = (p > b) ? p - b : b - p;
+    int pc = (p > c) ? p - c : c - p;
+    if (pa <= pb && pa <= pc) { return a; }
+    return (pb <= pc) ? b : c;
+}
+
+//====================================
+// Implementation of PNGDecoder class
+//====================================
+// read ahead in sector aligned unit (FatFs reads whole sectors directly into readBuf)
+bool PNGDecoder::fillReadBuf()
+{
+    uint64_t left = fileSize - fileRead;
+    if (left == 0) { return false; }
+    UINT btr = READ_BUF_SIZE - (size_t) (f_tell(&fil) % READ_BUF_ALIGN);
+    if (btr > left) { btr = (UINT) left; }
+    UINT br;
+    FRESULT fr = file_menu_read(&fil, FILE_MENU_CUR_POS, readBuf, btr, &br);  // read by core1 between audio refills
+    if (fr != FR_OK || br == 0) { return false; }
+    fileRead += br;
+    readBufPos = 0;
+    readBufLen = br;
+    return true;
+}
+
+bool PNGDecoder::readBytes(uint8_t* buf, size_t size)
+{
+    while (size > 0) {
+        if (readBufPos >= readBufLen && !fillReadBuf()) { return false; }
+        size_t len = readBufLen - readBufPos;
+        if (len > size) { len = size; }
+        if (buf != nullptr) {
+            memcpy(buf, &readBuf[readBufPos], len);
+            buf += len;
+        }
+        readBufPos += len;
+        size -= len;
+    }
+    return true;
+}
+
+bool PNGDecoder::skipBytes(uint32_t size)
+{
+    return readBytes(nullptr, size);
+}
+
+bool PNGDecoder::readChunkHeader(uint32_t* length, uint32_t* type)
+{
+    uint8_t buf[8];
+    if (!readBytes(buf, sizeof(buf))) { return false; }
+    *length = getBe32(&buf[0]);
+    *type = getBe32(&buf[4]);
+    return true;
+}
+
+// input of Inflater: data of consecutive IDAT chunks directly from readBuf
+size_t PNGDecoder::idatInput(void* ctx, const uint8_t** ptr)
+{
+    PNGDecoder* dec = static_cast<PNGDecoder*>(ctx);
+    while (dec->chunkLeft == 0) {
+        if (dec->idatEnd) { return 0; }
+        uint32_t length, type;
+        if (!dec->skipBytes(4) || !dec->readChunkHeader(&length, &type) || type != CHUNK_IDAT) {  // CRC of previous chunk is skipped
+            dec->idatEnd = true;
+            return 0;
+        }
+        dec->chunkLeft = length;
+    }
+    if (dec->readBufPos >= dec->readBufLen && !dec->fillReadBuf()) {
+        dec->idatEnd = true;
+        return 0;
+    }
+    size_t len = dec->readBufLen - dec->readBufPos;
+    if (len > dec->chunkLeft) { len = dec->chunkLeft; }
+    *ptr = &dec->readBuf[dec->readBufPos];
+    dec->readBufPos += len;
+    dec->chunkLeft -= len;
+    return len;
+}
+
+bool PNGDecoder::readHeader()
+{
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a};
+    uint8_t buf[13];
+    uint32_t length, type;
+    if (!readBytes(buf, sizeof(SIGNATURE)) || memcmp(buf, SIGNATURE, sizeof(SIGNATURE)) != 0) { return false; }
+    if (!readChunkHeader(&length, &type) || type != CHUNK_IHDR || length != 13) { return false; }
+    if (!readBytes(buf, 13) || !skipBytes(4)) { return false; }
+    uint32_t w = getBe32(&buf[0]);
+    uint32_t h = getBe32(&buf[4]);
+    bitDepth = buf[8];
+    colorType = static_cast<color_type_t>(buf[9]);
+    if (w == 0 || h == 0 || w > MAX_WIDTH || h > 0xffff) { return false; }
+    if (buf[10] != 0 || buf[11] != 0 || buf[12] != 0) { return false; }  // interlaced image is not supported
+    switch (colorType) {
+        case Gray:      channels = 1; break;
+        case RGB:       channels = 3; break;
+        case Palette:   channels = 1; break;
+        case GrayAlpha: channels = 2; break;
+        case RGBAlpha:  channels = 4; break;
+        default: return false;
+    }
+    bool validDepth = (colorType == Gray) ? (bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16) :
+                      (colorType == Palette) ? (bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8) :
+                      (bitDepth == 8 || bitDepth == 16);
+    if (!validDepth) { return false; }
+    width = (int) w;
+    height = (int) h;
+    stride = ((size_t) width * channels * bitDepth + 7) / 8;
+    bpp = (channels * bitDepth + 7) / 8;
+
+    // chunks up to first IDAT
+    bool hasPalette = false;
+    memset(palette, 0, sizeof(palette));
+    while (true) {
+        if (!readChunkHeader(&length, &type) || type == CHUNK_IEND) { return false; }
+        if (type == CHUNK_IDAT) { break; }
+        if (type == CHUNK_PLTE && length % 3 == 0 && length <= 256 * 3) {
+            for (uint32_t i = 0; i < length / 3; i++) {
+                if (!readBytes(buf, 3)) { return false; }
+                palette[i] = toRgb565(buf[0], buf[1], buf[2]);
+            }
+            length = 0;
+            hasPalette = true;
+        } else if (type == CHUNK_TRNS && colorType == Palette && hasPalette) {
+            for (uint32_t i = 0; i < length && i < 256; i++) {
+                if (!readBytes(buf, 1)) { return false; }
+                uint8_t r = ((palette[i] >> 8) & 0xf8) | (palette[i] >> 13);
+                uint8_t g = ((palette[i] >> 3) & 0xfc) | ((palette[i] >> 9) & 0x3);
+                uint8_t b = ((palette[i] << 3) & 0xf8) | ((palette[i] >> 2) & 0x7);
+                palette[i] = toRgb565(blend(r, buf[0]), blend(g, buf[0]), blend(b, buf[0]));
+            }
+            length = (length > 256) ? length - 256 : 0;
+        }
+        if (!skipBytes(length + 4)) { return false; }  // rest of chunk and CRC
+    }
+    if (colorType == Palette && !hasPalette) { return false; }
+    chunkLeft = length;
+    idatEnd = false;
+    return true;
+}
+
+int PNGDecoder::decodeSdFile(const char* pngFile, const uint64_t pos, const size_t size)
+{
+    abort();
+    file_menu_fs_lock();
+    FRESULT fr = f_open(&fil, (TCHAR*) pngFile, FA_READ);
+    if (fr == FR_OK && pos != 0) {
+        fr = f_lseek(&fil, (FSIZE_t) pos);
+        if (fr != FR_OK) { f_close(&fil); }
+    }
+    file_menu_fs_unlock();
+    if (fr != FR_OK) {
+        #ifdef DEBUG_PNG_DECODER
+        printf("ERROR: PNG file open failed\r\n");
+        #endif // DEBUG_PNG_DECODER
+        return -1;
+    }
+    isOpen = true;
+    fileSize = (pos == 0) ? f_size(&fil) : size;
+    fileRead = 0;
+    readBufPos = 0;
+    readBufLen = 0;
+    if (!readHeader()) {
+        #ifdef DEBUG_PNG_DECODER
+        printf("ERROR: PNG header not supported\r\n");
+        #endif // DEBUG_PNG_DECODER
+        abort();
+        return 0;
+    }
+
+    // zlib header at the head of IDAT data (Adler-32 at the end is not checked)
+    uint8_t zlibHeader[2];
+    if (chunkLeft < 2 || !readBytes(zlibHeader, 2)) {
+        abort();
+        return -1;
+    }
+    chunkLeft -= 2;
+    if ((zlibHeader[0] & 0x0f) != 8 || (zlibHeader[0] >> 4) > 7 || (zlibHeader[1] & 0x20) ||
+        (((uint16_t) zlibHeader[0] << 8) | zlibHeader[1]) % 31 != 0) {
+        abort();
+        return -1;
+    }
+    // window no larger than declared by encoder nor than whole raw data
+    size_t declared = (size_t) 1 << ((zlibHeader[0] >> 4) + 8);
+    uint64_t rawSize = (uint64_t) height * (stride + 1);
+    size_t windowSize = MIN_WINDOW_SIZE;
+    while (windowSize < declared && windowSize < rawSize && windowSize < Inflater::MAX_WINDOW_SIZE) {
+        windowSize <<= 1;
+    }
+    window = mem_pool_new<uint8_t>(MEM_POOL_IMAGE, windowSize);
+    prevLine = mem_pool_new<uint8_t>(MEM_POOL_IMAGE, stride);
+    curLine = mem_pool_new<uint8_t>(MEM_POOL_IMAGE, stride);
+    outLine = mem_pool_new<uint16_t>(MEM_POOL_IMAGE, width);
+    if (window == nullptr || prevLine == nullptr || curLine == nullptr || outLine == nullptr) {
+        #ifdef DEBUG_PNG_DECODER
+        printf("ERROR: PNG buffers not available in image pool\r\n");
+        #endif // DEBUG_PNG_DECODER
+        abort();
+        return 0;
+    }
+    memset(prevLine, 0, stride);
+    inflater.init(idatInput, this, window, windowSize);
+    lineY = 0;
+    #ifdef DEBUG_PNG_DECODER
+    printf("PNG %dx%d depth: %d color: %d window: %d\r\n", width, height, (int) bitDepth, (int) colorType, (int) windowSize);
+    #endif // DEBUG_PNG_DECODER
+    return 1;
+}
+
+bool PNGDecoder::unfilter(uint8_t filterType)
+{
+    uint8_t* cur = curLine;
+    const uint8_t* prev = prevLine;
+    switch (filterType) {
+        case 0:  // None
+            break;
+        case 1:  // Sub
+            for (size_t i = bpp; i < stride; i++) {
+                cur[i] += cur[i - bpp];
+            }
+            break;
+        case 2:  // Up
+            for (size_t i = 0; i < stride; i++) {
+                cur[i] += prev[i];
+            }
+            break;
+        case 3:  // Average
+            for (size_t i = 0; i < stride; i++) {
+                uint8_t a = (i >= bpp) ? cur[i - bpp] : 0;
+                cur[i] += (uint8_t) (((uint16_t) a + prev[i]) >> 1);
+            }
+            break;
+        case 4:  // Paeth
+            for (size_t i = 0; i < stride; i++) {
+                uint8_t a = (i >= bpp) ? cur[i - bpp] : 0;
+                uint8_t c = (i >= bpp) ? prev[i - bpp] : 0;
+                cur[i] += paeth(a, prev[i], c);
+            }
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// idx-th sample of line (upper 8 bits for 16 bit depth, raw value for less than 8 bit depth)
+uint8_t PNGDecoder::getSample(const uint8_t* line, int idx) const
+{
+    if (bitDepth == 8) { return line[idx]; }
+    if (bitDepth == 16) { return line[idx * 2]; }
+    int bitPos = idx * bitDepth;
+    int shift = 8 - bitDepth - (bitPos & 7);
+    return (line[bitPos >> 3] >> shift) & ((1 << bitDepth) - 1);
+}
+
+void PNGDecoder::convertLine()
+{
+    const uint8_t grayScale = (bitDepth < 8) ? 255 / ((1 << bitDepth) - 1) : 1;
+    for (int x = 0; x < width; x++) {
+        uint8_t r, g, b;
+        switch (colorType) {
+            case Palette:
+                outLine[x] = palette[getSample(curLine, x)];
+                continue;
+            case Gray:
+                r = g = b = getSample(curLine, x) * grayScale;
+                break;
+            case GrayAlpha:
+                r = g = b = blend(getSample(curLine, x * 2), getSample(curLine, x * 2 + 1));
+                break;
+            case RGB:
+                r = getSample(curLine, x * 3);
+                g = getSample(curLine, x * 3 + 1);
+                b = getSample(curLine, x * 3 + 2);
+                break;
+            case RGBAlpha:
+            default:
+            {
+                uint8_t a = getSample(curLine, x * 4 + 3);
+                r = blend(getSample(curLine, x * 4), a);
+                g = blend(getSample(curLine, x * 4 + 1), a);
+                b = blend(getSample(curLine, x * 4 + 2), a);
+                break;
+            }
+        }
+        outLine[x] = toRgb565(r, g, b);
+    }
+}
+
+const uint16_t* PNGDecoder::readLine()
+{
+    if (!isOpen) { return nullptr; }
+    if (lineY >= height) {
+        abort();
+        return nullptr;
+    }
+    uint8_t filterType;
+    if (inflater.read(&filterType, 1) != 1 || inflater.read(curLine, stride) != (int) stride || !unfilter(filterType)) {
+        #ifdef DEBUG_PNG_DECODER
+        printf("ERROR: PNG data broken at line %d\r\n", lineY);
+        #endif // DEBUG_PNG_DECODER
+        abort();
+        return nullptr;
+    }
+    convertLine();
+    uint8_t* tmp = prevLine;
+    prevLine = curLine;
+    curLine = tmp;
+    lineY++;
+    return outLine;
+}
+
+void PNGDecoder::abort()
+{
+    if (isOpen) {
+        file_menu_fs_lock();
+        f_close(&fil);
+        file_menu_fs_unlock();
+        isOpen = false;
+    }
+    mem_pool_free(MEM_POOL_IMAGE, window);
+    mem_pool_free(MEM_POOL_IMAGE, prevLine);
+    mem_pool_free(MEM_POOL_IMAGE, curLine);
+    mem_pool_free(MEM_POOL_IMAGE, outLine);
+    window = nullptr;
+    prevLine = nullptr;
+    curLine = nullptr;
+    outLine = nullptr;
+}
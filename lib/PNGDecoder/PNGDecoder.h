@@ -0,0 +1,77 @@
+/*------------------------------------------------------/
+/ PNGDecoder
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ff.h"
+#include "Inflater.h"
+
+//#define DEBUG_PNG_DECODER
+
+//=================================
+// Interface of PNGDecoder class
+//=================================
+// Line by line decoder of PNG image on SD card into RGB565
+// Only two raw lines and deflate window are held instead of whole image
+// (bit depth: 1/2/4/8/16, color type: gray/RGB/palette with or without alpha, non-interlaced only)
+// alpha is composited over black
+class PNGDecoder
+{
+public:
+    int width = 0;
+    int height = 0;
+    int decodeSdFile(const char* pngFile, const uint64_t pos = 0, const size_t size = 0);  // 1: OK, 0: unsupported, -1: error
+    const uint16_t* readLine();  // RGB565 line of width pixels, nullptr: no more line or error
+    void abort();
+protected:
+    static constexpr size_t READ_BUF_SIZE = 2048;  // read-ahead of SD file
+    static constexpr size_t READ_BUF_ALIGN = 512;  // sector size
+    static constexpr size_t MIN_WINDOW_SIZE = 256;
+    typedef enum {
+        Gray = 0,
+        RGB = 2,
+        Palette = 3,
+        GrayAlpha = 4,
+        RGBAlpha = 6
+    } color_type_t;
+    FIL fil;
+    bool isOpen = false;
+    uint64_t fileSize;  // bytes of PNG data
+    uint64_t fileRead;  // bytes read from SD file into readBuf
+    uint8_t readBuf[READ_BUF_SIZE];
+    size_t readBufPos = 0;
+    size_t readBufLen = 0;
+    uint32_t chunkLeft;  // bytes left in current IDAT chunk
+    bool idatEnd;
+    uint8_t bitDepth;
+    color_type_t colorType;
+    int channels;
+    size_t stride;  // bytes of raw line without filter type
+    size_t bpp;  // bytes per complete pixel for filtering (at least 1)
+    int lineY;
+    uint16_t palette[256];
+    Inflater inflater;
+    uint8_t* window = nullptr;
+    uint8_t* prevLine = nullptr;
+    uint8_t* curLine = nullptr;
+    uint16_t* outLine = nullptr;
+    bool fillReadBuf();
+    bool readBytes(uint8_t* buf, size_t size);
+    bool skipBytes(uint32_t size);
+    bool readChunkHeader(uint32_t* length, uint32_t* type);
+    static size_t idatInput(void* ctx, const uint8_t** ptr);
+    bool readHeader();
+    bool unfilter(uint8_t filterType);
+    uint8_t getSample(const uint8_t* line, int idx) const;
+    void convertLine();
+};
+
+extern PNGDecoder PngDec;
@@ -0,0 +1,175 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "Equalizer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+#include "i2s_audio_init.h"
+
+const Equalizer::band_t Equalizer::presets[NUM_PRESETS][MAX_BANDS] = {
+    // Off
+    {{LowShelf, 100.0f, 0.0f, 0.0f}, {Peaking, 1000.0f, 0.0f, 1.0f}, {HighShelf, 8000.0f, 0.0f, 0.0f}},
+    // BassBoost
+    {{LowShelf, 100.0f, 6.0f, 0.0f}, {Peaking, 1000.0f, 0.0f, 1.0f}, {HighShelf, 8000.0f, 0.0f, 0.0f}},
+    // TrebleBoost
+    {{HighShelf, 6000.0f, 6.0f, 0.0f}, {Peaking, 1000.0f, 0.0f, 1.0f}, {LowShelf, 100.0f, 0.0f, 0.0f}},
+    // Vocal
+    {{Peaking, 2500.0f, 4.0f, 1.0f}, {LowShelf, 100.0f, -3.0f, 0.0f}, {HighShelf, 8000.0f, 0.0f, 0.0f}},
+    // Loudness
+    {{LowShelf, 100.0f, 6.0f, 0.0f}, {HighShelf, 8000.0f, 4.0f, 0.0f}, {Peaking, 1000.0f, 0.0f, 1.0f}},
+};
+
+// saturate 64bit result into S32 (with margin for DAC_ZERO)
+static inline int32_t sat32(int64_t value)
+{
+    if (value > INT32_MAX - DAC_ZERO) { return INT32_MAX - DAC_ZERO; }
+    if (value < INT32_MIN) { return INT32_MIN; }
+    return static_cast<int32_t>(value);
+}
+
+//=================================
+// Implementation of Equalizer class
+//=================================
+Equalizer::Equalizer() : preset(Off), sampFreq(0), numBands(0), coefs{}, states{}
+{
+}
+
+// bands are limited by estimated cycles so that decode stage of high sampling frequency does not underrun
+// sum of boosts is taken as headroom by the first band so that boosted full scale signal is not clipped by sat32()
+void Equalizer::setup(preset_t preset, uint32_t sampFreq)
+{
+    this->preset = preset;
+    this->sampFreq = sampFreq;
+    numBands = 0;
+    if (preset >= NUM_PRESETS || sampFreq == 0) { return; }
+    uint64_t budget = static_cast<uint64_t>(clock_get_hz(clk_sys)) * BUDGET_PERCENT / 100;
+    uint64_t cyclesPerBand = static_cast<uint64_t>(sampFreq) * 2 * CYCLES_PER_BAND;
+    float boostDb = 0.0f;
+    for (int i = 0; i < MAX_BANDS; i++) {
+        const band_t& band = presets[preset][i];
+        if (band.gainDb == 0.0f || band.freq >= sampFreq * 0.45f) { continue; }  // no effect or beyond Nyquist
+        if (cyclesPerBand * (numBands + 1) > budget) {
+            printf("Equalizer: band %d disabled by cycle budget at %d Hz\r\n", i, static_cast<int>(sampFreq));
+            break;
+        }
+        coefs[numBands++] = calcCoef(band, sampFreq);
+        if (band.gainDb > 0.0f) { boostDb += band.gainDb; }
+    }
+    if (numBands > 0 && boostDb > 0.0f) {
+        float preGain = powf(10.0f, -boostDb / 20.0f);
+        coef_t& c = coefs[0];
+        c.b0 = static_cast<int32_t>(lroundf(c.b0 * preGain));
+        c.b1 = static_cast<int32_t>(lroundf(c.b1 * preGain));
+        c.b2 = static_cast<int32_t>(lroundf(c.b2 * preGain));
+    }
+    reset();
+}
+
+void Equalizer::reset()
+{
+    memset(states, 0, sizeof(states));
+}
+
+// Audio EQ Cookbook (RBJ) normalized by a0 and converted into Q28
+Equalizer::coef_t Equalizer::calcCoef(const band_t& band, uint32_t sampFreq)
+{
+    float a = powf(10.0f, band.gainDb / 40.0f);
+    float w0 = 2.0f * static_cast<float>(M_PI) * band.freq / static_cast<float>(sampFreq);
+    float cosW0 = cosf(w0);
+    float sinW0 = sinf(w0);
+    float b0, b1, b2, a0, a1, a2;
+    if (band.type == Peaking) {
+        float alpha = sinW0 / (2.0f * band.q);
+        b0 = 1.0f + alpha * a;
+        b1 = -2.0f * cosW0;
+        b2 = 1.0f - alpha * a;
+        a0 = 1.0f + alpha / a;
+        a1 = -2.0f * cosW0;
+        a2 = 1.0f - alpha / a;
+    } else {
+        float beta = 2.0f * sqrtf(a) * sinW0 / sqrtf(2.0f);  // 2 * sqrt(A) * alpha of slope 1
+        float sign = (band.type == LowShelf) ? 1.0f : -1.0f;
+        b0 = a * ((a + 1.0f) - sign * (a - 1.0f) * cosW0 + beta);
+        b1 = sign * 2.0f * a * ((a - 1.0f) - sign * (a + 1.0f) * cosW0);
+        b2 = a * ((a + 1.0f) - sign * (a - 1.0f) * cosW0 - beta);
+        a0 = (a + 1.0f) + sign * (a - 1.0f) * cosW0 + beta;
+        a1 = -sign * 2.0f * ((a - 1.0f) + sign * (a + 1.0f) * cosW0);
+        a2 = (a + 1.0f) + sign * (a - 1.0f) * cosW0 - beta;
+    }
+    const float scale = static_cast<float>(1 << COEF_BITS) / a0;
+    return {
+        static_cast<int32_t>(lroundf(b0 * scale)),
+        static_cast<int32_t>(lroundf(b1 * scale)),
+        static_cast<int32_t>(lroundf(b2 * scale)),
+        static_cast<int32_t>(lroundf(a1 * scale)),
+        static_cast<int32_t>(lroundf(a2 * scale))
+    };
+}
+
+// Direct Form I (history holds input and output without DAC_ZERO offset)
+void Equalizer::processBand(const coef_t& c, state_t& sl, state_t& sr, int32_t* samples, uint32_t count)
+{
+    state_t l = sl;
+    state_t r = sr;
+    for (uint32_t i = 0; i < count; i++, samples += 2) {
+        int32_t x = samples[0] - DAC_ZERO;
+        int64_t acc = static_cast<int64_t>(c.b0) * x + static_cast<int64_t>(c.b1) * l.x1 + static_cast<int64_t>(c.b2) * l.x2
+            - static_cast<int64_t>(c.a1) * l.y1 - static_cast<int64_t>(c.a2) * l.y2;
+        int32_t y = sat32(acc >> COEF_BITS);
+        l.x2 = l.x1;
+        l.x1 = x;
+        l.y2 = l.y1;
+        l.y1 = y;
+        samples[0] = y + DAC_ZERO;
+        x = samples[1] - DAC_ZERO;
+        acc = static_cast<int64_t>(c.b0) * x + static_cast<int64_t>(c.b1) * r.x1 + static_cast<int64_t>(c.b2) * r.x2
+            - static_cast<int64_t>(c.a1) * r.y1 - static_cast<int64_t>(c.a2) * r.y2;
+        y = sat32(acc >> COEF_BITS);
+        r.x2 = r.x1;
+        r.x1 = x;
+        r.y2 = r.y1;
+        r.y1 = y;
+        samples[1] = y + DAC_ZERO;
+    }
+    sl = l;
+    sr = r;
+}
+
+// the last band is dropped if bands take more than BUDGET_PERCENT of the time the samples are played
+void Equalizer::process(int32_t* samples, uint32_t count)
+{
+    if (numBands == 0 || count == 0) { return; }
+    uint32_t start = time_us_32();
+    for (int i = 0; i < numBands; i++) {
+        processBand(coefs[i], states[i][0], states[i][1], samples, count);
+    }
+    uint32_t elapsed = time_us_32() - start;
+    if (static_cast<uint64_t>(elapsed) * sampFreq * 100 > static_cast<uint64_t>(count) * 1000000 * BUDGET_PERCENT) {
+        numBands--;
+        printf("Equalizer: band %d disabled by decode time %d us\r\n", numBands, static_cast<int>(elapsed));
+    }
+}
+
+Equalizer::preset_t Equalizer::getPreset() const
+{
+    return preset;
+}
+
+uint32_t Equalizer::getSampFreq() const
+{
+    return sampFreq;
+}
+
+int Equalizer::getNumBands() const
+{
+    return numBands;
+}
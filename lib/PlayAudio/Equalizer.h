@@ -0,0 +1,65 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+
+//=================================
+// Interface of Equalizer Class
+//=================================
+// Cascade of stereo biquad filters in Q28 fixed point applied to S32 samples in place
+// coefficients are calculated per preset and sampling frequency by setup()
+// (negative pre-gain of the sum of boosts is applied so that presets cut rather than clip at full scale)
+class Equalizer
+{
+public:
+    typedef enum {
+        Off = 0,
+        BassBoost,
+        TrebleBoost,
+        Vocal,
+        Loudness,
+        NUM_PRESETS
+    } preset_t;
+    static constexpr int MAX_BANDS = 3;
+    Equalizer();
+    void setup(preset_t preset, uint32_t sampFreq);  // not to be called while process() runs
+    void reset();  // clear filter history
+    void process(int32_t* samples, uint32_t count);  // count: number of stereo samples
+    preset_t getPreset() const;
+    uint32_t getSampFreq() const;
+    int getNumBands() const;
+protected:
+    static constexpr int COEF_BITS = 28;
+    static constexpr uint32_t CYCLES_PER_BAND = 70;  // estimated cycles of a biquad per channel sample
+    static constexpr uint32_t BUDGET_PERCENT = 30;  // max share of clk_sys (and of play time of samples) for all bands
+    typedef enum {
+        LowShelf = 0,
+        Peaking,
+        HighShelf
+    } filter_t;
+    typedef struct _band_t {
+        filter_t type;
+        float freq;
+        float gainDb;
+        float q;  // only for Peaking
+    } band_t;
+    typedef struct _coef_t {
+        int32_t b0, b1, b2, a1, a2;
+    } coef_t;
+    typedef struct _state_t {
+        int32_t x1, x2, y1, y2;
+    } state_t;
+    static const band_t presets[NUM_PRESETS][MAX_BANDS];  // bands in order of priority (gainDb = 0: unused)
+    preset_t preset;
+    uint32_t sampFreq;
+    int numBands;
+    coef_t coefs[MAX_BANDS];
+    state_t states[MAX_BANDS][2];
+    static coef_t calcCoef(const band_t& band, uint32_t sampFreq);
+    static void processBand(const coef_t& c, state_t& sl, state_t& sr, int32_t* samples, uint32_t count);
+};
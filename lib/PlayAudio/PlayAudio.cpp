@@ -11,13 +11,17 @@
 #include "pico/stdlib.h"
 
 #include "audio_codec.h"
+#include "audio_stats.h"
+#include "file_menu_FatFs.h"
 #include "ReadBuffer.h"
 
 //#define DEBUG_PLAYAUDIO
 
-spin_lock_t* PlayAudio::spin_lock = nullptr;
 audio_buffer_pool_t* PlayAudio::ap = nullptr;
 uint8_t PlayAudio::volume = 65;
+volatile Equalizer::preset_t PlayAudio::eqPreset = Equalizer::Off;
+uint32_t PlayAudio::outputRate = 0;
+void (*PlayAudio::eventCallback)() = nullptr;
 
 const int32_t PlayAudio::vol_table[101] = {
     0, 4, 8, 12, 16, 20, 24, 27, 29, 31,
@@ -35,13 +39,11 @@ const int32_t PlayAudio::vol_table[101] = {
 
 void PlayAudio::initialize()
 {
-    spin_lock = spin_lock_init(spin_lock_claim_unused(true));
     i2s_setup(44100, ap);  // default 44.1 KHz
 }
 
 void PlayAudio::finalize()
 {
-    spin_lock_unclaim(spin_lock_get_num(spin_lock));
     i2s_audio_deinit();
 }
 
@@ -65,9 +67,30 @@ uint8_t PlayAudio::getVolume()
     return volume;
 }
 
-PlayAudio::PlayAudio() : playing(false), paused(false), rdbufWarning(false),
-    channels(2), sampFreq(0), bitRateKbps(44100*16*2/1000), bitsPerSample(16),
-    samplesPlayed(0), reinitI2s(false), levelL(0.0), levelR(0.0)
+void PlayAudio::setEqPreset(Equalizer::preset_t preset)
+{
+    eqPreset = preset;
+}
+
+void PlayAudio::setOutputRate(uint32_t value)
+{
+    outputRate = value;
+}
+
+void PlayAudio::setEventCallback(void (*callback)())
+{
+    eventCallback = callback;
+}
+
+void PlayAudio::notifyEvent()
+{
+    if (eventCallback != nullptr) { eventCallback(); }
+}
+
+PlayAudio::PlayAudio() : fil(&fils[0]), nextFil(nullptr), doneFil(nullptr), eodPos(0), nextEodPos(0),
+    nextQueuing(false), nextQueued(false), nextSwitched(false), seeking(false), fading(false), gain(0), playing(false), paused(false), ended(false), rdbufWarning(false),
+    channels(2), sampFreq(0), outFreq(0), bitRateKbps(44100*16*2/1000), bitsPerSample(16),
+    samplesPlayed(0), levels(0)
 {
     rdbuf = ReadBuffer::getInstance();
 }
@@ -76,28 +99,75 @@ PlayAudio::~PlayAudio()
 {
 }
 
+// parse header and move reading point of fil to fpos (or to the head of audio data) before binding to rdbuf
 bool PlayAudio::parseSetPos(size_t fpos)
 {
-    return rdbuf->seek(fpos);
+    eodPos = f_size(fil);
+    return f_lseek(fil, fpos) == FR_OK;
+}
+
+// file position and samples of the sample at millis (aligned to sample block)
+bool PlayAudio::getSeekPos(uint32_t /*millis*/, size_t* /*fpos*/, uint32_t* /*samples*/)
+{
+    return false;
+}
+
+// decoders keeping state across rdbuf (e.g. partially read frame) drop it here
+void PlayAudio::resetDecoder(uint32_t /*samples*/)
+{
+}
+
+// parse header of nextFil and move its reading point to the head of audio data
+// returns false if next track cannot be continued seamlessly
+bool PlayAudio::parseNext()
+{
+    return false;
+}
+
+// apply header of next track (called by decode stage at the switch)
+void PlayAudio::applyNext()
+{
 }
 
 void PlayAudio::play(const char* filename, size_t fpos, uint32_t samplesPlayed)
 {
     FRESULT fr;
-    fr = f_open(&fil, (TCHAR *) filename, FA_READ);
-    rdbuf->reqBind(&fil);
-    parseSetPos(fpos);
+    if (ended) { stop(); }
+    closeDoneFil();
+    nextSwitched = false;
+    file_menu_fs_lock();
+    fr = f_open(fil, (TCHAR *) filename, FA_READ);
+    if (fr != FR_OK) {
+        file_menu_fs_unlock();
+        printf("ERROR: f_open(%s) failed (%d)\r\n", filename, (int) fr);
+        return;
+    }
+    if (!parseSetPos(fpos)) {
+        f_close(fil);
+        file_menu_fs_unlock();
+        printf("ERROR: %s is not supported\r\n", filename);
+        return;
+    }
+    file_menu_fs_unlock();  // core1 needs FatFs to fill buffer in reqBind()
+    rdbuf->reqBind(fil, true, eodPos);
+    eq.reset();
+    levels = 0;
     setSamplesPlayed(samplesPlayed);
 
-    if (reinitI2s) {
+    // I2S follows sampling frequency of the track unless fixed output rate is chosen, where resampler converts it
+    uint32_t prevSampFreq = i2s_get_samp_freq();
+    outFreq = (outputRate != 0) ? outputRate : sampFreq;
+    resampler.setup(sampFreq, outFreq);
+    if (outFreq != prevSampFreq) {
         audio_codec_dac_enable(false);
-        i2s_setup(sampFreq, ap);
-        reinitI2s = false;
-        sleep_ms(100);
+        i2s_setup(outFreq, ap);
+        // wait until the buffer being played at previous frequency is finished and DAC locks to new clock
+        sleep_ms(i2s_get_samples_per_buffer() * 1000 / prevSampFreq + DAC_RELOCK_MS);
         audio_codec_dac_enable(true);
     }
 
     // Don't manipulate rdbuf after playing = true because decode callback handles it
+    fading = false;
     playing = true;
     paused = false;
     rdbufWarning = false;
@@ -110,18 +180,142 @@ void PlayAudio::pause(bool flg)
 
 void PlayAudio::stop()
 {
+    if (playing) { fadeOut(); }
     // stop playing at first to avoid blank noise
-    bool wasPlaying = playing;
+    bool wasPlaying = playing || ended;
     playing = false;
     paused = false;
+    fading = false;
+    ended = false;
 
     // it takes some time to stop ReadBuffer due to secondary buffer
     if (wasPlaying) {
-        rdbuf->reqBind(&fil, false);
-        f_close(&fil);
+        rdbuf->reqBind(fil, false);  // also cancels next track
+        file_menu_fs_lock();
+        f_close(fil);
+        if (nextQueued) {
+            nextQueued = false;
+            f_close(nextFil);
+            nextFil = nullptr;
+        }
+        file_menu_fs_unlock();
     }
 }
 
+// called by decode stage at the end of track
+// (decode stage must not wait for core1 nor FatFs, then the track is closed by stop() on UI side)
+void PlayAudio::endTrack()
+{
+    playing = false;
+    paused = false;
+    ended = true;
+    notifyEvent();
+}
+
+// decode stage is muted only until the first slot is read again from new position
+bool PlayAudio::seekMillis(uint32_t millis)
+{
+    size_t fpos;
+    uint32_t samples;
+    if (!playing || !getSeekPos(millis, &fpos, &samples)) { return false; }
+    fadeOut();
+    seeking = true;  // decode stage doesn't touch rdbuf nor publish position from next buffer
+    bool flag = rdbuf->seek(fil, fpos, eodPos);  // also cancels next track
+    if (nextQueued) {
+        nextQueued = false;
+        file_menu_fs_lock();
+        f_close(nextFil);
+        file_menu_fs_unlock();
+        nextFil = nullptr;
+    }
+    if (flag) {
+        resampler.reset();
+        resetDecoder(samples);
+        levels = 0;
+        setSamplesPlayed(samples);
+    }
+    seeking = false;
+    fading = false;  // decode stage fades in from the first buffer after seek
+    if (!flag) {
+        printf("ERROR: seek failed\r\n");
+        stop();
+    }
+    return flag;
+}
+
+// ask decode stage to produce one more buffer faded out to zero gain, then wait until it is given
+// (bounded by two buffer periods in case that I2S is not running)
+void PlayAudio::fadeOut()
+{
+    fading = true;
+    uint32_t timeoutUs = static_cast<uint32_t>(static_cast<uint64_t>(i2s_get_samples_per_buffer()) * 2000000 / outFreq);
+    uint32_t start = time_us_32();
+    while (gain != 0 && time_us_32() - start < timeoutUs) {
+        tight_loop_contents();
+    }
+}
+
+bool PlayAudio::queueNext(const char* filename)
+{
+    if (!playing || nextQueued) { return false; }
+    closeDoneFil();
+    nextQueuing = true;  // hold decode stage from stopping at the end of current track
+    nextFil = (fil == &fils[0]) ? &fils[1] : &fils[0];
+    file_menu_fs_lock();
+    if (f_open(nextFil, (TCHAR *) filename, FA_READ) != FR_OK) {
+        file_menu_fs_unlock();
+        nextFil = nullptr;
+        nextQueuing = false;
+        return false;
+    }
+    if (!parseNext()) {
+        f_close(nextFil);
+        file_menu_fs_unlock();
+        nextFil = nullptr;
+        nextQueuing = false;
+        return false;
+    }
+    file_menu_fs_unlock();
+    rdbuf->reqBindNext(nextFil, nextEodPos);
+    nextQueued = true;
+    nextQueuing = false;
+    return true;
+}
+
+// called by decode stage at the end of current stream
+bool PlayAudio::switchToNext()
+{
+    if (!nextQueued) { return false; }
+    if (!rdbuf->nextStream()) { return false; }
+    doneFil = fil;
+    fil = nextFil;
+    nextFil = nullptr;
+    eodPos = nextEodPos;
+    applyNext();
+    setSamplesPlayed(0);
+    nextQueued = false;
+    nextSwitched = true;
+    notifyEvent();
+    return true;
+}
+
+bool PlayAudio::checkNextSwitched()
+{
+    if (!nextSwitched) { return false; }
+    nextSwitched = false;
+    closeDoneFil();
+    return true;
+}
+
+void PlayAudio::closeDoneFil()
+{
+    if (doneFil == nullptr) { return; }
+    file_menu_fs_lock();
+    f_close(doneFil);
+    file_menu_fs_unlock();
+    doneFil = nullptr;
+}
+
 bool PlayAudio::isPlaying()
 {
     return playing;
@@ -132,6 +326,11 @@ bool PlayAudio::isPaused()
     return paused;
 }
 
+bool PlayAudio::isBufferFull()
+{
+    return rdbuf->isFull();
+}
+
 uint16_t PlayAudio::getU16LE(const char* ptr)
 {
     return ((uint16_t) ptr[1] << 8) + ((uint16_t) ptr[0]);
@@ -147,60 +346,71 @@ uint32_t PlayAudio::getU28BE(const char* ptr)
     return (((uint32_t) ptr[0] & 0x7f) << 21) + (((uint32_t) ptr[1] & 0x7f) << 14) + (((uint32_t) ptr[2] & 0x7f) << 7) + (((uint32_t) ptr[3] & 0x7f));
 }
 
-float PlayAudio::convLevelCurve(uint32_t levelInt) // assume 0 <= level <= 32768
+// returns number of vol_table entries less than or equal to levelInt*2 (binary search)
+uint32_t PlayAudio::convLevelCurve(uint32_t levelInt) // assume 0 <= level <= 32768
 {
-    int i;
-    for (i = 0; i < 101; i++) {
-        if (levelInt*2 < vol_table[i]) { break; }
+    int32_t value = static_cast<int32_t>(levelInt * 2);
+    uint32_t lo = 0;
+    uint32_t hi = 101;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (value < vol_table[mid]) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
-    return (float) i / 100.0;
+    return lo;
+}
+
+uint32_t PlayAudio::decayLevel(uint32_t prev, uint32_t next)
+{
+    return (prev > next + MaxLevelDown) ? prev - MaxLevelDown : next;
+}
+
+// position is stored only by a single writer context without lock:
+// by decode stage while playing, otherwise by play() or seekMillis() (decode stage does not publish meanwhile)
+void PlayAudio::publish()
+{
+    position.store({rdbuf->tell(), samplesPlayed, levels});
 }
 
 void PlayAudio::setSamplesPlayed(uint32_t value)
 {
-    uint32_t save = spin_lock_blocking(spin_lock);
     samplesPlayed = value;
-    spin_unlock(spin_lock, save);
+    publish();
 }
 
 void PlayAudio::incSamplesPlayed(uint32_t inc)
 {
-    uint32_t save = spin_lock_blocking(spin_lock);
     samplesPlayed += inc;
-    spin_unlock(spin_lock, save);
+    publish();
 }
 
 uint32_t PlayAudio::getSamplesPlayed()
 {
-    uint32_t save = spin_lock_blocking(spin_lock);
-    uint32_t value = samplesPlayed;
-    spin_unlock(spin_lock, save);
-    return value;
+    return position.load().samplesPlayed;
 }
 
-void PlayAudio::setLevelInt(uint32_t levelIntL, uint32_t levelIntR)
+// DSP stage of decoded samples (called from decode())
+// coefficients are recalculated here when preset or sampling frequency has changed
+void PlayAudio::applyEq(int32_t* samples, uint32_t count)
 {
-    uint32_t save;
-    // Level conversion with slow level down
-    const float MaxLevelDown = 0.02;
-
-    float levelL_nxt = convLevelCurve(levelIntL);
-    save = spin_lock_blocking(spin_lock);
-    if (levelL - MaxLevelDown > levelL_nxt) {
-        levelL -= MaxLevelDown;
-    } else {
-        levelL = levelL_nxt;
+    Equalizer::preset_t preset = eqPreset;
+    if (eq.getPreset() != preset || eq.getSampFreq() != outFreq) {
+        eq.setup(preset, outFreq);
     }
-    spin_unlock(spin_lock, save);
+    eq.process(samples, count);
+}
 
-    float levelR_nxt = convLevelCurve(levelIntR);
-    save = spin_lock_blocking(spin_lock);
-    if (levelR - MaxLevelDown > levelR_nxt) {
-        levelR -= MaxLevelDown;
-    } else {
-        levelR = levelR_nxt;
-    }
-    spin_unlock(spin_lock, save);
+// only called from decode()
+void PlayAudio::setLevelInt(uint32_t levelIntL, uint32_t levelIntR)
+{
+    // Level conversion with slow level down
+    uint32_t l = decayLevel(levels & 0xff, convLevelCurve(levelIntL));
+    uint32_t r = decayLevel((levels >> 8) & 0xff, convLevelCurve(levelIntR));
+    levels = (r << 8) | l;
+    publish();
 }
 
 void PlayAudio::decode()
@@ -223,8 +433,11 @@ void PlayAudio::decode()
         samples[i*2+1] = DAC_ZERO;
     }
     give_audio_buffer(ap, buffer);
-    levelL = 0.0;
-    levelR = 0.0;
+    gain = 0;
+    if (playing && !seeking && levels != 0) {
+        levels = 0;
+        publish();
+    }
 
     #ifdef DEBUG_PLAYAUDIO
     uint32_t time = to_ms_since_boot(get_absolute_time()) - start;
@@ -234,9 +447,10 @@ void PlayAudio::decode()
 
 bool PlayAudio::isMuteCondition()
 {
-    if (!playing || paused) { return true; }
+    if (!playing || paused || seeking || fading) { return true; }
     if (!rdbufWarning && rdbuf->isNearEmpty()) {
         rdbufWarning = true;
+        audio_stats_instant_mute();
         printf("AUDIO::rdbuf near empty. insert instant mute\r\n");
     } else if (rdbufWarning && rdbuf->isFull()) {
         rdbufWarning = false;
@@ -252,8 +466,9 @@ uint32_t PlayAudio::elapsedMillis()
 void PlayAudio::getCurrentPosition(size_t* fpos, uint32_t* samplesPlayed)
 {
     if (playing) {
-        *fpos = rdbuf->tell();
-        *samplesPlayed = getSamplesPlayed();
+        position_t pos = position.load();
+        *fpos = pos.fpos;
+        *samplesPlayed = pos.samplesPlayed;
     } else {
         *fpos = 0;
         *samplesPlayed = 0;
@@ -262,10 +477,9 @@ void PlayAudio::getCurrentPosition(size_t* fpos, uint32_t* samplesPlayed)
 
 void PlayAudio::getLevel(float* levelL, float* levelR)
 {
-    uint32_t save = spin_lock_blocking(spin_lock);
-    *levelL = this->levelL;
-    *levelR = this->levelR;
-    spin_unlock(spin_lock, save);
+    uint32_t value = playing ? position.load().levels : 0;
+    *levelL = static_cast<float>(value & 0xff) / 100.0f;
+    *levelR = static_cast<float>((value >> 8) & 0xff) / 100.0f;
 }
 
 uint32_t PlayAudio::getSampFreq()
@@ -6,10 +6,11 @@
 
 #pragma once
 
-#include "hardware/sync.h"
-
 #include "ff.h"
 #include "i2s_audio_init.h"
+#include "Equalizer.h"
+#include "Resampler.h"
+#include "SpscQueue.h"
 
 class ReadBuffer; // to avoid inter-lock
 
@@ -21,7 +22,8 @@ class PlayAudio
 public:
     typedef enum {
         AUDIO_CODEC_NONE = 0,
-        AUDIO_CODEC_WAV
+        AUDIO_CODEC_WAV,
+        AUDIO_CODEC_FLAC
     } audio_codec_t;
     static constexpr int RDBUF_SIZE = SAMPLES_PER_BUFFER * 8;  // 4 (16bit), 6 (24bit), 8 (32bit)
     static constexpr int RDBUF_THRESHOLD = RDBUF_SIZE / 4;
@@ -31,13 +33,20 @@ public:
     static void volumeDown();
     static void setVolume(uint8_t value);
     static uint8_t getVolume();
+    static void setEqPreset(Equalizer::preset_t preset);  // applied by decode stage from next buffer
+    static void setOutputRate(uint32_t value);  // fixed I2S sampling frequency by resampling (0: follow source), applied from next play
+    static void setEventCallback(void (*callback)());  // called by decode stage when track ends or switches to next track
     PlayAudio();
     virtual ~PlayAudio();
     virtual void play(const char* filename, size_t fpos = 0, uint32_t samplesPlayed = 0);
+    bool queueNext(const char* filename);  // bind next track ahead for gapless playback
+    bool checkNextSwitched();  // returns true once after playing has switched to queued next track
     void pause(bool flg = true);
-    void stop();
+    void stop();  // also closes the track ended by decode stage
+    bool seekMillis(uint32_t millis);  // move to the sample at millis of current track (cancels queued next track)
     bool isPlaying();
     bool isPaused();
+    bool isBufferFull();  // read buffer is filled up (core1 can be stalled for a while)
     uint32_t elapsedMillis();
     virtual uint32_t totalMillis() = 0;
     virtual void getCurrentPosition(size_t* fpos, uint32_t* samplesPlayed);
@@ -45,33 +54,82 @@ public:
     uint32_t getSampFreq();
     uint16_t getBitsPerSample();
 protected:
-    static spin_lock_t* spin_lock;
     static audio_buffer_pool_t* ap;
     static uint8_t volume;
+    static volatile Equalizer::preset_t eqPreset;
+    static uint32_t outputRate;
+    static void (*eventCallback)();
     static const int32_t vol_table[101];
-    FIL fil;
+    FIL fils[2];  // files for current track and next track
+    FIL* fil;
+    FIL* nextFil;  // next track bound to rdbuf ahead (nullptr: none)
+    FIL* doneFil;  // previous track to be closed out of decode stage (nullptr: none)
+    size_t eodPos;  // end of audio data in file
+    size_t nextEodPos;
+    volatile bool nextQueuing;
+    volatile bool nextQueued;
+    volatile bool nextSwitched;
+    volatile bool seeking;  // decode stage is held while rdbuf is rebound
+    volatile bool fading;  // decode stage fades out and stays muted until stop or seek is done
+    volatile int32_t gain;  // gain applied at the end of last buffer (written only by decode stage)
     bool playing;
     bool paused;
+    volatile bool ended;  // decode stage reached the end of track, which is left open until stop()
     bool rdbufWarning;
     uint16_t channels;
     uint32_t sampFreq;
+    uint32_t outFreq;  // I2S sampling frequency (differs from sampFreq while resampled)
     uint16_t bitRateKbps;
     uint16_t bitsPerSample;
-    uint32_t samplesPlayed;
-    bool reinitI2s;
-    float levelL;
-    float levelR;
+    uint32_t samplesPlayed;  // written only by decode stage while playing, otherwise by play() or seekMillis()
+    uint32_t levels;  // level steps (0 ~ 101) of L (bit 7:0) and R (bit 15:8), written as samplesPlayed
     ReadBuffer* rdbuf; // Read buffer for Audio codec stream
-    uint16_t getU16LE(const char* ptr);
-    uint32_t getU32LE(const char* ptr);
+    Equalizer eq;  // touched only by decode stage while playing, otherwise by play()
+    Resampler resampler;  // same as eq (also by seekMillis() while seeking)
+    static uint16_t getU16LE(const char* ptr);
+    static uint32_t getU32LE(const char* ptr);
+    static inline int32_t mulGain(int32_t value, int32_t gain);
+    static inline uint32_t levelOf(int32_t value);
     uint32_t getU28BE(const char* ptr);
     void setSamplesPlayed(uint32_t value);
     void incSamplesPlayed(uint32_t inc);
     uint32_t getSamplesPlayed();
     void setLevelInt(uint32_t levelIntL, uint32_t levelIntR);
+    void publish();
+    void applyEq(int32_t* samples, uint32_t count);
+    void fadeOut();
     virtual bool parseSetPos(size_t fpos);
+    virtual bool getSeekPos(uint32_t millis, size_t* fpos, uint32_t* samples);
+    virtual void resetDecoder(uint32_t samples);  // decoder state after rdbuf is rebound to the position of samples by seekMillis()
+    virtual bool parseNext();
+    virtual void applyNext();
+    bool switchToNext();
+    void endTrack();
+    void closeDoneFil();
+    static void notifyEvent();
     virtual void decode();
     virtual bool isMuteCondition();
 private:
-    float convLevelCurve(uint32_t levelInt);
+    static constexpr uint32_t MaxLevelDown = 2;  // level steps per update for slow level down
+    typedef struct _position_t {
+        size_t fpos;
+        uint32_t samplesPlayed;
+        uint32_t levels;
+    } position_t;
+    SpscValue<position_t> position;  // consistent set of playing position and levels for readers
+    static uint32_t convLevelCurve(uint32_t levelInt);
+    static uint32_t decayLevel(uint32_t prev, uint32_t next);
 };
+
+// apply volume gain (0 ~ 65536) to S32 sample by 32bit multiplications instead of 64bit one
+inline int32_t PlayAudio::mulGain(int32_t value, int32_t gain)
+{
+    return (value >> 16) * gain + static_cast<int32_t>((static_cast<uint32_t>(value & 0xffff) * static_cast<uint32_t>(gain)) >> 16);
+}
+
+// level of S32 sample scaled into 0 ~ 32768
+inline uint32_t PlayAudio::levelOf(int32_t value)
+{
+    int32_t v = value >> 16;
+    return static_cast<uint32_t>(v * v) >> 15;
+}
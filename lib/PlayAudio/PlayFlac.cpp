@@ -0,0 +1,656 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "PlayFlac.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "pico/stdlib.h"
+
+#include "audio_stats.h"
+#include "mem_budget.h"
+#include "ReadBuffer.h"
+
+//#define DEBUG_PLAYFLAC
+
+PlayFlac* PlayFlac::g_inst = nullptr;
+
+static inline uint32_t getBE(const uint8_t* ptr, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | ptr[i];
+    }
+    return value;
+}
+
+// CRC-8 of frame header (polynomial x^8 + x^2 + x + 1)
+static inline uint8_t updateCrc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+    }
+    return crc;
+}
+
+void PlayFlac::decode_func()
+{
+    if (g_inst == nullptr) { return; }
+    g_inst->decode();
+}
+
+PlayFlac::PlayFlac() : PlayAudio(), pcm{}, pcmPos(0), pcmLeft(0), resync(false), skipTo(NO_SKIP)
+{
+    g_inst = this;
+    // reserved at boot together with other audio buffers, not at first FLAC track when heap may be taken by others
+    pcm[0] = new int32_t[MAX_BLOCK_SIZE * 2];
+    pcm[1] = pcm[0] + MAX_BLOCK_SIZE;
+    mem_budget_reserve("audio.flac", PCM_BUFFER_SIZE);
+    resetReader();
+}
+
+PlayFlac::~PlayFlac()
+{
+    delete[] pcm[0];
+}
+
+void PlayFlac::play(const char* filename, size_t fpos, uint32_t samplesPlayed)
+{
+    accum[0] = 0;
+    accum[1] = 0;
+    accumCount = 0;
+    PlayAudio::play(filename, fpos, samplesPlayed);
+}
+
+// "fLaC" (optionally after ID3v2 tag) followed by metadata blocks, only STREAMINFO is read
+bool PlayFlac::parseHeader(FIL* fp, header_t& header)
+{
+    uint8_t buf[34];
+    UINT br;
+    size_t pos = 0;
+    if (f_lseek(fp, 0) != FR_OK) { return false; }
+    if (f_read(fp, buf, 10, &br) != FR_OK || br < 10) { return false; }
+    if (memcmp(buf, "ID3", 3) == 0) {
+        pos = 10 + ((buf[6] & 0x7f) << 21 | (buf[7] & 0x7f) << 14 | (buf[8] & 0x7f) << 7 | (buf[9] & 0x7f));
+        if (buf[5] & 0x10) { pos += 10; }  // footer
+        if (f_lseek(fp, pos) != FR_OK) { return false; }
+        if (f_read(fp, buf, 4, &br) != FR_OK || br < 4) { return false; }
+    }
+    if (memcmp(buf, "fLaC", 4) != 0) { return false; }
+    pos += 4;
+    bool hasInfo = false;
+    bool last = false;
+    while (!last) {
+        if (f_lseek(fp, pos) != FR_OK) { return false; }
+        if (f_read(fp, buf, 4, &br) != FR_OK || br < 4) { return false; }
+        last = (buf[0] & 0x80) != 0;
+        uint32_t type = buf[0] & 0x7f;
+        uint32_t length = getBE(&buf[1], 3);
+        if (type == 0 && length >= 34) {  // STREAMINFO
+            if (f_read(fp, buf, 34, &br) != FR_OK || br < 34) { return false; }
+            header.minBlockSize  = static_cast<uint16_t>(getBE(&buf[0], 2));
+            header.maxBlockSize  = static_cast<uint16_t>(getBE(&buf[2], 2));
+            header.maxFrameSize  = getBE(&buf[7], 3);
+            header.sampFreq      = getBE(&buf[10], 3) >> 4;
+            header.channels      = static_cast<uint16_t>(((buf[12] >> 1) & 0x7) + 1);
+            header.bitsPerSample = static_cast<uint16_t>((((buf[12] & 0x1) << 4) | (buf[13] >> 4)) + 1);
+            header.totalSamples  = (static_cast<uint64_t>(buf[13] & 0xf) << 32) | getBE(&buf[14], 4);
+            hasInfo = true;
+        }
+        pos += 4 + length;
+    }
+    if (!hasInfo || pos >= f_size(fp)) { return false; }
+    if (header.channels > 2 || header.bitsPerSample < 4 || header.bitsPerSample > 24) { return false; }
+    if (header.sampFreq == 0 || header.minBlockSize < 16 || header.maxBlockSize > MAX_BLOCK_SIZE) { return false; }
+    header.dataPos = pos;
+    header.dataSize = static_cast<uint32_t>(f_size(fp) - pos);
+    header.bitRateKbps = (header.totalSamples != 0) ?
+        static_cast<uint16_t>(static_cast<uint64_t>(header.dataSize) * 8 * header.sampFreq / header.totalSamples / 1000) : 0;
+    return true;
+}
+
+void PlayFlac::applyHeader(const header_t& header)
+{
+    channels      = header.channels;
+    sampFreq      = header.sampFreq;
+    levelPeriod   = 576 * header.sampFreq / 44100;  // normalized to 44100 Hz's timing
+    bitRateKbps   = header.bitRateKbps;
+    bitsPerSample = header.bitsPerSample;
+    dataPos       = header.dataPos;
+    dataSize      = header.dataSize;
+    minBlockSize  = header.minBlockSize;
+    totalSamples  = header.totalSamples;
+    // size of verbatim frame if not given
+    maxFrameSize  = (header.maxFrameSize != 0) ? header.maxFrameSize : header.maxBlockSize * header.channels * (header.bitsPerSample + 1) / 8 + 32;
+}
+
+bool PlayFlac::parseSetPos(size_t fpos)
+{
+    header_t header;
+    if (!parseHeader(fil, header)) { return false; }
+    applyHeader(header);
+    eodPos = dataPos + dataSize;
+    if (fpos < dataPos || fpos >= eodPos) { fpos = dataPos; }
+    resetDecoder(NO_SKIP);  // resumed fpos may be in the middle of a frame, position is taken from the next frame
+    return f_lseek(fil, fpos) == FR_OK;
+}
+
+// frames are not indexed, therefore start from the position estimated by average bit rate with margin of a frame
+// then the decode stage skips frames and samples up to the target
+bool PlayFlac::getSeekPos(uint32_t millis, size_t* fpos, uint32_t* samples)
+{
+    if (totalSamples == 0) { return false; }
+    uint64_t sample = std::min(static_cast<uint64_t>(millis) * sampFreq / 1000, totalSamples - 1);
+    uint64_t ofs = static_cast<uint64_t>(dataSize) * sample / totalSamples;
+    ofs = (ofs > maxFrameSize) ? ofs - maxFrameSize : 0;
+    *fpos = dataPos + static_cast<size_t>(ofs);
+    *samples = static_cast<uint32_t>(sample);
+    return true;
+}
+
+void PlayFlac::resetDecoder(uint32_t samples)
+{
+    resetReader();
+    pcmLeft = 0;
+    resync = true;
+    skipTo = samples;
+}
+
+bool PlayFlac::parseNext()
+{
+    if (!parseHeader(nextFil, nextHeader)) { return false; }
+    if (nextHeader.sampFreq != sampFreq) { return false; }  // needs I2S setup
+    nextEodPos = nextHeader.dataPos + nextHeader.dataSize;
+    return f_lseek(nextFil, nextHeader.dataPos) == FR_OK;
+}
+
+void PlayFlac::applyNext()
+{
+    applyHeader(nextHeader);
+}
+
+void PlayFlac::resetReader()
+{
+    cache = 0;
+    cacheBits = 0;
+    ptr = nullptr;
+    avail = 0;
+    taken = 0;
+    starved = false;
+}
+
+// next contiguous run of rdbuf after shifting out the bytes taken from the last run
+bool PlayFlac::nextRun()
+{
+    if (starved) { return false; }  // not to read on from the data after gap
+    rdbuf->shift(taken);
+    taken = 0;
+    avail = rdbuf->getLeft();
+    ptr = rdbuf->buf();
+    return avail != 0;
+}
+
+// fill cache with 25 bits or more unless rdbuf runs out
+inline void PlayFlac::refill()
+{
+    while (cacheBits <= 24) {
+        if (avail == 0 && !nextRun()) { return; }
+        cache |= static_cast<uint32_t>(*ptr++) << (24 - cacheBits);
+        cacheBits += 8;
+        avail--;
+        taken++;
+    }
+}
+
+// returns 0 for missing bits (starved)
+inline uint32_t PlayFlac::getBits(int bits)
+{
+    if (bits == 0) { return 0; }
+    if (bits > 24) {
+        uint32_t hi = getBits(bits - 16);
+        return (hi << 16) | getBits(16);
+    }
+    if (cacheBits < bits) {
+        refill();
+        if (cacheBits < bits) {
+            starved = true;
+            cache = 0;
+            cacheBits = 0;
+            return 0;
+        }
+    }
+    uint32_t value = cache >> (32 - bits);
+    cache <<= bits;
+    cacheBits -= bits;
+    return value;
+}
+
+inline int32_t PlayFlac::getSigned(int bits)
+{
+    if (bits == 0) { return 0; }
+    return static_cast<int32_t>(getBits(bits) << (32 - bits)) >> (32 - bits);
+}
+
+// count of 0 bits before 1 bit (bits beyond cacheBits are always 0 in cache)
+inline uint32_t PlayFlac::getUnary()
+{
+    uint32_t count = 0;
+    while (true) {
+        if (cache != 0) {
+            int zeros = __builtin_clz(cache);
+            cache = (cache << zeros) << 1;
+            cacheBits -= zeros + 1;
+            return count + zeros;
+        }
+        count += cacheBits;
+        cacheBits = 0;
+        refill();
+        if (cacheBits == 0) {
+            starved = true;
+            return 0;
+        }
+    }
+}
+
+uint8_t PlayFlac::getByte()
+{
+    uint8_t value = static_cast<uint8_t>(getBits(8));
+    crc8 = updateCrc8(crc8, value);
+    return value;
+}
+
+void PlayFlac::alignByte()
+{
+    int bits = cacheBits & 0x7;
+    cache <<= bits;
+    cacheBits -= bits;
+}
+
+// frame sync code (14 bits) and reserved bit (0) on byte boundary
+bool PlayFlac::findSync()
+{
+    alignByte();
+    while (true) {
+        if (cacheBits < 16) {
+            refill();
+            if (cacheBits < 16) {
+                starved = true;
+                return false;
+            }
+        }
+        if ((cache >> 17) == (0xfff8 >> 1)) { return true; }
+        cache <<= 8;
+        cacheBits -= 8;
+    }
+}
+
+bool PlayFlac::readFrameHeader(frame_t& frame)
+{
+    static constexpr uint32_t rateTable[12] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    static constexpr uint16_t bpsTable[8] = {0, 8, 12, 0, 16, 20, 24, 0};
+    crc8 = 0;
+    getByte();
+    bool variable = (getByte() & 0x1) != 0;
+    uint8_t codes = getByte();
+    uint8_t format = getByte();
+    if (format & 0x1) { return false; }
+    // frame number (fixed block size) or sample number (variable block size) in UTF-8 like coding
+    uint8_t lead = getByte();
+    int extra = 0;
+    while (extra < 8 && (lead & (0x80 >> extra))) { extra++; }
+    if (extra == 1 || extra == 8) { return false; }
+    uint64_t number = lead & (0xff >> (extra + 1));
+    for (int i = 1; i < extra; i++) {
+        uint8_t value = getByte();
+        if ((value & 0xc0) != 0x80) { return false; }
+        number = (number << 6) | (value & 0x3f);
+    }
+    uint32_t bsCode = codes >> 4;
+    uint32_t blockSize;
+    if (bsCode == 0) {
+        return false;
+    } else if (bsCode == 1) {
+        blockSize = 192;
+    } else if (bsCode <= 5) {
+        blockSize = 576 << (bsCode - 2);
+    } else if (bsCode == 6) {
+        blockSize = getByte() + 1;
+    } else if (bsCode == 7) {
+        blockSize = getByte() << 8;
+        blockSize = (blockSize | getByte()) + 1;
+    } else {
+        blockSize = 256 << (bsCode - 8);
+    }
+    uint32_t rateCode = codes & 0xf;
+    uint32_t rate;
+    if (rateCode < 12) {
+        rate = rateTable[rateCode];
+    } else if (rateCode == 12) {
+        rate = getByte() * 1000;
+    } else if (rateCode <= 14) {
+        rate = getByte() << 8;
+        rate = (rate | getByte()) * ((rateCode == 14) ? 10 : 1);
+    } else {
+        return false;
+    }
+    uint8_t crc = crc8;
+    if (getByte() != crc || starved) { return false; }
+    // frames are decoded only if consistent with STREAMINFO
+    uint16_t bps = bpsTable[(format >> 1) & 0x7];
+    uint8_t assign = format >> 4;
+    if ((rate != 0 && rate != sampFreq) || (bps != 0 && bps != bitsPerSample)) { return false; }
+    if (assign > 10 || ((assign < 8) ? assign + 1 : 2) != channels) { return false; }
+    if (blockSize > MAX_BLOCK_SIZE) { return false; }
+    frame.blockSize = blockSize;
+    frame.firstSample = static_cast<uint32_t>(variable ? number : number * minBlockSize);
+    frame.bitsPerSample = bitsPerSample;
+    frame.channelAssign = assign;
+    return true;
+}
+
+bool PlayFlac::readSubframe(int32_t* samples, uint32_t blockSize, uint16_t bps)
+{
+    uint32_t head = getBits(8);
+    if (head & 0x80) { return false; }
+    uint32_t type = (head >> 1) & 0x3f;
+    uint32_t wasted = 0;
+    if (head & 0x1) {
+        wasted = getUnary() + 1;
+        if (wasted >= bps) { return false; }
+        bps -= wasted;
+    }
+    if (type == 0) {  // CONSTANT
+        int32_t value = getSigned(bps);
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = value;
+        }
+    } else if (type == 1) {  // VERBATIM
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = getSigned(bps);
+        }
+    } else if ((type & 0x38) == 0x08) {  // FIXED
+        uint32_t order = type & 0x7;
+        if (order > 4 || order > blockSize) { return false; }
+        for (uint32_t i = 0; i < order; i++) {
+            samples[i] = getSigned(bps);
+        }
+        if (!readResidual(samples, blockSize, order)) { return false; }
+        predictFixed(samples, blockSize, order);
+    } else if (type & 0x20) {  // LPC
+        uint32_t order = (type & 0x1f) + 1;
+        if (order > blockSize) { return false; }
+        for (uint32_t i = 0; i < order; i++) {
+            samples[i] = getSigned(bps);
+        }
+        int precision = static_cast<int>(getBits(4)) + 1;
+        int shift = getSigned(5);
+        if (precision == 16 || shift < 0) { return false; }
+        int32_t coefs[32];
+        for (uint32_t i = 0; i < order; i++) {
+            coefs[i] = getSigned(precision);
+        }
+        if (!readResidual(samples, blockSize, order)) { return false; }
+        // 32bit accumulation is enough unless sum of coef * sample can exceed it
+        bool wide = bps + precision + (32 - __builtin_clz(order)) > 32;
+        predictLpc(samples, blockSize, coefs, order, shift, wide);
+    } else {
+        return false;
+    }
+    if (wasted != 0) {
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = static_cast<int32_t>(static_cast<uint32_t>(samples[i]) << wasted);
+        }
+    }
+    return !starved;
+}
+
+// Rice coded residuals into samples after warm-up samples of order
+bool PlayFlac::readResidual(int32_t* samples, uint32_t blockSize, uint32_t order)
+{
+    uint32_t method = getBits(2);
+    if (method > 1) { return false; }
+    int paramBits = (method == 0) ? 4 : 5;
+    uint32_t escape = (1 << paramBits) - 1;
+    uint32_t partOrder = getBits(4);
+    uint32_t partSize = blockSize >> partOrder;
+    if ((partSize << partOrder) != blockSize || partSize < order) { return false; }
+    int32_t* dst = &samples[order];
+    for (uint32_t part = 0; part < (1U << partOrder); part++) {
+        uint32_t count = (part == 0) ? partSize - order : partSize;
+        uint32_t param = getBits(paramBits);
+        if (param == escape) {
+            int bits = static_cast<int>(getBits(5));
+            for (uint32_t i = 0; i < count; i++) {
+                *dst++ = getSigned(bits);
+            }
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t value = (getUnary() << param) | getBits(param);
+                *dst++ = static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 0x1);
+            }
+        }
+        if (starved) { return false; }
+    }
+    return true;
+}
+
+void PlayFlac::predictFixed(int32_t* samples, uint32_t blockSize, uint32_t order)
+{
+    int32_t* s = samples;
+    switch (order) {
+        case 1:
+            for (uint32_t i = 1; i < blockSize; i++) { s[i] += s[i-1]; }
+            break;
+        case 2:
+            for (uint32_t i = 2; i < blockSize; i++) { s[i] += 2*s[i-1] - s[i-2]; }
+            break;
+        case 3:
+            for (uint32_t i = 3; i < blockSize; i++) { s[i] += 3*(s[i-1] - s[i-2]) + s[i-3]; }
+            break;
+        case 4:
+            for (uint32_t i = 4; i < blockSize; i++) { s[i] += 4*(s[i-1] + s[i-3]) - 6*s[i-2] - s[i-4]; }
+            break;
+        default:
+            break;
+    }
+}
+
+void PlayFlac::predictLpc(int32_t* samples, uint32_t blockSize, const int32_t* coefs, uint32_t order, int shift, bool wide)
+{
+    if (!wide) {
+        for (uint32_t i = order; i < blockSize; i++) {
+            const int32_t* hist = &samples[i];
+            int32_t sum = 0;
+            for (uint32_t j = 0; j < order; j++) {
+                sum += coefs[j] * hist[-1-static_cast<int32_t>(j)];
+            }
+            samples[i] += sum >> shift;
+        }
+    } else {
+        for (uint32_t i = order; i < blockSize; i++) {
+            const int32_t* hist = &samples[i];
+            int64_t sum = 0;
+            for (uint32_t j = 0; j < order; j++) {
+                sum += static_cast<int64_t>(coefs[j]) * hist[-1-static_cast<int32_t>(j)];
+            }
+            samples[i] += static_cast<int32_t>(sum >> shift);
+        }
+    }
+}
+
+// decode a frame into pcm, returns false if no frame is available from rdbuf
+// (frames broken or cut by underrun are dropped, then the next frame is searched)
+bool PlayFlac::decodeFrame()
+{
+    starved = false;
+    if (!findSync()) { return false; }
+    frame_t frame;
+    if (!readFrameHeader(frame)) { return !starved; }
+    uint32_t blockSize = frame.blockSize;
+    if (skipTo != NO_SKIP && frame.firstSample + blockSize <= skipTo) { return true; }  // skip without decoding subframes
+    uint8_t assign = frame.channelAssign;
+    int numChannels = (assign < 8) ? assign + 1 : 2;
+    for (int ch = 0; ch < numChannels; ch++) {
+        bool side = (assign == 8 && ch == 1) || (assign == 9 && ch == 0) || (assign == 10 && ch == 1);
+        if (!readSubframe(pcm[ch], blockSize, frame.bitsPerSample + side)) { return !starved; }
+    }
+    alignByte();
+    getBits(16);  // CRC-16 of frame is not checked
+    if (starved) { return false; }
+    int32_t* ch0 = pcm[0];
+    int32_t* ch1 = pcm[1];
+    if (assign == 8) {  // left/side
+        for (uint32_t i = 0; i < blockSize; i++) { ch1[i] = ch0[i] - ch1[i]; }
+    } else if (assign == 9) {  // side/right
+        for (uint32_t i = 0; i < blockSize; i++) { ch0[i] += ch1[i]; }
+    } else if (assign == 10) {  // mid/side
+        for (uint32_t i = 0; i < blockSize; i++) {
+            int32_t mid = (ch0[i] * 2) | (ch1[i] & 0x1);
+            ch0[i] = (mid + ch1[i]) >> 1;
+            ch1[i] = (mid - ch1[i]) >> 1;
+        }
+    }
+    pcmShift = 32 - frame.bitsPerSample;
+    pcmPos = 0;
+    pcmLeft = blockSize;
+    if (skipTo != NO_SKIP && frame.firstSample < skipTo) {
+        pcmPos = skipTo - frame.firstSample;
+        pcmLeft -= pcmPos;
+    }
+    skipTo = NO_SKIP;
+    if (resync) {
+        // first frame after play or seek, where no sample has been played yet in decode()
+        resync = false;
+        setSamplesPlayed(frame.firstSample + pcmPos);
+    }
+    return true;
+}
+
+void PlayFlac::decode()
+{
+    if (ap == nullptr) { return; }
+
+    // fade out by one more buffer from rdbuf if it is still allowed to be read, then mute
+    bool mute = isMuteCondition();
+    if (mute && (gain == 0 || !playing || seeking)) {
+        PlayAudio::decode();
+        return;
+    }
+
+    audio_buffer_t* buffer;
+    if ((buffer = take_audio_buffer(ap, false)) == nullptr) { return; }
+
+    #ifdef DEBUG_PLAYFLAC
+    static int decodeCount = 0;
+    uint64_t start = to_us_since_boot(get_absolute_time());
+    #endif // DEBUG_PLAYFLAC
+
+    int32_t* samples = reinterpret_cast<int32_t*>(buffer->buffer->bytes);
+    uint32_t sampleCount = 0;
+    uint32_t played = 0;  // samples of current track taken from pcm
+    // frames are decoded into pcm on demand, then drained into the buffer across buffers
+    // (into resampler input while resampled, then it produces samples of the buffer)
+    bool resample = resampler.isActive();
+    uint32_t resampleUs = 0;
+    // ramp gain per sample across the buffer from the gain at the end of last buffer
+    int32_t target = mute ? 0 : vol_table[volume];
+    int32_t span = static_cast<int32_t>(resampler.inputFor(buffer->max_sample_count));
+    int32_t step = (target - gain) / span;  // rounded toward zero not to overshoot
+    int32_t curGain = gain;
+    while (sampleCount < buffer->max_sample_count) {
+        if (resample) {
+            uint32_t t = time_us_32();
+            sampleCount += resampler.process(&samples[sampleCount*2], buffer->max_sample_count - sampleCount);
+            resampleUs += time_us_32() - t;
+            if (sampleCount >= buffer->max_sample_count) { break; }
+        }
+        if (pcmLeft == 0) {
+            if (decodeFrame()) { continue; }
+            // continue to next track seamlessly in the same buffer
+            if (avail == 0 && rdbuf->isEof() && switchToNext()) {
+                resetReader();
+                played = 0;
+                continue;
+            }
+            break;
+        }
+        uint32_t room = resample ? resampler.getRoom() : buffer->max_sample_count - sampleCount;
+        uint32_t run = std::min(pcmLeft, room);
+        int32_t* dst = resample ? resampler.getInput() : &samples[sampleCount*2];
+        const int32_t* srcL = &pcm[0][pcmPos];
+        const int32_t* srcR = (channels == 2) ? &pcm[1][pcmPos] : srcL;
+        int shift = pcmShift;
+        int32_t g = curGain;
+        uint32_t accumL = accum[0];
+        uint32_t accumR = accum[1];
+        for (uint32_t i = 0; i < run; i++) {
+            int32_t l = static_cast<int32_t>(static_cast<uint32_t>(srcL[i]) << shift);
+            int32_t r = static_cast<int32_t>(static_cast<uint32_t>(srcR[i]) << shift);
+            *dst++ = mulGain(l, g) + DAC_ZERO;
+            *dst++ = mulGain(r, g) + DAC_ZERO;
+            g += step;
+            accumL += levelOf(l);
+            accumR += levelOf(r);
+        }
+        accum[0] = accumL;
+        accum[1] = accumR;
+        curGain += step * static_cast<int32_t>(run);
+        accumCount += run;
+        pcmPos += run;
+        pcmLeft -= run;
+        played += run;
+        if (resample) {
+            resampler.commit(run);
+        } else {
+            sampleCount += run;
+        }
+    }
+    if (resample) { audio_stats_resample(resampleUs, static_cast<uint32_t>(static_cast<uint64_t>(sampleCount) * 1000000 / outFreq)); }
+    gain = (mute || step == 0) ? target : curGain;  // remainder less than a step per sample is applied at once
+    applyEq(samples, sampleCount);
+    bool reachedEnd = pcmLeft == 0 && avail == 0 && rdbuf->isEof() && !nextQueuing;
+    buffer->sample_count = reachedEnd ? sampleCount : buffer->max_sample_count;
+    if (sampleCount < buffer->sample_count) { audio_stats_underrun(); }
+    for (uint32_t i = sampleCount; i < buffer->sample_count; i++) {
+        // insert zeros to avoid blank noise when secondaryBuffer is empty
+        samples[i*2+0] = DAC_ZERO;
+        samples[i*2+1] = DAC_ZERO;
+    }
+    give_audio_buffer(ap, buffer);
+    incSamplesPlayed(played);
+    if (accumCount >= levelPeriod) {
+        setLevelInt(accum[0] / accumCount, accum[1] / accumCount);  // average is independent of sampling frequency
+        accum[0] = 0;
+        accum[1] = 0;
+        accumCount = 0;
+    }
+    if (reachedEnd) { endTrack(); }
+
+    #ifdef DEBUG_PLAYFLAC
+    uint32_t time = static_cast<uint32_t>(to_us_since_boot(get_absolute_time()) - start);
+    if (decodeCount++ % 97 == 0) {  // use prime number to avoid sync
+        printf("FLAC::decode %d us\n", time);
+    }
+    #endif // DEBUG_PLAYFLAC
+}
+
+bool PlayFlac::probe(FIL* fp, uint32_t& sampFreq, uint32_t& durationMillis)
+{
+    header_t header;
+    if (!parseHeader(fp, header)) { return false; }
+    sampFreq = header.sampFreq;
+    durationMillis = static_cast<uint32_t>(header.totalSamples * 1000 / header.sampFreq);
+    return true;
+}
+
+uint32_t PlayFlac::totalMillis()
+{
+    if (totalSamples == 0) { return elapsedMillis(); }
+    return std::max(static_cast<uint32_t>(totalSamples * 1000 / sampFreq), elapsedMillis());
+}
@@ -0,0 +1,95 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include "PlayAudio.h"
+
+//=================================
+// Definition of PlayFlac Class
+//=================================
+// FLAC frames are decoded in fixed point by the decode stage directly from secondaryBuffer slots of rdbuf
+// (up to 2 channels, 4 ~ 24 bits per sample and block size of MAX_BLOCK_SIZE)
+class PlayFlac : public PlayAudio
+{
+public:
+    static void decode_func();
+    PlayFlac();
+    ~PlayFlac();
+    void play(const char* filename, size_t fpos = 0, uint32_t samplesPlayed = 0);
+    uint32_t totalMillis();
+    static bool probe(FIL* fp, uint32_t& sampFreq, uint32_t& durationMillis);  // read header only (fp is left open)
+    static constexpr uint32_t MAX_BLOCK_SIZE = 4608;  // max of subset streams up to 48 KHz
+    static constexpr size_t PCM_BUFFER_SIZE = sizeof(int32_t) * MAX_BLOCK_SIZE * 2;  // reserved at construction
+protected:
+    static constexpr uint32_t NO_SKIP = UINT32_MAX;
+    typedef struct _header_t {
+        uint32_t sampFreq;
+        uint16_t channels;
+        uint16_t bitsPerSample;
+        uint16_t bitRateKbps;
+        uint16_t minBlockSize;
+        uint16_t maxBlockSize;
+        uint32_t maxFrameSize;  // 0: unknown
+        uint64_t totalSamples;  // 0: unknown
+        size_t dataPos;
+        uint32_t dataSize;
+    } header_t;
+    typedef struct _frame_t {
+        uint32_t blockSize;
+        uint32_t firstSample;
+        uint16_t bitsPerSample;
+        uint8_t channelAssign;  // 0 ~ 7: independent channels - 1, 8: left/side, 9: right/side, 10: mid/side
+    } frame_t;
+    static PlayFlac* g_inst;
+    size_t dataPos;  // offset of the first frame (cached by parseHeader)
+    uint32_t dataSize;
+    uint16_t minBlockSize;
+    uint32_t maxFrameSize;
+    uint64_t totalSamples;
+    header_t nextHeader;  // header of next track for gapless playback
+    uint32_t accum[2] = {};
+    uint32_t accumCount;
+    uint32_t levelPeriod;  // samples per level update (set per track)
+    // bit reader over contiguous runs of rdbuf (bytes are shifted out of rdbuf when the run is used up)
+    uint32_t cache;  // MSB aligned
+    int cacheBits;
+    const uint8_t* ptr;
+    size_t avail;  // bytes left in the run from ptr
+    size_t taken;  // bytes of the run moved into cache
+    bool starved;  // rdbuf ran out while reading (sticky until next frame)
+    uint8_t crc8;
+    // decoded frame
+    int32_t* pcm[2];  // MAX_BLOCK_SIZE samples per channel (allocated in constructor)
+    uint32_t pcmPos;
+    uint32_t pcmLeft;
+    uint16_t pcmShift;  // into S32
+    bool resync;  // samplesPlayed is taken from the next frame
+    uint32_t skipTo;  // samples before skipTo are discarded after seek (NO_SKIP: none)
+    static bool parseHeader(FIL* fp, header_t& header);
+    void applyHeader(const header_t& header);
+    bool parseSetPos(size_t fpos);
+    bool getSeekPos(uint32_t millis, size_t* fpos, uint32_t* samples);
+    void resetDecoder(uint32_t samples);
+    bool parseNext();
+    void applyNext();
+    void decode();
+    void resetReader();
+    bool nextRun();
+    void refill();
+    uint32_t getBits(int bits);
+    int32_t getSigned(int bits);
+    uint32_t getUnary();
+    uint8_t getByte();  // with CRC-8 update
+    void alignByte();
+    bool findSync();
+    bool readFrameHeader(frame_t& frame);
+    bool readSubframe(int32_t* samples, uint32_t blockSize, uint16_t bps);
+    bool readResidual(int32_t* samples, uint32_t blockSize, uint32_t order);
+    static void predictFixed(int32_t* samples, uint32_t blockSize, uint32_t order);
+    static void predictLpc(int32_t* samples, uint32_t blockSize, const int32_t* coefs, uint32_t order, int shift, bool wide);
+    bool decodeFrame();
+};
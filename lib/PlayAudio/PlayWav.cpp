@@ -12,19 +12,172 @@
 
 #include "pico/stdlib.h"
 
+#include "audio_stats.h"
 #include "ReadBuffer.h"
+#include "RiffChunk.h"
 
 //#define DEBUG_PLAYWAV
 
 PlayWav* PlayWav::g_inst = nullptr;
 
+// load one sample converted into normalized S32
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_PCM, 16>(const uint8_t* ptr)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(ptr[1]) << 24) | (ptr[0] << 16));
+}
+
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_PCM, 24>(const uint8_t* ptr)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(ptr[2]) << 24) | (ptr[1] << 16) | (ptr[0] << 8));
+}
+
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_PCM, 32>(const uint8_t* ptr)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(ptr[3]) << 24) | (ptr[2] << 16) | (ptr[1] << 8) | (ptr[0] << 0));
+}
+
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_PCM, 8>(const uint8_t* ptr)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(ptr[0] ^ 0x80) << 24);  // 8bit PCM is unsigned
+}
+
+// IEEE float is converted by bit operations without soft-float library (saturated at +/-1.0)
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_FLOAT, 32>(const uint8_t* ptr)
+{
+    uint32_t bits = (static_cast<uint32_t>(ptr[3]) << 24) | (ptr[2] << 16) | (ptr[1] << 8) | (ptr[0] << 0);
+    int exp = static_cast<int>((bits >> 23) & 0xff);
+    int32_t value;
+    if (exp >= 127) {
+        value = 0x7fffffff;  // |v| >= 1.0, Inf or NaN
+    } else if (exp <= 127 - 32) {
+        value = 0;
+    } else {
+        uint32_t mantissa = ((bits & 0x7fffff) | 0x800000) << 8;  // 1.m with MSB at bit31
+        value = static_cast<int32_t>(mantissa >> (127 - exp));
+    }
+    return (bits & 0x80000000) ? -value : value;
+}
+
+template <>
+inline int32_t PlayWav::loadSample<PlayWav::FMT_FLOAT, 64>(const uint8_t* ptr)
+{
+    uint32_t lo = (static_cast<uint32_t>(ptr[3]) << 24) | (ptr[2] << 16) | (ptr[1] << 8) | (ptr[0] << 0);
+    uint32_t hi = (static_cast<uint32_t>(ptr[7]) << 24) | (ptr[6] << 16) | (ptr[5] << 8) | (ptr[4] << 0);
+    int exp = static_cast<int>((hi >> 20) & 0x7ff);
+    int32_t value;
+    if (exp >= 1023) {
+        value = 0x7fffffff;  // |v| >= 1.0, Inf or NaN
+    } else if (exp <= 1023 - 32) {
+        value = 0;
+    } else {
+        uint32_t mantissa = 0x80000000 | ((hi & 0xfffff) << 11) | (lo >> 21);  // 1.m with MSB at bit31
+        value = static_cast<int32_t>(mantissa >> (1023 - exp));
+    }
+    return (hi & 0x80000000) ? -value : value;
+}
+
+template <uint16_t FORMAT, uint16_t BITS, uint16_t CHANNELS>
+void PlayWav::decodeKernel(const uint8_t* buf, int32_t* samples, uint32_t count, int32_t gain, int32_t gainStep, uint32_t* accum)
+{
+    constexpr int BYTES = BITS / 8;
+    uint32_t accumL = accum[0];
+    uint32_t accumR = accum[1];
+    for (uint32_t i = 0; i < count; i++, buf += BYTES * CHANNELS) {
+        int32_t l = loadSample<FORMAT, BITS>(buf);
+        int32_t r = (CHANNELS == 2) ? loadSample<FORMAT, BITS>(buf + BYTES) : l;
+        *samples++ = mulGain(l, gain) + DAC_ZERO;
+        *samples++ = mulGain(r, gain) + DAC_ZERO;
+        gain += gainStep;
+        accumL += levelOf(l);
+        accumR += levelOf(r);
+    }
+    accum[0] = accumL;
+    accum[1] = accumR;
+}
+
+// 16bit stereo: load L/R pair by a word, and process 2 samples per iteration
+// (16bit sample * gain never overflows, which is identical result to mulGain())
+template <>
+void PlayWav::decodeKernel<PlayWav::FMT_PCM, 16, 2>(const uint8_t* buf, int32_t* samples, uint32_t count, int32_t gain, int32_t gainStep, uint32_t* accum)
+{
+    if (reinterpret_cast<uintptr_t>(buf) & 0x3) {
+        // unaligned word access is not allowed on Cortex-M0+
+        uint32_t accumL = accum[0];
+        uint32_t accumR = accum[1];
+        for (uint32_t i = 0; i < count; i++, buf += 4) {
+            int32_t l = static_cast<int16_t>(buf[0] | (buf[1] << 8));
+            int32_t r = static_cast<int16_t>(buf[2] | (buf[3] << 8));
+            *samples++ = l * gain + DAC_ZERO;
+            *samples++ = r * gain + DAC_ZERO;
+            gain += gainStep;
+            accumL += static_cast<uint32_t>(l * l) >> 15;
+            accumR += static_cast<uint32_t>(r * r) >> 15;
+        }
+        accum[0] = accumL;
+        accum[1] = accumR;
+        return;
+    }
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(buf);
+    uint32_t accumL = accum[0];
+    uint32_t accumR = accum[1];
+    uint32_t i;
+    for (i = 0; i + 1 < count; i += 2) {
+        uint32_t w0 = *words++;
+        uint32_t w1 = *words++;
+        int32_t l0 = static_cast<int32_t>(w0 << 16) >> 16;
+        int32_t r0 = static_cast<int32_t>(w0) >> 16;
+        int32_t l1 = static_cast<int32_t>(w1 << 16) >> 16;
+        int32_t r1 = static_cast<int32_t>(w1) >> 16;
+        samples[0] = l0 * gain + DAC_ZERO;
+        samples[1] = r0 * gain + DAC_ZERO;
+        gain += gainStep;
+        samples[2] = l1 * gain + DAC_ZERO;
+        samples[3] = r1 * gain + DAC_ZERO;
+        gain += gainStep;
+        samples += 4;
+        accumL += (static_cast<uint32_t>(l0 * l0) >> 15) + (static_cast<uint32_t>(l1 * l1) >> 15);
+        accumR += (static_cast<uint32_t>(r0 * r0) >> 15) + (static_cast<uint32_t>(r1 * r1) >> 15);
+    }
+    if (i < count) {
+        uint32_t w0 = *words;
+        int32_t l0 = static_cast<int32_t>(w0 << 16) >> 16;
+        int32_t r0 = static_cast<int32_t>(w0) >> 16;
+        samples[0] = l0 * gain + DAC_ZERO;
+        samples[1] = r0 * gain + DAC_ZERO;
+        accumL += static_cast<uint32_t>(l0 * l0) >> 15;
+        accumR += static_cast<uint32_t>(r0 * r0) >> 15;
+    }
+    accum[0] = accumL;
+    accum[1] = accumR;
+}
+
 void PlayWav::decode_func()
 {
     if (g_inst == nullptr) { return; }
     g_inst->decode();
 }
 
-PlayWav::PlayWav() : PlayAudio()
+PlayWav::decodeKernel_t PlayWav::selectKernel(uint16_t format, uint16_t bitsPerSample, uint16_t channels)
+{
+    if (channels != 1 && channels != 2) { return nullptr; }
+    bool stereo = (channels == 2);
+    switch ((format << 8) | bitsPerSample) {
+        case ((FMT_PCM   << 8) |  8): return stereo ? decodeKernel<FMT_PCM,    8, 2> : decodeKernel<FMT_PCM,    8, 1>;
+        case ((FMT_PCM   << 8) | 16): return stereo ? decodeKernel<FMT_PCM,   16, 2> : decodeKernel<FMT_PCM,   16, 1>;
+        case ((FMT_PCM   << 8) | 24): return stereo ? decodeKernel<FMT_PCM,   24, 2> : decodeKernel<FMT_PCM,   24, 1>;
+        case ((FMT_PCM   << 8) | 32): return stereo ? decodeKernel<FMT_PCM,   32, 2> : decodeKernel<FMT_PCM,   32, 1>;
+        case ((FMT_FLOAT << 8) | 32): return stereo ? decodeKernel<FMT_FLOAT, 32, 2> : decodeKernel<FMT_FLOAT, 32, 1>;
+        case ((FMT_FLOAT << 8) | 64): return stereo ? decodeKernel<FMT_FLOAT, 64, 2> : decodeKernel<FMT_FLOAT, 64, 1>;
+        default: return nullptr;
+    }
+}
+
+PlayWav::PlayWav() : PlayAudio(), kernel(nullptr)
 {
     g_inst = this;
 }
@@ -41,50 +194,119 @@ void PlayWav::play(const char* filename, size_t fpos, uint32_t samplesPlayed)
     PlayAudio::play(filename, fpos, samplesPlayed);
 }
 
-void PlayWav::skipToDataChunk()
-{
-    const char* buf = reinterpret_cast<const char*>(rdbuf->buf());
-    if (buf[ 0]=='R' && buf[ 1]=='I' && buf[ 2]=='F' && buf[ 3]=='F' &&
-        buf[ 8]=='W' && buf[ 9]=='A' && buf[10]=='V' && buf[11]=='E')
-    {
-        size_t ofs = 12;
-        while (true) {
-            const char* chunk_id = buf + ofs;
-            const uint32_t size = getU32LE(buf + ofs + 4);
-            if (memcmp(chunk_id, "fmt ", 4) == 0) {
-                uint32_t sf;
-                format        = static_cast<uint16_t>(getU16LE(buf + ofs + 4 + 4)); // format
-                channels      = static_cast<uint16_t>(getU16LE(buf + ofs + 4 + 4 + 2)); // channels
-                sf            = static_cast<uint32_t>(getU32LE(buf + ofs + 4 + 4 + 2 + 2)); // samplerate
-                bitRateKbps   = static_cast<uint16_t>(getU32LE(buf + ofs + 4 + 4 + 2 + 2 + 4) /* bytepersec */ * 8 / 1000); // Kbps
-                blockBytes    = static_cast<uint16_t>(getU16LE(buf + ofs + 4 + 4 + 2 + 2 + 4 + 4)); // blockBytes
-                bitsPerSample = static_cast<uint16_t>(getU16LE(buf + ofs + 4 + 4 + 2 + 2 + 4 + 4 + 2)); // bitswidth
-                reinitI2s = (sampFreq != sf);
-                sampFreq = sf;
-            } else if (memcmp(chunk_id, "data", 4) == 0) {
-                dataSize = size;
-                rdbuf->setEodPos(ofs + 8 + dataSize);
-                rdbuf->shift(ofs + 8);
-                return;
+// walk RIFF chunks by seeking (only chunk headers and "fmt " body are read)
+bool PlayWav::parseHeader(FIL* fp, header_t& header)
+{
+    riff_t riff;
+    if (!riff_read_header(*fp, 0, "RIFF", riff) || riff.fmt_id != "WAVE") { return false; }
+    size_t endPos = f_size(fp);
+    // ignore trailing garbage out of RIFF unless RIFF size is implausible (0 or 0xffffffff by unfinished recording)
+    if (riff.end_pos() > riff.chunk_pos() && riff.end_pos() < endPos) { endPos = riff.end_pos(); }
+    bool hasFmt = false;
+    size_t pos = riff.chunk_pos();
+    riff_chunk_t chunk;
+    while (true) {
+        if (pos + 8 > endPos) { return false; }  // no "data" chunk
+        size_t chunkPos = pos;
+        bool found = riff_find_next_chunk(*fp, endPos, pos, chunk);
+        if (pos == chunkPos) { return false; }  // failed to read chunk header
+        if (chunk.id == "fmt ") {
+            if (!found) { return false; }
+            char buf[40];  // up to WAVEFORMATEXTENSIBLE
+            UINT br;
+            UINT btr = std::min(chunk.size, sizeof(buf));
+            if (f_lseek(fp, chunk.body_pos()) != FR_OK) { return false; }
+            if (f_read(fp, buf, btr, &br) != FR_OK || br < 16) { return false; }
+            header.format        = static_cast<uint16_t>(getU16LE(buf + 0)); // format
+            header.channels      = static_cast<uint16_t>(getU16LE(buf + 2)); // channels
+            header.sampFreq      = static_cast<uint32_t>(getU32LE(buf + 4)); // samplerate
+            header.bitRateKbps   = static_cast<uint16_t>(getU32LE(buf + 8) /* bytepersec */ * 8 / 1000); // Kbps
+            header.blockBytes    = static_cast<uint16_t>(getU16LE(buf + 12)); // blockBytes
+            header.bitsPerSample = static_cast<uint16_t>(getU16LE(buf + 14)); // bitswidth (container size)
+            if (header.format == FMT_EXTENSIBLE) {
+                // valid bits are MSB aligned in container, therefore decoded as container size
+                header.format = (br >= 40) ? static_cast<uint16_t>(getU16LE(buf + 24)) : 0; // SubFormat
             }
-            ofs += 8 + size;
-            if (ofs + 8 > rdbuf->getLeft()) { return; }
+            if (header.blockBytes == 0) { return false; }
+            header.kernel = selectKernel(header.format, header.bitsPerSample, header.channels);
+            hasFmt = true;
+        } else if (chunk.id == "data") {
+            if (!hasFmt) { return false; }
+            header.dataPos = chunk.body_pos();
+            // accept "data" chunk exceeding file size (unfinished recording)
+            header.dataSize = static_cast<uint32_t>(std::min(chunk.size, static_cast<size_t>(f_size(fp)) - header.dataPos));
+            return true;
         }
+        if (!found) { return false; }
     }
 }
 
+// kernel steps by whole sample block, which needs to fit in wrap area of rdbuf
+bool PlayWav::isSupported(const header_t& header)
+{
+    return header.kernel != nullptr && header.sampFreq != 0 &&
+        header.blockBytes == header.channels * header.bitsPerSample / 8 && header.blockBytes <= ReadBuffer::WRAP_THRESHOLD;
+}
+
+void PlayWav::applyHeader(const header_t& header)
+{
+    format        = header.format;
+    channels      = header.channels;
+    sampFreq      = header.sampFreq;
+    levelPeriod   = 576 * header.sampFreq / 44100;  // normalized to 44100 Hz's timing
+    bitRateKbps   = header.bitRateKbps;
+    blockBytes    = header.blockBytes;
+    bitsPerSample = header.bitsPerSample;
+    dataPos       = header.dataPos;
+    dataSize      = header.dataSize;
+    kernel        = header.kernel;
+}
+
 bool PlayWav::parseSetPos(size_t fpos)
 {
-    skipToDataChunk();
-    if (fpos == 0) { return true; } // stay its position
-    return PlayAudio::parseSetPos(fpos);
+    header_t header;
+    if (!parseHeader(fil, header) || !isSupported(header)) { return false; }
+    applyHeader(header);
+    eodPos = dataPos + dataSize;
+    if (fpos < dataPos || fpos >= eodPos) {
+        fpos = dataPos;
+    } else {
+        fpos = dataPos + (fpos - dataPos) / blockBytes * blockBytes;  // align to sample block
+    }
+    return f_lseek(fil, fpos) == FR_OK;  // single seek to the first sample to play
+}
+
+bool PlayWav::getSeekPos(uint32_t millis, size_t* fpos, uint32_t* samples)
+{
+    uint32_t numSamples = dataSize / blockBytes;
+    if (numSamples == 0) { return false; }
+    uint32_t sample = static_cast<uint32_t>(std::min(static_cast<uint64_t>(millis) * sampFreq / 1000, static_cast<uint64_t>(numSamples - 1)));
+    *fpos = dataPos + static_cast<size_t>(sample) * blockBytes;
+    *samples = sample;
+    return true;
+}
+
+bool PlayWav::parseNext()
+{
+    if (!parseHeader(nextFil, nextHeader) || !isSupported(nextHeader)) { return false; }
+    if (nextHeader.sampFreq != sampFreq) { return false; }  // needs I2S setup
+    if (nextHeader.dataSize < nextHeader.blockBytes) { return false; }
+    nextEodPos = nextHeader.dataPos + nextHeader.dataSize;
+    return f_lseek(nextFil, nextHeader.dataPos) == FR_OK;
+}
+
+void PlayWav::applyNext()
+{
+    applyHeader(nextHeader);
 }
 
 void PlayWav::decode()
 {
     if (ap == nullptr) { return; }
 
-    if (isMuteCondition()) {
+    // fade out by one more buffer from rdbuf if it is still allowed to be read, then mute
+    bool mute = isMuteCondition();
+    if (mute && (gain == 0 || !playing || seeking)) {
         PlayAudio::decode();
         return;
     }
@@ -98,34 +320,73 @@ void PlayWav::decode()
     #endif // DEBUG_PLAYWAV
 
     int32_t* samples = reinterpret_cast<int32_t*>(buffer->buffer->bytes);
-    const uint8_t* buf = rdbuf->buf();
-    buffer->sample_count = std::min(static_cast<uint32_t>(rdbuf->getLeft()/blockBytes), buffer->max_sample_count);
-    for (int i = 0; i < buffer->sample_count; i++, buf += blockBytes) {
-        for (int j = 0; j < 2; j++) {
-            int base = (channels == 2) ? j * bitsPerSample / 8 : 0;
-            int32_t buf_s32;
-            switch ((format << 8) | bitsPerSample) {
-                case ((FMT_PCM   << 8) | 16): buf_s32 = static_cast<int32_t>((buf[base+1] << 24) | (buf[base+0] << 16)); break;
-                case ((FMT_PCM   << 8) | 24): buf_s32 = static_cast<int32_t>((buf[base+2] << 24) | (buf[base+1] << 16) | (buf[base+0] << 8)); break;
-                case ((FMT_PCM   << 8) | 32): buf_s32 = static_cast<int32_t>((buf[base+3] << 24) | (buf[base+2] << 16) | (buf[base+1] << 8) | (buf[base+0] << 0)); break;
-                case ((FMT_FLOAT << 8) | 32): buf_s32 = 0; break;
-                default: buf_s32 = 0; break;
+    uint32_t sampleCount = 0;
+    uint32_t played = 0;  // samples of current track taken from rdbuf
+    // decode directly from secondaryBuffer slots of rdbuf by contiguous runs
+    // (into resampler input while resampled, then it produces samples of the buffer)
+    bool resample = resampler.isActive();
+    uint32_t resampleUs = 0;
+    // ramp gain per sample across the buffer from the gain at the end of last buffer
+    int32_t target = mute ? 0 : vol_table[volume];
+    int32_t span = static_cast<int32_t>(resampler.inputFor(buffer->max_sample_count));
+    int32_t step = (target - gain) / span;  // rounded toward zero not to overshoot
+    int32_t curGain = gain;
+    while (sampleCount < buffer->max_sample_count) {
+        if (resample) {
+            uint32_t t = time_us_32();
+            sampleCount += resampler.process(&samples[sampleCount*2], buffer->max_sample_count - sampleCount);
+            resampleUs += time_us_32() - t;
+            if (sampleCount >= buffer->max_sample_count) { break; }
+        }
+        uint32_t room = resample ? resampler.getRoom() : buffer->max_sample_count - sampleCount;
+        uint32_t run = std::min(static_cast<uint32_t>(rdbuf->getLeft()/blockBytes), room);
+        if (run == 0) {
+            // continue to next track seamlessly in the same buffer
+            if (rdbuf->isEof() && switchToNext()) {
+                played = 0;
+                continue;
             }
-            samples[i*2+j] = static_cast<int32_t>((static_cast<int64_t>(buf_s32) * vol_table[volume] / 65536)) + DAC_ZERO;
-            accum[j] += (buf_s32/65536) * (buf_s32/65536) / 32768 * 44100 / sampFreq;  // normalized to 44100 Hz's level
+            break;
         }
-        accumCount++;
+        int32_t* dst = resample ? resampler.getInput() : &samples[sampleCount*2];
+        if (kernel != nullptr) {
+            (*kernel)(rdbuf->buf(), dst, run, curGain, step, accum);
+        } else {
+            for (uint32_t i = 0; i < run; i++) {
+                dst[i*2+0] = DAC_ZERO;
+                dst[i*2+1] = DAC_ZERO;
+            }
+        }
+        curGain += step * static_cast<int32_t>(run);
+        accumCount += run;
+        rdbuf->shift(run*blockBytes);
+        played += run;
+        if (resample) {
+            resampler.commit(run);
+        } else {
+            sampleCount += run;
+        }
+    }
+    if (resample) { audio_stats_resample(resampleUs, static_cast<uint32_t>(static_cast<uint64_t>(sampleCount) * 1000000 / outFreq)); }
+    gain = (mute || step == 0) ? target : curGain;  // remainder less than a step per sample is applied at once
+    applyEq(samples, sampleCount);
+    bool reachedEnd = rdbuf->isEof() && rdbuf->getLeft() < blockBytes && !nextQueuing;
+    buffer->sample_count = reachedEnd ? sampleCount : buffer->max_sample_count;
+    if (sampleCount < buffer->sample_count) { audio_stats_underrun(); }
+    for (uint32_t i = sampleCount; i < buffer->sample_count; i++) {
+        // insert zeros to avoid blank noise when secondaryBuffer is empty
+        samples[i*2+0] = DAC_ZERO;
+        samples[i*2+1] = DAC_ZERO;
     }
     give_audio_buffer(ap, buffer);
-    incSamplesPlayed(buffer->sample_count);
-    if (accumCount >= 576 * sampFreq / 44100) {  // normalized to 44100 Hz's timing
-        setLevelInt(accum[0] / buffer->sample_count, accum[1] / buffer->sample_count);
+    incSamplesPlayed(played);
+    if (accumCount >= levelPeriod) {
+        setLevelInt(accum[0] / accumCount, accum[1] / accumCount);  // average is independent of sampling frequency
         accum[0] = 0;
         accum[1] = 0;
         accumCount = 0;
     }
-    rdbuf->shift(buffer->sample_count*blockBytes);
-    if (rdbuf->getLeft()/channels/blockBytes == 0) { stop(); }
+    if (reachedEnd) { endTrack(); }
 
     #ifdef DEBUG_PLAYWAV
     uint32_t time = static_cast<uint32_t>(to_us_since_boot(get_absolute_time()) - start);
@@ -135,6 +396,15 @@ void PlayWav::decode()
     #endif // DEBUG_PLAYWAV
 }
 
+bool PlayWav::probe(FIL* fp, uint32_t& sampFreq, uint32_t& durationMillis)
+{
+    header_t header;
+    if (!parseHeader(fp, header) || !isSupported(header)) { return false; }
+    sampFreq = header.sampFreq;
+    durationMillis = static_cast<uint32_t>(static_cast<uint64_t>(header.dataSize / header.blockBytes) * 1000 / header.sampFreq);
+    return true;
+}
+
 uint32_t PlayWav::totalMillis()
 {
     return  std::max(
@@ -19,16 +19,44 @@ public:
     ~PlayWav();
     void play(const char* filename, size_t fpos = 0, uint32_t samplesPlayed = 0);
     uint32_t totalMillis();
+    static bool probe(FIL* fp, uint32_t& sampFreq, uint32_t& durationMillis);  // read header only (fp is left open)
 protected:
     static constexpr uint16_t FMT_PCM   = 1;
     static constexpr uint16_t FMT_FLOAT = 3;
+    static constexpr uint16_t FMT_EXTENSIBLE = 0xfffe;  // actual format is in the head of SubFormat GUID
+    typedef void (*decodeKernel_t)(const uint8_t* buf, int32_t* samples, uint32_t count, int32_t gain, int32_t gainStep, uint32_t* accum);
+    typedef struct _header_t {
+        uint16_t format;
+        uint16_t channels;
+        uint32_t sampFreq;
+        uint16_t bitRateKbps;
+        uint16_t blockBytes;
+        uint16_t bitsPerSample;
+        size_t dataPos;
+        uint32_t dataSize;
+        decodeKernel_t kernel;
+    } header_t;
     static PlayWav* g_inst;
+    size_t dataPos;  // offset of the first sample (cached by parseHeader)
     uint32_t dataSize;
     uint16_t blockBytes;
     uint16_t format;  // 1: PCM, 3: IEEE float
+    decodeKernel_t kernel;  // specialized for format, bitsPerSample and channels (nullptr: not supported)
+    header_t nextHeader;  // header of next track for gapless playback
     uint32_t accum[2] = {};
     uint32_t accumCount;
-    void skipToDataChunk();
+    uint32_t levelPeriod;  // samples per level update (set per track)
+    template <uint16_t FORMAT, uint16_t BITS>
+    static int32_t loadSample(const uint8_t* ptr);
+    template <uint16_t FORMAT, uint16_t BITS, uint16_t CHANNELS>
+    static void decodeKernel(const uint8_t* buf, int32_t* samples, uint32_t count, int32_t gain, int32_t gainStep, uint32_t* accum);
+    static decodeKernel_t selectKernel(uint16_t format, uint16_t bitsPerSample, uint16_t channels);
+    static bool parseHeader(FIL* fp, header_t& header);
+    static bool isSupported(const header_t& header);
+    void applyHeader(const header_t& header);
     bool parseSetPos(size_t fpos);
+    bool getSeekPos(uint32_t millis, size_t* fpos, uint32_t* samples);
+    bool parseNext();
+    void applyNext();
     void decode();
 };
@@ -6,14 +6,29 @@
 
 #include "ReadBuffer.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include "pico/stdlib.h"
 #include "pico/flash.h"
 #include "pico/multicore.h"
+#include "hardware/sync.h"
+
+#include "audio_stats.h"
+#include "file_menu_FatFs.h"
+#include "mem_budget.h"
+#include "profiler.h"
 
 ReadBuffer* ReadBuffer::_inst = nullptr;
+size_t ReadBuffer::_numSecondaryBuffers = ReadBuffer::NUM_SECONDARY_BUFFERS;
+volatile ReadBuffer::backgroundTask_t ReadBuffer::_backgroundTask = nullptr;
+
+static FRESULT readBufferAuxRead(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br)
+{
+    return ReadBuffer::getInstance()->readAux(fp, ofs, buff, btr, br);
+}
 
 void readBufferCore1Process()
 {
@@ -22,6 +37,19 @@ void readBufferCore1Process()
     printf("ERROR: ReadBuffer::fillLoop() exit\r\n");
 }
 
+void ReadBuffer::configure(size_t numSecondaryBuffers)
+{
+    if (_inst != nullptr) { return; }  // not changeable once the instance is created
+    _numSecondaryBuffers = std::max(numSecondaryBuffers, MIN_SECONDARY_BUFFERS);
+}
+
+// task needs to return within budgetUs and to hold file_menu_fs_lock() while accessing FatFs
+// core1 sleeps instead of calling task again once it returns 0
+void ReadBuffer::setBackgroundTask(backgroundTask_t task)
+{
+    _backgroundTask = task;
+}
+
 ReadBuffer* ReadBuffer::getInstance()
 {
     if (_inst == nullptr) {
@@ -30,23 +58,31 @@ ReadBuffer* ReadBuffer::getInstance()
         // start process on core1
         multicore_reset_core1();
         multicore_launch_core1(readBufferCore1Process);
+        file_menu_set_read_func(readBufferAuxRead);  // metadata and artwork are read by core1 as well
     }
     return _inst;
 }
 
-// fillThreshold: auto fill if left is lower than fillThreshold
-//                set fillThreshold = 0 if using manual fill instead of auto fill
-//                set fillThreshold = size if auto fill everytime when shift (not recommended due to too many memmove)
+// Decoder reads directly out of secondaryBuffer slots (zero-copy)
+// The slot being read is held out of secondaryBufferQueue, therefore the queue accepts _numSecondaryBuffers - 1 items
+// Only a sample block straddling the slot boundary is joined in wrapBuffer
 ReadBuffer::ReadBuffer() :
-    _size(PlayAudio::RDBUF_SIZE), _left(0), _fillThreshold(PlayAudio::RDBUF_THRESHOLD), _isEof(false)
+    secondaryBuffer(new uint8_t[SECONDARY_BUFFER_SIZE * _numSecondaryBuffers]),
+    _aux{}, _hasAux(false), _item{}, _pos(0), _left(0), _hasNextReq(false), _ptr(secondaryBuffer), _inWrap(false), _wrapTail(0), _wrapPos(0), _isEof(false), _priming(false),
+    _batch(1), _winStart(0), _winBusyUs(0), _winReads(0)
 {
-    _head = reinterpret_cast<uint8_t*>(calloc(_size, sizeof(uint8_t)));
-    _ptr = _head;
+    // initialized before core1 starts
+    bindReqQueue.init(1);
+    bindRespQueue.init(1);
+    auxReqQueue.init(1);
+    auxRespQueue.init(1);
+    secondaryBufferQueue.init(_numSecondaryBuffers - 1);  // one slot is held by decoder
+    mem_budget_reserve("audio.rdbuf", SECONDARY_BUFFER_SIZE * _numSecondaryBuffers);
 }
 
 ReadBuffer::~ReadBuffer()
 {
-    free(_head);
+    delete[] secondaryBuffer;
 }
 
 const uint8_t* ReadBuffer::buf()
@@ -54,42 +90,50 @@ const uint8_t* ReadBuffer::buf()
     return reinterpret_cast<const uint8_t*>(_ptr);
 }
 
-void ReadBuffer::bind(FIL* fp)
+void ReadBuffer::bind(FIL* fp, size_t eodPos)
 {
     _fp = fp;
-    _ptr = _head;
+    _item = {};
+    _ptr = secondaryBuffer;
     _left = 0;
+    _inWrap = false;
     _isEof = false;
-    _eodPos = f_size(_fp);
+    _eodPos = std::min(eodPos, static_cast<size_t>(f_size(_fp)));
     _isEod = false;
 }
 
 bool ReadBuffer::fill()
 {
     if (_isEof) { return false; }
-    if (queue_is_empty(&secondaryBufferQueue)) {
-        // insert zeros to avoid blank noise
-        memmove(_head, _ptr, _left);
-        _ptr = _head;
-        size_t space = _size - _left;
-        memset(_head + _left, 0, space);
-        _left += space;
-        printf("ERROR: ReadBuffer::secondaryBuffer is empty\r\n");
+    secondaryBufferItem_t item;
+    if (!secondaryBufferQueue.tryPeek(&item)) {
+        audio_stats_queue_level(0);
+        if (_left == 0) {
+            printf("ERROR: ReadBuffer::secondaryBuffer is empty\r\n");
+        }
         return false;
     }
-    secondaryBufferItem_t item;
-    queue_peek_blocking(&secondaryBufferQueue, &item);  // not remove here to preend from overwrite by new data
-    memmove(_head, _ptr, _left);
-    _ptr = _head;
-    size_t space = _size - _left;
-    memcpy(_head + _left, item.ptr, item.length);
-    queue_remove_blocking(&secondaryBufferQueue, &item);  // remove from queue here actually
+    if (_left > 0) {
+        // join the tail of current slot and the head of next slot
+        // (copy before removing from queue because current slot is released to core1 by remove)
+        size_t head = std::min(WRAP_SIZE - _left, item.length);
+        memmove(wrapBuffer, _ptr, _left);
+        memcpy(wrapBuffer + _left, item.ptr, head);
+        _wrapPos = item.pos - item.length - _left;
+        _wrapTail = _left;
+        _ptr = wrapBuffer;
+        _left += head;
+        _inWrap = true;
+    } else {
+        _ptr = item.ptr;
+        _left = item.length;
+        _inWrap = false;
+    }
+    secondaryBufferQueue.tryPop(&item);  // hold next slot (current slot is released)
+    audio_stats_queue_level(secondaryBufferQueue.level());
+    _item = item;
     _pos = item.pos;
-    _left += item.length;
     _isEof = item.reachedEof;
-    if (space > item.length) {
-        memset(_head + _left, 0, space - item.length);  // fill 0
-    }
     return true;
 }
 
@@ -98,7 +142,17 @@ bool ReadBuffer::shift(size_t bytes)
     if (_left < bytes) { return false; }
     _ptr += bytes;
     _left -= bytes;
-    if (_left < _fillThreshold) { fill(); }
+    if (_inWrap) {
+        size_t consumed = static_cast<size_t>(_ptr - wrapBuffer);
+        if (consumed >= _wrapTail) {
+            // the tail of previous slot has been consumed, continue directly in current slot
+            size_t ofs = consumed - _wrapTail;
+            _ptr = _item.ptr + ofs;
+            _left = _item.length - ofs;
+            _inWrap = false;
+        }
+    }
+    if (!_inWrap && _left < WRAP_THRESHOLD) { fill(); }
     return true;
 }
 
@@ -107,97 +161,273 @@ bool ReadBuffer::shiftAll()
     return shift(_left);
 }
 
-void ReadBuffer::setEodPos(size_t pos)
+// switch to the stream of next file after current stream has reached its end (called by decoder)
+// partial sample block left at the end of current stream is discarded
+bool ReadBuffer::nextStream()
 {
-    if (pos >= f_size(_fp)) { return; }
-    _eodPos = pos;
+    if (!_isEof) { return false; }
+    _left = 0;
+    _inWrap = false;
+    _isEof = false;
+    fill();
+    return true;
 }
 
-bool ReadBuffer::seek(size_t pos)
+// resume as soon as the first slot is read instead of waiting for full secondaryBuffer
+bool ReadBuffer::seek(FIL* fp, size_t pos, size_t eodPos)
 {
-    if (pos >= f_size(_fp)) { return false; }
-    if (pos >= _eodPos) { return false; }
-    size_t eodPos = _eodPos;
-    reqBind(_fp, false);  // disconnect secondaryBuffer (dispose current secondaryBuffer)
-    f_lseek(_fp, pos);   // seek (move reading point)
-    reqBind(_fp);         // reconnect
-    _eodPos = eodPos;
+    if (pos >= f_size(fp)) { return false; }
+    if (pos >= eodPos) { return false; }
+    sendBindReq(fp, false, SIZE_MAX);  // disconnect secondaryBuffer (dispose current secondaryBuffer, also cancels next file)
+    file_menu_fs_lock();
+    FRESULT fr = f_lseek(fp, pos);   // seek (move reading point)
+    file_menu_fs_unlock();
+    if (fr != FR_OK) { return false; }
+    sendBindReq(fp, true, eodPos);  // reconnect
+    _priming = true;
+    waitSlots(1);
     return true;
 }
 
 size_t ReadBuffer::getLeft()
 {
+    if (!_inWrap && _left < WRAP_THRESHOLD) { fill(); }  // retry if secondaryBuffer was empty at last shift
     return _left;
 }
 
 size_t ReadBuffer::tell()
 {
+    if (_inWrap) {
+        return _wrapPos + static_cast<size_t>(_ptr - wrapBuffer);
+    }
     return _pos - _left;
 }
 
+bool ReadBuffer::isEof()
+{
+    return _isEof;  // no more data comes after getLeft() bytes
+}
+
 bool ReadBuffer::isFull()
 {
-    return queue_is_full(&secondaryBufferQueue);
+    return secondaryBufferQueue.isFull();
 }
 
 bool ReadBuffer::isNearEmpty()
 {
-    return (!_isEod && queue_get_level(&secondaryBufferQueue) <= NUM_SECONDARY_BUFFERS / 4);
+    size_t level = secondaryBufferQueue.level();
+    if (_priming) {
+        if (level > _numSecondaryBuffers / 4 || _isEod) { _priming = false; }
+        return false;
+    }
+    return (!_isEod && level <= _numSecondaryBuffers / 4);
 }
 
-void ReadBuffer::reqBind(FIL* fp, bool flag)
+void ReadBuffer::reqBind(FIL* fp, bool flag, size_t eodPos)
 {
-    bindReq_t req = {fp, flag};
+    sendBindReq(fp, flag, eodPos);
+    if (flag) {
+        // wait until secondaryBuffer is full unless data is shorter than secondaryBuffer
+        _priming = false;
+        waitSlots(_numSecondaryBuffers - 1);
+    }
+}
+
+void ReadBuffer::sendBindReq(FIL* fp, bool flag, size_t eodPos)
+{
+    bindReq_t req = {fp, flag, eodPos, false};  // eodPos is handed to core1 together to be applied before the first read
     // send request
-    queue_try_add(&bindReqQueue, &req);
+    bindReqQueue.tryPush(req);
     // wait response
-    queue_remove_blocking(&bindRespQueue, &req);
-    if (flag) {
-        while (!queue_is_full(&secondaryBufferQueue)) {}
-        fill();
+    bindRespQueue.popBlocking(&req);
+    if (!flag) {
+        // discard data left in secondaryBufferQueue (core1 has stopped pushing before response)
+        secondaryBufferItem_t item;
+        while (secondaryBufferQueue.tryPop(&item)) {}
+    }
+}
+
+// wait until num slots are queued unless data is shorter, then hold the first slot
+void ReadBuffer::waitSlots(size_t num)
+{
+    // each push of core1 signals event by __sev()
+    while (secondaryBufferQueue.level() < num && !(_isEod && !secondaryBufferQueue.isEmpty())) {
+        __wfe();
+    }
+    fill();
+}
+
+// core1 starts reading fp as soon as current file is read through, then slots of both files are queued in order
+// decoder needs to call nextStream() at the end of current stream to proceed to fp
+void ReadBuffer::reqBindNext(FIL* fp, size_t eodPos)
+{
+    bindReq_t req = {fp, true, eodPos, true};
+    // send request
+    bindReqQueue.tryPush(req);
+    // wait response
+    bindRespQueue.popBlocking(&req);
+}
+
+// core0 sleeps until core1 completes the read (served in chunks between audio refills)
+FRESULT ReadBuffer::readAux(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br)
+{
+    auxReq_t req = {fp, ofs, static_cast<uint8_t*>(buff), btr, 0, FR_OK};
+    auxReqQueue.tryPush(req);
+    auxRespQueue.popBlocking(&req);
+    *br = req.br;
+    return req.fr;
+}
+
+// proceed aux read by one chunk (core1), returns false if no aux read is requested
+bool ReadBuffer::serveAux()
+{
+    if (!_hasAux) {
+        if (!auxReqQueue.tryPop(&_aux)) { return false; }
+        _hasAux = true;
+        _aux.br = 0;
+        _aux.fr = FR_OK;
+        if (_aux.ofs != FILE_MENU_CUR_POS) {
+            file_menu_fs_lock();
+            if (_aux.ofs != f_tell(_aux.fp)) { _aux.fr = f_lseek(_aux.fp, _aux.ofs); }
+            file_menu_fs_unlock();
+        }
     }
+    bool done = (_aux.fr != FR_OK || _aux.br >= _aux.btr);
+    if (!done) {
+        UINT btr = std::min(_aux.btr - _aux.br, AUX_CHUNK_SIZE);
+        UINT br = 0;
+        file_menu_fs_lock();
+        _aux.fr = f_read(_aux.fp, &_aux.buf[_aux.br], btr, &br);
+        file_menu_fs_unlock();
+        _aux.br += br;
+        done = (_aux.fr != FR_OK || br < btr || _aux.br >= _aux.btr);  // br < btr: end of file
+    }
+    if (done) {
+        auxRespQueue.tryPush(_aux);
+        _hasAux = false;
+    }
+    return true;
+}
+
+// trim read size only if pos is off sector boundary (e.g. head of audio data), so that the read ends at sector boundary
+// then following reads are sector aligned and fill whole slots (FatFs splits them at cluster boundaries internally)
+UINT ReadBuffer::alignRead(size_t pos, UINT reqBr)
+{
+    if (pos % SECTOR_SIZE == 0) { return reqBr; }
+    size_t alignedEnd = (pos + reqBr) / SECTOR_SIZE * SECTOR_SIZE;
+    if (alignedEnd > pos + WRAP_THRESHOLD) { return static_cast<UINT>(alignedEnd - pos); }
+    return reqBr;
+}
+
+// slower cards spend more time by command overhead of each read, which is amortized by larger read
+// batch size is adapted by the ratio of time in f_read to elapsed time (= consumption rate / read throughput)
+void ReadBuffer::adaptBatch(uint32_t readUs)
+{
+    _winBusyUs += readUs;
+    if (++_winReads < ADAPT_WINDOW) { return; }
+    uint32_t now = time_us_32();
+    uint32_t elapsed = now - _winStart;
+    if (elapsed > 0) {
+        uint32_t busyPercent = static_cast<uint32_t>(static_cast<uint64_t>(_winBusyUs) * 100 / elapsed);
+        int maxBatch = static_cast<int>(_numSecondaryBuffers) / 2;  // keep the rest for margin
+        if (busyPercent > BUSY_HIGH_PERCENT && _batch < maxBatch) {
+            _batch++;
+        } else if (busyPercent < BUSY_LOW_PERCENT && _batch > 1) {
+            _batch--;
+        }
+    }
+    _winStart = now;
+    _winBusyUs = 0;
+    _winReads = 0;
 }
 
 void ReadBuffer::fillLoop()
 {
     int id = 0;
     FIL* fp;
-    queue_init(&bindReqQueue, sizeof(bindReq_t), 1);
-    queue_init(&bindRespQueue, sizeof(bindReq_t), 1);
-    queue_init(&secondaryBufferQueue, sizeof(secondaryBufferItem_t), NUM_SECONDARY_BUFFERS);
     bindReq_t req;
     secondaryBufferItem_t item;
 
     while (true) {
-        // expecting reqBind(true)
-        while (queue_is_empty(&bindReqQueue)) {}
-        queue_remove_blocking(&bindReqQueue, &req);
-        if (req.flag) {
-            fp = req.fp;
-            bind(fp);
-            item.pos = f_tell(fp);
-            item.reachedEof = _isEod || static_cast<bool>(f_eof(fp));
+        if (_hasNextReq) {
+            // continue to next file without waiting for request (decoder still reads slots of previous file)
+            _hasNextReq = false;
+            fp = _nextReq.fp;
+            _fp = fp;
+            _eodPos = std::min(_nextReq.eodPos, static_cast<size_t>(f_size(_fp)));
+            _isEod = false;
+            req = _nextReq;
+        } else {
+            // expecting reqBind(true) while serving aux reads (sleep by __wfe() until either request is pushed)
+            while (!bindReqQueue.tryPop(&req)) {
+                if (!serveAux()) { __wfe(); }
+            }
+            if (req.next) {
+                // current file has already been read through
+                _nextReq = req;
+                _hasNextReq = true;
+                bindRespQueue.tryPush(req);
+                continue;
+            }
+            if (req.flag) {
+                fp = req.fp;
+                bind(fp, req.eodPos);
+            }
+            // data left in secondaryBufferQueue is discarded by consumer side in reqBind(false)
+            bindRespQueue.tryPush(req);  // response regardless of flag
+            if (!req.flag) { continue; }  // retry if reqBind(false)
+        }
+        item.pos = f_tell(fp);
+        _isEod = (item.pos >= _eodPos) || static_cast<bool>(f_eof(fp));
+        item.reachedEof = _isEod;
+        if (item.reachedEof) {
+            // nothing to read: notify decoder of end by an empty slot
+            // (only happens by reqBind() where queue is empty, reqBindNext() is not given empty data)
+            item.ptr = &secondaryBuffer[SECONDARY_BUFFER_SIZE * id];
+            item.length = 0;
+            secondaryBufferQueue.tryPush(item);
+            id = (id + 1) % _numSecondaryBuffers;
         }
-        queue_try_add(&bindRespQueue, &req);  // response regardless of flag
-        if (!req.flag) { continue; }  // retry if reqBind(false)
 
         while (!item.reachedEof) {
             // read from file to store secondaryBuffer
-            while (!queue_is_full(&secondaryBufferQueue)) {
+            while (!secondaryBufferQueue.isFull()) {
                 // read at once for max efficiency as min of either till the end of buffer or spare number of queue
-                int level = static_cast<int>(queue_get_level(&secondaryBufferQueue));
-                int reqN = NUM_SECONDARY_BUFFERS - ((id > level) ? id : level);
+                // (the slot just before the queued ones could be still held by decoder)
+                int level = static_cast<int>(secondaryBufferQueue.level());
+                int reqN = std::min(static_cast<int>(_numSecondaryBuffers) - id, static_cast<int>(_numSecondaryBuffers) - 1 - level);
+                // wait for spare slots of batch size unless buffer runs short or reached the end of buffer
+                bool isLow = level <= static_cast<int>(_numSecondaryBuffers) / 4;
+                if (reqN < _batch && id + reqN < static_cast<int>(_numSecondaryBuffers) && !isLow) { break; }
                 UINT reqBr;
                 if (item.pos + SECONDARY_BUFFER_SIZE * reqN >= _eodPos) {
                     reqBr = _eodPos - item.pos;
                     _isEod = true;
                 } else {
-                    reqBr = SECONDARY_BUFFER_SIZE * reqN;
+                    reqBr = alignRead(item.pos, SECONDARY_BUFFER_SIZE * reqN);
                 }
                 UINT br;
+                PROF_BEGIN(profBegin);
+                file_menu_fs_lock();
+                uint32_t start = time_us_32();
                 FRESULT fr = f_read(fp, &secondaryBuffer[SECONDARY_BUFFER_SIZE * id], reqBr, &br);
+                uint32_t readUs = time_us_32() - start;
+                file_menu_fs_unlock();
+                PROF_END("rdbuf", "fill", profBegin);
+                audio_stats_read(br, readUs);
+                adaptBatch(readUs);
                 _isEod |= static_cast<bool>(f_eof(fp));
-                if (fr != FR_OK || br == 0) { return; }
+                if (fr != FR_OK || br == 0) {
+                    // end the stream by an empty slot and go back to serve bind and aux requests
+                    // (core0 waits in readAux() for core1 on every tag and cover art read)
+                    item.ptr = &secondaryBuffer[SECONDARY_BUFFER_SIZE * id];
+                    item.length = 0;
+                    item.reachedEof = true;
+                    _isEod = true;
+                    secondaryBufferQueue.tryPush(item);
+                    id = (id + 1) % _numSecondaryBuffers;
+                    break;
+                }
                 // put on queue divided by SECONDARY_BUFFER_SIZE
                 int readN = (br + SECONDARY_BUFFER_SIZE - 1) / SECONDARY_BUFFER_SIZE;
                 for (int i = 0; i < readN; i++) {
@@ -210,23 +440,36 @@ void ReadBuffer::fillLoop()
                     }
                     item.ptr = &secondaryBuffer[SECONDARY_BUFFER_SIZE * id];
                     item.pos += item.length;
-                    queue_try_add(&secondaryBufferQueue, &item);
-                    id = (id + 1) % NUM_SECONDARY_BUFFERS;
+                    secondaryBufferQueue.tryPush(item);
+                    id = (id + 1) % _numSecondaryBuffers;
                 }
                 if (item.reachedEof) { break; }
             }
-            // acceptance of reqBind(false)
-            if (!queue_is_empty(&bindReqQueue)) {
-                queue_remove_blocking(&bindReqQueue, &req);
-                if (!req.flag) {
-                    // discard all data in senondaryBufferQueue
-                    while (!queue_is_empty(&secondaryBufferQueue)) {
-                        queue_remove_blocking(&secondaryBufferQueue, &item);
-                    }
+            // acceptance of reqBind(false) and reqBindNext()
+            if (bindReqQueue.tryPop(&req)) {
+                if (req.next) {
+                    _nextReq = req;
+                    _hasNextReq = true;
+                } else if (!req.flag) {
+                    // stop pushing, then data left in secondaryBufferQueue is discarded by reqBind(false)
+                    _hasNextReq = false;
                 }
-                queue_try_add(&bindRespQueue, &req);  // response regardless of flag
+                bindRespQueue.tryPush(req);  // response regardless of flag
                 if (!req.flag) { break; }  // start over if reqBind(false), otherwise ignore
             }
+            // aux reads by one chunk so that audio is refilled in between (skipped when buffer runs short)
+            bool busy = false;
+            if (!item.reachedEof && bindReqQueue.isEmpty() && secondaryBufferQueue.level() > _numSecondaryBuffers / 4) {
+                busy = serveAux();
+            }
+            // spare time while waiting for free slots (skipped when buffered data is not enough)
+            backgroundTask_t task = _backgroundTask;
+            if (!busy && task != nullptr && !item.reachedEof && bindReqQueue.isEmpty() &&
+                secondaryBufferQueue.level() > _numSecondaryBuffers / 2) {
+                busy = task(BACKGROUND_BUDGET_US) != 0;
+            }
+            // sleep until decoder releases a slot or a request comes (both pop and push signal event by __sev())
+            if (!busy && !item.reachedEof && bindReqQueue.isEmpty()) { __wfe(); }
         }
     }
 }
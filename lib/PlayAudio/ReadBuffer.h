@@ -6,35 +6,53 @@
 
 #pragma once
 
-#include "pico/util/queue.h"
-
 #include "ff.h"
 #include "PlayAudio.h"
+#include "SpscQueue.h"
 
 //=================================
 // Interface of ReadBuffer Class
 //=================================
+// core1 serves SD reads in priority order: audio stream, aux reads of core0 (metadata and artwork), background task
 class ReadBuffer
 {
 public:
+    static constexpr size_t SECTOR_SIZE = 512;
+    static constexpr size_t SECONDARY_BUFFER_SIZE = (PlayAudio::RDBUF_SIZE - PlayAudio::RDBUF_THRESHOLD) / SECTOR_SIZE * SECTOR_SIZE;  // multiple of sector
+    static constexpr size_t NUM_SECONDARY_BUFFERS = 8;  // default
+    static constexpr size_t MIN_SECONDARY_BUFFERS = 4;
+    static constexpr size_t WRAP_THRESHOLD = 16;  // max bytes of one sample block (all channels)
+    typedef int (*backgroundTask_t)(uint32_t budgetUs);  // returns non-zero while work is left
+    static void configure(size_t numSecondaryBuffers);  // needs to be called before getInstance()
+    static void setBackgroundTask(backgroundTask_t task);  // cooperative task run on core1 while secondaryBuffer is filled enough
     static ReadBuffer* getInstance();  // Singleton
     ReadBuffer();
     virtual ~ReadBuffer();
-    void reqBind(FIL* fp, bool flag = true);
+    void reqBind(FIL* fp, bool flag = true, size_t eodPos = SIZE_MAX);  // read from current file position up to eodPos
+    void reqBindNext(FIL* fp, size_t eodPos = SIZE_MAX);  // continue reading fp after current file (gapless)
+    bool nextStream();
     const uint8_t* buf();
     bool shift(size_t bytes);
     bool shiftAll();
-    void setEodPos(size_t pos);
-    bool seek(size_t pos);
+    bool seek(FIL* fp, size_t pos, size_t eodPos = SIZE_MAX);  // rebind fp from pos, decoder needs to be held meanwhile
+    FRESULT readAux(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br);  // read by core1 in spare time of audio stream (core0 only)
     size_t getLeft();
     size_t tell();
+    bool isEof();
     bool isFull();
     bool isNearEmpty();
 private:
-    static constexpr size_t SECONDARY_BUFFER_SIZE = PlayAudio::RDBUF_SIZE - PlayAudio::RDBUF_THRESHOLD;
-    static constexpr size_t NUM_SECONDARY_BUFFERS = 8;
+    static constexpr size_t WRAP_SIZE = WRAP_THRESHOLD * 2;
+    static constexpr int ADAPT_WINDOW = 16;  // number of reads to evaluate busy ratio of f_read
+    static constexpr uint32_t BUSY_HIGH_PERCENT = 60;  // enlarge read batch if core1 is busier than this in f_read
+    static constexpr uint32_t BUSY_LOW_PERCENT = 25;  // reduce read batch if core1 is less busy than this in f_read
+    static constexpr uint32_t BACKGROUND_BUDGET_US = 2000;  // time slice of background task in each call
+    static constexpr UINT AUX_CHUNK_SIZE = SECONDARY_BUFFER_SIZE;  // max bytes of aux read between audio refills
     static ReadBuffer* _inst;  // Singleton instance
-    uint8_t secondaryBuffer[SECONDARY_BUFFER_SIZE * NUM_SECONDARY_BUFFERS];
+    static size_t _numSecondaryBuffers;
+    static volatile backgroundTask_t _backgroundTask;
+    uint8_t* secondaryBuffer;  // SECONDARY_BUFFER_SIZE * _numSecondaryBuffers
+    uint8_t wrapBuffer[WRAP_SIZE];  // joins the tail of a slot and the head of the next slot
     typedef struct _secondaryBufferItem_t {
         uint8_t* ptr;
         size_t   pos;
@@ -44,21 +62,48 @@ private:
     typedef struct _bindReq_t {
         FIL* fp;
         bool flag;
+        size_t eodPos;
+        bool next;
     } bindReq_t;
-    queue_t secondaryBufferQueue;
-    queue_t bindReqQueue;
-    queue_t bindRespQueue;
+    typedef struct _auxReq_t {
+        FIL* fp;
+        FSIZE_t ofs;  // FILE_MENU_CUR_POS: current position
+        uint8_t* buf;
+        UINT btr;
+        UINT br;  // progress
+        FRESULT fr;
+    } auxReq_t;
+    SpscQueue<secondaryBufferItem_t> secondaryBufferQueue;  // core1 -> core0 (decoder)
+    SpscQueue<bindReq_t> bindReqQueue;  // core0 -> core1
+    SpscQueue<bindReq_t> bindRespQueue;  // core1 -> core0
+    SpscQueue<auxReq_t> auxReqQueue;  // core0 -> core1
+    SpscQueue<auxReq_t> auxRespQueue;  // core1 -> core0
+    auxReq_t _aux;  // aux read in progress (core1)
+    bool _hasAux;
     FIL* _fp;
-    size_t _size;
+    secondaryBufferItem_t _item;  // slot currently read by decoder (held out of the queue)
     size_t _pos;
     size_t _left;
     size_t _eodPos;
-    bool _isEod;
-    uint8_t* _head;
+    bindReq_t _nextReq;  // next file to be continued by core1
+    bool _hasNextReq;
+    volatile bool _isEod;  // written by core1
     uint8_t* _ptr;
-    size_t _fillThreshold;
+    bool _inWrap;
+    size_t _wrapTail;
+    size_t _wrapPos;
     bool _isEof;
-    void bind(FIL* fp);
+    bool _priming;  // near empty is not reported until refill after seek (decoder side)
+    int _batch;  // minimum number of slots per read (core1)
+    uint32_t _winStart;
+    uint32_t _winBusyUs;
+    int _winReads;
+    void bind(FIL* fp, size_t eodPos);
+    void sendBindReq(FIL* fp, bool flag, size_t eodPos);
+    void waitSlots(size_t num);
+    bool serveAux();
+    UINT alignRead(size_t pos, UINT reqBr);
+    void adaptBatch(uint32_t readUs);
     bool fill();
     void fillLoop();
     friend void readBufferCore1Process();
@@ -0,0 +1,156 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "i2s_audio_init.h"
+
+int16_t Resampler::coefs[PHASES + 1][TAPS];
+float Resampler::coefCutoff = 0.0f;
+
+// S32 result of filter from sums of upper (hi * 4 = (hi << 16) >> COEF_BITS) and lower 16bit parts (saturated with margin for DAC_ZERO)
+static inline int32_t combine(int32_t hi, int32_t lo)
+{
+    constexpr int32_t HI_MAX = (1 << 29) - (1 << 20);
+    if (hi > HI_MAX) { return INT32_MAX - DAC_ZERO; }
+    if (hi < -HI_MAX) { return INT32_MIN; }
+    return hi * 4 + lo;
+}
+
+//=================================
+// Implementation of Resampler class
+//=================================
+Resampler::Resampler() : inFreq(0), outFreq(0), stepInt(1), stepFrac(0), pos(0), frac(0), level(0), buf{}
+{
+}
+
+void Resampler::setup(uint32_t inFreq, uint32_t outFreq)
+{
+    this->inFreq = inFreq;
+    this->outFreq = outFreq;
+    if (isActive()) {
+        uint64_t step = (static_cast<uint64_t>(inFreq) << 32) / outFreq;
+        stepInt = static_cast<uint32_t>(step >> 32);
+        stepFrac = static_cast<uint32_t>(step);
+        // pass band up to 91% of Nyquist frequency of the lower side
+        float cutoff = 0.5f * 0.91f * std::min(1.0f, static_cast<float>(outFreq) / static_cast<float>(inFreq));
+        if (cutoff != coefCutoff) { calcCoefs(cutoff); }
+    }
+    reset();
+}
+
+// first output sample is centered on the first input sample
+void Resampler::reset()
+{
+    level = TAPS/2 - 1;
+    for (uint32_t i = 0; i < level; i++) {
+        buf[i*2+0] = DAC_ZERO;
+        buf[i*2+1] = DAC_ZERO;
+    }
+    pos = 0;
+    frac = 0;
+}
+
+// Blackman windowed sinc, each phase normalized to unity DC gain
+// (the last phase is the first one delayed by a tap for interpolation)
+void Resampler::calcCoefs(float cutoff)
+{
+    for (int p = 0; p <= PHASES; p++) {
+        float h[TAPS];
+        float sum = 0.0f;
+        for (int k = 0; k < TAPS; k++) {
+            float t = static_cast<float>(k - (TAPS/2 - 1)) - static_cast<float>(p) / PHASES;  // distance from output point
+            float x = 2.0f * cutoff * t;
+            float sinc = (x == 0.0f) ? 1.0f : sinf(static_cast<float>(M_PI) * x) / (static_cast<float>(M_PI) * x);
+            float w = 0.42f + 0.5f * cosf(2.0f * static_cast<float>(M_PI) * t / TAPS) + 0.08f * cosf(4.0f * static_cast<float>(M_PI) * t / TAPS);
+            h[k] = sinc * w;
+            sum += h[k];
+        }
+        int32_t total = 0;
+        for (int k = 0; k < TAPS; k++) {
+            coefs[p][k] = static_cast<int16_t>(lroundf(h[k] / sum * (1 << COEF_BITS)));
+            total += coefs[p][k];
+        }
+        coefs[p][TAPS/2 - 1 + (p >= PHASES/2)] += static_cast<int16_t>((1 << COEF_BITS) - total);  // rounding residual to the nearest tap
+    }
+    coefCutoff = cutoff;
+}
+
+bool Resampler::isActive() const
+{
+    return inFreq != 0 && outFreq != 0 && inFreq != outFreq;
+}
+
+uint32_t Resampler::inputFor(uint32_t outCount) const
+{
+    if (!isActive()) { return outCount; }
+    return static_cast<uint32_t>((static_cast<uint64_t>(outCount) * inFreq + outFreq - 1) / outFreq) + CHUNK + TAPS;
+}
+
+int32_t* Resampler::getInput()
+{
+    return &buf[level*2];
+}
+
+uint32_t Resampler::getRoom() const
+{
+    return CHUNK + TAPS - level;
+}
+
+void Resampler::commit(uint32_t count)
+{
+    level += count;
+}
+
+// (sample * coef) >> COEF_BITS is accumulated as hi * coef and (lo * coef) >> COEF_BITS of sample = (hi << 16) + lo
+// so that only 32bit multiplications are used
+uint32_t Resampler::process(int32_t* out, uint32_t count)
+{
+    uint32_t produced = 0;
+    uint32_t p = pos;
+    uint32_t f = frac;
+    while (produced < count && p + TAPS <= level) {
+        const int16_t* c0 = coefs[f >> (32 - PHASE_BITS)];
+        const int16_t* c1 = c0 + TAPS;
+        int32_t w = static_cast<int32_t>((f << PHASE_BITS) >> 17);  // 15bit weight of c1
+        const int32_t* x = &buf[p*2];
+        int32_t hiL = 0, loL = 0, hiR = 0, loR = 0;
+        for (int k = 0; k < TAPS; k++, x += 2) {
+            int32_t ck = c0[k] + (((c1[k] - c0[k]) * w) >> 15);
+            hiL += (x[0] >> 16) * ck;
+            loL += (static_cast<int32_t>(x[0] & 0xffff) * ck) >> COEF_BITS;
+            hiR += (x[1] >> 16) * ck;
+            loR += (static_cast<int32_t>(x[1] & 0xffff) * ck) >> COEF_BITS;
+        }
+        *out++ = combine(hiL, loL);
+        *out++ = combine(hiR, loR);
+        produced++;
+        uint32_t next = f + stepFrac;
+        p += stepInt + (next < f);
+        f = next;
+    }
+    frac = f;
+    // keep samples from the first tap of next output
+    uint32_t drop = std::min(p, level);
+    memmove(buf, &buf[drop*2], (level - drop) * 2 * sizeof(int32_t));
+    level -= drop;
+    pos = p - drop;
+    return produced;
+}
+
+uint32_t Resampler::getInFreq() const
+{
+    return inFreq;
+}
+
+uint32_t Resampler::getOutFreq() const
+{
+    return outFreq;
+}
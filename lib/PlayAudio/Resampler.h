@@ -0,0 +1,48 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+
+//=================================
+// Interface of Resampler Class
+//=================================
+// Polyphase windowed-sinc FIR converting S32 stereo samples from inFreq to outFreq in fixed point
+// coefficients are linearly interpolated between adjacent phases per output sample
+// decoder writes input samples at getInput() up to getRoom(), then process() produces output samples from them
+class Resampler
+{
+public:
+    static constexpr uint32_t CHUNK = 64;  // input samples buffered in addition to filter taps
+    Resampler();
+    void setup(uint32_t inFreq, uint32_t outFreq);  // not to be called while process() runs
+    void reset();  // clear filter history
+    bool isActive() const;  // false if inFreq == outFreq
+    uint32_t inputFor(uint32_t outCount) const;  // upper bound of input samples taken while outCount samples are produced
+    int32_t* getInput();
+    uint32_t getRoom() const;
+    void commit(uint32_t count);  // count samples have been written at getInput()
+    uint32_t process(int32_t* out, uint32_t count);  // returns number of samples produced (up to count)
+    uint32_t getInFreq() const;
+    uint32_t getOutFreq() const;
+protected:
+    static constexpr int TAPS = 16;
+    static constexpr int PHASE_BITS = 6;
+    static constexpr int PHASES = 1 << PHASE_BITS;
+    static constexpr int COEF_BITS = 14;
+    static int16_t coefs[PHASES + 1][TAPS];  // shared by instances (only one codec plays at a time)
+    static float coefCutoff;  // cutoff of coefs (0: not calculated)
+    uint32_t inFreq;
+    uint32_t outFreq;
+    uint32_t stepInt;  // input samples per output sample in integer part and 32bit fraction
+    uint32_t stepFrac;
+    uint32_t pos;  // index of the first tap in buf (can exceed level while input is skipped)
+    uint32_t frac;  // fraction of position between taps
+    uint32_t level;  // samples in buf
+    int32_t buf[(CHUNK + TAPS) * 2];
+    static void calcCoefs(float cutoff);
+};
@@ -0,0 +1,47 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2021, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "RiffChunk.h"
+
+#include <cstring>
+
+static size_t getLESize4(const uint8_t* buf)
+{
+    return ((size_t) buf[3] << 24) + ((size_t) buf[2] << 16) + ((size_t) buf[1] << 8) + ((size_t) buf[0]);
+}
+
+bool riff_read_header(FIL& file, const size_t& pos, const char* riff_id, riff_t& riff)
+{
+    uint8_t buf[12];  // id(4) + size(4) + fmt_id(4)
+    UINT br;
+    if (f_lseek(&file, pos) != FR_OK) { return false; }
+    if (f_read(&file, buf, sizeof(buf), &br) != FR_OK || br != sizeof(buf)) { return false; }
+    if (memcmp(buf, riff_id, 4) != 0) { return false; }
+    riff.riff_id = riff_id;
+    riff.fmt_id = std::string(reinterpret_cast<const char*>(&buf[8]), 4);
+    riff.pos = pos;
+    riff.size = getLESize4(&buf[4]);
+    return true;
+}
+
+bool riff_find_next_chunk(FIL& file, const size_t& end_pos, size_t& pos, riff_chunk_t& chunk)
+{
+    uint8_t buf[8];  // id(4) + size(4)
+    UINT br;
+    if (end_pos < pos + 8) { return false; }
+    if (f_lseek(&file, pos) != FR_OK) { return false; }
+    if (f_read(&file, buf, sizeof(buf), &br) != FR_OK || br != sizeof(buf)) { return false; }
+    chunk.id = std::string(reinterpret_cast<const char*>(&buf[0]), 4);
+    chunk.pos = pos;
+    chunk.size = getLESize4(&buf[4]);
+    uint64_t next = static_cast<uint64_t>(pos) + (static_cast<uint64_t>(chunk.size) + 8 + 1) / 2 * 2;  // keep even byte alighment
+    if (end_pos < next) {
+        pos = end_pos;  // saturated, chunk exceeds search range
+        return false;
+    }
+    pos = static_cast<size_t>(next);
+    return true;
+}
@@ -0,0 +1,56 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2021, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "ff.h"
+
+// end position saturated instead of wrapping around (size field could be up to 0xffffffff)
+inline size_t sat_end_pos(size_t pos, size_t size)
+{
+    uint64_t end = static_cast<uint64_t>(pos) + size + 8;
+    return (end > SIZE_MAX) ? SIZE_MAX : static_cast<size_t>(end);
+}
+
+typedef struct _riff_t {
+    std::string riff_id;
+    std::string fmt_id;
+    size_t pos;
+    size_t size;
+    size_t chunk_pos() { return pos + 12; }
+    size_t end_pos() { return sat_end_pos(pos, size); }
+} riff_t;
+
+typedef struct _riff_chunk_t {
+    std::string id;
+    size_t      pos;
+    size_t      size;
+    size_t body_pos() { return pos + 8; }
+    size_t end_pos() { return sat_end_pos(pos, size); }
+} riff_chunk_t;
+
+/**
+ * Read RIFF header (walks chunks by seeking, nothing but headers are read)
+ *
+ * @param file is FIL file
+ * @param pos is RIFF header position
+ * @param riff_id is expected RIFF id ("RIFF", "LIST")
+ * @param riff is out: riff header
+ */
+bool riff_read_header(FIL& file, const size_t& pos, const char* riff_id, riff_t& riff);
+
+/**
+ * Find next chunk
+ *
+ * @param file is FIL file
+ * @param end_pos is chunk search stop position
+ * @param pos is in: chunk search start position, out: next chunk search start position
+ * @param chunk is  out: riff chunk (valid even if returns false as long as its header exists)
+ */
+bool riff_find_next_chunk(FIL& file, const size_t& end_pos, size_t& pos, riff_chunk_t& chunk);
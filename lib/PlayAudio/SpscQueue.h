@@ -0,0 +1,119 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hardware/sync.h"
+
+//=================================
+// Interface of SpscQueue Class
+//=================================
+// Lock-free ring between a single producer and a single consumer (e.g. core1 and core0)
+// _head is written only by consumer and _tail only by producer, items are handed over by release/acquire fences
+// push and pop signal event by __sev() so that the other side waiting by __wfe() wakes up
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue() : _buf(nullptr), _size(0), _head(0), _tail(0) {}
+    virtual ~SpscQueue() { delete[] _buf; }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    void init(size_t capacity)  // needs to be called before both sides start
+    {
+        delete[] _buf;
+        _size = static_cast<uint32_t>(capacity) + 1;  // one entry is kept empty to tell full from empty
+        _buf = new T[_size];
+        _head = 0;
+        _tail = 0;
+    }
+    // producer side
+    bool tryPush(const T& item)
+    {
+        uint32_t tail = _tail;
+        uint32_t next = inc(tail);
+        if (next == _head) { return false; }
+        _buf[tail] = item;
+        __mem_fence_release();  // item is written before it is published by _tail
+        _tail = next;
+        __sev();
+        return true;
+    }
+    // consumer side
+    bool tryPeek(T* item) const
+    {
+        uint32_t head = _head;
+        if (head == _tail) { return false; }
+        __mem_fence_acquire();  // item is read after it is published by _tail
+        *item = _buf[head];
+        return true;
+    }
+    bool tryPop(T* item)
+    {
+        if (!tryPeek(item)) { return false; }
+        __mem_fence_release();  // item is read out before the entry is released to producer
+        _head = inc(_head);
+        __sev();
+        return true;
+    }
+    void popBlocking(T* item)  // sleep by __wfe() until an item comes
+    {
+        while (!tryPop(item)) {
+            __wfe();
+        }
+    }
+    // either side (snapshot)
+    size_t level() const
+    {
+        uint32_t head = _head;
+        uint32_t tail = _tail;
+        return (tail >= head) ? tail - head : tail + _size - head;
+    }
+    bool isEmpty() const { return _head == _tail; }
+    bool isFull() const { return inc(_tail) == _head; }
+private:
+    T* _buf;
+    uint32_t _size;
+    volatile uint32_t _head;  // next entry to pop
+    volatile uint32_t _tail;  // next entry to push
+    uint32_t inc(uint32_t idx) const { return (idx + 1 < _size) ? idx + 1 : 0; }
+};
+
+//=================================
+// Interface of SpscValue Class
+//=================================
+// Latest value published by a single writer context and read by any number of readers (sequence lock)
+// readers retry while the writer is in the middle of store(), the writer never waits for readers
+template <typename T>
+class SpscValue
+{
+public:
+    SpscValue() : _seq(0), _value{} {}
+    void store(const T& value)  // writer only
+    {
+        _seq = _seq + 1;  // odd: writing
+        __mem_fence_release();
+        _value = value;
+        __mem_fence_release();
+        _seq = _seq + 1;  // even: stable
+    }
+    T load() const
+    {
+        while (true) {
+            uint32_t seq = _seq;
+            __mem_fence_acquire();
+            T value = _value;
+            __mem_fence_acquire();
+            if ((seq & 1) == 0 && seq == _seq) { return value; }
+        }
+    }
+private:
+    volatile uint32_t _seq;
+    T _value;
+};
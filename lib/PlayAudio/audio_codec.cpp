@@ -9,30 +9,86 @@
 #include <cstdio>
 
 #include "pico/stdlib.h"
+#include "hardware/irq.h"
 
+#include "audio_stats.h"
+#include "mem_budget.h"
+#include "PlayFlac.h"
 #include "PlayNone.h"
 #include "PlayWav.h"
+#include "ReadBuffer.h"
 
-static PlayAudio* playAudio_ary[2] = {};
-static void (*decode_func_ary[2])() = {};
+static PlayAudio* playAudio_ary[3] = {};
+static void (*decode_func_ary[3])() = {};
 static PlayAudio::audio_codec_t cur_audio_codec = PlayAudio::AUDIO_CODEC_NONE;
 static void (*set_dac_enable_func)(bool flag) = nullptr;
+static int decode_irq_num = -1;
 
-void audio_codec_init()
+// decode-ahead stage runs at the lowest IRQ priority
+// it fills all free producer buffers so that I2S DMA IRQ only hands over ready buffers
+static void decode_irq_handler()
 {
+    uint32_t start = time_us_32();
+    for (int i = 0; i < i2s_get_num_producer_buffers(); i++) {
+        decode_func_ary[cur_audio_codec]();  // returns immediately if no free buffer is left
+    }
+    audio_stats_decode_time(time_us_32() - start);
+}
+
+// split memory budget into producer buffers (I2S side) and secondary buffers (SD card side) by 2:3
+// audio buffers are reserved from heap before any run-time allocation, within heap left by static pools
+static void configure_buffers(size_t buffer_budget)
+{
+    constexpr size_t BYTES_PER_SAMPLE = 8;  // S32 stereo
+    size_t heap_free = mem_budget_heap_free();
+    size_t heap_other = PlayFlac::PCM_BUFFER_SIZE + MEM_BUDGET_HEAP_RESERVE;
+    if (heap_free < buffer_budget + heap_other) {
+        size_t clamped = (heap_free > heap_other) ? heap_free - heap_other : 0;
+        printf("Audio buffer budget %d bytes is clamped to %d bytes by heap\r\n", static_cast<int>(buffer_budget), static_cast<int>(clamped));
+        buffer_budget = clamped;
+    }
+    int samples_per_buffer = (buffer_budget < 64 * 1024) ? SAMPLES_PER_BUFFER / 2 : SAMPLES_PER_BUFFER;  // shorter latency for small budget
+    size_t producer_budget = buffer_budget * 2 / 5;
+    int num_producer_buffers = static_cast<int>(producer_budget / (samples_per_buffer * BYTES_PER_SAMPLE));
+    if (num_producer_buffers < 3) { num_producer_buffers = 3; }
+    size_t num_secondary_buffers = (buffer_budget - producer_budget) / ReadBuffer::SECONDARY_BUFFER_SIZE;
+    i2s_set_buffer_config(samples_per_buffer, num_producer_buffers);
+    ReadBuffer::configure(num_secondary_buffers);
+    printf("Audio buffers: %d x %d samples, %d x %d bytes\r\n", num_producer_buffers, samples_per_buffer,
+        static_cast<int>(num_secondary_buffers), static_cast<int>(ReadBuffer::SECONDARY_BUFFER_SIZE));
+}
+
+void audio_codec_init(size_t buffer_budget)
+{
+    configure_buffers(buffer_budget);
+    audio_stats_reset();
     PlayAudio::initialize();
     playAudio_ary[PlayAudio::AUDIO_CODEC_NONE] = static_cast<PlayAudio*>(new PlayNone());
     playAudio_ary[PlayAudio::AUDIO_CODEC_WAV]  = static_cast<PlayAudio*>(new PlayWav());
+    playAudio_ary[PlayAudio::AUDIO_CODEC_FLAC] = static_cast<PlayAudio*>(new PlayFlac());
     decode_func_ary[PlayAudio::AUDIO_CODEC_NONE] = PlayNone::decode_func;
     decode_func_ary[PlayAudio::AUDIO_CODEC_WAV]  = PlayWav::decode_func;
+    decode_func_ary[PlayAudio::AUDIO_CODEC_FLAC] = PlayFlac::decode_func;
     cur_audio_codec = PlayAudio::AUDIO_CODEC_NONE;
+    decode_irq_num = user_irq_claim_unused(true);
+    irq_set_exclusive_handler(decode_irq_num, decode_irq_handler);
+    irq_set_priority(decode_irq_num, PICO_LOWEST_IRQ_PRIORITY);
+    irq_set_enabled(decode_irq_num, true);
+    irq_set_pending(decode_irq_num);  // fill initial buffers
 }
 
 void audio_codec_deinit()
 {
+    if (decode_irq_num >= 0) {
+        irq_set_enabled(decode_irq_num, false);
+        irq_remove_handler(decode_irq_num, decode_irq_handler);
+        user_irq_unclaim(decode_irq_num);
+        decode_irq_num = -1;
+    }
     PlayAudio::finalize();
     delete playAudio_ary[PlayAudio::AUDIO_CODEC_NONE];
     delete playAudio_ary[PlayAudio::AUDIO_CODEC_WAV];
+    delete playAudio_ary[PlayAudio::AUDIO_CODEC_FLAC];
 }
 
 void audio_codec_set_dac_enable_func(void (*func)(bool flag))
@@ -47,6 +103,21 @@ void audio_codec_dac_enable(bool flag)
     }
 }
 
+void audio_codec_set_background_task(int (*func)(uint32_t budget_us))
+{
+    ReadBuffer::setBackgroundTask(func);
+}
+
+void audio_codec_set_eq_preset(uint32_t preset)
+{
+    PlayAudio::setEqPreset((preset < Equalizer::NUM_PRESETS) ? static_cast<Equalizer::preset_t>(preset) : Equalizer::Off);
+}
+
+void audio_codec_set_output_rate(uint32_t samp_freq)
+{
+    PlayAudio::setOutputRate(samp_freq);
+}
+
 PlayAudio* get_audio_codec()
 {
     return playAudio_ary[cur_audio_codec];
@@ -62,7 +133,9 @@ PlayAudio* set_audio_codec(PlayAudio::audio_codec_t audio_codec)
 //   void __isr __time_critical_func(audio_i2s_dma_irq_handler)()
 //   defined at pico_audio_i2s_32b/audio_i2s.c
 //   where i2s_callback_func() is declared with __attribute__((weak))
+// only kicks decode-ahead stage to keep DMA IRQ latency deterministic
 void i2s_callback_func()
 {
-    decode_func_ary[cur_audio_codec]();
+    if (decode_irq_num < 0) { return; }
+    irq_set_pending(decode_irq_num);
 }
\ No newline at end of file
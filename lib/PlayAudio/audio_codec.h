@@ -10,10 +10,15 @@
 
 #include "PlayAudio.h"
 
-void audio_codec_init();
+static constexpr size_t AUDIO_BUFFER_BUDGET = 90 * 1024;  // default memory budget for audio buffers (bytes)
+
+void audio_codec_init(size_t buffer_budget = AUDIO_BUFFER_BUDGET);
 void audio_codec_deinit();
 void audio_codec_set_dac_enable_func(void (*func)(bool flag));
 void audio_codec_dac_enable(bool flag);
+void audio_codec_set_background_task(int (*func)(uint32_t budget_us));  // run on core1 while read buffer is filled enough
+void audio_codec_set_eq_preset(uint32_t preset);  // Equalizer::preset_t
+void audio_codec_set_output_rate(uint32_t samp_freq);  // 0: I2S follows sampling frequency of track
 PlayAudio* get_audio_codec();
 PlayAudio* set_audio_codec(PlayAudio::audio_codec_t audio_codec);
 extern "C" {
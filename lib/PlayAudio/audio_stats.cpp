@@ -0,0 +1,128 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2021, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "audio_stats.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+static volatile audio_stats_t stats;
+
+void audio_stats_reset()
+{
+    stats.underruns = 0;
+    stats.instantMutes = 0;
+    stats.decodeCount = 0;
+    stats.decodeMinUs = UINT32_MAX;
+    stats.decodeMaxUs = 0;
+    stats.decodeTotalUs = 0;
+    stats.queueLowWater = UINT32_MAX;
+    stats.readCount = 0;
+    stats.readBytes = 0;
+    stats.readTotalUs = 0;
+    stats.readMaxUs = 0;
+    stats.readMinKBps = UINT32_MAX;
+    stats.resampleUs = 0;
+    stats.resamplePlayUs = 0;
+}
+
+void audio_stats_get(audio_stats_t* dst)
+{
+    dst->underruns = stats.underruns;
+    dst->instantMutes = stats.instantMutes;
+    dst->decodeCount = stats.decodeCount;
+    dst->decodeMinUs = stats.decodeMinUs;
+    dst->decodeMaxUs = stats.decodeMaxUs;
+    dst->decodeTotalUs = stats.decodeTotalUs;
+    dst->queueLowWater = stats.queueLowWater;
+    dst->readCount = stats.readCount;
+    dst->readBytes = stats.readBytes;
+    dst->readTotalUs = stats.readTotalUs;
+    dst->readMaxUs = stats.readMaxUs;
+    dst->readMinKBps = stats.readMinKBps;
+    dst->resampleUs = stats.resampleUs;
+    dst->resamplePlayUs = stats.resamplePlayUs;
+}
+
+void audio_stats_print()
+{
+    audio_stats_t s;
+    audio_stats_get(&s);
+    printf("=== AudioStats ===\r\n");
+    printf("underruns: %" PRIu32 "\r\n", s.underruns);
+    printf("instant mutes: %" PRIu32 "\r\n", s.instantMutes);
+    if (s.decodeCount > 0) {
+        printf("decode: %" PRIu32 " calls, min %" PRIu32 " us, max %" PRIu32 " us, avg %" PRIu32 " us\r\n", s.decodeCount, s.decodeMinUs, s.decodeMaxUs, s.decodeTotalUs / s.decodeCount);
+    }
+    if (s.queueLowWater != UINT32_MAX) {
+        printf("secondaryBuffer low water: %" PRIu32 "\r\n", s.queueLowWater);
+    }
+    if (s.readCount > 0 && s.readTotalUs > 0) {
+        printf("f_read: %" PRIu32 " calls, avg %" PRIu32 " bytes, max %" PRIu32 " us, avg %" PRIu32 " KB/s, min %" PRIu32 " KB/s\r\n", s.readCount, s.readBytes / s.readCount, s.readMaxUs,
+            static_cast<uint32_t>(static_cast<uint64_t>(s.readBytes) * 1000 / s.readTotalUs), s.readMinKBps);
+    }
+    if (s.resamplePlayUs > 0) {
+        uint32_t permil = static_cast<uint32_t>(static_cast<uint64_t>(s.resampleUs) * 1000 / s.resamplePlayUs);
+        printf("resampler: load %" PRIu32 ".%" PRIu32 " %%\r\n", permil / 10, permil % 10);
+    }
+}
+
+void audio_stats_underrun()
+{
+    stats.underruns = stats.underruns + 1;
+}
+
+void audio_stats_instant_mute()
+{
+    stats.instantMutes = stats.instantMutes + 1;
+}
+
+void audio_stats_decode_time(uint32_t us)
+{
+    if (us < stats.decodeMinUs) { stats.decodeMinUs = us; }
+    if (us > stats.decodeMaxUs) { stats.decodeMaxUs = us; }
+    if (stats.decodeTotalUs > UINT32_MAX - us) {
+        // halve to keep average without overflow
+        stats.decodeTotalUs = stats.decodeTotalUs / 2;
+        stats.decodeCount = stats.decodeCount / 2;
+    }
+    stats.decodeTotalUs = stats.decodeTotalUs + us;
+    stats.decodeCount = stats.decodeCount + 1;
+}
+
+void audio_stats_queue_level(uint32_t level)
+{
+    if (level < stats.queueLowWater) { stats.queueLowWater = level; }
+}
+
+void audio_stats_read(uint32_t bytes, uint32_t us)
+{
+    if (us == 0) { us = 1; }
+    uint32_t kbps = static_cast<uint32_t>(static_cast<uint64_t>(bytes) * 1000 / us);  // bytes/us * 1000 = KB/s
+    if (us > stats.readMaxUs) { stats.readMaxUs = us; }
+    if (kbps < stats.readMinKBps) { stats.readMinKBps = kbps; }
+    if (stats.readBytes > UINT32_MAX - bytes || stats.readTotalUs > UINT32_MAX - us) {
+        // halve to keep average without overflow
+        stats.readBytes = stats.readBytes / 2;
+        stats.readTotalUs = stats.readTotalUs / 2;
+        stats.readCount = stats.readCount / 2;
+    }
+    stats.readBytes = stats.readBytes + bytes;
+    stats.readTotalUs = stats.readTotalUs + us;
+    stats.readCount = stats.readCount + 1;
+}
+
+// load of resampler is the ratio of its time to play time of produced samples
+void audio_stats_resample(uint32_t us, uint32_t play_us)
+{
+    if (stats.resamplePlayUs > UINT32_MAX - play_us) {
+        // halve to keep ratio without overflow
+        stats.resampleUs = stats.resampleUs / 2;
+        stats.resamplePlayUs = stats.resamplePlayUs / 2;
+    }
+    stats.resampleUs = stats.resampleUs + us;
+    stats.resamplePlayUs = stats.resamplePlayUs + play_us;
+}
@@ -0,0 +1,38 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2021, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+
+// Always-on counters of audio pipeline
+// each counter has single writer (decode stage on core0 or fillLoop on core1), therefore no lock is needed
+typedef struct _audio_stats_t {
+    uint32_t underruns;       // producer buffers padded with silence due to empty secondaryBuffer
+    uint32_t instantMutes;    // instant mute events by rdbuf near empty
+    uint32_t decodeCount;     // decode stage (IRQ) calls
+    uint32_t decodeMinUs;
+    uint32_t decodeMaxUs;
+    uint32_t decodeTotalUs;
+    uint32_t queueLowWater;   // minimum level of secondaryBufferQueue seen by decoder
+    uint32_t readCount;       // f_read calls by fillLoop
+    uint32_t readBytes;
+    uint32_t readTotalUs;
+    uint32_t readMaxUs;
+    uint32_t readMinKBps;     // throughput of the slowest f_read call
+    uint32_t resampleUs;      // time of resampler in decode stage
+    uint32_t resamplePlayUs;  // play time of samples produced by resampler
+} audio_stats_t;
+
+void audio_stats_reset();
+void audio_stats_get(audio_stats_t* stats);
+void audio_stats_print();
+void audio_stats_underrun();
+void audio_stats_instant_mute();
+void audio_stats_decode_time(uint32_t us);
+void audio_stats_queue_level(uint32_t level);
+void audio_stats_read(uint32_t bytes, uint32_t us);
+void audio_stats_resample(uint32_t us, uint32_t play_us);
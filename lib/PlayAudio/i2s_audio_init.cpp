@@ -10,7 +10,11 @@
 
 #include "pico/stdlib.h"
 
+#include "mem_budget.h"
+
 static audio_buffer_pool_t* _producer_pool = nullptr;
+static int _samples_per_buffer = SAMPLES_PER_BUFFER;
+static int _num_producer_buffers = NUM_PRODUCER_BUFFERS;
 
 static audio_format_t audio_format = {
     .sample_freq = 44100,
@@ -31,22 +35,48 @@ static audio_i2s_config_t i2s_config = {
     .pio_sm = 0
 };
 
+void i2s_set_buffer_config(int samples_per_buffer, int num_buffers)
+{
+    if (_producer_pool != nullptr) { return; }  // not changeable once the pool is created
+    _samples_per_buffer = samples_per_buffer;
+    _num_producer_buffers = (num_buffers <= MAX_PRODUCER_BUFFERS) ? num_buffers : MAX_PRODUCER_BUFFERS;
+}
+
+int i2s_get_samples_per_buffer()
+{
+    return _samples_per_buffer;
+}
+
+int i2s_get_num_producer_buffers()
+{
+    return _num_producer_buffers;
+}
+
 void i2s_setup(uint32_t samp_freq, audio_buffer_pool_t*& ap)
 {
     printf("Samp Freq = %d Hz\n", static_cast<int>(samp_freq));
     if (_producer_pool != nullptr) {
-        ap = nullptr;
-        i2s_audio_deinit(); // less gap noise if deinit() is done when input is stable
+        // fast path: keep producer pool and DMA channels, only PIO clock divider is retuned
+        // audio_i2s picks up sample_freq of producer format at the next buffer taken by consumer
+        audio_format.sample_freq = samp_freq;
+        ap = _producer_pool;
+        return;
     }
     i2s_audio_init(samp_freq);
     ap = _producer_pool;
 }
 
+uint32_t i2s_get_samp_freq()
+{
+    return audio_format.sample_freq;
+}
+
 void i2s_audio_init(uint32_t sample_freq)
 {
     audio_format.sample_freq = sample_freq;
 
-    _producer_pool = audio_new_producer_pool(&producer_format, 3, SAMPLES_PER_BUFFER);
+    _producer_pool = audio_new_producer_pool(&producer_format, _num_producer_buffers, _samples_per_buffer);
+    mem_budget_reserve("audio.producer", _num_producer_buffers * _samples_per_buffer * producer_format.sample_stride);
 
     bool __unused ok;
     const audio_format_t *output_format;
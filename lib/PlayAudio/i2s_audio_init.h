@@ -8,9 +8,16 @@
 
 #include "pico/audio_i2s.h"
 
-static constexpr int SAMPLES_PER_BUFFER = PICO_AUDIO_I2S_BUFFER_SAMPLE_LENGTH; // Samples / channel
+static constexpr int SAMPLES_PER_BUFFER = PICO_AUDIO_I2S_BUFFER_SAMPLE_LENGTH; // Samples / channel (default)
+static constexpr int NUM_PRODUCER_BUFFERS = 4; // one is played by DMA, others are decoded ahead (default)
+static constexpr int MAX_PRODUCER_BUFFERS = 8;
 static constexpr int32_t DAC_ZERO = 1; // to avoid pop noise caused by auto-mute function of DAC
+static constexpr uint32_t DAC_RELOCK_MS = 10; // time for DAC to lock to new I2S clock
 
+void i2s_set_buffer_config(int samples_per_buffer, int num_buffers);  // needs to be called before i2s_setup()
+int i2s_get_samples_per_buffer();
+int i2s_get_num_producer_buffers();
 void i2s_setup(uint32_t samp_freq, audio_buffer_pool_t*& ap);
+uint32_t i2s_get_samp_freq();
 void i2s_audio_init(uint32_t sample_freq);
 void i2s_audio_deinit();
@@ -12,6 +12,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "pico/mutex.h"
+#include "pico/time.h"
+#include "mem_budget.h"
+#include "profiler.h"
 #include "tf_card.h"
 
 //#define DEBUG_FILE_MENU
@@ -19,9 +23,95 @@
 
 #define TGT_DIRS    (1<<0)
 #define TGT_FILES   (1<<1)
-#define FFL_SZ 8
+#define FFL_SZ_MAX 32 // prefix key width (bytes) of fast_fname_list when arena has room
+#define FFL_SZ_MIN 8
+
+// Arena for index structures of current directory (reset at every directory change)
+#ifndef FILE_MENU_ARENA_SIZE
+#define FILE_MENU_ARENA_SIZE (32*1024)
+#endif
+
+// Directory index cache (hidden file in each large directory to skip sorting on reopen)
+#define IDX_CACHE_FNAME ".file_menu.idx"
+#define IDX_CACHE_MAGIC 0x58444d46 // "FMDX"
+#define IDX_CACHE_VERSION 3
+#define IDX_CACHE_MIN_ENTRIES 32
+
+// DIR position table (checkpoint every dir_pos_intvl entries for random access by idx_f_stat)
+#define DIR_POS_TBL_SZ 128
+#define DIR_POS_INIT_INTVL 16
+
+#define FNV1A_INIT 2166136261UL
+
+// Counters of sort cost for host benchmark (tools/host_bench)
+#ifdef FILE_MENU_BENCH
+#define BENCH_INC(field) (bench.field++)
+#else
+#define BENCH_INC(field)
+#endif // FILE_MENU_BENCH
+
+// Background prefetch slots (parent directory and next directory in it)
+#define PF_PARENT 0
+#define PF_NEXT   1
+#define PF_NUM    2
+
+typedef struct {
+    DWORD dptr;
+    DWORD clust;
+    LBA_t sect;
+} dir_pos_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_cnt;
+    uint16_t ffl_sz;
+    uint16_t target;
+    uint32_t signature; // hash of names, sizes, timestamps and attributes of listed entries
+} idx_cache_header_t;
+
+// Index state of one directory (exchanged between current directory and prefetch slots)
+typedef struct {
+    DIR dir;
+    int16_t f_stat_cnt;
+    uint16_t max_entry_cnt;
+    uint16_t* entry_list;
+    uint32_t* sorted_flg;
+    char* fast_fname_list;
+    uint8_t* type_list;
+    uint16_t* audio_cnt_by_order;
+    int audio_cnt_dirty;
+    uint16_t ffl_sz;
+    size_t arena_base;
+    size_t arena_used;
+    int entry_truncated;
+    uint32_t* is_file_flg;
+    uint16_t last_order;
+    int idx_cache_done;
+    uint32_t dir_signature;
+    dir_pos_t dir_pos_tbl[DIR_POS_TBL_SZ];
+    uint16_t dir_pos_cnt;
+    uint16_t dir_pos_intvl;
+} idx_state_t;
+
+typedef enum {
+    PF_IDLE = 0,
+    PF_COUNT, // count entries
+    PF_SCAN,  // read attributes and prefix keys
+    PF_FIND,  // find next directory (PF_PARENT only)
+    PF_READY
+} pf_state_t;
+
+typedef struct {
+    pf_state_t state;
+    uint16_t cnt; // progress in PF_COUNT, PF_SCAN and PF_FIND
+    uint32_t hash;
+    idx_state_t st;
+} pf_slot_t;
 
 static FATFS fs;
+auto_init_recursive_mutex(fs_mtx);
+static file_menu_read_func_t read_func = NULL;
 static DIR dir;
 static FILINFO fno, fno_temp;
 static int target = TGT_DIRS | TGT_FILES; // TGT_DIRS, TGT_FILES
@@ -29,9 +119,74 @@ static int16_t f_stat_cnt;
 static uint16_t max_entry_cnt;
 static uint16_t* entry_list;
 static uint32_t* sorted_flg;
-static char (*fast_fname_list)[FFL_SZ];
+static char* fast_fname_list; // prefix key of ffl_sz bytes for each index
+static uint8_t* type_list; // file_menu_type_t for each index
+static uint16_t* audio_cnt_by_order; // number of audio files in order [0, k)
+static int audio_cnt_dirty; // 1: audio_cnt_by_order needs update because order changed
+static uint16_t ffl_sz = FFL_SZ_MAX;
+static uint32_t arena[FILE_MENU_ARENA_SIZE/sizeof(uint32_t)];
+static size_t arena_base; // arena above arena_base is used by current directory (prefetch slots are put above it)
+static size_t arena_used;
+static size_t arena_peak; // high-water mark of arena_used
+static int entry_truncated; // 1: entries over arena capacity are not listed
 static uint32_t* is_file_flg; // 0: Dir, 1: File
 static uint16_t last_order; // order number memo for last file_menu_get_fname() request
+static int idx_cache_enable = 1;
+static int idx_cache_done; // 1: cache file loaded or save already tried for current directory
+static uint32_t dir_signature;
+static dir_pos_t dir_pos_tbl[DIR_POS_TBL_SZ]; // dir_pos_tbl[k]: position to read entry of index k * dir_pos_intvl
+static uint16_t dir_pos_cnt = 1;
+static uint16_t dir_pos_intvl = DIR_POS_INIT_INTVL;
+static FIL idx_cache_fil; // static to save stack of core1 (used under fs_mtx)
+static TCHAR fname_buf[FF_LFN_BUF + 1]; // returned by file_menu_get_fname_ptr()
+static pf_slot_t pf_slot[PF_NUM];
+static uint16_t pf_order; // order of current directory in parent directory
+static uint16_t pf_next_order; // order of PF_NEXT directory in parent directory
+static int pf_requested; // 1: prefetch for current directory is requested
+static int pf_parent_taken; // 1: current directory is PF_PARENT directory (PF_NEXT is still valid)
+static TCHAR pf_path[FF_LFN_BUF + 32];
+static TCHAR cwd_path[FILE_MENU_PATH_SIZE]; // absolute path of current directory ("": unknown or too long)
+#ifdef FILE_MENU_BENCH
+static file_menu_bench_t bench;
+#endif // FILE_MENU_BENCH
+
+//==============================
+// Arena Internal Funcions
+//==============================
+
+static void* arena_alloc(size_t size)
+{
+    void* ptr;
+    size = (size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    if (arena_used + size > sizeof(arena)) return NULL;
+    ptr = (uint8_t*) arena + arena_used;
+    arena_used += size;
+    if (arena_used > arena_peak) arena_peak = arena_used;
+    return ptr;
+}
+
+static void arena_reset(void)
+{
+    arena_used = arena_base;
+}
+
+// Arena bytes needed for num entries with key width of key_sz (including merge sort work)
+static size_t arena_required(uint32_t num, uint32_t key_sz)
+{
+    size_t flg_sz = sizeof(uint32_t) * ((num+31)/32);
+    size_t list_sz = (sizeof(uint16_t) * num + 3) & ~3;
+    size_t type_sz = (num + 3) & ~3;
+    size_t cnt_sz = (sizeof(uint16_t) * (num+1) + 3) & ~3; // shares area with merge sort work
+    return list_sz + flg_sz * 2 + ((num * key_sz + 3) & ~3) + type_sz + cnt_sz;
+}
+
+static uint16_t arena_capacity(void)
+{
+    size_t size = sizeof(arena) - arena_base;
+    uint32_t num = size / (sizeof(uint16_t) * 2 + FFL_SZ_MIN + 1);
+    while (num > 0 && arena_required(num, FFL_SZ_MIN) > size) num--;
+    return (num > 0xffff) ? 0xffff : (uint16_t) num;
+}
 
 //==============================
 // idx Internal Funcions
@@ -44,6 +199,7 @@ static void idx_entry_swap(uint32_t entry_number1, uint32_t entry_number2)
     tmp_entry = entry_list[entry_number1];
     entry_list[entry_number1] = entry_list[entry_number2];
     entry_list[entry_number2] = tmp_entry;
+    audio_cnt_dirty = 1;
 }
 
 static int32_t my_strcmp(char* str1 , char* str2)
@@ -76,19 +232,90 @@ static int32_t my_strncmp(char* str1 , char* str2, int size)
     return result;
 }
 
+static void dir_pos_reset(void)
+{
+    dir_pos_cnt = 1; // dir_pos_tbl[0] is not used (rewind instead)
+    dir_pos_intvl = DIR_POS_INIT_INTVL;
+}
+
+// Save current directory position as the one to read entry of index cnt
+static void dir_pos_save(uint16_t cnt)
+{
+    if (cnt != dir_pos_cnt * dir_pos_intvl) return;
+    if (dir_pos_cnt >= DIR_POS_TBL_SZ) {
+        // Table full: double the interval by dropping every other checkpoint
+        for (int k = 1; k < DIR_POS_TBL_SZ/2; k++) {
+            dir_pos_tbl[k] = dir_pos_tbl[k*2];
+        }
+        dir_pos_cnt = DIR_POS_TBL_SZ/2;
+        dir_pos_intvl *= 2;
+        if (cnt != dir_pos_cnt * dir_pos_intvl) return;
+    }
+    dir_pos_tbl[dir_pos_cnt].dptr = dir.dptr;
+    dir_pos_tbl[dir_pos_cnt].clust = dir.clust;
+    dir_pos_tbl[dir_pos_cnt].sect = dir.sect;
+    dir_pos_cnt++;
+}
+
+// Move directory position to the nearest checkpoint at or before idx
+static void dir_pos_seek(uint16_t idx)
+{
+    uint16_t k = idx / dir_pos_intvl;
+    if (k >= dir_pos_cnt) k = dir_pos_cnt - 1;
+    if (k == 0) {
+        // Rewind directory index
+        f_readdir(&dir, 0);
+        f_stat_cnt = 1;
+        return;
+    }
+    dir.dptr = dir_pos_tbl[k].dptr;
+    dir.clust = dir_pos_tbl[k].clust;
+    dir.sect = dir_pos_tbl[k].sect;
+    #if FF_MAX_SS == FF_MIN_SS
+    dir.dir = dir.obj.fs->win + dir.dptr % FF_MAX_SS;
+    #else
+    dir.dir = dir.obj.fs->win + dir.dptr % dir.obj.fs->ssize;
+    #endif
+    f_stat_cnt = k * dir_pos_intvl;
+}
+
+static int ext_match_nocase(const char* fname, const char* ext)
+{
+    const char* ext_pos = strrchr(fname, '.');
+    if (ext_pos == NULL) return 0;
+    ext_pos++;
+    while (*ext_pos != '\0' && *ext != '\0') {
+        char chr = *ext_pos++;
+        if (chr >= 'A' && chr <= 'Z') chr += 'a' - 'A';
+        if (chr != *ext++) return 0;
+    }
+    return (*ext_pos == '\0' && *ext == '\0');
+}
+
+static file_menu_type_t get_type_by_fno(const FILINFO* fno)
+{
+    if (fno->fattrib & AM_DIR) return FILE_MENU_TYPE_DIR;
+    if (ext_match_nocase(fno->fname, "wav") || ext_match_nocase(fno->fname, "flac")) return FILE_MENU_TYPE_AUDIO;
+    if (ext_match_nocase(fno->fname, "jpg") || ext_match_nocase(fno->fname, "jpeg")) return FILE_MENU_TYPE_JPEG;
+    if (ext_match_nocase(fno->fname, "png")) return FILE_MENU_TYPE_PNG;
+    return FILE_MENU_TYPE_OTHER;
+}
+
 static FRESULT idx_f_stat(uint16_t idx, FILINFO* fno)
 {
     FRESULT res = FR_OK;
     int error_count = 0;
+    uint16_t k;
+    BENCH_INC(f_stat_cnt);
     if (idx == 0) {
         strncpy(fno->fname, "..", FF_LFN_BUF);
         fno->fattrib = AM_DIR;
         return res;
     }
-    if (f_stat_cnt == 1 || f_stat_cnt > idx) {
-        // Rewind directory index
-        f_readdir(&dir, 0);
-        f_stat_cnt = 1;
+    k = idx / dir_pos_intvl;
+    if (k >= dir_pos_cnt) k = dir_pos_cnt - 1;
+    if (f_stat_cnt > idx || f_stat_cnt < k * dir_pos_intvl) {
+        dir_pos_seek(idx);
     }
     for (;;) {
         f_readdir(&dir, fno);
@@ -120,6 +347,11 @@ static void set_sorted(uint16_t pos) /* pos is entry_list's position, not index
     *(sorted_flg + (pos/32)) |= 1<<(pos%32);
 }
 
+static void clear_sorted(uint16_t pos) /* pos is entry_list's position, not index number */
+{
+    *(sorted_flg + (pos/32)) &= ~(1<<(pos%32));
+}
+
 static int get_sorted(uint16_t pos) /* pos is entry_list's position, not index number */
 {
     return ((*(sorted_flg + (pos/32)) & 1<<(pos%32)) != 0);
@@ -153,6 +385,65 @@ static int get_is_file(uint16_t idx)
     return ((*(is_file_flg + (idx/32)) & 1<<(idx%32)) != 0);
 }
 
+// Compare by Dir/File and prefix key only (0 does not mean identical name)
+static int32_t idx_key_cmp(uint16_t idx1, uint16_t idx2)
+{
+    int32_t result = get_is_file(idx1) - get_is_file(idx2);
+    BENCH_INC(key_cmp_cnt);
+    if (result == 0) {
+        result = my_strncmp(&fast_fname_list[idx1*ffl_sz], &fast_fname_list[idx2*ffl_sz], ffl_sz);
+    }
+    return result;
+}
+
+// Stable bottom-up merge sort of entry_list[start, end_1) by prefix key, work needs (end_1 - start) elements
+static void idx_msort_entry_list(uint16_t start, uint16_t end_1, uint16_t* work)
+{
+    uint32_t n = end_1 - start;
+    uint16_t* src = &entry_list[start];
+    uint16_t* dst = work;
+    uint16_t* tmp;
+    for (uint32_t width = 1; width < n; width *= 2) {
+        for (uint32_t lo = 0; lo < n; lo += width*2) {
+            uint32_t mid = (lo + width < n) ? lo + width : n;
+            uint32_t hi = (lo + width*2 < n) ? lo + width*2 : n;
+            uint32_t i = lo;
+            uint32_t j = mid;
+            uint32_t k = lo;
+            while (i < mid && j < hi) {
+                dst[k++] = (idx_key_cmp(src[j], src[i]) < 0) ? src[j++] : src[i++];
+            }
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != &entry_list[start]) {
+        memcpy(&entry_list[start], src, sizeof(uint16_t) * n);
+    }
+}
+
+// Sort by prefix key, then leave only runs tied by truncated keys to idx_qsort_entry_list_by_range()
+static void idx_presort_entry_list(void)
+{
+    uint16_t* work;
+    size_t arena_mark = arena_used;
+    memset(sorted_flg, 0xff, sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+    if (max_entry_cnt <= 2) return;
+    work = (uint16_t*) arena_alloc(sizeof(uint16_t) * max_entry_cnt);
+    idx_msort_entry_list(1, max_entry_cnt, work); // keep ".." at top
+    arena_used = arena_mark; // release work
+    for (int i = 1; i < max_entry_cnt - 1; i++) {
+        uint16_t idx = entry_list[i];
+        if (memchr(&fast_fname_list[idx*ffl_sz], '\0', ffl_sz) == NULL && idx_key_cmp(idx, entry_list[i+1]) == 0) {
+            clear_sorted(i);
+            clear_sorted(i+1);
+        }
+    }
+}
+
 static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, uint16_t start, uint16_t end_1)
 {
     int result;
@@ -170,7 +461,7 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
             start_next++;
         }
         end_1_next = start_next+1;
-        while (!get_sorted(end_1_next) && end_1_next < end_1) {
+        while (end_1_next < end_1 && !get_sorted(end_1_next)) {
             end_1_next++;
         }
         #ifdef DEBUG_FILE_MENU
@@ -194,11 +485,7 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
         set_sorted(start);
     } else if (end_1 - start <= 2) {
         // try fast_fname_list compare
-        result = get_is_file(entry_list[start]) - get_is_file(entry_list[start+1]);
-        if (result == 0) {
-            result = my_strncmp(fast_fname_list[entry_list[start]], fast_fname_list[entry_list[start+1]], FFL_SZ);
-        }
-        //printf("fast_fname_list %s %s %d, %d\n\r", fast_fname_list[entry_list[0]], fast_fname_list[entry_list[1]], entry_list[0], entry_list[1]);
+        result = idx_key_cmp(entry_list[start], entry_list[start+1]);
         if (result > 0) {
             idx_entry_swap(start, start+1);
         } else if (result < 0) {
@@ -209,6 +496,7 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
             idx_f_stat(entry_list[start+1], &fno_temp);
             fno_ptr = (strncmp(fno.fname, "The ", 4) == 0) ? &fno.fname[4] : fno.fname;
             fno_temp_ptr = (strncmp(fno_temp.fname, "The ", 4) == 0) ? &fno_temp.fname[4] : fno_temp.fname;
+            BENCH_INC(name_cmp_cnt);
             result = my_strcmp(fno_ptr, fno_temp_ptr);
             if (result >= 0) {
                 idx_entry_swap(start, start+1);
@@ -226,10 +514,7 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
         #endif // #ifdef DEBUG_FILE_MENU_LVL2
         while (1) {
             // try fast_fname_list compare
-            result = get_is_file(entry_list[top]) - get_is_file(key_idx);
-            if (result == 0) {
-                result = my_strncmp(fast_fname_list[entry_list[top]], fast_fname_list[key_idx], FFL_SZ);
-            }
+            result = idx_key_cmp(entry_list[top], key_idx);
             if (result < 0) {
                 top++;
             } else if (result > 0) {
@@ -240,6 +525,7 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
                 idx_f_stat(entry_list[top], &fno);
                 fno_ptr = (strncmp(fno.fname, "The ", 4) == 0) ? &fno.fname[4] : fno.fname;
                 fno_temp_ptr = (strncmp(fno_temp.fname, "The ", 4) == 0) ? &fno_temp.fname[4] : fno_temp.fname;
+                BENCH_INC(name_cmp_cnt);
                 result = my_strcmp(fno_ptr, fno_temp_ptr);
                 if (result < 0) {
                     top++;
@@ -277,15 +563,24 @@ static void idx_qsort_entry_list_by_range(uint16_t r_start, uint16_t r_end_1, ui
     }
 }
 
-static uint16_t idx_get_size(int target)
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size)
 {
-    int16_t cnt = 1;
-    // Rewind directory index
-    f_readdir(&dir, 0);
-    // Directory search completed with null character
+    const uint8_t* ptr = (const uint8_t*) data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ptr[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+// Read one entry to count by idx_get_size(), returns 0 at the end of directory
+static int idx_count_next(uint16_t* cnt, uint32_t* hash)
+{
+    uint32_t fsize;
     for (;;) {
+        dir_pos_save(*cnt);
         f_readdir(&dir, &fno);
-        if (fno.fname[0] == '\0') break;
+        // Directory search completed with null character
+        if (fno.fname[0] == '\0') return 0;
         if (fno.fname[0] == '.') continue;
         if (fno.fattrib & AM_HID) continue;
         if (!(target & TGT_DIRS)) { // File Only
@@ -293,59 +588,409 @@ static uint16_t idx_get_size(int target)
         } else if (!(target & TGT_FILES)) { // Dir Only
             if (!(fno.fattrib & AM_DIR)) continue;
         }
-        cnt++;
+        fsize = (uint32_t) fno.fsize;
+        *hash = fnv1a(*hash, fno.fname, strlen(fno.fname));
+        *hash = fnv1a(*hash, &fsize, sizeof(fsize));
+        *hash = fnv1a(*hash, &fno.fdate, sizeof(fno.fdate));
+        *hash = fnv1a(*hash, &fno.ftime, sizeof(fno.ftime));
+        *hash = fnv1a(*hash, &fno.fattrib, sizeof(fno.fattrib));
+        (*cnt)++;
+        return 1;
+    }
+}
+
+static void idx_count_begin(void)
+{
+    // Rewind directory index
+    f_readdir(&dir, 0);
+    dir_pos_reset();
+}
+
+static void idx_count_end(uint16_t cnt, uint32_t hash)
+{
+    max_entry_cnt = cnt;
+    dir_signature = hash;
+    f_readdir(&dir, 0);
+    f_stat_cnt = 1;
+}
+
+// Count entries to max_entry_cnt
+static void idx_get_size(void)
+{
+    uint16_t cnt = 1;
+    uint32_t hash = FNV1A_INIT;
+    idx_count_begin();
+    while (idx_count_next(&cnt, &hash)) {}
+    idx_count_end(cnt, hash);
+}
+
+static int idx_cache_read(FIL* fp, void* buf, UINT size)
+{
+    UINT br;
+    return (f_read(fp, buf, size, &br) == FR_OK && br == size);
+}
+
+// Restore sorted order, attributes and prefixes from the cache file if it matches the current directory
+static int idx_cache_load(const TCHAR* fname)
+{
+    FIL* fp = &idx_cache_fil;
+    idx_cache_header_t hdr;
+    int ok = 0;
+    if (!idx_cache_enable || max_entry_cnt < IDX_CACHE_MIN_ENTRIES) return 0;
+    if (f_open(fp, fname, FA_READ) != FR_OK) return 0;
+    if (idx_cache_read(fp, &hdr, sizeof(hdr)) &&
+        hdr.magic == IDX_CACHE_MAGIC && hdr.version == IDX_CACHE_VERSION &&
+        hdr.entry_cnt == max_entry_cnt && hdr.ffl_sz == ffl_sz &&
+        hdr.target == target && hdr.signature == dir_signature) {
+        ok = idx_cache_read(fp, entry_list, sizeof(uint16_t) * max_entry_cnt) &&
+             idx_cache_read(fp, is_file_flg, sizeof(uint32_t) * ((max_entry_cnt+31)/32)) &&
+             idx_cache_read(fp, fast_fname_list, ffl_sz * max_entry_cnt) &&
+             idx_cache_read(fp, type_list, max_entry_cnt);
+        for (int i = 0; ok && i < max_entry_cnt; i++) {
+            if (entry_list[i] >= max_entry_cnt) ok = 0;
+        }
+    }
+    f_close(fp);
+    #ifdef DEBUG_FILE_MENU
+    printf("idx cache load %s\n\r", ok ? "hit" : "miss");
+    #endif // #ifdef DEBUG_FILE_MENU
+    return ok;
+}
+
+// Store fully sorted order to the cache file (tried once per directory)
+static void idx_cache_save(void)
+{
+    #if !FF_FS_READONLY
+    FIL* fp = &idx_cache_fil;
+    UINT bw;
+    idx_cache_header_t hdr = {IDX_CACHE_MAGIC, IDX_CACHE_VERSION, max_entry_cnt, ffl_sz, (uint16_t) target, dir_signature};
+    FRESULT fr;
+    idx_cache_done = 1;
+    if (!idx_cache_enable || max_entry_cnt < IDX_CACHE_MIN_ENTRIES) return;
+    if (f_open(fp, IDX_CACHE_FNAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) return;
+    fr = f_write(fp, &hdr, sizeof(hdr), &bw);
+    if (fr == FR_OK) fr = f_write(fp, entry_list, sizeof(uint16_t) * max_entry_cnt, &bw);
+    if (fr == FR_OK) fr = f_write(fp, is_file_flg, sizeof(uint32_t) * ((max_entry_cnt+31)/32), &bw);
+    if (fr == FR_OK) fr = f_write(fp, fast_fname_list, ffl_sz * max_entry_cnt, &bw);
+    if (fr == FR_OK) fr = f_write(fp, type_list, max_entry_cnt, &bw);
+    f_close(fp);
+    if (fr != FR_OK) {
+        f_unlink(IDX_CACHE_FNAME);
+        return;
+    }
+    #if FF_USE_CHMOD
+    f_chmod(IDX_CACHE_FNAME, AM_HID, AM_HID);
+    #endif // #if FF_USE_CHMOD
+    #ifdef DEBUG_FILE_MENU
+    printf("idx cache saved %d entries\n\r", max_entry_cnt);
+    #endif // #ifdef DEBUG_FILE_MENU
+    #else
+    idx_cache_done = 1;
+    #endif // #if !FF_FS_READONLY
+}
+
+static void idx_scan_begin(void)
+{
+    for (int i = 0; i < max_entry_cnt; i++) entry_list[i] = i;
+    memset(is_file_flg, 0, sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+}
+
+// Fill attributes, type and prefix key of index i (read in order of index for sequential directory read)
+static void idx_scan_entry(uint16_t i)
+{
+    idx_f_stat(i, &fno);
+    if (!(fno.fattrib & AM_DIR)) set_is_file(i);
+    type_list[i] = (uint8_t) get_type_by_fno(&fno);
+    // "The " is stripped once here to share the key with full name compare
+    strncpy(&fast_fname_list[i*ffl_sz], (strncmp(fno.fname, "The ", 4) == 0) ? &fno.fname[4] : fno.fname, ffl_sz);
+    #ifdef DEBUG_FILE_MENU_LVL2
+    char temp_str[5] = "    ";
+    strncpy(temp_str, &fast_fname_list[i*ffl_sz], 4);
+    printf("fast_fname_list[%d] = %4s, is_file = %d\r\n", i, temp_str, get_is_file(i));
+    #endif // #ifdef DEBUG_FILE_MENU_LVL2
+}
+
+// Fill attributes, types and prefix keys by one pass of directory read
+static void idx_scan_entries(void)
+{
+    idx_scan_begin();
+    for (int i = 0; i < max_entry_cnt; i++) {
+        idx_scan_entry(i);
+    }
+}
+
+// Allocate index structures for max_entry_cnt entries (truncated to arena capacity)
+static void idx_alloc(void)
+{
+    uint16_t capacity = arena_capacity();
+    arena_reset();
+    entry_truncated = (max_entry_cnt > capacity);
+    if (entry_truncated) {
+        #ifdef DEBUG_FILE_MENU
+        printf("%d entries over capacity %d\n\r", max_entry_cnt, capacity);
+        #endif // #ifdef DEBUG_FILE_MENU
+        max_entry_cnt = capacity;
+    }
+    // Widest key that fits the arena
+    ffl_sz = FFL_SZ_MAX;
+    while (ffl_sz > FFL_SZ_MIN && arena_required(max_entry_cnt, ffl_sz) > sizeof(arena) - arena_base) ffl_sz--;
+    entry_list = (uint16_t*) arena_alloc(sizeof(uint16_t) * max_entry_cnt);
+    sorted_flg = (uint32_t*) arena_alloc(sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+    memset(sorted_flg, 0, sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+    is_file_flg = (uint32_t*) arena_alloc(sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+    fast_fname_list = (char*) arena_alloc(ffl_sz * max_entry_cnt);
+    type_list = (uint8_t*) arena_alloc(max_entry_cnt);
+}
+
+// Finish index after all entries are scanned or loaded from cache file
+static void idx_sort_finish(void)
+{
+    if (idx_cache_done) {
+        memset(sorted_flg, 0xff, sizeof(uint32_t) * ((max_entry_cnt+31)/32));
+    } else {
+        idx_presort_entry_list();
     }
-    // Returns the number of entries read
-    return cnt;
+    audio_cnt_by_order = (uint16_t*) arena_alloc(sizeof(uint16_t) * (max_entry_cnt+1));
+    audio_cnt_dirty = 1;
 }
 
 static void idx_sort_new(void)
 {
-    int i, k;
-    max_entry_cnt = idx_get_size(target);
-    entry_list = (uint16_t*) malloc(sizeof(uint16_t) * max_entry_cnt);
-    if (entry_list == NULL) printf("malloc entry_list failed\n\r");
-    for (i = 0; i < max_entry_cnt; i++) entry_list[i] = i;
-    sorted_flg = (uint32_t*) malloc(sizeof(uint32_t) * (max_entry_cnt+31)/32);
-    if (sorted_flg == NULL) printf("malloc sorted_flg failed\n\r");
-    memset(sorted_flg, 0, sizeof(uint32_t) * (max_entry_cnt+31)/32);
-    is_file_flg = (uint32_t*) malloc(sizeof(uint32_t) * (max_entry_cnt+31)/32);
-    if (is_file_flg == NULL) printf("malloc is_file_flg failed\n\r");
-    memset(is_file_flg, 0, sizeof(uint32_t) * (max_entry_cnt+31)/32);
-    fast_fname_list = (char (*)[FFL_SZ]) malloc(sizeof(char[FFL_SZ]) * max_entry_cnt);
-    if (fast_fname_list == NULL) printf("malloc fast_fname_list failed\n\r");
-    for (i = 0; i < max_entry_cnt; i++) {
-        idx_f_stat(i, &fno);
-        if (!(fno.fattrib & AM_DIR)) set_is_file(i);
-        if (strncmp(fno.fname, "The ", 4) == 0) {
-            for (k = 0; k < FFL_SZ; k++) {
-                fast_fname_list[i][k] = fno.fname[k+4];
+    idx_get_size();
+    idx_alloc();
+    idx_cache_done = idx_cache_load(IDX_CACHE_FNAME);
+    if (!idx_cache_done) idx_scan_entries();
+    idx_sort_finish();
+}
+
+static void idx_sort_delete(void)
+{
+    arena_reset();
+    max_entry_cnt = 0;
+}
+
+//==============================
+// Prefetch Internal Funcions
+//   index of other directory is built in arena above current directory
+//   (exchanged with current directory state under fs_mtx)
+//==============================
+
+static void mem_swap(void* ptr1, void* ptr2, size_t size)
+{
+    uint8_t* p1 = (uint8_t*) ptr1;
+    uint8_t* p2 = (uint8_t*) ptr2;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t tmp = p1[i];
+        p1[i] = p2[i];
+        p2[i] = tmp;
+    }
+}
+
+#define IDX_STATE_SWAP(var) mem_swap(&var, &st->var, sizeof(var))
+
+static void idx_state_swap(idx_state_t* st)
+{
+    IDX_STATE_SWAP(dir);
+    IDX_STATE_SWAP(f_stat_cnt);
+    IDX_STATE_SWAP(max_entry_cnt);
+    IDX_STATE_SWAP(entry_list);
+    IDX_STATE_SWAP(sorted_flg);
+    IDX_STATE_SWAP(fast_fname_list);
+    IDX_STATE_SWAP(type_list);
+    IDX_STATE_SWAP(audio_cnt_by_order);
+    IDX_STATE_SWAP(audio_cnt_dirty);
+    IDX_STATE_SWAP(ffl_sz);
+    IDX_STATE_SWAP(arena_base);
+    IDX_STATE_SWAP(arena_used);
+    IDX_STATE_SWAP(entry_truncated);
+    IDX_STATE_SWAP(is_file_flg);
+    IDX_STATE_SWAP(last_order);
+    IDX_STATE_SWAP(idx_cache_done);
+    IDX_STATE_SWAP(dir_signature);
+    IDX_STATE_SWAP(dir_pos_tbl);
+    IDX_STATE_SWAP(dir_pos_cnt);
+    IDX_STATE_SWAP(dir_pos_intvl);
+}
+
+#define PTR_MOVE_DOWN(ptr, ofs) ptr = (void*) ((uint8_t*) (ptr) - (ofs))
+
+// Follow index structures moved down by ofs bytes in arena
+static void idx_state_move_down(idx_state_t* st, size_t ofs)
+{
+    PTR_MOVE_DOWN(st->entry_list, ofs);
+    PTR_MOVE_DOWN(st->sorted_flg, ofs);
+    PTR_MOVE_DOWN(st->fast_fname_list, ofs);
+    PTR_MOVE_DOWN(st->type_list, ofs);
+    PTR_MOVE_DOWN(st->audio_cnt_by_order, ofs);
+    PTR_MOVE_DOWN(st->is_file_flg, ofs);
+    st->arena_base -= ofs;
+    st->arena_used -= ofs;
+}
+
+static void pf_cancel_slot(int i)
+{
+    if (pf_slot[i].state != PF_IDLE) f_closedir(&pf_slot[i].st.dir);
+    pf_slot[i].state = PF_IDLE;
+}
+
+static void pf_cancel(void)
+{
+    for (int i = 0; i < PF_NUM; i++) pf_cancel_slot(i);
+    pf_requested = 0;
+    pf_parent_taken = 0;
+}
+
+// Open directory of pf_path (relative to current directory) for slot i indexed in arena from base
+static void pf_start(int i, size_t base)
+{
+    pf_slot_t* pf = &pf_slot[i];
+    if (f_opendir(&pf->st.dir, pf_path) != FR_OK) return;
+    pf->st.arena_base = base;
+    pf->st.arena_used = base;
+    pf->st.last_order = 0;
+    pf->cnt = 1;
+    pf->hash = FNV1A_INIT;
+    pf->state = PF_COUNT;
+    idx_state_swap(&pf->st);
+    idx_count_begin();
+    idx_state_swap(&pf->st);
+}
+
+// Proceed index of slot i in the same steps as idx_sort_new() until budget_us passes from start_us
+static void pf_run(int i, uint32_t start_us, uint32_t budget_us)
+{
+    pf_slot_t* pf = &pf_slot[i];
+    int found_next = 0;
+    size_t len;
+    idx_state_swap(&pf->st);
+    while (pf->state != PF_IDLE && pf->state != PF_READY && time_us_32() - start_us < budget_us) {
+        if (pf->state == PF_COUNT) {
+            if (idx_count_next(&pf->cnt, &pf->hash)) continue;
+            idx_count_end(pf->cnt, pf->hash);
+            if (max_entry_cnt > arena_capacity()) { // no room left above current directory
+                pf->state = PF_IDLE;
+                break;
             }
-        } else {
-            for (k = 0; k < FFL_SZ; k++) {
-                fast_fname_list[i][k] = fno.fname[k];
+            idx_alloc();
+            len = strlen(pf_path);
+            snprintf(&pf_path[len], sizeof(pf_path) - len, "/%s", IDX_CACHE_FNAME);
+            idx_cache_done = idx_cache_load(pf_path);
+            pf_path[len] = '\0';
+            if (!idx_cache_done) idx_scan_begin();
+            pf->cnt = idx_cache_done ? max_entry_cnt : 0;
+            pf->state = PF_SCAN;
+        } else if (pf->state == PF_SCAN) {
+            if (pf->cnt < max_entry_cnt) {
+                idx_scan_entry(pf->cnt++);
+                continue;
+            }
+            idx_sort_finish();
+            pf->cnt = pf_order + 1;
+            pf->state = (i == PF_PARENT) ? PF_FIND : PF_READY;
+        } else { // PF_FIND: next directory in the same order as sequential search
+            if (pf->cnt >= max_entry_cnt) {
+                pf->state = PF_READY;
+                continue;
             }
+            file_menu_sort_entry(pf->cnt, pf->cnt+1);
+            if (get_is_file(entry_list[pf->cnt])) {
+                pf->cnt++;
+                continue;
+            }
+            idx_f_stat(entry_list[pf->cnt], &fno);
+            snprintf(pf_path, sizeof(pf_path), "../%s", fno.fname);
+            pf_next_order = pf->cnt;
+            pf->state = PF_READY;
+            found_next = 1;
         }
-        #ifdef DEBUG_FILE_MENU_LVL2
-        char temp_str[5] = "    ";
-        strncpy(temp_str, fast_fname_list[i], 4);
-        printf("fast_fname_list[%d] = %4s, is_file = %d\r\n", i, temp_str, get_is_file(i));
-        #endif // #ifdef DEBUG_FILE_MENU_LVL2
     }
+    idx_state_swap(&pf->st);
+    if (pf->state == PF_IDLE) f_closedir(&pf->st.dir);
+    if (found_next) pf_start(PF_NEXT, pf->st.arena_used);
 }
 
-static void idx_sort_delete(void)
+// Take over prefetched index when current directory is changed to order, returns 1 if taken
+static int pf_take(uint16_t order)
 {
-    free(entry_list);
-    free(sorted_flg);
-    free(fast_fname_list);
-    free(is_file_flg);
+    int i;
+    int keep_next;
+    size_t ofs, end;
+    pf_slot_t* pf;
+    if (order == 0 && !pf_parent_taken && pf_slot[PF_PARENT].state == PF_READY) {
+        i = PF_PARENT;
+    } else if (order != 0 && pf_parent_taken && order == pf_next_order && pf_slot[PF_NEXT].state == PF_READY) {
+        i = PF_NEXT;
+    } else {
+        pf_cancel();
+        return 0;
+    }
+    pf = &pf_slot[i];
+    keep_next = (i == PF_PARENT && pf_slot[PF_NEXT].state == PF_READY);
+    if (i == PF_PARENT && !keep_next) pf_cancel_slot(PF_NEXT);
+    // Move to the bottom of arena (followed by PF_NEXT if kept)
+    ofs = pf->st.arena_base;
+    end = keep_next ? pf_slot[PF_NEXT].st.arena_used : pf->st.arena_used;
+    memmove(arena, (uint8_t*) arena + ofs, end - ofs);
+    idx_state_move_down(&pf->st, ofs);
+    if (keep_next) idx_state_move_down(&pf_slot[PF_NEXT].st, ofs);
+    idx_state_swap(&pf->st); // index of previous directory is left in the slot to discard
+    pf->state = PF_IDLE;
+    if (i == PF_PARENT) {
+        pf_parent_taken = 1;
+    } else {
+        pf_cancel();
+    }
+    #ifdef DEBUG_FILE_MENU
+    printf("prefetched index taken (%d entries)\n\r", max_entry_cnt);
+    #endif // #ifdef DEBUG_FILE_MENU
+    return 1;
 }
 
 //==============================
 // File Menu Public Funcions
 //   provided by sorted 'order'
 //==============================
+// Lock for FatFs shared by core0 and core1 (all public functions hold it)
+void file_menu_fs_lock(void)
+{
+    recursive_mutex_enter_blocking(&fs_mtx);
+}
+
+int file_menu_fs_try_lock(void)
+{
+    return recursive_mutex_try_enter(&fs_mtx, NULL);
+}
+
+void file_menu_fs_unlock(void)
+{
+    recursive_mutex_exit(&fs_mtx);
+}
+
+void file_menu_set_read_func(file_menu_read_func_t func)
+{
+    read_func = func;
+}
+
+// read directly if the caller already holds the lock (scheduler would wait for the lock held by the caller)
+FRESULT file_menu_read(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br)
+{
+    file_menu_read_func_t func = read_func;
+    if (func == NULL || get_core_num() != 0 || fs_mtx.owner == lock_get_caller_owner_id()) {
+        return file_menu_read_direct(fp, ofs, buff, btr, br);
+    }
+    return (*func)(fp, ofs, buff, btr, br);
+}
+
+FRESULT file_menu_read_direct(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br)
+{
+    FRESULT fr = FR_OK;
+    file_menu_fs_lock();
+    if (ofs != FILE_MENU_CUR_POS && ofs != f_tell(fp)) fr = f_lseek(fp, ofs);
+    if (fr == FR_OK) fr = f_read(fp, buff, btr, br);
+    file_menu_fs_unlock();
+    return fr;
+}
+
 // Mount FAT
 FRESULT file_menu_init(uint8_t* fs_type)
 {
@@ -361,6 +1006,7 @@ FRESULT file_menu_init(uint8_t* fs_type)
         true  // use internal pullup
     };
 
+    file_menu_fs_lock();
     pico_fatfs_set_config(&config);
     for (int i = 0; i < 5; i++) {
         fr = f_mount(&fs, "", 1); // fr: 0: mount successful, 1: mount failed
@@ -370,23 +1016,55 @@ FRESULT file_menu_init(uint8_t* fs_type)
         }
         pico_fatfs_reboot_spi();
     }
+    file_menu_fs_unlock();
     return fr;
 }
 
+void file_menu_track_budget(void)
+{
+    mem_budget_track("file_menu", sizeof(arena), &arena_used, &arena_peak);
+}
+
 FRESULT file_menu_deinit()
 {
-    FRESULT fr = f_unmount("");
+    FRESULT fr;
+    file_menu_fs_lock();
+    pf_cancel();
+    fr = f_unmount("");
     pico_fatfs_reboot_spi();
+    file_menu_fs_unlock();
     return fr;
 }
 
+void file_menu_set_index_cache(int enable)
+{
+    idx_cache_enable = enable;
+}
+
 // For implicit sort all entries
+#ifdef FILE_MENU_BENCH
+void file_menu_bench_reset(void)
+{
+    memset(&bench, 0, sizeof(bench));
+}
+
+void file_menu_bench_get(file_menu_bench_t* dst)
+{
+    *dst = bench;
+}
+#endif // FILE_MENU_BENCH
+
 void file_menu_idle(void)
 {
     static int up_down = 0;
     uint16_t r_start = 0;
     uint16_t r_end_1 = 0;
-    if (get_range_full_sorted(0, max_entry_cnt)) return;
+    file_menu_fs_lock();
+    if (get_range_full_sorted(0, max_entry_cnt)) {
+        if (!idx_cache_done) idx_cache_save();
+        file_menu_fs_unlock();
+        return;
+    }
     for (;;) {
         if (up_down & 0x1) {
             r_start = last_order + 1;
@@ -421,6 +1099,42 @@ void file_menu_idle(void)
     printf("implicit sort %d %d\n\r", r_start, r_end_1);
     #endif // #ifdef DEBUG_FILE_MENU
     idx_qsort_entry_list_by_range(r_start, r_end_1, 0, max_entry_cnt);
+    file_menu_fs_unlock();
+}
+
+// Index parent directory and the next directory after current one in it by file_menu_prefetch_step()
+void file_menu_prefetch(uint16_t order_in_parent)
+{
+    file_menu_fs_lock();
+    if (!pf_requested || pf_parent_taken || pf_order != order_in_parent) {
+        pf_cancel();
+        if (fs.fs_type != FS_EXFAT) { // ".." is not available in exFAT (see UIFileViewMode::chdir())
+            pf_requested = 1;
+            pf_order = order_in_parent;
+            strncpy(pf_path, "..", sizeof(pf_path));
+            pf_start(PF_PARENT, arena_used);
+        }
+    }
+    file_menu_fs_unlock();
+}
+
+// Proceed prefetch for budget_us (skipped if FatFs is in use)
+int file_menu_prefetch_step(uint32_t budget_us)
+{
+    int left = 0;
+    uint32_t start_us = time_us_32();
+    if (!file_menu_fs_try_lock()) return 1;
+    for (int i = 0; i < PF_NUM; i++) {
+        if (pf_slot[i].state != PF_IDLE && pf_slot[i].state != PF_READY) {
+            PROF_BEGIN(prof_begin);
+            pf_run(i, start_us, budget_us);
+            PROF_END("file_menu", "prefetch_step", prof_begin);
+            left = 1;
+            break;
+        }
+    }
+    file_menu_fs_unlock();
+    return left;
 }
 
 void file_menu_sort_entry(uint16_t scope_start, uint16_t scope_end_1)
@@ -428,6 +1142,8 @@ void file_menu_sort_entry(uint16_t scope_start, uint16_t scope_end_1)
     uint16_t wing;
     uint16_t wing_start, wing_end_1;
     if (scope_start >= scope_end_1) return;
+    PROF_BEGIN(prof_begin);
+    file_menu_fs_lock();
     if (scope_start > max_entry_cnt - 1) scope_start = max_entry_cnt - 1;
     if (scope_end_1 > max_entry_cnt) scope_end_1 = max_entry_cnt;
     wing = (scope_end_1 - scope_start)*2;
@@ -438,64 +1154,159 @@ void file_menu_sort_entry(uint16_t scope_start, uint16_t scope_end_1)
     if (!get_range_full_sorted(scope_start, scope_end_1)) {
         idx_qsort_entry_list_by_range(wing_start, wing_end_1, 0, max_entry_cnt);
     }
+    file_menu_fs_unlock();
+    PROF_END("file_menu", "sort_entry", prof_begin);
 }
 
 void file_menu_full_sort(void)
 {
+    file_menu_fs_lock();
     file_menu_sort_entry(0, max_entry_cnt);
+    file_menu_fs_unlock();
 }
 
 TCHAR* file_menu_get_fname_ptr(uint16_t order)
 {
-    FRESULT fr = FR_INVALID_PARAMETER;     /* FatFs return code */
-    file_menu_sort_entry(order, order+5);
-    if (order < max_entry_cnt) {
-        fr = idx_f_stat(entry_list[order], &fno);
-        last_order = order;
-
-    }
-    if (fr == FR_OK) {
-        return fno.fname;
-    } else {
-        return "";
-    }
+    file_menu_fs_lock();
+    // copied because fno is also used by prefetch on the other core
+    if (file_menu_get_fname(order, fname_buf, sizeof(fname_buf)) != FR_OK) fname_buf[0] = '\0';
+    file_menu_fs_unlock();
+    return fname_buf;
 }
 
 FRESULT file_menu_get_fname(uint16_t order, char* str, uint16_t size)
 {
     FRESULT fr = FR_INVALID_PARAMETER;     /* FatFs return code */
+    file_menu_fs_lock();
     file_menu_sort_entry(order, order+5);
     if (order < max_entry_cnt) {
         fr = idx_f_stat(entry_list[order], &fno);
-        strncpy(str, fno.fname, size);
+        if (size > 0) { // copy only within length, always terminated
+            size_t len = strnlen(fno.fname, size - 1);
+            memcpy(str, fno.fname, len);
+            str[len] = '\0';
+        }
         last_order = order;
     }
+    file_menu_fs_unlock();
     return fr;
 }
 
 int file_menu_is_dir(uint16_t order)
 {
+    int res = -1;
+    file_menu_fs_lock();
     if (order < max_entry_cnt) {
-        return !get_is_file(entry_list[order]);
-    } else {
-        return -1;
+        res = !get_is_file(entry_list[order]);
     }
+    file_menu_fs_unlock();
+    return res;
 }
 
 uint16_t file_menu_get_num(void)
 {
-    return max_entry_cnt;
+    uint16_t num;
+    file_menu_fs_lock();
+    num = max_entry_cnt;
+    file_menu_fs_unlock();
+    return num;
+}
+
+uint16_t file_menu_get_capacity(void)
+{
+    uint16_t capacity;
+    file_menu_fs_lock();
+    capacity = arena_capacity();
+    file_menu_fs_unlock();
+    return capacity;
+}
+
+file_menu_type_t file_menu_get_type(uint16_t order)
+{
+    file_menu_type_t type = FILE_MENU_TYPE_OTHER;
+    file_menu_fs_lock();
+    if (order < max_entry_cnt) {
+        file_menu_sort_entry(order, order+1);
+        type = (file_menu_type_t) type_list[entry_list[order]];
+    }
+    file_menu_fs_unlock();
+    return type;
+}
+
+uint16_t file_menu_get_type_num(file_menu_type_t type)
+{
+    uint16_t count;
+    file_menu_fs_lock();
+    count = file_menu_get_type_num_from_max(type, max_entry_cnt);
+    file_menu_fs_unlock();
+    return count;
+}
+
+uint16_t file_menu_get_type_num_from_max(file_menu_type_t type, uint16_t max_order)
+{
+    uint16_t count = 0;
+    file_menu_fs_lock();
+    if (max_order > max_entry_cnt) max_order = max_entry_cnt;
+    if (max_order <= 1) {
+        file_menu_fs_unlock();
+        return 0;
+    }
+    // Count in whole directory does not depend on order
+    if (max_order < max_entry_cnt && !get_range_full_sorted(0, max_order)) {
+        idx_qsort_entry_list_by_range(0, max_order, 0, max_entry_cnt);
+    }
+    if (type == FILE_MENU_TYPE_AUDIO) {
+        if (audio_cnt_dirty) {
+            for (int i = 0; i < max_entry_cnt; i++) {
+                audio_cnt_by_order[i] = count;
+                if (type_list[entry_list[i]] == FILE_MENU_TYPE_AUDIO) count++;
+            }
+            audio_cnt_by_order[max_entry_cnt] = count;
+            audio_cnt_dirty = 0;
+        }
+        count = audio_cnt_by_order[max_order] - audio_cnt_by_order[1];
+    } else {
+        for (int i = 1; i < max_order; i++) {
+            if (type_list[entry_list[i]] == type) count++;
+        }
+    }
+    file_menu_fs_unlock();
+    return count;
 }
 
 uint16_t file_menu_get_dir_num(void)
 {
     uint16_t count = 0;
+    file_menu_fs_lock();
     for (int i = 1; i < max_entry_cnt; i++) {
         if (file_menu_is_dir(i) > 0) { count++; }
     }
+    file_menu_fs_unlock();
     return count;
 }
 
+int32_t file_menu_find(const TCHAR* name)
+{
+    const char* key = (strncmp(name, "The ", 4) == 0) ? &name[4] : name;
+    int32_t order = -1;
+    file_menu_fs_lock();
+    for (int i = 1; i < max_entry_cnt; i++) {
+        uint16_t idx = entry_list[i];
+        // full name is read only for entries matching prefix key
+        if (strncmp(&fast_fname_list[idx*ffl_sz], key, ffl_sz) != 0) continue;
+        if (idx_f_stat(idx, &fno) != FR_OK || strcmp(fno.fname, name) != 0) continue;
+        if (!get_sorted(i)) {
+            // order is not fixed yet in tied entries
+            file_menu_sort_entry(i, i+1);
+            for (i = 1; i < max_entry_cnt && entry_list[i] != idx; i++) {}
+        }
+        order = i;
+        break;
+    }
+    file_menu_fs_unlock();
+    return order;
+}
+
 int file_menu_match_ext(uint16_t order, const char* ext, size_t ext_size)
 {
     char name[FF_MAX_LFN];
@@ -509,7 +1320,7 @@ int file_menu_match_ext(uint16_t order, const char* ext, size_t ext_size)
 
 uint16_t file_menu_get_ext_num(const char* ext, size_t ext_size)
 {
-    return file_menu_get_ext_num_from_max(ext, ext_size, max_entry_cnt);
+    return file_menu_get_ext_num_from_max(ext, ext_size, file_menu_get_num());
 }
 
 uint16_t file_menu_get_ext_num_from_max(const char* ext, size_t ext_size, uint16_t max_order)
@@ -528,30 +1339,82 @@ uint16_t file_menu_get_ext_num_from_max(const char* ext, size_t ext_size, uint16
     return count;
 }
 
+// follow f_chdir() of open_dir / ch_dir in cwd_path
+static void cwd_path_set(const TCHAR* path)
+{
+    if (path[0] != '/' || strlen(path) >= sizeof(cwd_path)) {
+        cwd_path[0] = '\0';
+        return;
+    }
+    strncpy(cwd_path, path, sizeof(cwd_path));
+}
+
+static void cwd_path_ch_dir(const TCHAR* name)
+{
+    size_t len = strlen(cwd_path);
+    if (len == 0) return;
+    if (strcmp(name, "..") == 0) {
+        TCHAR* sep = strrchr(cwd_path, '/');
+        if (sep == cwd_path) sep++; // keep root
+        *sep = '\0';
+        return;
+    }
+    if (len + strlen(name) + 2 > sizeof(cwd_path)) {
+        cwd_path[0] = '\0';
+        return;
+    }
+    if (cwd_path[len-1] != '/') cwd_path[len++] = '/';
+    strcpy(&cwd_path[len], name);
+}
+
+FRESULT file_menu_get_cwd_path(char* str, uint16_t size)
+{
+    if (cwd_path[0] == '\0' || strlen(cwd_path) >= size) return FR_INVALID_NAME;
+    strncpy(str, cwd_path, size);
+    return FR_OK;
+}
+
 FRESULT file_menu_open_dir(const TCHAR* path)
 {
     FRESULT fr = FR_INVALID_PARAMETER;     /* FatFs return code */
+    PROF_BEGIN(prof_begin);
+    file_menu_fs_lock();
+    pf_cancel();
     //fr = f_opendir(&dir, path);
     f_chdir(path);
+    cwd_path_set(path);
     fr = f_opendir(&dir, ".");
     f_stat_cnt = 1;
     last_order = 0;
     if (fr == FR_OK) {
         idx_sort_new();
+        if (entry_truncated) fr = FR_NOT_ENOUGH_CORE;
     }
+    file_menu_fs_unlock();
+    PROF_END("file_menu", "open_dir", prof_begin);
     return fr;
 }
 
 FRESULT file_menu_ch_dir(uint16_t order)
 {
     FRESULT fr = FR_INVALID_PARAMETER;     /* FatFs return code */
+    PROF_BEGIN(prof_begin);
+    file_menu_fs_lock();
     if (order < max_entry_cnt) {
         fr = idx_f_stat(entry_list[order], &fno);
         f_closedir(&dir);
         //printf("chdir %s\n\r", fno.fname);
         f_chdir(fno.fname);
+        cwd_path_ch_dir(fno.fname);
+        if (pf_take(order)) {
+            file_menu_fs_unlock();
+            PROF_END("file_menu", "ch_dir", prof_begin);
+            return FR_OK;
+        }
         fr = f_opendir(&dir, ".");
         idx_sort_delete();
+    } else {
+        pf_cancel();
     }
     f_stat_cnt = 1;
     last_order = 0;
@@ -560,7 +1423,10 @@ FRESULT file_menu_ch_dir(uint16_t order)
     //fr = f_opendir(&dir, ".");
     if (fr == FR_OK) {
         idx_sort_new();
+        if (entry_truncated) fr = FR_NOT_ENOUGH_CORE;
     }
+    file_menu_fs_unlock();
+    PROF_END("file_menu", "ch_dir", prof_begin);
     return fr;
 }
 
@@ -569,10 +1435,13 @@ void file_menu_close_dir(void)
     /*
     for (int i = 0; i < max_entry_cnt; i++) {
         char temp_str[5] = "    ";
-        strncpy(temp_str, fast_fname_list[i], 4);
+        strncpy(temp_str, &fast_fname_list[i*ffl_sz], 4);
         printf("fast_fname_list[%d] = %4s\r\n", i, temp_str);
     }
     */
+    file_menu_fs_lock();
+    pf_cancel();
     idx_sort_delete();
     f_closedir(&dir);
+    file_menu_fs_unlock();
 }
@@ -16,13 +16,41 @@
 extern "C" {
 #endif
 
+#define FILE_MENU_PATH_SIZE 256 // max length of absolute path of current directory including '\0'
+#define FILE_MENU_CUR_POS ((FSIZE_t) -1) // ofs of file_menu_read() to read from current position
+
+typedef enum {
+    FILE_MENU_TYPE_DIR = 0,
+    FILE_MENU_TYPE_AUDIO, // .wav, .flac
+    FILE_MENU_TYPE_JPEG,  // .jpg, .jpeg
+    FILE_MENU_TYPE_PNG,   // .png
+    FILE_MENU_TYPE_OTHER
+} file_menu_type_t;
+
+void file_menu_fs_lock(void); // hold while accessing FatFs out of file_menu (recursive, shared with core1)
+int file_menu_fs_try_lock(void); // returns 1 if locked
+void file_menu_fs_unlock(void);
+typedef FRESULT (*file_menu_read_func_t)(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br);
+void file_menu_set_read_func(file_menu_read_func_t func); // route file_menu_read() of core0 to I/O scheduler (NULL: read directly)
+FRESULT file_menu_read(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br); // read of metadata and artwork (ofs: FILE_MENU_CUR_POS or offset to seek)
+FRESULT file_menu_read_direct(FIL* fp, FSIZE_t ofs, void* buff, UINT btr, UINT* br); // same as file_menu_read() without routing
 FRESULT file_menu_init(uint8_t* fs_type);
 FRESULT file_menu_deinit();
-FRESULT file_menu_open_dir(const TCHAR* path);
-FRESULT file_menu_ch_dir(uint16_t order);
+void file_menu_track_budget(void); // account index arena in memory budget map
+void file_menu_set_index_cache(int enable); // enable: 1 to use hidden per-directory index file
+void file_menu_prefetch(uint16_t order_in_parent); // index parent directory and next directory after order_in_parent in background
+int file_menu_prefetch_step(uint32_t budget_us); // proceed prefetch (to be called by background task), returns 1 if prefetch is left
+FRESULT file_menu_open_dir(const TCHAR* path); // FR_NOT_ENOUGH_CORE: entries are listed up to file_menu_get_capacity()
+FRESULT file_menu_ch_dir(uint16_t order); // FR_NOT_ENOUGH_CORE: entries are listed up to file_menu_get_capacity()
 void file_menu_close_dir(void);
+FRESULT file_menu_get_cwd_path(char* str, uint16_t size); // absolute path of current directory (FR_INVALID_NAME: not known)
 uint16_t file_menu_get_num(void);
+uint16_t file_menu_get_capacity(void); // max number of entries listed per directory
 uint16_t file_menu_get_dir_num(void);
+file_menu_type_t file_menu_get_type(uint16_t order); // classified by extension at directory scan (case insensitive)
+uint16_t file_menu_get_type_num(file_menu_type_t type);
+uint16_t file_menu_get_type_num_from_max(file_menu_type_t type, uint16_t max_order);
+int32_t file_menu_find(const TCHAR* name); // returns order of name in current directory (-1: not found)
 int file_menu_match_ext(uint16_t order, const char* ext, size_t ext_size); // ext: "mp3", "wav" (ext does not include ".")
 uint16_t file_menu_get_ext_num(const char* ext, size_t ext_size); // ext: "mp3", "wav" (ext does not include ".")
 uint16_t file_menu_get_ext_num_from_max(const char* ext, size_t ext_size, uint16_t max_order); // ext: "mp3", "wav" (ext does not include ".")
@@ -33,6 +61,16 @@ TCHAR* file_menu_get_fname_ptr(uint16_t order);
 int file_menu_is_dir(uint16_t order);
 void file_menu_idle(void);
 
+#ifdef FILE_MENU_BENCH
+typedef struct {
+    uint32_t key_cmp_cnt; // prefix key comparisons by merge sort and quick sort
+    uint32_t name_cmp_cnt; // full name comparisons of entries tied by prefix key
+    uint32_t f_stat_cnt; // idx_f_stat() calls (each reads entries by f_readdir)
+} file_menu_bench_t;
+void file_menu_bench_reset(void);
+void file_menu_bench_get(file_menu_bench_t* bench); // counters since file_menu_bench_reset()
+#endif // FILE_MENU_BENCH
+
 #ifdef __cplusplus
 }
 #endif
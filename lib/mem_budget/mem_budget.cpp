@@ -0,0 +1,155 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "mem_budget.h"
+
+#include <cstdio>
+#include "pico/stdlib.h"
+
+#if PICO_ON_DEVICE
+#include <malloc.h>
+#include <unistd.h>
+#include "hardware/sync.h"
+
+extern "C" {
+extern char end;  // bottom of heap
+extern char __StackLimit;  // top of heap
+extern uint32_t __StackBottom;
+extern uint32_t __StackTop;
+extern uint32_t __StackOneBottom;
+extern uint32_t __StackOneTop;
+}
+#endif // PICO_ON_DEVICE
+
+typedef struct _mem_pool_t {
+    const char* name;
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    uint32_t live;  // blocks not freed yet
+    uint32_t fails;
+} mem_pool_t;
+
+typedef struct _mem_region_t {
+    const char* name;
+    size_t size;
+    const size_t* used;  // nullptr: reserved as a whole
+    const size_t* peak;
+} mem_region_t;
+
+static constexpr size_t PoolAlign = 8;
+alignas(PoolAlign) static uint8_t imagePool[MEM_POOL_IMAGE_SIZE];
+static mem_pool_t pools[MEM_POOL_NUM] = {
+    {"image", imagePool, sizeof(imagePool), 0, 0, 0, 0},
+};
+static mem_region_t regions[MEM_BUDGET_MAX_REGIONS];
+static int numRegions;
+
+#if PICO_ON_DEVICE
+static constexpr uint32_t StackPaint = 0x4b435453;  // "STCK"
+
+// bytes of stack ever used (stack grows downward from top)
+static size_t stack_high_water(const uint32_t* bottom, const uint32_t* top)
+{
+    const uint32_t* p = bottom;
+    while (p < top && *p == StackPaint) { p++; }
+    return static_cast<size_t>(top - p) * sizeof(uint32_t);
+}
+#endif // PICO_ON_DEVICE
+
+void mem_budget_init(void)
+{
+#if PICO_ON_DEVICE
+    // core0: paint below current frame with interrupts disabled (handlers would push on the area being painted)
+    uint32_t marker;
+    uint32_t save = save_and_disable_interrupts();
+    for (uint32_t* p = &__StackBottom; p < &marker - 16; p++) { *p = StackPaint; }
+    restore_interrupts(save);
+    // core1: not launched yet (high-water mark is kept over relaunches)
+    for (uint32_t* p = &__StackOneBottom; p < &__StackOneTop; p++) { *p = StackPaint; }
+#endif // PICO_ON_DEVICE
+}
+
+void mem_budget_reserve(const char* name, size_t size)
+{
+    for (int i = 0; i < numRegions; i++) {
+        if (regions[i].name == name && regions[i].used == nullptr) {
+            regions[i].size += size;
+            return;
+        }
+    }
+    mem_budget_track(name, size, nullptr, nullptr);
+}
+
+void mem_budget_track(const char* name, size_t size, const size_t* used, const size_t* peak)
+{
+    if (numRegions >= MEM_BUDGET_MAX_REGIONS) { return; }
+    regions[numRegions++] = {name, size, used, peak};
+}
+
+size_t mem_budget_heap_free(void)
+{
+#if PICO_ON_DEVICE
+    struct mallinfo mi = mallinfo();
+    return static_cast<size_t>(&__StackLimit - static_cast<char*>(sbrk(0))) + mi.fordblks;
+#else
+    return SIZE_MAX;
+#endif // PICO_ON_DEVICE
+}
+
+void mem_budget_print(void)
+{
+    printf("=== Memory Budget ===\r\n");
+#if PICO_ON_DEVICE
+    struct mallinfo mi = mallinfo();
+    printf("heap: %u / %u bytes used, top %u, free %u\r\n",
+        static_cast<unsigned>(mi.uordblks), static_cast<unsigned>(&__StackLimit - &end),
+        static_cast<unsigned>(mi.arena), static_cast<unsigned>(mem_budget_heap_free()));
+    printf("stack core0: %u / %u bytes, core1: %u / %u bytes\r\n",
+        static_cast<unsigned>(stack_high_water(&__StackBottom, &__StackTop)),
+        static_cast<unsigned>((&__StackTop - &__StackBottom) * sizeof(uint32_t)),
+        static_cast<unsigned>(stack_high_water(&__StackOneBottom, &__StackOneTop)),
+        static_cast<unsigned>((&__StackOneTop - &__StackOneBottom) * sizeof(uint32_t)));
+#endif // PICO_ON_DEVICE
+    for (int i = 0; i < MEM_POOL_NUM; i++) {
+        const mem_pool_t& pool = pools[i];
+        printf("pool %s: %u / %u bytes, peak %u, %u failed\r\n", pool.name,
+            static_cast<unsigned>(pool.used), static_cast<unsigned>(pool.size),
+            static_cast<unsigned>(pool.peak), static_cast<unsigned>(pool.fails));
+    }
+    for (int i = 0; i < numRegions; i++) {
+        const mem_region_t& r = regions[i];
+        if (r.used == nullptr) {
+            printf("%s: %u bytes\r\n", r.name, static_cast<unsigned>(r.size));
+        } else {
+            printf("%s: %u / %u bytes, peak %u\r\n", r.name, static_cast<unsigned>(*r.used),
+                static_cast<unsigned>(r.size), static_cast<unsigned>((r.peak != nullptr) ? *r.peak : *r.used));
+        }
+    }
+}
+
+void* mem_pool_alloc(mem_pool_id_t id, size_t size)
+{
+    mem_pool_t& pool = pools[id];
+    size = (size + PoolAlign - 1) & ~(PoolAlign - 1);
+    if (size == 0 || size > pool.size - pool.used) {
+        pool.fails++;
+        return nullptr;
+    }
+    void* ptr = pool.base + pool.used;
+    pool.used += size;
+    if (pool.used > pool.peak) { pool.peak = pool.used; }
+    pool.live++;
+    return ptr;
+}
+
+void mem_pool_free(mem_pool_id_t id, void* ptr)
+{
+    mem_pool_t& pool = pools[id];
+    if (ptr == nullptr || pool.live == 0) { return; }
+    if (--pool.live == 0) { pool.used = 0; }
+}
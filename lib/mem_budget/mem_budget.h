@@ -0,0 +1,54 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory budget map
+// Audio buffers are reserved from heap at boot and never allocated again while playing.
+// Subsystems allocating at run time take memory only from their own pool reserved statically at build time,
+// therefore they can neither fail by heap fragmentation nor take heap needed for audio buffers.
+// Pools are used from core0 only.
+
+#ifndef MEM_POOL_IMAGE_SIZE
+#define MEM_POOL_IMAGE_SIZE (48*1024)  // cover art decoding: PNG inflate window (32 KB) and lines, JPEG MCU, resampler
+#endif
+#ifndef MEM_BUDGET_HEAP_RESERVE
+#define MEM_BUDGET_HEAP_RESERVE (8*1024)  // heap kept for small run-time allocations (directory stack, config strings)
+#endif
+#ifndef MEM_BUDGET_MAX_REGIONS
+#define MEM_BUDGET_MAX_REGIONS 16  // entries of budget map
+#endif
+
+typedef enum {
+    MEM_POOL_IMAGE = 0,
+    MEM_POOL_NUM
+} mem_pool_id_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mem_budget_init(void);  // paint stacks for high-water marks, call first in main() before core1 is launched
+// name must point to static string: only the pointer is stored
+void mem_budget_reserve(const char* name, size_t size);  // account memory reserved from heap at boot
+void mem_budget_track(const char* name, size_t size, const size_t* used, const size_t* peak);  // account static area with its usage
+size_t mem_budget_heap_free(void);  // heap bytes left for reservation
+void mem_budget_print(void);
+void* mem_pool_alloc(mem_pool_id_t pool, size_t size);  // returns NULL if pool is exhausted (never falls back to heap)
+void mem_pool_free(mem_pool_id_t pool, void* ptr);  // pool is rewound when all of its blocks are freed
+
+#ifdef __cplusplus
+}
+
+template <typename T>
+T* mem_pool_new(mem_pool_id_t pool, size_t num)  // for trivial types only (no constructor is called)
+{
+    return static_cast<T*>(mem_pool_alloc(pool, sizeof(T) * num));
+}
+#endif
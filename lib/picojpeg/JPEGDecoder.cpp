@@ -40,6 +40,8 @@ Bodmer (24/1/17): Correct greyscale images, update examples
 
 #include <cstring>
 
+#include "file_menu_FatFs.h"
+#include "mem_budget.h"
 #include "picojpeg.h"
 
 JPEGDecoder JpegDec;
@@ -53,7 +55,7 @@ JPEGDecoder::JPEGDecoder(){
 
 
 JPEGDecoder::~JPEGDecoder(){
-	if (pImage) delete[] pImage;
+	mem_pool_free(MEM_POOL_IMAGE, pImage);
 }
 
 
@@ -78,14 +80,38 @@ uint8_t JPEGDecoder::pjpeg_need_bytes_callback(uint8_t* pBuf, uint8_t buf_size,
 		}
 	}
 
-	UINT br;
-	if (jpg_source == JPEG_SD_FILE) f_read(&g_fil, pBuf, n, &br);
+	if (jpg_source == JPEG_SD_FILE) {
+		uint copied = 0;
+		while (copied < n) {
+			if (read_buf_pos >= read_buf_len && !fillReadBuf()) { break; }
+			uint len = jpg_min(n - copied, read_buf_len - read_buf_pos);
+			memcpy(&pBuf[copied], &read_buf[read_buf_pos], len);
+			read_buf_pos += len;
+			copied += len;
+		}
+		n = copied;
+	}
 
-	*pBytes_actually_read = (uint8_t) br;
+	*pBytes_actually_read = (uint8_t) n;
 	g_nInFileOfs += n;
 	return 0;
 }
 
+// read ahead in sector aligned unit (FatFs reads whole sectors directly into read_buf)
+bool JPEGDecoder::fillReadBuf(void) {
+	uint64_t left = g_nInFileSize - g_nInFileRead;
+	if (left == 0) { return false; }
+	UINT btr = READ_BUF_SIZE - (uint) (f_tell(&g_fil) % READ_BUF_ALIGN);
+	if (btr > left) { btr = (UINT) left; }
+	UINT br;
+	FRESULT fr = file_menu_read(&g_fil, FILE_MENU_CUR_POS, read_buf, btr, &br); // read by core1 between audio refills
+	if (fr != FR_OK || br == 0) { return false; }
+	g_nInFileRead += br;
+	read_buf_pos = 0;
+	read_buf_len = br;
+	return true;
+}
+
 int JPEGDecoder::decode_mcu(void) {
 
 	status = pjpeg_decode_mcu();
@@ -115,10 +141,11 @@ int JPEGDecoder::read(void) {
 	}
 	
 	// Copy MCU's pixel blocks into the destination bitmap.
+	// (reduced block is (8 >> g_reduce) pixels square at top-left of each 8x8 block)
 	for (y = 0; y < image_info.m_MCUHeight; y += 8) {
 
 		int by_limit = jpg_min(8, image_info.m_height - (mcu_y * image_info.m_MCUHeight + y));
-		if (g_reduce) by_limit /= 8;
+		by_limit = (by_limit + (1 << g_reduce) - 1) >> g_reduce;
 
 		for (x = 0; x < image_info.m_MCUWidth; x += 8) {
 
@@ -129,13 +156,9 @@ int JPEGDecoder::read(void) {
 			const uint8_t *pSrcB = image_info.m_pMCUBufB + src_ofs;
 
 			int bx_limit = jpg_min(8, image_info.m_width - (mcu_x * image_info.m_MCUWidth + x));
-			if (g_reduce) bx_limit /= 8;
+			bx_limit = (bx_limit + (1 << g_reduce) - 1) >> g_reduce;
 
-			if (!g_reduce) {
-				pDst = pImage + row_pitch * y + x;
-			} else {
-				pDst = pImage + row_pitch * y/8 + x/8;
-			}
+			pDst = pImage + row_pitch * (y >> g_reduce) + (x >> g_reduce);
 
 			if (image_info.m_scanType == PJPG_GRAYSCALE) {
 				int bx, by;
@@ -147,18 +170,10 @@ int JPEGDecoder::read(void) {
 #else
 						*pDst++ = (*pSrcR & 0xF8) << 8 | (*pSrcR & 0xFC) <<3 | *pSrcR >> 3;
 #endif
-						if (!g_reduce) {
-							pSrcR++;
-						} else {
-							pSrcR += 8;
-						}
+						pSrcR++;
 					}
 
-					if (!g_reduce) {
-						pSrcR += (8 - bx_limit);
-					} else {
-						pSrcR += (1 - bx_limit)*8 + (8-1)*8;
-					}
+					pSrcR += (8 - bx_limit);
 					pDst += (row_pitch - bx_limit);
 				}
 			}
@@ -172,22 +187,12 @@ int JPEGDecoder::read(void) {
 #else
 						*pDst++ = (*pSrcR & 0xF8) << 8 | (*pSrcG & 0xFC) <<3 | *pSrcB >> 3;
 #endif
-						if (!g_reduce) {
-							pSrcR++; pSrcG++; pSrcB++;
-						} else {
-							pSrcR += 8; pSrcG += 8; pSrcB += 8;
-						}
+						pSrcR++; pSrcG++; pSrcB++;
 					}
 
-					if (!g_reduce) {
-						pSrcR += (8 - bx_limit);
-						pSrcG += (8 - bx_limit);
-						pSrcB += (8 - bx_limit);
-					} else {
-						pSrcR += (1 - bx_limit)*8 + (8-1)*8;
-						pSrcG += (1 - bx_limit)*8 + (8-1)*8;
-						pSrcB += (1 - bx_limit)*8 + (8-1)*8;
-					}
+					pSrcR += (8 - bx_limit);
+					pSrcG += (8 - bx_limit);
+					pSrcB += (8 - bx_limit);
 					pDst += (row_pitch - bx_limit);
 				}
 			}
@@ -211,7 +216,9 @@ int JPEGDecoder::read(void) {
 int JPEGDecoder::decodeSdFile(const char *jpgFile, const uint64_t pos, const size_t size, const uint8_t reduce){
 	FRESULT fr;
 
+	file_menu_fs_lock();
 	fr = f_open(&g_fil, (TCHAR *) jpgFile, FA_READ);
+	file_menu_fs_unlock();
 	if (fr != FR_OK) {
 		#ifdef DEBUG
 		printf("ERROR: SD file not found!\n");
@@ -222,11 +229,16 @@ int JPEGDecoder::decodeSdFile(const char *jpgFile, const uint64_t pos, const siz
 	jpg_source = JPEG_SD_FILE; // Flag to indicate a SD file
 
 	g_nInFileOfs = 0;
+	g_nInFileRead = 0;
+	read_buf_pos = 0;
+	read_buf_len = 0;
 
 	if (pos == 0) {
 		g_nInFileSize = f_size(&g_fil);
 	} else {
+		file_menu_fs_lock();
 		fr = f_lseek(&g_fil, (FSIZE_t) pos);
+		file_menu_fs_unlock();
 		if (fr != FR_OK) {
 			#ifdef DEBUG
 			printf("ERROR: f_lseek failed\n");
@@ -285,8 +297,12 @@ int JPEGDecoder::decodeCommon() {
 	decoded_width =  image_info.m_width;
 	decoded_height =  image_info.m_height;
 	
-	row_pitch = (!g_reduce) ? image_info.m_MCUWidth : image_info.m_MCUWidth/8;
-	pImage = new uint16_t[image_info.m_MCUWidth * image_info.m_MCUHeight];
+	row_pitch = image_info.m_MCUWidth >> g_reduce;
+	pImage = mem_pool_new<uint16_t>(MEM_POOL_IMAGE, image_info.m_MCUWidth * image_info.m_MCUHeight);
+	if (pImage == NULL) {
+		printf("JPEG MCU buffer not available in image pool\n");
+		return 0;
+	}
 
 	memset(pImage , 0 , image_info.m_MCUWidth * image_info.m_MCUHeight * sizeof(*pImage));
 
@@ -312,8 +328,13 @@ void JPEGDecoder::abort(void) {
 	mcu_x = 0 ;
 	mcu_y = 0 ;
 	is_available = 0;
-	if(pImage) delete[] pImage;
+	mem_pool_free(MEM_POOL_IMAGE, pImage);
 	pImage = NULL;
 	
-	if (jpg_source == JPEG_SD_FILE) f_close(&g_fil);
+	if (jpg_source == JPEG_SD_FILE) {
+		file_menu_fs_lock();
+		f_close(&g_fil);
+		file_menu_fs_unlock();
+		jpg_source = JPEG_ARRAY; // not to close twice
+	}
 }
@@ -39,6 +39,8 @@ typedef enum {
 } jpg_source_t;
 
 private:
+  static constexpr uint READ_BUF_SIZE = 2048; // read-ahead of SD file
+  static constexpr uint READ_BUF_ALIGN = 512; // sector size
   FIL g_fil;
   pjpeg_scan_type_t scan_type;
   pjpeg_image_info_t image_info;
@@ -48,6 +50,10 @@ private:
   int mcu_y;
   uint64_t g_nInFileSize;
   uint64_t g_nInFileOfs;
+  uint64_t g_nInFileRead; // bytes read from SD file into read_buf
+  uint8_t read_buf[READ_BUF_SIZE];
+  uint read_buf_pos = 0;
+  uint read_buf_len = 0;
   uint8_t g_reduce = 0;
   uint row_pitch;
   uint decoded_width, decoded_height;
@@ -58,6 +64,7 @@ private:
   
   static uint8 pjpeg_callback(unsigned char* pBuf, unsigned char buf_size, unsigned char *pBytes_actually_read, void *pCallback_data);
   uint8 pjpeg_need_bytes_callback(unsigned char* pBuf, unsigned char buf_size, unsigned char *pBytes_actually_read, void *pCallback_data);
+  bool fillReadBuf(void);
   int decode_mcu(void);
   int decodeCommon();
 public:
@@ -84,7 +91,9 @@ public:
   
 // reduce:
 //  0: normal MCU size
-//  1: 1/8 MCU size for x, y
+//  1: 1/2 MCU size for x, y
+//  2: 1/4 MCU size for x, y
+//  3: 1/8 MCU size for x, y
   int decodeSdFile(const char *jpgFile, const uint64_t pos = 0, const size_t size = 0, const uint8_t reduce = 0);
   int decodeArray(const uint8_t array[], uint32_t  array_size, uint8_t reduce = 0);
   void abort(void);
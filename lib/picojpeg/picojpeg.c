@@ -157,14 +157,18 @@ static int16 gQuant3[8*8];
 // 6 bytes
 static int16 gLastDC[3];
 
+// Codes up to PJPG_HUFF_LOOKUP_BITS long are decoded by a single table lookup
+#define PJPG_HUFF_LOOKUP_BITS 9
+
 typedef struct HuffTableT
 {
    uint16 mMinCode[16];
    uint16 mMaxCode[16];
    uint8 mValPtr[16];
+   uint16 mLookup[1 << PJPG_HUFF_LOOKUP_BITS]; // (code length << 8) | value indexed by the next bits, 0 if longer
 } HuffTable;
 
-// DC - 192
+// DC - 192 (+ 2048 of lookup)
 static HuffTable gHuffTab0;
 
 static uint8 gHuffVal0[16];
@@ -172,7 +176,7 @@ static uint8 gHuffVal0[16];
 static HuffTable gHuffTab1;
 static uint8 gHuffVal1[16];
 
-// AC - 672
+// AC - 672 (+ 2048 of lookup)
 static HuffTable gHuffTab2;
 static uint8 gHuffVal2[256];
 
@@ -402,9 +406,28 @@ static PJPG_INLINE int16 huffExtend(uint16 x, uint8 s)
 //------------------------------------------------------------------------------
 static PJPG_INLINE uint8 huffDecode(const HuffTable* pHuffTable, const uint8* pHuffVal)
 {
-   uint8 i = 0;
+   uint8 i;
    uint8 j;
-   uint16 code = getBit();
+   uint16 code;
+   uint16 entry;
+
+   // Top 8 + gBitsLeft bits of gBitBuf are valid. Fetch a byte if needed so that the lookup bits can be peeked.
+   if (!gBitsLeft)
+   {
+      gBitBuf |= getOctet(1);
+      gBitsLeft = 8;
+   }
+
+   entry = pHuffTable->mLookup[gBitBuf >> (16 - PJPG_HUFF_LOOKUP_BITS)];
+   if (entry)
+   {
+      getBits2((uint8)(entry >> 8));
+      return (uint8)entry;
+   }
+
+   // Longer code (or invalid one): continue bit by bit after the lookup bits.
+   code = getBits2(PJPG_HUFF_LOOKUP_BITS);
+   i = PJPG_HUFF_LOOKUP_BITS - 1;
 
    // This func only reads a bit at a time, which on modern CPU's is not terribly efficient.
    // But on microcontrollers without strong integer shifting support this seems like a 
@@ -431,12 +454,16 @@ static PJPG_INLINE uint8 huffDecode(const HuffTable* pHuffTable, const uint8* pH
    return pHuffVal[j];
 }
 //------------------------------------------------------------------------------
-static void huffCreate(const uint8* pBits, HuffTable* pHuffTable)
+static void huffCreate(const uint8* pBits, const uint8* pHuffVal, HuffTable* pHuffTable)
 {
    uint8 i = 0;
    uint8 j = 0;
 
    uint16 code = 0;
+   uint16 k;
+
+   for (k = 0; k < (1 << PJPG_HUFF_LOOKUP_BITS); k++)
+      pHuffTable->mLookup[k] = 0;
       
    for ( ; ; )
    {
@@ -453,6 +480,22 @@ static void huffCreate(const uint8* pBits, HuffTable* pHuffTable)
          pHuffTable->mMinCode[i] = code;
          pHuffTable->mMaxCode[i] = code + num - 1;
          pHuffTable->mValPtr[i] = j;
+
+         if (i < PJPG_HUFF_LOOKUP_BITS)
+         {
+            // Every entry whose top (i + 1) bits are the code
+            uint8 shift = (uint8)(PJPG_HUFF_LOOKUP_BITS - 1 - i);
+            for (k = 0; k < num; k++)
+            {
+               uint16 entry = (uint16)(((i + 1) << 8) | pHuffVal[j + k]);
+               uint16 first = (uint16)((code + k) << shift);
+               uint16 n;
+               if ((code + k) >> (i + 1))
+                  break; // over-subscribed table
+               for (n = 0; n < (1 << shift); n++)
+                  pHuffTable->mLookup[first + n] = entry;
+            }
+         }
          
          j = (uint8)(j + num);
          
@@ -550,7 +593,7 @@ static uint8 readDHTMarker(void)
 
       left = (uint16)(left - totalRead);
 
-      huffCreate(bits, pHuffTable);
+      huffCreate(bits, pHuffVal, pHuffTable);
    }
       
    return 0;
@@ -1452,6 +1495,63 @@ static void idctCols(void)
    }      
 }
 
+//----------------------------------------------------------------------------
+// Scaled IDCT: N x N (N = 4 or 2) output from the lowest N x N coefficients,
+// equivalent to sampling the 8x8 IDCT at the center of each (8/N x 8/N) area.
+// Weights are C(u) / (Winograd scale of u) * cos((2x+1)u*pi/2N) * 256
+
+static const int16 gScaledIdct4[4][4] =
+{
+   { 181,  181,  181,  181 },
+   { 171,   71,  -71, -171 },
+   { 139, -139, -139,  139 },
+   {  83, -201,  201,  -83 },
+};
+
+static const int16 gScaledIdct2[2][2] =
+{
+   { 181,  181 },
+   { 131, -131 },
+};
+
+// Output N x N pixels at top-left of gCoeffBuf (pitch 8)
+static void idctScaled(uint8 n)
+{
+   const int16* pW = (n == 4) ? &gScaledIdct4[0][0] : &gScaledIdct2[0][0];
+   int16 tmp[4];
+   uint8 u, x, y;
+
+   for (y = 0; y < n; y++)
+   {
+      int16* pSrc = gCoeffBuf + y*8;
+      for (x = 0; x < n; x++)
+      {
+         long acc = 0;
+         for (u = 0; u < n; u++)
+            acc += (long)pW[u*n + x] * pSrc[u];
+         tmp[x] = (int16)(PJPG_ARITH_SHIFT_RIGHT_8_L(acc + 128L));
+      }
+      for (x = 0; x < n; x++)
+         pSrc[x] = tmp[x];
+   }
+
+   for (x = 0; x < n; x++)
+   {
+      int16* pSrc = gCoeffBuf + x;
+      for (y = 0; y < n; y++)
+      {
+         long acc = 0;
+         for (u = 0; u < n; u++)
+            acc += (long)pW[u*n + y] * pSrc[u*8];
+         // descale (1/64 of 2D IDCT), convert to unsigned and clamp to 8-bit
+         tmp[y] = (int16)(PJPG_ARITH_SHIFT_RIGHT_8_L(acc + 128L));
+         tmp[y] = clamp(PJPG_ARITH_SHIFT_RIGHT_N_16(tmp[y] + 32, 6) + 128);
+      }
+      for (y = 0; y < n; y++)
+         pSrc[y*8] = tmp[y];
+   }
+}
+
 /*----------------------------------------------------------------------------*/
 static PJPG_INLINE uint8 addAndClamp(uint8 a, int16 b)
 {
@@ -2125,6 +2225,65 @@ static void transformBlockReduce(uint8 mcuBlock)
    }
 }
 //------------------------------------------------------------------------------
+// Scaled (1/2, 1/4) block: N x N pixels at top-left of each 8x8 block area of MCU buffer
+static void transformBlockScaled(uint8 mcuBlock)
+{
+   uint8 n = 8 >> gReduce;
+   uint8 componentID = gMCUOrg[mcuBlock];
+   uint8 x, y;
+
+   idctScaled(n);
+
+   if (componentID == 0)
+   {
+      // Y block order in MCU: left to right, top to bottom
+      uint8 dstOfs = (gScanType == PJPG_YH1V2) ? mcuBlock * 128 : mcuBlock * 64;
+      for (y = 0; y < n; y++)
+      {
+         for (x = 0; x < n; x++)
+         {
+            uint8 c = (uint8)gCoeffBuf[y*8 + x];
+            uint8 ofs = dstOfs + y*8 + x;
+            gMCUBufR[ofs] = c;
+            gMCUBufG[ofs] = c;
+            gMCUBufB[ofs] = c;
+         }
+      }
+   }
+   else
+   {
+      // Cb/Cr block covers whole MCU, upsampled to each Y block
+      uint8 hShift = (gMaxMCUXSize == 16) ? 1 : 0;
+      uint8 vShift = (gMaxMCUYSize == 16) ? 1 : 0;
+      uint8 bx, by;
+      for (by = 0; by <= vShift; by++)
+      {
+         for (bx = 0; bx <= hShift; bx++)
+         {
+            uint8 dstOfs = by*128 + bx*64;
+            for (y = 0; y < n; y++)
+            {
+               for (x = 0; x < n; x++)
+               {
+                  uint8 c = (uint8)gCoeffBuf[((by*n + y) >> vShift)*8 + ((bx*n + x) >> hShift)];
+                  uint8 ofs = dstOfs + y*8 + x;
+                  if (componentID == 1)
+                  {
+                     gMCUBufG[ofs] = subAndClamp(gMCUBufG[ofs], ((c * 88U) >> 8U) - 44U);
+                     gMCUBufB[ofs] = addAndClamp(gMCUBufB[ofs], (c + ((c * 198U) >> 8U)) - 227U);
+                  }
+                  else
+                  {
+                     gMCUBufR[ofs] = addAndClamp(gMCUBufR[ofs], (c + ((c * 103U) >> 8U)) - 179);
+                     gMCUBufG[ofs] = subAndClamp(gMCUBufG[ofs], ((c * 183U) >> 8U) - 91);
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+//------------------------------------------------------------------------------
 static uint8 decodeNextMCU(void)
 {
    uint8 status;
@@ -2165,9 +2324,9 @@ static uint8 decodeNextMCU(void)
 
       compACTab = gCompACTab[componentID];
 
-      if (gReduce)
+      if (gReduce == 3)
       {
-         // Decode, but throw out the AC coefficients in reduce mode.
+         // Decode, but throw out the AC coefficients in 1/8 reduce mode.
          for (k = 1; k < 64; k++)
          {
             s = huffDecode(compACTab ? &gHuffTab3 : &gHuffTab2, compACTab ? gHuffVal3 : gHuffVal2);
@@ -2262,7 +2421,10 @@ static uint8 decodeNextMCU(void)
          while (k < 64)
             gCoeffBuf[ZAG[k++]] = 0;
 
-         transformBlock(mcuBlock); 
+         if (gReduce)
+            transformBlockScaled(mcuBlock);
+         else
+            transformBlock(mcuBlock); 
       }
    }
          
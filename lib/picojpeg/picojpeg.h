@@ -113,7 +113,9 @@ typedef unsigned char (*pjpeg_need_bytes_callback_t)(unsigned char* pBuf, unsign
 
 // Initializes the decompressor. Returns 0 on success, or one of the above error codes on failure.
 // pNeed_bytes_callback will be called to fill the decompressor's internal input buffer.
-// If reduce is 1, only the first pixel of each block will be decoded. This mode is much faster because it skips the AC dequantization, IDCT and chroma upsampling of every image pixel.
+// reduce is log2 of the reduction ratio of each 8x8 block (0: 1/1, 1: 1/2, 2: 1/4, 3: 1/8).
+// If reduce is 1 or 2, the lowest 4x4 or 2x2 coefficients are transformed by a smaller IDCT into 4x4 or 2x2 pixels placed at the top-left of each block (pitch 8).
+// If reduce is 3, only the first pixel of each block will be decoded. This mode is much faster because it skips the AC dequantization, IDCT and chroma upsampling of every image pixel.
 // Not thread safe.
 unsigned char pjpeg_decode_init(pjpeg_image_info_t *pInfo, pjpeg_need_bytes_callback_t pNeed_bytes_callback, void *pCallback_data, unsigned char reduce);
 
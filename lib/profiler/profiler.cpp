@@ -0,0 +1,157 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "profiler.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include "pico/stdlib.h"
+
+#ifdef PROFILER_ENABLE
+
+typedef struct _prof_event_t {
+    uint64_t beginUs;
+    uint32_t durUs;
+    const char* cat;
+    const char* name;
+} prof_event_t;
+
+typedef struct _prof_stage_t {
+    const char* cat;
+    const char* name;
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t totalUs;
+} prof_stage_t;
+
+static constexpr int NumCores = 2;
+static prof_event_t events[NumCores][PROFILER_TRACE_SIZE];
+static uint32_t eventCount[NumCores];  // total recorded, ring index is eventCount % PROFILER_TRACE_SIZE
+static prof_stage_t stages[NumCores][PROFILER_MAX_STAGES];
+static int numStages[NumCores];
+static volatile bool recording = true;
+
+uint64_t profiler_now(void)
+{
+    return time_us_64();
+}
+
+void profiler_record(const char* cat, const char* name, uint64_t begin_us)
+{
+    if (!recording) { return; }
+    uint core = get_core_num();
+    uint32_t dur = static_cast<uint32_t>(time_us_64() - begin_us);
+
+    prof_event_t& ev = events[core][eventCount[core] % PROFILER_TRACE_SIZE];
+    ev.beginUs = begin_us;
+    ev.durUs = dur;
+    ev.cat = cat;
+    ev.name = name;
+    eventCount[core]++;
+
+    // stage names are static strings, so pointer comparison identifies a stage
+    prof_stage_t* stage = nullptr;
+    for (int i = 0; i < numStages[core]; i++) {
+        if (stages[core][i].name == name && stages[core][i].cat == cat) {
+            stage = &stages[core][i];
+            break;
+        }
+    }
+    if (stage == nullptr) {
+        if (numStages[core] >= PROFILER_MAX_STAGES) { return; }
+        stage = &stages[core][numStages[core]++];
+        stage->cat = cat;
+        stage->name = name;
+        stage->count = 0;
+        stage->maxUs = 0;
+        stage->totalUs = 0;
+    }
+    stage->count++;
+    stage->totalUs += dur;
+    if (dur > stage->maxUs) { stage->maxUs = dur; }
+}
+
+// pause recording and let the other core finish an event in flight
+static void pause_recording()
+{
+    recording = false;
+    sleep_us(100);
+}
+
+void profiler_reset(void)
+{
+    pause_recording();
+    for (int core = 0; core < NumCores; core++) {
+        eventCount[core] = 0;
+        numStages[core] = 0;
+    }
+    recording = true;
+}
+
+void profiler_print_summary(void)
+{
+    pause_recording();
+    printf("=== Profiler ===\r\n");
+    for (int core = 0; core < NumCores; core++) {
+        for (int i = 0; i < numStages[core]; i++) {
+            const prof_stage_t& s = stages[core][i];
+            printf("core%d %s/%s: %" PRIu32 " calls, max %" PRIu32 " us, avg %" PRIu32 " us\r\n",
+                core, s.cat, s.name, s.count, s.maxUs, static_cast<uint32_t>(s.totalUs / s.count));
+        }
+    }
+    recording = true;
+}
+
+// Chrome trace event format (load in chrome://tracing or Perfetto)
+// trace ring is cleared after dump so that consecutive dumps do not overlap
+void profiler_dump_trace(void)
+{
+    pause_recording();
+    printf("{\"traceEvents\":[\r\n");
+    for (int core = 0; core < NumCores; core++) {
+        printf("%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"core%d\"}}",
+            (core == 0) ? "" : ",\r\n", core, core);
+    }
+    for (int core = 0; core < NumCores; core++) {
+        uint32_t count = eventCount[core];
+        uint32_t start = (count > PROFILER_TRACE_SIZE) ? count - PROFILER_TRACE_SIZE : 0;
+        for (uint32_t n = start; n < count; n++) {
+            const prof_event_t& ev = events[core][n % PROFILER_TRACE_SIZE];
+            printf(",\r\n{\"ph\":\"X\",\"cat\":\"%s\",\"name\":\"%s\",\"ts\":%" PRIu64 ",\"dur\":%" PRIu32 ",\"pid\":0,\"tid\":%d}",
+                ev.cat, ev.name, ev.beginUs, ev.durUs, core);
+        }
+        eventCount[core] = 0;
+    }
+    printf("\r\n]}\r\n");
+    recording = true;
+}
+
+#else // PROFILER_ENABLE
+
+uint64_t profiler_now(void)
+{
+    return 0;
+}
+
+void profiler_record(const char* cat, const char* name, uint64_t begin_us)
+{
+}
+
+void profiler_reset(void)
+{
+}
+
+void profiler_print_summary(void)
+{
+    printf("profiler disabled (build with PROFILER_ENABLE)\r\n");
+}
+
+void profiler_dump_trace(void)
+{
+    printf("profiler disabled (build with PROFILER_ENABLE)\r\n");
+}
+
+#endif // PROFILER_ENABLE
@@ -0,0 +1,65 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Stage profiler
+// Build with PROFILER_ENABLE to record stage timings; otherwise PROF_* macros compile to nothing.
+// Each core owns its own trace ring and stage table (single writer), therefore no lock is needed.
+// Record only from task context: an IRQ recording on the same core would race with the interrupted writer.
+
+#ifndef PROFILER_TRACE_SIZE
+#define PROFILER_TRACE_SIZE 256  // events kept per core (oldest overwritten)
+#endif
+#ifndef PROFILER_MAX_STAGES
+#define PROFILER_MAX_STAGES 32   // distinct (cat, name) pairs summarized per core
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t profiler_now(void);
+// cat and name must point to static strings: only the pointers are stored
+void profiler_record(const char* cat, const char* name, uint64_t begin_us);
+void profiler_reset(void);
+void profiler_print_summary(void);
+void profiler_dump_trace(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef PROFILER_ENABLE
+#define PROF_BEGIN(var)           uint64_t var = profiler_now()
+#define PROF_END(cat, name, var)  profiler_record(cat, name, var)
+#else
+#define PROF_BEGIN(var)
+#define PROF_END(cat, name, var)
+#endif
+
+#ifdef __cplusplus
+class ProfilerScope
+{
+public:
+    ProfilerScope(const char* cat, const char* name) : cat(cat), name(name), begin(profiler_now()) {}
+    ~ProfilerScope() { profiler_record(cat, name, begin); }
+    ProfilerScope(const ProfilerScope&) = delete;
+    ProfilerScope& operator=(const ProfilerScope&) = delete;
+private:
+    const char* cat;
+    const char* name;
+    uint64_t begin;
+};
+
+#ifdef PROFILER_ENABLE
+#define PROF_SCOPE(cat, name)  ProfilerScope profilerScope_(cat, name)
+#else
+#define PROF_SCOPE(cat, name)
+#endif
+#endif // __cplusplus
@@ -11,6 +11,9 @@
 #include <cinttypes>
 #include <cstdio>
 
+#include "audio_codec.h"
+#include "CoverCache.h"
+#include "file_menu_FatFs.h"
 #include "LcdCanvas.h"
 #include "ui_control.h"
 
@@ -34,6 +37,30 @@ void hookDispRotation()
     lcd.switchToListView();
 }
 
+void hookGeneralDirIndexCache()
+{
+    ConfigMenu& cfgMenu = ConfigMenu::instance();
+    file_menu_set_index_cache(cfgMenu.get(ConfigMenuId::GENERAL_DIR_INDEX_CACHE));
+}
+
+void hookGeneralCoverArtCache()
+{
+    ConfigMenu& cfgMenu = ConfigMenu::instance();
+    CoverCache::instance().setEnabled(cfgMenu.get(ConfigMenuId::GENERAL_COVER_ART_CACHE));
+}
+
+void hookPlayEqualizer()
+{
+    ConfigMenu& cfgMenu = ConfigMenu::instance();
+    audio_codec_set_eq_preset(cfgMenu.get(ConfigMenuId::PLAY_EQUALIZER));
+}
+
+void hookPlayOutputRate()
+{
+    ConfigMenu& cfgMenu = ConfigMenu::instance();
+    audio_codec_set_output_rate(cfgMenu.get(ConfigMenuId::PLAY_OUTPUT_RATE));
+}
+
 //=================================
 // Implementation of ConfigMenu class
 //=================================
@@ -18,6 +18,8 @@ enum class ConfigMenuId: uint32_t {
     GENERAL_TIME_TO_LEAVE_CONFIG,
     GENERAL_PUSH_BUTTON_LAYOUT,
     GENERAL_HP_BUTTON_LAYOUT,
+    GENERAL_DIR_INDEX_CACHE,
+    GENERAL_COVER_ART_CACHE,
     DISPLAY_LCD_CONFIG,
     DISPLAY_ROTATION,
     DISPLAY_BACKLIGHT_LOW_LEVEL,
@@ -26,6 +28,9 @@ enum class ConfigMenuId: uint32_t {
     PLAY_TIME_TO_NEXT_PLAY,
     PLAY_NEXT_PLAY_ALBUM,
     PLAY_RANDOM_DIR_DEPTH,
+    PLAY_BUFFER_PROFILE,
+    PLAY_EQUALIZER,
+    PLAY_OUTPUT_RATE,
 };
 
 //=================================
@@ -33,6 +38,10 @@ enum class ConfigMenuId: uint32_t {
 //=================================
 void hookDispLcdConfig();
 void hookDispRotation();
+void hookGeneralDirIndexCache();
+void hookGeneralCoverArtCache();
+void hookPlayEqualizer();
+void hookPlayOutputRate();
 
 //=================================
 // Interface of ConfigMenu class
@@ -51,7 +60,8 @@ public:
         Sequential,
         SequentialRepeat,
         Repeat,
-        Random
+        Random,
+        Shuffle
     } NextPlayAction_t;
 
     typedef struct {
@@ -143,6 +153,7 @@ private:
         {"SequentialRepeat", SequentialRepeat},
         {"Repeat", Repeat},
         {"Random", Random},
+        {"Shuffle", Shuffle},
     };
     const std::vector<ConfigSel_t> selRandDirDepth = {
         {"1", 1},
@@ -150,10 +161,33 @@ private:
         {"3", 3},
         {"4", 4},
     };
+    const std::vector<ConfigSel_t> selBufferProfile = {  // memory budget (KB) for audio buffers, applied at next boot
+        {"Low Latency", 48},
+        {"Standard", 90},
+        {"Robust", 128},
+    };
+    const std::vector<ConfigSel_t> selEqualizer = {  // value is Equalizer::preset_t
+        {"Off", 0},
+        {"Bass Boost", 1},
+        {"Treble Boost", 2},
+        {"Vocal", 3},
+        {"Loudness", 4},
+    };
+    const std::vector<ConfigSel_t> selOutputRate = {  // I2S sampling frequency (Hz), resampled if it differs from track
+        {"Follow Track", 0},
+        {"44.1 KHz", 44100},
+        {"48 KHz", 48000},
+        {"88.2 KHz", 88200},
+        {"96 KHz", 96000},
+    };
     const std::vector<ConfigSel_t> selButtonLayout = {
         {"Horizontal", 0},
         {"Vetical", 1},
     };
+    const std::vector<ConfigSel_t> selOffOn = {
+        {"Off", 0},
+        {"On", 1},
+    };
 
     const std::map<const CategoryId_t, const char*> categoryMap = {
         {CategoryId_t::GENERAL, "General"},
@@ -167,6 +201,8 @@ private:
         {ConfigMenuId::GENERAL_TIME_TO_LEAVE_CONFIG,  {"Time to Leave Config",  CategoryId_t::GENERAL, CFG_MENU_IDX_GENERAL_TIME_TO_LEAVE_CONFIG,  &selTime2,          nullptr}},
         {ConfigMenuId::GENERAL_PUSH_BUTTON_LAYOUT,    {"Push Button Layout",    CategoryId_t::GENERAL, CFG_MENU_IDX_GENERAL_PUSH_BUTTON_LAYOUT,    &selButtonLayout,   nullptr}},
         {ConfigMenuId::GENERAL_HP_BUTTON_LAYOUT,      {"HP Button Layout",      CategoryId_t::GENERAL, CFG_MENU_IDX_GENERAL_HP_BUTTON_LAYOUT,      &selButtonLayout,   nullptr}},
+        {ConfigMenuId::GENERAL_DIR_INDEX_CACHE,       {"Dir Index Cache",       CategoryId_t::GENERAL, CFG_MENU_IDX_GENERAL_DIR_INDEX_CACHE,       &selOffOn,          hookGeneralDirIndexCache}},
+        {ConfigMenuId::GENERAL_COVER_ART_CACHE,       {"Cover Art Cache",       CategoryId_t::GENERAL, CFG_MENU_IDX_GENERAL_COVER_ART_CACHE,       &selOffOn,          hookGeneralCoverArtCache}},
         {ConfigMenuId::DISPLAY_LCD_CONFIG,            {"LCD Config",            CategoryId_t::DISPLAY, CFG_MENU_IDX_DISPLAY_LCD_CONFIG,            &selLcdConfig,      hookDispLcdConfig}},
         {ConfigMenuId::DISPLAY_ROTATION,              {"Rotation",              CategoryId_t::DISPLAY, CFG_MENU_IDX_DISPLAY_ROTATION,              &selRotation,       hookDispRotation}},
         {ConfigMenuId::DISPLAY_BACKLIGHT_LOW_LEVEL,   {"Backlight Low Level",   CategoryId_t::DISPLAY, CFG_MENU_IDX_DISPLAY_BACKLIGHT_LOW_LEVEL,   &selBacklightLevel, nullptr}},
@@ -175,6 +211,9 @@ private:
         {ConfigMenuId::PLAY_TIME_TO_NEXT_PLAY,        {"Time to Next Play",     CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_TIME_TO_NEXT_PLAY,        &selTime2,          nullptr}},
         {ConfigMenuId::PLAY_NEXT_PLAY_ALBUM,          {"Next Play Album",       CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_NEXT_PLAY_ALBUM,          &selNextPlayAlbum,  nullptr}},
         {ConfigMenuId::PLAY_RANDOM_DIR_DEPTH,         {"Random Dir Depth",      CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_RANDOM_DIR_DEPTH,         &selRandDirDepth,   nullptr}},
+        {ConfigMenuId::PLAY_BUFFER_PROFILE,           {"Buffer Profile",        CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_BUFFER_PROFILE,           &selBufferProfile,  nullptr}},
+        {ConfigMenuId::PLAY_EQUALIZER,                {"Equalizer",             CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_EQUALIZER,                &selEqualizer,      hookPlayEqualizer}},
+        {ConfigMenuId::PLAY_OUTPUT_RATE,              {"Output Rate",           CategoryId_t::PLAY,    CFG_MENU_IDX_PLAY_OUTPUT_RATE,              &selOutputRate,     hookPlayOutputRate}},
     };
 
     std::map<const CategoryId_t, std::map<const ConfigMenuId, const Item_t*>> menuMapByCategory;
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "FlashParam.h"
+#include "file_menu_FatFs.h"
 
 typedef enum {
     CFG_REVISION = FlashParamNs::CFG_ID_BASE,
@@ -45,6 +46,12 @@ typedef enum {
     CFG_MENU_IDX_PLAY_TIME_TO_NEXT_PLAY,
     CFG_MENU_IDX_PLAY_NEXT_PLAY_ALBUM,
     CFG_MENU_IDX_PLAY_RANDOM_DIR_DEPTH,
+    CFG_MENU_IDX_PLAY_BUFFER_PROFILE,
+    CFG_MENU_IDX_GENERAL_DIR_INDEX_CACHE,
+    CFG_MENU_IDX_GENERAL_COVER_ART_CACHE,
+    CFG_PLAY_PATH,
+    CFG_MENU_IDX_PLAY_EQUALIZER,
+    CFG_MENU_IDX_PLAY_OUTPUT_RATE,
 } ParamId_t;
 
 //=================================
@@ -89,6 +96,13 @@ struct ConfigParam : FlashParamNs::FlashParam {
     FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_TIME_TO_NEXT_PLAY       {CFG_MENU_IDX_PLAY_TIME_TO_NEXT_PLAY,        "CFG_MENU_IDX_PLAY_TIME_TO_NEXT_PLAY",        2};
     FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_NEXT_PLAY_ALBUM         {CFG_MENU_IDX_PLAY_NEXT_PLAY_ALBUM,          "CFG_MENU_IDX_PLAY_NEXT_PLAY_ALBUM",          1};
     FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_RANDOM_DIR_DEPTH        {CFG_MENU_IDX_PLAY_RANDOM_DIR_DEPTH,         "CFG_MENU_IDX_PLAY_RANDOM_DIR_DEPTH",         1};
+    FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_BUFFER_PROFILE          {CFG_MENU_IDX_PLAY_BUFFER_PROFILE,           "CFG_MENU_IDX_PLAY_BUFFER_PROFILE",           1};
+    FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_GENERAL_DIR_INDEX_CACHE      {CFG_MENU_IDX_GENERAL_DIR_INDEX_CACHE,       "CFG_MENU_IDX_GENERAL_DIR_INDEX_CACHE",       1};
+    FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_GENERAL_COVER_ART_CACHE      {CFG_MENU_IDX_GENERAL_COVER_ART_CACHE,       "CFG_MENU_IDX_GENERAL_COVER_ART_CACHE",       1};
+    // resume snapshot: absolute path of playing file to start playback before restoring directories ("": none)
+    FlashParamNs::Parameter<std::string> P_CFG_PLAY_PATH                             {CFG_PLAY_PATH,                              "CFG_PLAY_PATH",                              "",      FILE_MENU_PATH_SIZE};
+    FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_EQUALIZER               {CFG_MENU_IDX_PLAY_EQUALIZER,                "CFG_MENU_IDX_PLAY_EQUALIZER",                0};
+    FlashParamNs::Parameter<uint32_t>    P_CFG_MENU_IDX_PLAY_OUTPUT_RATE             {CFG_MENU_IDX_PLAY_OUTPUT_RATE,              "CFG_MENU_IDX_PLAY_OUTPUT_RATE",              0};
 
     void initialize(bool preserveStoreCount = false) override {
         FlashParamNs::FlashParam::initialize();
@@ -0,0 +1,242 @@
+/*------------------------------------------------------/
+/ CoverCache
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "CoverCache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "file_menu_FatFs.h"
+
+//#define DEBUG_COVER_CACHE
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t* buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= buf[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+//====================================
+// Implementation of CoverCache class
+//====================================
+CoverCache& CoverCache::instance()
+{
+    static CoverCache instance; // Singleton
+    return instance;
+}
+
+bool CoverCache::isSame(const image_key_t& a, const image_key_t& b)
+{
+    return a.hash == b.hash && a.size == b.size && a.boxW == b.boxW && a.boxH == b.boxH;
+}
+
+void CoverCache::setEnabled(bool flag)
+{
+    enabled = flag;
+}
+
+bool CoverCache::open(FIL* fp, BYTE mode)
+{
+    file_menu_fs_lock();
+    FRESULT fr = f_open(fp, CACHE_FILENAME, mode);
+    file_menu_fs_unlock();
+    return fr == FR_OK;
+}
+
+void CoverCache::close(FIL* fp)
+{
+    file_menu_fs_lock();
+    f_close(fp);
+    file_menu_fs_unlock();
+}
+
+bool CoverCache::readAt(FIL* fp, FSIZE_t ofs, void* buf, size_t size)
+{
+    uint8_t* ptr = static_cast<uint8_t*>(buf);
+    while (size > 0) {
+        UINT btr = (size < IO_CHUNK) ? size : IO_CHUNK;
+        UINT br;
+        bool ok = file_menu_read(fp, ofs, ptr, btr, &br) == FR_OK && br == btr;
+        if (!ok) { return false; }
+        ptr += btr;
+        ofs += btr;
+        size -= btr;
+    }
+    return true;
+}
+
+bool CoverCache::writeAt(FIL* fp, FSIZE_t ofs, const void* buf, size_t size)
+{
+    const uint8_t* ptr = static_cast<const uint8_t*>(buf);
+    while (size > 0) {
+        UINT btw = (size < IO_CHUNK) ? size : IO_CHUNK;
+        UINT bw;
+        file_menu_fs_lock();
+        bool ok = f_lseek(fp, ofs) == FR_OK && f_write(fp, ptr, btw, &bw) == FR_OK && bw == btw;
+        file_menu_fs_unlock();
+        if (!ok) { return false; }
+        ptr += btw;
+        ofs += btw;
+        size -= btw;
+    }
+    return true;
+}
+
+bool CoverCache::loadTable(FIL* fp)
+{
+    if (!readAt(fp, 0, &header, sizeof(header))) { return false; }
+    if (header.magic != MAGIC || header.version != VERSION || header.numSlots != NUM_SLOTS) { return false; }
+    if (!readAt(fp, sizeof(header), slots, sizeof(slots))) { return false; }
+    // overlay LRU stamps not written yet
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        if (pendingUse[i] == 0) { continue; }
+        slots[i].lastUse = pendingUse[i];
+        if (pendingUse[i] > header.useCount) { header.useCount = pendingUse[i]; }
+    }
+    return true;
+}
+
+// update slot record (and use counter in header)
+bool CoverCache::writeSlot(FIL* fp, int idx)
+{
+    if (!writeAt(fp, sizeof(header) + sizeof(slot_t) * idx, &slots[idx], sizeof(slot_t))) { return false; }
+    return writeAt(fp, 0, &header, sizeof(header));
+}
+
+// update all slot records and header
+bool CoverCache::writeTable(FIL* fp)
+{
+    if (!writeAt(fp, sizeof(header), slots, sizeof(slots))) { return false; }
+    return writeAt(fp, 0, &header, sizeof(header));
+}
+
+void CoverCache::clearPending()
+{
+    memset(pendingUse, 0, sizeof(pendingUse));
+    dirty = false;
+}
+
+FSIZE_t CoverCache::getPixelOfs(int idx) const
+{
+    return sizeof(header) + sizeof(slots) + (FSIZE_t) header.slotW * header.slotH * sizeof(uint16_t) * idx;
+}
+
+bool CoverCache::makeKey(const char* filename, uint64_t pos, size_t size, uint16_t boxW, uint16_t boxH, image_key_t& key)
+{
+    FIL fil;
+    uint8_t buf[SIGN_BYTES];
+    file_menu_fs_lock();
+    if (f_open(&fil, filename, FA_READ) != FR_OK) {
+        file_menu_fs_unlock();
+        return false;
+    }
+    file_menu_fs_unlock();
+    FSIZE_t fsize = f_size(&fil);
+    bool ok = pos < fsize;
+    if (ok) {
+        FSIZE_t dataSize = fsize - pos;
+        if (size > 0 && size < dataSize) { dataSize = size; }
+        size_t n = (dataSize < SIGN_BYTES) ? dataSize : SIGN_BYTES;
+        uint32_t hash = 2166136261UL;
+        ok = readAt(&fil, pos, buf, n);
+        if (ok) { hash = fnv1a(hash, buf, n); }
+        if (ok && dataSize > SIGN_BYTES) {
+            ok = readAt(&fil, pos + dataSize - n, buf, n);
+            if (ok) { hash = fnv1a(hash, buf, n); }
+        }
+        key.hash = hash;
+        key.size = (uint32_t) dataSize;
+        key.boxW = boxW;
+        key.boxH = boxH;
+    }
+    close(&fil);
+    return ok;
+}
+
+bool CoverCache::load(const image_key_t& key, uint16_t* img, uint16_t* imgW, uint16_t* imgH)
+{
+    if (!enabled) { return false; }
+    FIL fil;
+    if (!open(&fil, FA_READ)) { return false; }
+    bool hit = false;
+    if (loadTable(&fil) && header.slotW == key.boxW && header.slotH == key.boxH) {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            slot_t& slot = slots[i];
+            if (slot.imgW == 0 || !isSame(slot.key, key)) { continue; }
+            hit = readAt(&fil, getPixelOfs(i), img, (size_t) slot.imgW * slot.imgH * sizeof(uint16_t));
+            if (hit) {
+                *imgW = slot.imgW;
+                *imgH = slot.imgH;
+                slot.lastUse = ++header.useCount;
+                pendingUse[i] = slot.lastUse;  // written by flush() or next store()
+                dirty = true;
+            }
+            break;
+        }
+    }
+    close(&fil);
+    #ifdef DEBUG_COVER_CACHE
+    printf("CoverCache load hash: %08x size: %d %s\r\n", (unsigned int) key.hash, (int) key.size, hit ? "hit" : "miss");
+    #endif // DEBUG_COVER_CACHE
+    return hit;
+}
+
+void CoverCache::store(const image_key_t& key, const uint16_t* img, uint16_t imgW, uint16_t imgH)
+{
+    if (!enabled) { return; }
+    if (imgW == 0 || imgH == 0 || imgW > key.boxW || imgH > key.boxH) { return; }
+    FIL fil;
+    if (!open(&fil, FA_OPEN_ALWAYS | FA_READ | FA_WRITE)) { return; }
+    if (!loadTable(&fil) || header.slotW != key.boxW || header.slotH != key.boxH) {
+        // (re)initialize for this ImageBox dimension
+        header = {MAGIC, VERSION, key.boxW, key.boxH, NUM_SLOTS, 0};
+        memset(slots, 0, sizeof(slots));
+        clearPending();
+        if (!writeAt(&fil, 0, &header, sizeof(header)) || !writeAt(&fil, sizeof(header), slots, sizeof(slots))) {
+            close(&fil);
+            return;
+        }
+    }
+    // same key, then empty slot, then least recently used
+    int idx = -1;
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        if (slots[i].imgW != 0 && isSame(slots[i].key, key)) { idx = i; break; }
+        if (idx < 0 || (slots[idx].imgW != 0 && (slots[i].imgW == 0 || slots[i].lastUse < slots[idx].lastUse))) { idx = i; }
+    }
+    slot_t& slot = slots[idx];
+    // invalidate slot while its pixels are rewritten
+    slot.imgW = 0;
+    bool ok = writeSlot(&fil, idx);
+    ok = ok && writeAt(&fil, getPixelOfs(idx), img, (size_t) imgW * imgH * sizeof(uint16_t));
+    if (ok) {
+        slot.key = key;
+        slot.imgW = imgW;
+        slot.imgH = imgH;
+        slot.lastUse = ++header.useCount;
+        writeTable(&fil);  // together with pending LRU stamps
+    }
+    clearPending();
+    close(&fil);
+    #ifdef DEBUG_COVER_CACHE
+    printf("CoverCache store hash: %08x size: %d slot: %d\r\n", (unsigned int) key.hash, (int) key.size, idx);
+    #endif // DEBUG_COVER_CACHE
+}
+
+void CoverCache::flush()
+{
+    if (!dirty) { return; }
+    FIL fil;
+    if (enabled && open(&fil, FA_READ | FA_WRITE)) {
+        if (loadTable(&fil)) { writeTable(&fil); }
+        close(&fil);
+    }
+    clearPending();
+}
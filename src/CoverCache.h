@@ -0,0 +1,76 @@
+/*------------------------------------------------------/
+/ CoverCache
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ff.h"
+
+//=================================
+// Interface of CoverCache class
+//=================================
+// Fitted RGB565 cover art images kept in hidden file CACHE_FILENAME (NUM_SLOTS entries, LRU)
+// Images are identified by content of image data, therefore identical embedded cover art
+// in each track of an album shares one entry
+class CoverCache
+{
+public:
+    static constexpr const char* CACHE_FILENAME = "/.coverart.cache";
+    static constexpr int NUM_SLOTS = 8;
+    typedef struct {
+        uint32_t hash;  // FNV-1a of head and tail of image data
+        uint32_t size;  // size of image data
+        uint16_t boxW;  // dimension of ImageBox fitted into
+        uint16_t boxH;
+    } image_key_t;
+    static CoverCache& instance(); // Singleton
+    static bool isSame(const image_key_t& a, const image_key_t& b);
+    void setEnabled(bool flag);  // false: not to read or write CACHE_FILENAME
+    bool makeKey(const char* filename, uint64_t pos, size_t size, uint16_t boxW, uint16_t boxH, image_key_t& key);
+    bool load(const image_key_t& key, uint16_t* img, uint16_t* imgW, uint16_t* imgH);  // read only (LRU stamp is kept in RAM)
+    void store(const image_key_t& key, const uint16_t* img, uint16_t imgW, uint16_t imgH);
+    void flush();  // write LRU stamps of load() hits, call while audio is not played
+protected:
+    static constexpr uint32_t MAGIC = 0x43525643; // "CVRC"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t SIGN_BYTES = 256;  // bytes hashed at head and tail of image data
+    static constexpr size_t IO_CHUNK = 2048;  // FatFs lock is released between chunks for core1
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint16_t slotW;
+        uint16_t slotH;
+        uint32_t numSlots;
+        uint32_t useCount;
+    } header_t;
+    typedef struct {
+        image_key_t key;
+        uint16_t imgW;  // 0: empty
+        uint16_t imgH;
+        uint32_t lastUse;
+    } slot_t;
+    CoverCache() = default;
+    CoverCache(const CoverCache&) = delete;
+    CoverCache& operator=(const CoverCache&) = delete;
+    bool enabled = true;
+    header_t header;
+    slot_t slots[NUM_SLOTS];
+    uint32_t pendingUse[NUM_SLOTS] = {};  // lastUse stamped by load() hit and not written yet (0: none)
+    bool dirty = false;
+    bool open(FIL* fp, BYTE mode);
+    void close(FIL* fp);
+    bool readAt(FIL* fp, FSIZE_t ofs, void* buf, size_t size);
+    bool writeAt(FIL* fp, FSIZE_t ofs, const void* buf, size_t size);
+    bool loadTable(FIL* fp);
+    bool writeSlot(FIL* fp, int idx);
+    bool writeTable(FIL* fp);
+    void clearPending();
+    FSIZE_t getPixelOfs(int idx) const;
+};
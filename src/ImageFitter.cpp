@@ -8,10 +8,39 @@
 
 #include <cstring>
 
+#include "pico/stdlib.h"
+#if PICO_ON_DEVICE
+#include "hardware/interp.h"
+#endif // PICO_ON_DEVICE
+
 #include "JPEGDecoder.h"
+#include "mem_budget.h"
+#include "PNGDecoder.h"
 
 //#define DEBUG_IMAGE_FITTER
 
+static inline uint16_t swapPixel(uint16_t pix)
+{
+    #ifdef IMAGE_FITTER_SWAP_BYTES
+    return ((pix & 0xff00) >> 8) | ((pix & 0x00ff) << 8);
+    #else
+    return pix;
+    #endif // IMAGE_FITTER_SWAP_BYTES
+}
+
+// spread RGB565 into 0x07E0F81F bit fields of 32bit word, so that one multiplication weights R, G and B
+static inline uint32_t spreadPixel(uint16_t pix)
+{
+    return ((uint32_t) pix | ((uint32_t) pix << 16)) & 0x07E0F81FUL;
+}
+
+// pack sum of spread pixels weighted up to 32 in total (rounded) into RGB565
+static inline uint16_t packPixel(uint32_t sum)
+{
+    sum = ((sum + 0x02008010UL) >> 5) & 0x07E0F81FUL;
+    return (uint16_t) (sum | (sum >> 16));
+}
+
 //=====================================
 // Implementation of ImageFitter class
 //=====================================
@@ -40,6 +69,23 @@ void ImageFitter::config(uint16_t *img_rgb565, uint16_t width, uint16_t height,
     this->packHBlank = packHBlank;
 }
 
+// average of 2x2 RGB565 pixels truncated per channel (a sum of 4 spread pixels doesn't overflow into next field)
+static inline uint16_t averagePixel4(uint16_t p0, uint16_t p1, uint16_t p2, uint16_t p3)
+{
+    #ifdef IMAGE_DECODER_SWAP_BYTES
+    p0 = (p0 >> 8) | (p0 << 8);
+    p1 = (p1 >> 8) | (p1 << 8);
+    p2 = (p2 >> 8) | (p2 << 8);
+    p3 = (p3 >> 8) | (p3 << 8);
+    #endif // IMAGE_DECODER_SWAP_BYTES
+    uint32_t sum = ((spreadPixel(p0) + spreadPixel(p1) + spreadPixel(p2) + spreadPixel(p3)) >> 2) & 0x07E0F81FUL;
+    uint16_t pix = (uint16_t) (sum | (sum >> 16));
+    #ifdef IMAGE_DECODER_SWAP_BYTES
+    pix = (pix >> 8) | (pix << 8);
+    #endif // IMAGE_DECODER_SWAP_BYTES
+    return pix;
+}
+
 // MCU block 1/2 Accumulation (Shrink) x count times
 void ImageFitter::jpegMcu2sAccum(int count, uint16_t mcu_w, uint16_t mcu_h, uint16_t *pImage)
 {
@@ -47,35 +93,14 @@ void ImageFitter::jpegMcu2sAccum(int count, uint16_t mcu_w, uint16_t mcu_h, uint
     mcu_w <<= count;
     mcu_h <<= count;
     for (i = 0; i < count; i++) {
+        uint16_t *dst = pImage;
         for (int16_t mcu_ofs_y = 0; mcu_ofs_y < mcu_h; mcu_ofs_y+=2) {
+            const uint16_t *src0 = &pImage[mcu_w*mcu_ofs_y];
+            const uint16_t *src1 = src0 + mcu_w;
             for (int16_t mcu_ofs_x = 0; mcu_ofs_x < mcu_w; mcu_ofs_x+=2) {
-                uint32_t r = 0;
-                uint32_t g = 0;
-                uint32_t b = 0;
-                uint16_t pix;
-                for (int y = 0; y < 2; y++) {
-                    for (int x = 0; x < 2; x++) {
-                        // RGB565 format
-                        pix = pImage[mcu_w*(mcu_ofs_y+y)+mcu_ofs_x+x];
-#ifdef IMAGE_DECODER_SWAP_BYTES
-                        r += (pix & 0x00f8) >> 3;
-                        g += ((pix & 0x0007) << 3) | ((pix & 0xe000) >> 13);
-                        b += (pix & 0x1f00) >> 8;
-#else
-                        r += (pix & 0xf800) >> 11;
-                        g += (pix & 0x07e0) >> 5;
-                        b += (pix & 0x001f);
-#endif // IMAGE_DECODER_SWAP_BYTES
-                    }
-                }
-                r /= 4;
-                g /= 4;
-                b /= 4;
-#ifdef IMAGE_DECODER_SWAP_BYTES
-                pImage[mcu_w/2*(mcu_ofs_y/2)+mcu_ofs_x/2] = (uint16_t) (((r & 0x1f) << 3) | ((g & 0x38) >> 3) | ((g & 0x07) << 13) | ((b & 0x1f) << 8));
-#else
-                pImage[mcu_w/2*(mcu_ofs_y/2)+mcu_ofs_x/2] = (uint16_t) (((r & 0x1f) << 11) | ((g & 0x3f) << 5) | ((b & 0x1f) << 0));
-#endif // IMAGE_DECODER_SWAP_BYTES
+                *dst++ = averagePixel4(src0[0], src0[1], src1[0], src1[1]);  // dst never overtakes src0
+                src0 += 2;
+                src1 += 2;
             }
         }
         mcu_w /= 2;
@@ -83,31 +108,31 @@ void ImageFitter::jpegMcu2sAccum(int count, uint16_t mcu_w, uint16_t mcu_h, uint
     }
 }
 
-void ImageFitter::loadJpeg(bool reduce)
+// calculate fitting parameters of JPEG decode job
+bool ImageFitter::setupJpeg(uint8_t reduce)
 {
-    if (img_rgb565 == NULL) { return; }
     src_w = JpegDec.width;
     src_h = JpegDec.height;
-    uint16_t mcu_w = JpegDec.MCUWidth;
-    uint16_t mcu_h = JpegDec.MCUHeight;
+    mcu_w = JpegDec.MCUWidth;
+    mcu_h = JpegDec.MCUHeight;
     #ifdef DEBUG_IMAGE_FITTER
     { // DEBUG
         printf("JPEG info: (w, h) = (%d, %d), (mcu_w, mcu_h) = (%d, %d)\n", src_w, src_h, mcu_w, mcu_h);
     }
     #endif // DEBUG_IMAGE_FITTER
-   if (reduce) {
-        src_w /= 8;
-        src_h /= 8;
-        mcu_w /= 8;
-        mcu_h /= 8;
+    if (reduce > 0) {
+        src_w = (src_w + (1 << reduce) - 1) >> reduce;
+        src_h = (src_h + (1 << reduce) - 1) >> reduce;
+        mcu_w >>= reduce;
+        mcu_h >>= reduce;
         #ifdef DEBUG_IMAGE_FITTER
         { // DEBUG
-            printf("Reduce applied:  (w, h) = (%d, %d), (virtual) (mcu_w, mcu_h) = (%d, %d)\n", src_w, src_h, mcu_w, mcu_h);
+            printf("Reduce 1/%d applied:  (w, h) = (%d, %d), (virtual) (mcu_w, mcu_h) = (%d, %d)\n", 1 << reduce, src_w, src_h, mcu_w, mcu_h);
         }
         #endif // DEBUG_IMAGE_FITTER
-   }
+    }
     // Calculate MCU 2's Accumulation Count
-    int mcu_2s_accum_cnt = 0;
+    mcu_2s_accum_cnt = 0;
     {
         while (1) {
             if (!resizeFit) break;
@@ -131,160 +156,297 @@ void ImageFitter::loadJpeg(bool reduce)
         }
         #endif // DEBUG_IMAGE_FITTER
     }
-    // Horizontal ratio
-    int16_t mod_x_pls;
-    uint16_t target_w;
+    setupFit();
+    return !resizeFit || setupResample(mcu_h);
+}
+
+// calculate fitting parameters from src_w, src_h
+void ImageFitter::setupFit()
+{
     if (!keepAspectRatio || src_h*width < src_w*height) {
-        mod_x_pls = src_w;
         target_w = width;
     } else {
-        //mod_x_pls = src_w * height / src_h;
-        mod_x_pls = src_w;
         target_w = src_w * height / src_h;
     }
-    // Vertical ratio
-    int16_t mod_y_pls;
-    uint16_t target_h;
     if (!keepAspectRatio || src_h*width >= src_w*height) {
-        mod_y_pls = src_h;
         target_h = height;
     } else {
-        //mod_y_pls = src_h * width / src_w;
-        mod_y_pls = src_h;
         target_h = src_h * width / src_w;
     }
+    if (target_w == 0) { target_w = 1; }
+    if (target_h == 0) { target_h = 1; }
     #ifdef DEBUG_IMAGE_FITTER
     {
-        printf("mod_x_pls, target_w = %d %d\n", mod_x_pls, target_w);
-        printf("mod_y_pls, target_h = %d %d\n", mod_y_pls, target_h);
+        printf("target_w, target_h = %d %d\n", target_w, target_h);
     }
     #endif // DEBUG_IMAGE_FITTER
-    int16_t mcu_y_prev = 0;
-    int16_t mod_y_start = 0;
-    int16_t plot_y_start = 0;
-    while (JpegDec.read()) {
-        // MCU 2's Accumulation
-        jpegMcu2sAccum(mcu_2s_accum_cnt, mcu_w, mcu_h, JpegDec.pImage);
-        int idx = 0;
-        int16_t x, y;
-        int16_t mcu_x = JpegDec.MCUx;
-        int16_t mcu_y = JpegDec.MCUy;
-        // prepare plot_y (, mod_y) condition
-        int16_t mod_y = 0;
-        int16_t plot_y = 0;
-        if (!resizeFit) {
-            plot_y = mcu_h * mcu_y;
-            if (plot_y >= height) continue; // don't use break because MCU order is not always left-to-right and top-to-bottom
-        } else {
-            if (mcu_y != mcu_y_prev) {
-                for (y = 0; y < mcu_h * mcu_y; y++) {
-                    while (mod_y <= 0) {
-                        mod_y += mod_y_pls;
-                        plot_y++;
-                    }
-                    mod_y -= target_h;
-                }
-                // memorize plot_y (, mod_y) start condition
-                mcu_y_prev = mcu_y;
-                mod_y_start = mod_y;
-                plot_y_start = plot_y;
-            } else {
-                // reuse plot_y (, mod_y) start condition
-                mod_y = mod_y_start;
-                plot_y = plot_y_start;
+    line_plot_y = 0;
+    h_scan = nullptr;
+    h_lines = nullptr;
+    v_accum = nullptr;
+}
+
+// prepare resampler for source lines processed together (MCU height), returns false if image pool is exhausted
+bool ImageFitter::setupResample(uint16_t lines)
+{
+    h_step = target_w * ResampleUnit / src_w;
+    h_rem_step = target_w * ResampleUnit % src_w;
+    v_step = target_h * ResampleUnit / src_h;
+    v_rem_step = target_h * ResampleUnit % src_h;
+    h_scan = mem_pool_new<resample_t>(MEM_POOL_IMAGE, lines);
+    h_lines = mem_pool_new<uint16_t>(MEM_POOL_IMAGE, target_w * lines);
+    v_accum = mem_pool_new<uint32_t>(MEM_POOL_IMAGE, target_w);
+    if (h_scan == nullptr || h_lines == nullptr || v_accum == nullptr) {
+        freeResample();
+        return false;
+    }
+    memset(h_scan, 0, sizeof(resample_t) * lines);
+    memset(&v_scan, 0, sizeof(v_scan));
+    memset(v_accum, 0, sizeof(uint32_t) * target_w);
+    return true;
+}
+
+void ImageFitter::freeResample()
+{
+    mem_pool_free(MEM_POOL_IMAGE, h_scan);
+    mem_pool_free(MEM_POOL_IMAGE, h_lines);
+    mem_pool_free(MEM_POOL_IMAGE, v_accum);
+    h_scan = nullptr;
+    h_lines = nullptr;
+    v_accum = nullptr;
+}
+
+// area-average n source pixels (continued from previous call for the line) into dst
+void ImageFitter::resampleH(resample_t& s, const uint16_t *src, int n, uint16_t *dst)
+{
+    for (int i = 0; i < n; i++) {
+        uint32_t pix = spreadPixel(src[i]);
+        uint32_t pos1 = s.pos + h_step;
+        s.rem += h_rem_step;
+        if (s.rem >= src_w) {
+            s.rem -= src_w;
+            pos1++;
+        }
+        while (s.pos < pos1 && s.out < target_w) {
+            uint32_t bound = (s.out + 1) * ResampleUnit;
+            uint32_t end = (pos1 < bound) ? pos1 : bound;
+            s.sum += (end - s.pos) * pix;
+            s.pos = end;
+            if (end == bound) {
+                dst[s.out++] = packPixel(s.sum);
+                s.sum = 0;
             }
         }
-        int16_t mod_x_start = 0;
-        int16_t plot_x_start = 0;
-        for (int16_t mcu_ofs_y = 0; mcu_ofs_y < mcu_h; mcu_ofs_y++) {
-            y = mcu_h * mcu_y + mcu_ofs_y;
-            if (y >= src_h) break;
-            int16_t mod_x = 0;
-            int16_t plot_x = 0;
-            // prepare plot_x (, mod_x) condition
-            if (!resizeFit) {
-                plot_x = mcu_w * mcu_x;
-                if (plot_x >= width) break;
-            } else {
-                if (mcu_ofs_y == 0) {
-                    for (x = 0; x < mcu_w * mcu_x; x++) {
-                        while (mod_x <= 0) {
-                            mod_x += mod_x_pls;
-                            plot_x++;
-                        }
-                        mod_x -= target_w;
-                    }
-                    // memorize plot_x (, mod_x) start condition
-                    mod_x_start = mod_x;
-                    plot_x_start = plot_x;
-                } else {
-                    // reuse plot_x (, mod_x) start condition
-                    mod_x = mod_x_start;
-                    plot_x = plot_x_start;
-                }
+        s.pos = pos1;
+    }
+}
+
+// area-average horizontally resampled line into target lines of img_rgb565
+void ImageFitter::resampleV(const uint16_t *line)
+{
+    resample_t& s = v_scan;
+    uint32_t pos1 = s.pos + v_step;
+    s.rem += v_rem_step;
+    if (s.rem >= src_h) {
+        s.rem -= src_h;
+        pos1++;
+    }
+    while (s.pos < pos1 && s.out < target_h) {
+        uint32_t bound = (s.out + 1) * ResampleUnit;
+        uint32_t end = (pos1 < bound) ? pos1 : bound;
+        uint32_t w = end - s.pos;
+        uint16_t *dst = &img_rgb565[target_w*s.out];
+        if (w == ResampleUnit) { // whole target line from this line
+            for (int16_t x = 0; x < target_w; x++) {
+                dst[x] = swapPixel(line[x]);
             }
-            // actual plot_x
-            for (int16_t mcu_ofs_x = 0; mcu_ofs_x < mcu_w; mcu_ofs_x++) {
-                x = mcu_w * mcu_x + mcu_ofs_x;
-                if (x >= src_w) {
-                    idx += mcu_w - src_w%mcu_w; // skip horizontal padding area
-                    break;
-                }
-                if (!resizeFit) {
-                    if (plot_x >= width) break;
-                    #ifdef IMAGE_FITTER_SWAP_BYTES
-                    {
-                        uint16_t pix = JpegDec.pImage[idx];
-                        img_rgb565[width*plot_y+plot_x] = ((pix & 0xff00) >> 8) | ((pix & 0x00ff) << 8);
-
-                    }
-                    #else
-                    img_rgb565[width*plot_y+plot_x] = JpegDec.pImage[idx];
-                    #endif // IMAGE_DECODER_SWAP_BYTES
-                    if (plot_x+1 > img_w) { img_w = plot_x+1; }
-                    plot_x++;
-                } else {
-                    if (mod_y <= 0) {
-                        while (mod_x <= 0) {
-                            if (plot_x >= target_w) break;
-                            #ifdef IMAGE_FITTER_SWAP_BYTES
-                            {
-                                uint16_t pix = JpegDec.pImage[idx];
-                                img_rgb565[target_w*plot_y+plot_x] = ((pix & 0xff00) >> 8) | ((pix & 0x00ff) << 8);
-
-                            }
-                            #else
-                            img_rgb565[target_w*plot_y+plot_x] = JpegDec.pImage[idx];
-                            #endif // IMAGE_DECODER_SWAP_BYTES
-                            if (plot_x+1 > img_w) { img_w = plot_x+1; }
-                            mod_x += mod_x_pls;
-                            plot_x++;
-                        }
-                        mod_x -= target_w;
-                    }
-                }
-                idx++;
+        } else if (end == bound) { // last part of target line
+            for (int16_t x = 0; x < target_w; x++) {
+                dst[x] = swapPixel(packPixel(v_accum[x] + w * spreadPixel(line[x])));
+                v_accum[x] = 0;
             }
-            if (!resizeFit) {
-                if (plot_y+1 > img_h) { img_h = plot_y+1; }
-                plot_y++;
-                if (plot_y >= target_h) break;
-            } else {
-                while (mod_y <= 0) { // repeat previous line in case of expanding
-                    if (plot_y+1 > img_h) { img_h = plot_y+1; }
-                    mod_y += mod_y_pls;
-                    plot_y++;
-                    if (plot_y >= target_h) break;
-                    if (mod_y <= 0) {
-                        for (x = plot_x_start; x < plot_x; x++) {
-                            img_rgb565[target_w*plot_y+x] = img_rgb565[target_w*(plot_y-1)+x];
-                        }
-                    }
-                }
-                mod_y -= target_h;
+        } else {
+            for (int16_t x = 0; x < target_w; x++) {
+                v_accum[x] += w * spreadPixel(line[x]);
+            }
+        }
+        s.pos = end;
+        if (end == bound) { s.out++; }
+    }
+    s.pos = pos1;
+    img_w = target_w;
+    img_h = s.out;
+}
+
+// plot current MCU of JpegDec into img_rgb565
+void ImageFitter::plotJpegMcu()
+{
+    // MCU 2's Accumulation
+    jpegMcu2sAccum(mcu_2s_accum_cnt, mcu_w, mcu_h, JpegDec.pImage);
+    int16_t mcu_x = JpegDec.MCUx;
+    int16_t mcu_y = JpegDec.MCUy;
+    if (resizeFit) {
+        // horizontal per MCU, then vertical at the last MCU of MCU row (MCUs come in raster order)
+        int n = src_w - mcu_w * mcu_x;
+        if (n > mcu_w) { n = mcu_w; }
+        for (int16_t mcu_ofs_y = 0; mcu_ofs_y < mcu_h && n > 0; mcu_ofs_y++) {
+            uint16_t pix[16]; // mcu_w is 16 at most
+            for (int i = 0; i < n; i++) {
+                pix[i] = JpegDec.pImage[mcu_w*mcu_ofs_y+i];
+                #ifdef IMAGE_DECODER_SWAP_BYTES
+                pix[i] = ((pix[i] & 0xff00) >> 8) | ((pix[i] & 0x00ff) << 8);
+                #endif // IMAGE_DECODER_SWAP_BYTES
             }
+            resampleH(h_scan[mcu_ofs_y], pix, n, &h_lines[target_w*mcu_ofs_y]);
         }
+        if (mcu_x == JpegDec.MCUSPerRow - 1) {
+            for (int16_t mcu_ofs_y = 0; mcu_ofs_y < mcu_h && mcu_h * mcu_y + mcu_ofs_y < src_h; mcu_ofs_y++) {
+                resampleV(&h_lines[target_w*mcu_ofs_y]);
+            }
+            memset(h_scan, 0, sizeof(resample_t) * mcu_h);
+        }
+        return;
+    }
+    int16_t plot_y = mcu_h * mcu_y;
+    if (plot_y >= height) return; // don't stop the job because MCU order is not always left-to-right and top-to-bottom
+    for (int16_t mcu_ofs_y = 0; mcu_ofs_y < mcu_h; mcu_ofs_y++) {
+        int16_t y = mcu_h * mcu_y + mcu_ofs_y;
+        if (y >= src_h || plot_y >= height) break;
+        int16_t plot_x = mcu_w * mcu_x;
+        for (int16_t mcu_ofs_x = 0; mcu_ofs_x < mcu_w; mcu_ofs_x++) {
+            int16_t x = mcu_w * mcu_x + mcu_ofs_x;
+            if (x >= src_w || plot_x >= width) break;
+            img_rgb565[width*plot_y+plot_x] = swapPixel(JpegDec.pImage[mcu_w*mcu_ofs_y+mcu_ofs_x]);
+            if (plot_x+1 > img_w) { img_w = plot_x+1; }
+            plot_x++;
+        }
+        if (plot_y+1 > img_h) { img_h = plot_y+1; }
+        plot_y++;
     }
+}
+
+// calculate fitting parameters of PNG decode job
+bool ImageFitter::setupPng()
+{
+    src_w = PngDec.width;
+    src_h = PngDec.height;
+    #ifdef DEBUG_IMAGE_FITTER
+    { // DEBUG
+        printf("PNG info: (w, h) = (%d, %d)\n", src_w, src_h);
+    }
+    #endif // DEBUG_IMAGE_FITTER
+    // Calculate 2's Accumulation Count of lines
+    png_shrink = 0;
+    while (resizeFit && png_shrink < MaxPngShrink) {
+        if (keepAspectRatio) {
+            if (src_w <= width * 2 && src_h <= height * 2) break;
+        } else {
+            if (src_w <= width * 2 || src_h <= height * 2) break;
+        }
+        src_w /= 2;
+        src_h /= 2;
+        png_shrink++;
+    }
+    png_row = 0;
+    png_accum = nullptr;
+    if (png_shrink > 0) {
+        png_accum = mem_pool_new<uint16_t>(MEM_POOL_IMAGE, src_w * 4);
+        if (png_accum == nullptr) { return false; }
+        memset(png_accum, 0, src_w * 3 * sizeof(uint16_t));
+        #ifdef DEBUG_IMAGE_FITTER
+        { // DEBUG
+            printf("Accumulated %d times: (w, h) = (%d, %d)\n", png_shrink, src_w, src_h);
+        }
+        #endif // DEBUG_IMAGE_FITTER
+    }
+    setupFit();
+    return !resizeFit || setupResample(1);
+}
+
+#if PICO_ON_DEVICE
+// interp0 unpacks R (lane0) and G (lane1 crossed from ACCUM0) of RGB565 written once into ACCUM0
+static void setupInterpRgb565()
+{
+    interp_config cfg = interp_default_config();
+    interp_config_set_shift(&cfg, 11);
+    interp_config_set_mask(&cfg, 0, 4);
+    interp_set_config(interp0, 0, &cfg);
+    cfg = interp_default_config();
+    interp_config_set_cross_input(&cfg, true);
+    interp_config_set_shift(&cfg, 5);
+    interp_config_set_mask(&cfg, 0, 5);
+    interp_set_config(interp0, 1, &cfg);
+    interp0->base[0] = 0;
+    interp0->base[1] = 0;
+}
+#endif // PICO_ON_DEVICE
+
+// accumulate PNG line into png_accum then plot every (1 << png_shrink) lines
+void ImageFitter::accumPngLine(const uint16_t *line)
+{
+    int n = 1 << png_shrink;
+    uint16_t *acc = png_accum;
+    #if PICO_ON_DEVICE
+    interp_hw_save_t saved;
+    interp_save(interp0, &saved);  // interp0 of this core is shared with other users
+    setupInterpRgb565();
+    #endif // PICO_ON_DEVICE
+    for (int16_t x = 0; x < src_w; x++) {
+        uint32_t r = 0, g = 0, b = 0;
+        for (int i = 0; i < n; i++) {
+            uint16_t pix = *line++;
+            #if PICO_ON_DEVICE
+            interp0->accum[0] = pix;
+            r += interp0->peek[0];
+            g += interp0->peek[1];
+            #else
+            r += pix >> 11;
+            g += (pix >> 5) & 0x3f;
+            #endif // PICO_ON_DEVICE
+            b += pix & 0x1f;
+        }
+        acc[0] += r;
+        acc[1] += g;
+        acc[2] += b;
+        acc += 3;
+    }
+    #if PICO_ON_DEVICE
+    interp_restore(interp0, &saved);
+    #endif // PICO_ON_DEVICE
+    if ((png_row & (n - 1)) != n - 1) { return; }
+    uint16_t *shrunk = &png_accum[src_w * 3];
+    int shift = png_shrink * 2;
+    acc = png_accum;
+    for (int16_t x = 0; x < src_w; x++) {
+        shrunk[x] = (uint16_t) (((acc[0] >> shift) << 11) | ((acc[1] >> shift) << 5) | (acc[2] >> shift));
+        acc += 3;
+    }
+    memset(png_accum, 0, src_w * 3 * sizeof(uint16_t));
+    if (png_row / n < src_h) { plotLine(shrunk); }
+}
+
+// plot line of src_w pixels (RGB565) as next line, returns false if no more line is needed
+bool ImageFitter::plotLine(const uint16_t *line)
+{
+    if (resizeFit) {
+        resampleH(h_scan[0], line, src_w, h_lines);
+        memset(h_scan, 0, sizeof(resample_t));
+        resampleV(h_lines);
+        return v_scan.out < target_h;
+    }
+    if (line_plot_y >= height) { return false; }
+    int16_t x;
+    for (x = 0; x < src_w && x < width; x++) {
+        img_rgb565[width*line_plot_y+x] = swapPixel(line[x]);
+    }
+    if (x > img_w) { img_w = x; }
+    line_plot_y++;
+    if (line_plot_y > img_h) { img_h = line_plot_y; }
+    return line_plot_y < height;
+}
+
+void ImageFitter::finishFit()
+{
     #ifdef DEBUG_IMAGE_FITTER
     { // DEBUG
         printf("Resized to (img_w, img_h) = (%d, %d)\n", img_w, img_h);
@@ -297,28 +459,119 @@ void ImageFitter::loadJpeg(bool reduce)
     }
 }
 
-// load from JPEG File
-bool ImageFitter::loadJpegFile(const char *filename, const uint64_t pos, const size_t size)
+// start JPEG decode job
+bool ImageFitter::startJpegFile(const char *filename, const uint64_t pos, const size_t size)
 {
     int decoded;
-    bool reduce = false;
+    uint8_t reduce = 0;
+    abortDecode();
+    if (img_rgb565 == NULL) { return false; }
     decoded = JpegDec.decodeSdFile(filename, pos, size, 0); // reduce == 0
-    if (decoded <= 0) { return false; }
+    if (decoded <= 0) { JpegDec.abort(); return false; }
     src_w = JpegDec.width;
     src_h = JpegDec.height;
-    if (resizeFit && (
-        (keepAspectRatio && (src_w >= width*8 && src_h >= height*8)) ||
-        (!keepAspectRatio && (src_w >= width*8 || src_h >= height*8))
-    )) { // Use reduce decode for x8 larger image
-        reduce = true;
+    // Use scaled decode (1/2, 1/4, 1/8) as long as the decoded image still covers the ImageBox
+    while (resizeFit && reduce < MaxJpegReduce) {
+        uint8_t r = reduce + 1;
+        if (keepAspectRatio) {
+            if (!(src_w >= (width << r) && src_h >= (height << r))) { break; }
+        } else {
+            if (!(src_w >= (width << r) || src_h >= (height << r))) { break; }
+        }
+        reduce = r;
+    }
+    if (reduce > 0) {
         JpegDec.abort();
-        decoded = JpegDec.decodeSdFile(filename, pos, size, 1); // reduce == 1
-        if (decoded <= 0) { return false; }
+        decoded = JpegDec.decodeSdFile(filename, pos, size, reduce);
+        if (decoded <= 0) { JpegDec.abort(); return false; }
     }
     img_w = 0;
     img_h = 0;
-    loadJpeg(reduce);
-    JpegDec.abort();
+    job = JobJpeg;
+    if (!setupJpeg(reduce)) { abortDecode(); return false; }
+    return true;
+}
+
+// start PNG decode job
+bool ImageFitter::startPngFile(const char *filename, const uint64_t pos, const size_t size)
+{
+    abortDecode();
+    if (img_rgb565 == NULL) { return false; }
+    if (PngDec.decodeSdFile(filename, pos, size) <= 0) { return false; }
+    img_w = 0;
+    img_h = 0;
+    job = JobPng;
+    if (!setupPng()) { abortDecode(); return false; }
+    return true;
+}
+
+// decode MCUs (JPEG) or lines (PNG) for budgetUs at least one of them, returns true while the job continues
+bool ImageFitter::stepDecode(uint32_t budgetUs)
+{
+    uint32_t startUs = time_us_32();
+    if (job == JobJpeg) {
+        while (JpegDec.read()) {
+            plotJpegMcu();
+            if (time_us_32() - startUs >= budgetUs) { return true; }
+        }
+        // JpegDec has been closed by read()
+    } else if (job == JobPng) {
+        const uint16_t *line;
+        while ((line = PngDec.readLine()) != nullptr) {
+            bool more = true;
+            if (png_shrink > 0) {
+                accumPngLine(line);
+                more = v_scan.out < target_h;
+            } else {
+                more = plotLine(line);
+            }
+            png_row++;
+            if (!more) { break; }
+            if (time_us_32() - startUs >= budgetUs) { return true; }
+        }
+        PngDec.abort();
+        mem_pool_free(MEM_POOL_IMAGE, png_accum);
+        png_accum = nullptr;
+    } else {
+        return false;
+    }
+    freeResample();
+    finishFit();
+    job = JobNone;
+    return false;
+}
+
+void ImageFitter::abortDecode()
+{
+    if (job == JobJpeg) {
+        JpegDec.abort();
+    } else if (job == JobPng) {
+        PngDec.abort();
+        mem_pool_free(MEM_POOL_IMAGE, png_accum);
+        png_accum = nullptr;
+    }
+    freeResample();
+    job = JobNone;
+}
+
+bool ImageFitter::isBusy() const
+{
+    return job != JobNone;
+}
+
+// load from JPEG File
+bool ImageFitter::loadJpegFile(const char *filename, const uint64_t pos, const size_t size)
+{
+    if (!startJpegFile(filename, pos, size)) { return false; }
+    while (stepDecode(UINT32_MAX)) {}
+    return true;
+}
+
+// load from PNG File
+bool ImageFitter::loadPngFile(const char *filename, const uint64_t pos, const size_t size)
+{
+    if (!startPngFile(filename, pos, size)) { return false; }
+    while (stepDecode(UINT32_MAX)) {}
     return true;
 }
 
@@ -19,6 +19,8 @@
 //=================================
 class ImageFitter {
 private:
+    static constexpr uint8_t MaxJpegReduce = 3; // 1/8 scaled decode of JPEG
+    static constexpr uint8_t MaxPngShrink = 4; // 1/16 accumulation of PNG lines (keeps sums in 16 bit)
 	uint16_t width, height; // ImageBox dimension
     uint16_t *img_rgb565;
     uint16_t img_w, img_h; // dimention of image stored
@@ -26,15 +28,60 @@ private:
     bool resizeFit; // true: resize to fit ImageBox size, false: original size (1:1)
     bool keepAspectRatio; // keep Aspect Ratio when resizeFit == true
     bool packHBlank; // pack (delete) Horizontal Blank if width > img_w
+    // decode job
+    typedef enum {
+        JobNone = 0,
+        JobJpeg,
+        JobPng
+    } job_t;
+    job_t job = JobNone;
+    uint16_t mcu_w, mcu_h; // MCU dimension after reduce and 2's accumulation
+    int mcu_2s_accum_cnt;
+    uint16_t target_w, target_h;
+    int16_t line_plot_y; // for line by line plot of original size
+    // area-average resampler (resizeFit): coverage of source pixel is counted in 1/ResampleUnit of target pixel
+    static constexpr uint32_t ResampleUnit = 32; // weights up to 32 keep R, G and B sums apart in one 32bit word
+    typedef struct {
+        uint16_t out; // target pixel (or line) in progress
+        uint16_t rem; // remainder of pos
+        uint32_t pos; // start of current source pixel
+        uint32_t sum; // partial sum of target pixel in spread RGB565
+    } resample_t;
+    uint32_t h_step, v_step;
+    uint16_t h_rem_step, v_rem_step;
+    resample_t *h_scan; // horizontal state per line of MCU row
+    uint16_t *h_lines; // horizontally resampled lines of MCU row
+    resample_t v_scan;
+    uint32_t *v_accum; // partial sums of target line in spread RGB565
+    uint8_t png_shrink; // 2's accumulation count of PNG lines
+    uint16_t png_row;
+    uint16_t *png_accum; // R, G, B sums of shrinking line followed by shrunk line
     ImageFitter();
     virtual ~ImageFitter();
     ImageFitter(const ImageFitter&) = delete;
 	ImageFitter& operator=(const ImageFitter&) = delete;
     void jpegMcu2sAccum(int count, uint16_t mcu_w, uint16_t mcu_h, uint16_t *pImage);
-    void loadJpeg(bool reduce);
+    void setupFit();
+    bool setupResample(uint16_t lines);
+    void freeResample();
+    void resampleH(resample_t& s, const uint16_t *src, int n, uint16_t *dst);
+    void resampleV(const uint16_t *line);
+    bool setupJpeg(uint8_t reduce);
+    void plotJpegMcu();
+    bool setupPng();
+    void accumPngLine(const uint16_t *line);
+    bool plotLine(const uint16_t *line);
+    void finishFit();
 public:
     static ImageFitter& instance(); // Singleton
     void config(uint16_t *img_rgb565, uint16_t width, uint16_t height, bool resizeFit = true, bool keepAspectRatio = true, bool packHBlank = false);
     bool loadJpegFile(const char *filename, const uint64_t pos = 0, const size_t size = 0);
+    bool loadPngFile(const char *filename, const uint64_t pos = 0, const size_t size = 0);
+    // resumable decode (startJpegFile() or startPngFile() then stepDecode() until it returns false)
+    bool startJpegFile(const char *filename, const uint64_t pos = 0, const size_t size = 0);
+    bool startPngFile(const char *filename, const uint64_t pos = 0, const size_t size = 0);
+    bool stepDecode(uint32_t budgetUs);
+    void abortDecode();
+    bool isBusy() const;
     void getSizeAfterFit(uint16_t *img_w, uint16_t *img_h);
 };
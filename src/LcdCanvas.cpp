@@ -13,6 +13,8 @@
 
 #include "ImageFitter.h"
 #include "LcdCanvasIcon.h"
+#include "mem_budget.h"
+#include "profiler.h"
 
 uint8_t* ICON2PTR(IconIndex_t index)
 {
@@ -29,7 +31,7 @@ void BatteryIconBox::draw()
 {
     if (!isUpdated) { return; }
     isUpdated = false;
-    clear();
+    clearOnce();
     LCD_ShowIcon(pos_x, pos_y, icon, !bgOpaque, fgColor);
     if (isCharging) {
         LCD_Fill(pos_x+4, pos_y+13-level/10, pos_x+4+8-1, pos_y+13-level/10+level/10+1-1, 0x07ff);
@@ -156,13 +158,14 @@ LcdCanvas& LcdCanvas::instance()
     static LcdCanvas* instance = nullptr; // Singleton
     if (instance == nullptr) {
         instance = new LcdCanvas();
+        mem_budget_reserve("lcd", sizeof(LcdCanvas) + LCD_W() * LCD_H() * sizeof(uint16_t));  // with ImageBox frame
     }
     return *instance;
 }
 
 void LcdCanvas::switchToOpening()
 {
-    clear(true);
+    clearAtNextDraw(true);
     msg.setText("");
     for (int i = 0; i < (int) (sizeof(groupOpening)/sizeof(*groupOpening)); i++) {
         groupOpening[i]->update();
@@ -171,7 +174,7 @@ void LcdCanvas::switchToOpening()
 
 void LcdCanvas::switchToListView()
 {
-    clear(true);
+    clearAtNextDraw(true);
     msg.setText("");
     battery.setBgOpaque(true);
     for (int i = 0; i < (int) (sizeof(groupListView)/sizeof(*groupListView)); i++) {
@@ -181,7 +184,7 @@ void LcdCanvas::switchToListView()
 
 void LcdCanvas::switchToPlay()
 {
-    clear(false);
+    clearAtNextDraw(false);
     msg.setText("");
     battery.setBgOpaque(false);
     for (int i = 0; i < (int) (sizeof(groupPlay)/sizeof(*groupPlay)); i++) {
@@ -198,7 +201,7 @@ void LcdCanvas::switchToPlay()
 
 void LcdCanvas::switchToPowerOff()
 {
-    clear(true);
+    clearAtNextDraw(true);
     for (int i = 0; i < (int) (sizeof(groupPowerOff)/sizeof(*groupPowerOff)); i++) {
         groupPowerOff[i]->update();
     }
@@ -209,6 +212,12 @@ void LcdCanvas::clear(bool bgOpaque)
     LCD_FillBackground(0, 0, LCD_W()-1, LCD_H()-1, !bgOpaque, LCD_BLACK);
 }
 
+// full screen clear handed to compositor to be merged with clear of elements
+void LcdCanvas::clearAtNextDraw(bool bgOpaque)
+{
+    compositor.addFill(0, 0, LCD_W()-1, LCD_H()-1, !bgOpaque, LCD_BLACK);
+}
+
 void LcdCanvas::setRotation(uint8_t rot)
 {
     LCD_SetRotation(rot);
@@ -216,13 +225,23 @@ void LcdCanvas::setRotation(uint8_t rot)
 
 void LcdCanvas::drawOpening()
 {
+    for (int i = 0; i < (int) (sizeof(groupOpening)/sizeof(*groupOpening)); i++) {
+        groupOpening[i]->collectFill(compositor);
+        if (groupOpening[i]->isDrawing()) { break; } // elements above are deferred until image is pushed
+    }
+    compositor.flush();
     for (int i = 0; i < (int) (sizeof(groupOpening)/sizeof(*groupOpening)); i++) {
         groupOpening[i]->draw();
+        if (groupOpening[i]->isDrawing()) { break; }
     }
 }
 
 void LcdCanvas::drawListView()
 {
+    for (int i = 0; i < (int) (sizeof(groupListView)/sizeof(*groupListView)); i++) {
+        groupListView[i]->collectFill(compositor);
+    }
+    compositor.flush();
     for (int i = 0; i < (int) (sizeof(groupListView)/sizeof(*groupListView)); i++) {
         groupListView[i]->draw();
     }
@@ -230,15 +249,30 @@ void LcdCanvas::drawListView()
 
 void LcdCanvas::drawPlay()
 {
+    bool isMode0 = play_count % play_cycle < play_change || !image.hasImage();
+    for (int i = 0; i < (int) (sizeof(groupPlay)/sizeof(*groupPlay)); i++) {
+        groupPlay[i]->collectFill(compositor);
+    }
+    if (isMode0) {
+        for (int i = 0; i < (int) (sizeof(groupPlay0)/sizeof(*groupPlay0)); i++) {
+            groupPlay0[i]->collectFill(compositor);
+        }
+    } else {
+        for (int i = 0; i < (int) (sizeof(groupPlay1)/sizeof(*groupPlay1)); i++) {
+            groupPlay1[i]->collectFill(compositor);
+        if (groupPlay1[i]->isDrawing()) { break; } // elements above are deferred until image is pushed
+        }
+    }
+    compositor.flush();
     for (int i = 0; i < (int) (sizeof(groupPlay)/sizeof(*groupPlay)); i++) {
         groupPlay[i]->draw();
     }
-    if (play_count % play_cycle < play_change || !image.hasImage()) { // Play mode 0 display
+    if (isMode0) { // Play mode 0 display
         for (int i = 0; i < (int) (sizeof(groupPlay0)/sizeof(*groupPlay0)); i++) {
             groupPlay0[i]->draw();
         }
         if (play_count % play_cycle == play_change-1 && image.hasImage()) { // Play mode 0 -> 1
-            clear(false);
+            clearAtNextDraw(false);
             for (int i = 0; i < (int) (sizeof(groupPlay)/sizeof(*groupPlay)); i++) {
                 groupPlay[i]->update();
             }
@@ -249,9 +283,10 @@ void LcdCanvas::drawPlay()
     } else { // Play mode 1 display
         for (int i = 0; i < (int) (sizeof(groupPlay1)/sizeof(*groupPlay1)); i++) {
             groupPlay1[i]->draw();
+        if (groupPlay1[i]->isDrawing()) { break; }
         }
         if (play_count % play_cycle == play_cycle-1) { // Play mode 1 -> 0
-            clear(false);
+            clearAtNextDraw(false);
             for (int i = 0; i < (int) (sizeof(groupPlay)/sizeof(*groupPlay)); i++) {
                 groupPlay[i]->update();
             }
@@ -265,6 +300,10 @@ void LcdCanvas::drawPlay()
 
 void LcdCanvas::drawPowerOff()
 {
+    for (int i = 0; i < (int) (sizeof(groupPowerOff)/sizeof(*groupPowerOff)); i++) {
+        groupPowerOff[i]->collectFill(compositor);
+    }
+    compositor.flush();
     for (int i = 0; i < (int) (sizeof(groupPowerOff)/sizeof(*groupPowerOff)); i++) {
         groupPowerOff[i]->draw();
     }
@@ -272,19 +311,76 @@ void LcdCanvas::drawPowerOff()
 
 void LcdCanvas::setImageJpeg(const char* filename, const uint64_t pos, const size_t size)
 {
+    PROF_SCOPE("image", "setImageJpeg");
+    requestImageJpeg(filename, pos, size);
+    while (stepImage(UINT32_MAX)) {}
+}
+
+void LcdCanvas::requestImageJpeg(const char* filename, const uint64_t pos, const size_t size)
+{
+    requestImage(filename, pos, size, false);
+}
+
+void LcdCanvas::requestImagePng(const char* filename, const uint64_t pos, const size_t size)
+{
+    requestImage(filename, pos, size, true);
+}
+
+void LcdCanvas::requestImage(const char* filename, const uint64_t pos, const size_t size, bool isPng)
+{
+    imgFit.abortDecode();
+    strncpy(imageFilename, filename, sizeof(imageFilename) - 1);
+    imageFilename[sizeof(imageFilename) - 1] = '\0';
+    imagePos = pos;
+    imageSize = size;
+    imageIsPng = isPng;
+    imageJob = ImageRequested;
+}
+
+bool LcdCanvas::stepImage(uint32_t budgetUs)
+{
+    PROF_SCOPE("image", "stepImage");
     uint16_t* img_ptr;
     uint16_t w, h;
     image.getImagePtr(&img_ptr, &w, &h);
-    imgFit.config(img_ptr, w, h);
-    imgFit.loadJpegFile(filename, pos, size);
-    imgFit.getSizeAfterFit(&w, &h);
-    image.setImageSize(w, h);
-    image.update();
+    CoverCache& cache = CoverCache::instance();
+    if (imageJob == ImageRequested) {
+        imageJob = ImageIdle;
+        hasJobKey = cache.makeKey(imageFilename, imagePos, imageSize, w, h, jobKey);
+        if (hasJobKey && hasImageKey && CoverCache::isSame(jobKey, imageKey) && image.hasImage()) { return false; }  // already shown
+        hasImageKey = false;
+        if (hasJobKey && cache.load(jobKey, img_ptr, &w, &h)) {
+            image.setImageSize(w, h);
+            imageKey = jobKey;
+            hasImageKey = true;
+            return false;
+        }
+        image.resetImage();  // not to show image under decoding
+        imgFit.config(img_ptr, w, h);
+        bool started = imageIsPng ? imgFit.startPngFile(imageFilename, imagePos, imageSize) : imgFit.startJpegFile(imageFilename, imagePos, imageSize);
+        if (!started) { return false; }
+        imageJob = ImageDecoding;
+        return true;
+    } else if (imageJob == ImageDecoding) {
+        if (imgFit.stepDecode(budgetUs)) { return true; }
+        imageJob = ImageIdle;
+        imgFit.getSizeAfterFit(&w, &h);
+        image.setImageSize(w, h);
+        if (hasJobKey) {
+            cache.store(jobKey, img_ptr, w, h);
+            imageKey = jobKey;
+            hasImageKey = true;
+        }
+    }
+    return false;
 }
 
 void LcdCanvas::resetImage()
 {
+    imgFit.abortDecode();
+    imageJob = ImageIdle;
     image.resetImage();
+    hasImageKey = false;
 }
 
 void LcdCanvas::setMsg(const char* str, bool blink)
@@ -294,11 +390,16 @@ void LcdCanvas::setMsg(const char* str, bool blink)
 }
 
 void LcdCanvas::setListItem(int column, const char* str, const IconIndex_t index, bool isFocused)
+{
+    setListItemStyle(column, index, isFocused);
+    listItem[column].setText(str);
+}
+
+void LcdCanvas::setListItemStyle(int column, const IconIndex_t index, bool isFocused)
 {
     uint16_t color[2] = {LCD_GRAY, LCD_GBLUE};
     listItem[column].setIcon(ICON2PTR(index));
     listItem[column].setFgColor(color[isFocused]);
-    listItem[column].setText(str);
     listItem[column].setScroll(isFocused); // Scroll for focused item only
 }
 
@@ -353,6 +454,11 @@ void LcdCanvas::setTrack(const char* str)
     track.setText(str);
 }
 
+void LcdCanvas::setTrack(uint16_t trackNum, uint16_t numTracks)
+{
+    track.setFormatText("%d/%d", trackNum, numTracks);
+}
+
 void LcdCanvas::setTitle(const char* str)
 {
     title.setText(str);
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "CoverCache.h"
 #include "LcdElementBox.h"
 #include "LcdCanvasIconDef.h"
 #include "ui_control.h"
@@ -49,18 +50,32 @@ public:
     void clear(bool bgOpaque = false);
     void setRotation(uint8_t rot);
     void setImageJpeg(const char* filename, const uint64_t pos = 0, const size_t size = 0);
+    void requestImageJpeg(const char* filename, const uint64_t pos = 0, const size_t size = 0);  // decoded by stepImage()
+    void requestImagePng(const char* filename, const uint64_t pos = 0, const size_t size = 0);  // decoded by stepImage()
+    bool stepImage(uint32_t budgetUs);  // returns true while requested image is being decoded
     void resetImage();
     void setMsg(const char* str, bool blink = false);
     void setListItem(int column, const char* str, const IconIndex_t index = IconIndex_t::UNDEF, bool isFocused = false);
+    template <typename Writer>
+    void writeListItem(int column, Writer writer, const IconIndex_t index = IconIndex_t::UNDEF, bool isFocused = false)
+    {
+        setListItemStyle(column, index, isFocused);
+        listItem[column].writeText(writer);
+    }
     void setVolume(uint8_t value);
     void setAudioLevel(float levelL, float levelR);
     void setBitRes(uint16_t value);
     void setSampleFreq(uint32_t sampFreq);
     void setPlayTime(uint32_t posionSec, uint32_t lengthSec, bool blink = false);
     void setTrack(const char* str);
+    void setTrack(uint16_t trackNum, uint16_t numTracks);
     void setTitle(const char* str);
     void setAlbum(const char* str);
     void setArtist(const char* str);
+    // bool writer(char* str, size_t size) converts text straight into the text box buffer
+    template <typename Writer> void writeTitle(Writer writer) { title.writeText(writer); }
+    template <typename Writer> void writeAlbum(Writer writer) { album.writeText(writer); }
+    template <typename Writer> void writeArtist(Writer writer) { artist.writeText(writer); }
     //void setYear(const char* str);
     void setBatteryVoltage(const float& voltage);
     void switchToOpening();
@@ -77,7 +92,25 @@ protected:
     int play_count;
     const int play_cycle = 400;
     const int play_change = 350;
+    typedef enum {
+        ImageIdle = 0,
+        ImageRequested,
+        ImageDecoding
+    } image_job_t;
+    CoverCache::image_key_t imageKey;  // image shown in ImageBox
+    bool hasImageKey = false;
+    image_job_t imageJob = ImageIdle;
+    char imageFilename[256];
+    uint64_t imagePos;
+    size_t imageSize;
+    bool imageIsPng;
+    CoverCache::image_key_t jobKey;
+    bool hasJobKey = false;
     uint8_t bitSampIcon[32] = {};
+    LcdCompositor compositor;
+    void clearAtNextDraw(bool bgOpaque);
+    void requestImage(const char* filename, const uint64_t pos, const size_t size, bool isPng);
+    void setListItemStyle(int column, const IconIndex_t index, bool isFocused);
 #if defined(USE_ST7735S_160x80)
     IconScrollTextBox listItem[5] = {
         IconScrollTextBox(16*0, 16*0, nullptr, LCD_W(), FONT_HEIGHT, LCD_GRAY, LCD_BLACK, true),
@@ -0,0 +1,145 @@
+/*------------------------------------------------------/
+/ ResumeLog
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "ResumeLog.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "hardware/regs/addressmap.h"
+#include "pico/flash.h"
+
+extern char __flash_binary_end;  // defined by linker script
+
+//=====================================
+// Implementation of ResumeLog class
+//=====================================
+ResumeLog& ResumeLog::instance()
+{
+    static ResumeLog instance;
+    return instance;
+}
+
+uint32_t ResumeLog::checkOf(const record_t* rec)
+{
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(rec);
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < offsetof(record_t, check); i++) {
+        hash = (hash ^ ptr[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+void ResumeLog::programFunc(void* param)
+{
+    ResumeLog* self = static_cast<ResumeLog*>(param);
+    flash_range_program(self->flashOffset, self->buf.bytes, RECORD_SIZE);
+}
+
+void ResumeLog::eraseFunc(void* param)
+{
+    ResumeLog* self = static_cast<ResumeLog*>(param);
+    flash_range_erase(self->flashOffset, FLASH_SECTOR_SIZE);
+}
+
+const ResumeLog::record_t* ResumeLog::slot(uint32_t idx) const
+{
+    return reinterpret_cast<const record_t*>(XIP_BASE + REGION_OFFSET + RECORD_SIZE * idx);
+}
+
+bool ResumeLog::isValid(const record_t* rec) const
+{
+    return rec->magic == MAGIC && rec->check == checkOf(rec);
+}
+
+bool ResumeLog::isErased(uint32_t idx) const
+{
+    const uint32_t* ptr = reinterpret_cast<const uint32_t*>(slot(idx));
+    for (size_t i = 0; i < RECORD_SIZE / sizeof(uint32_t); i++) {
+        if (ptr[i] != 0xffffffffUL) { return false; }
+    }
+    return true;
+}
+
+void ResumeLog::initialize()
+{
+    enabled = (reinterpret_cast<uintptr_t>(&__flash_binary_end) - XIP_BASE <= REGION_OFFSET);
+    if (!enabled) {
+        printf("ERROR: ResumeLog region overlaps program\r\n");
+        return;
+    }
+    newest = -1;
+    seq = 0;
+    for (uint32_t i = 0; i < NUM_RECORDS; i++) {
+        const record_t* rec = slot(i);
+        if (isValid(rec) && (newest < 0 || static_cast<int32_t>(rec->seq - seq) > 0)) {
+            newest = i;
+            seq = rec->seq;
+        }
+    }
+    head = (newest < 0) ? 0 : (newest + 1) % NUM_RECORDS;
+}
+
+bool ResumeLog::load(checkpoint_t& cp) const
+{
+    if (!enabled || newest < 0) { return false; }
+    memcpy(&cp, &slot(newest)->cp, sizeof(checkpoint_t));
+    return true;
+}
+
+bool ResumeLog::store(const checkpoint_t& cp)
+{
+    if (!enabled) { return false; }
+    if (!isErased(head)) {  // full, wait for maintain()
+        if (!fullReported) { printf("ResumeLog: full, checkpoints are skipped until playback pauses, stops or changes track\r\n"); }
+        fullReported = true;
+        return false;
+    }
+    memset(buf.bytes, 0xff, sizeof(buf.bytes));  // padding is left unprogrammed
+    buf.record.magic = MAGIC;
+    buf.record.seq = seq + 1;
+    memcpy(&buf.record.cp, &cp, sizeof(checkpoint_t));
+    buf.record.check = checkOf(&buf.record);
+    flashOffset = REGION_OFFSET + RECORD_SIZE * head;
+    if (flash_safe_execute(programFunc, this, SafeExecTimeoutMs) != PICO_OK) { return false; }
+    if (!isValid(slot(head))) {  // skip the slot
+        head = (head + 1) % NUM_RECORDS;
+        return false;
+    }
+    newest = head;
+    seq++;
+    head = (head + 1) % NUM_RECORDS;
+    return true;
+}
+
+void ResumeLog::maintain()
+{
+    if (!enabled) { return; }
+    // rest of the sector of newest record is not erased (not written by this log), skip it
+    if (!isErased(head) && head % RECORDS_PER_SECTOR != 0) {
+        head = (head / RECORDS_PER_SECTOR + 1) % NUM_SECTORS * RECORDS_PER_SECTOR;
+    }
+    // erase the sector at head if the ring is full, otherwise the next sector of oldest records
+    // so that a whole sector is left for store() until next gap of playback
+    uint32_t target = isErased(head) ? (head / RECORDS_PER_SECTOR + 1) % NUM_SECTORS * RECORDS_PER_SECTOR : head;
+    if (isErased(target)) { return; }
+    flashOffset = REGION_OFFSET + RECORD_SIZE * target;
+    if (flash_safe_execute(eraseFunc, this, SafeExecTimeoutMs) != PICO_OK) { return; }
+    if (newest >= 0 && static_cast<uint32_t>(newest) / RECORDS_PER_SECTOR == target / RECORDS_PER_SECTOR) { newest = -1; }
+    fullReported = false;
+}
+
+void ResumeLog::close()
+{
+    if (!enabled) { return; }
+    checkpoint_t cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.closed = 1;
+    maintain();
+    store(cp);
+}
@@ -0,0 +1,86 @@
+/*------------------------------------------------------/
+/ ResumeLog
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hardware/flash.h"
+#include "file_menu_FatFs.h"
+
+#ifndef RESUME_LOG_FLASH_OFFSET
+// below the top 64KB of flash left for pico_flash_param
+#define RESUME_LOG_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - 128 * 1024)
+#endif
+
+//=================================
+// Interface of ResumeLog class
+//=================================
+// Journal of resume state checkpointed during playback so that power loss doesn't lose playing position
+// Records are appended into a ring of flash sectors without erase (program only),
+// the sector ahead of the one being filled is erased by maintain() in gaps of playback (stop, pause, between tracks)
+class ResumeLog
+{
+public:
+    static constexpr int MAX_STACK = 5;  // same as CFG_STACK_HEAD0 ~ CFG_STACK_HEAD4
+    typedef struct {
+        uint64_t playPos;
+        uint32_t samplesPlayed;
+        uint32_t uiMode;  // ui_mode_enm_t to resume
+        uint16_t idxHead;
+        uint16_t idxColumn;
+        uint16_t idxPlay;
+        uint8_t stackCount;
+        uint8_t closed;  // 1: state was stored to ConfigParam at power off (newer than this log)
+        uint16_t stackHead[MAX_STACK];  // stackHead[0]: top of dir_stack
+        uint16_t stackColumn[MAX_STACK];
+        char playPath[FILE_MENU_PATH_SIZE];  // "": none
+    } checkpoint_t;
+    static ResumeLog& instance(); // Singleton
+    void initialize();  // find newest record (region overlapping program disables the log)
+    bool load(checkpoint_t& cp) const;  // newest record
+    bool store(const checkpoint_t& cp);  // ~1 ms with both cores stalled, false if no erased slot is left (reported once)
+    void maintain();  // erase a sector ahead (~50 ms with both cores stalled) if needed, call only while audio is not played
+    void close();  // mark that state is stored to ConfigParam (at power off)
+protected:
+    static constexpr uint32_t MAGIC = 0x4c534d52; // "RMSL"
+    static constexpr uint32_t REGION_OFFSET = RESUME_LOG_FLASH_OFFSET;
+    static constexpr uint32_t NUM_SECTORS = 16;
+    static constexpr uint32_t RECORD_SIZE = FLASH_PAGE_SIZE * 2;
+    static constexpr uint32_t RECORDS_PER_SECTOR = FLASH_SECTOR_SIZE / RECORD_SIZE;
+    static constexpr uint32_t NUM_RECORDS = RECORDS_PER_SECTOR * NUM_SECTORS;
+    static constexpr uint32_t SafeExecTimeoutMs = 100;
+    typedef struct {
+        uint32_t magic;
+        uint32_t seq;  // newest record has the largest
+        checkpoint_t cp;
+        uint32_t check;  // FNV-1a of fields above
+    } record_t;
+    static_assert(sizeof(record_t) <= RECORD_SIZE, "record_t exceeds RECORD_SIZE");
+    static_assert(REGION_OFFSET % FLASH_SECTOR_SIZE == 0, "RESUME_LOG_FLASH_OFFSET must be sector aligned");
+    bool enabled = false;
+    int32_t newest = -1;  // slot of newest record (-1: none)
+    uint32_t seq = 0;
+    uint32_t head = 0;  // slot to be programmed next
+    bool fullReported = false;
+    union {
+        record_t record;
+        uint8_t bytes[RECORD_SIZE];
+    } buf;  // flash is programmed from RAM
+    uint32_t flashOffset;  // argument of flash_safe_execute() callbacks
+    ResumeLog() = default;
+    ResumeLog(const ResumeLog&) = delete;
+    ResumeLog& operator=(const ResumeLog&) = delete;
+    static uint32_t checkOf(const record_t* rec);
+    static void programFunc(void* param);
+    static void eraseFunc(void* param);
+    const record_t* slot(uint32_t idx) const;
+    bool isValid(const record_t* rec) const;
+    bool isErased(uint32_t idx) const;
+};
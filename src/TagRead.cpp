@@ -11,22 +11,41 @@
 
 #include "TagRead.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
-#include <tuple>
 
+#include "file_menu_FatFs.h"
 #include "utf_conv.h"
 
+static_assert(sizeof(id31) == 128, "ID3v1 record must be 128 bytes");
+
+// fields recorded by scan (other frames and chunks are skipped without reading)
+static const char* const ID3V22_FIELDS[] = {"TT2", "TAL", "TP1", "TYE", "TRK", "PIC"};
+static const char* const ID3V23_FIELDS[] = {"TIT2", "TALB", "TPE1", "TYER", "TRCK", "APIC"};
+static const char* const RIFF_INFO_FIELDS[] = {"INAM", "IPRD", "IART", "ICRD", "IPRT"};
+
+template <size_t N>
+static bool isListed(const char* const (&table)[N], const uint8_t* id, size_t len)
+{
+    for (const char* item : table) {
+        if (strlen(item) == len && memcmp(item, id, len) == 0) { return true; }
+    }
+    return false;
+}
+
 TagRead::TagRead()
 {
-    id3v1 = NULL;
-    id3v2 = NULL;
-    clearMP4_ilst();
+    isOpen = false;
+    cachePos = 0;
+    cacheLen = 0;
+    readPos = 0;
+    clear();
 }
 
 TagRead::~TagRead()
 {
-    if (id3v1) ID31Free(id3v1);
-    if (id3v2) ID32Free(id3v2);
+    close();
 }
 
 size_t TagRead::getBESize3(const uint8_t* buf)
@@ -39,15 +58,6 @@ size_t TagRead::getBESize3(const uint8_t* buf)
     return size;
 }
 
-size_t TagRead::getLESize4(const std::vector<uint8_t>& v)
-{
-    size_t size = 0;
-    for (int i = 0; i < 4; i++) {
-        size += v.at(i) << (8*i);
-    }
-    return size;
-}
-
 size_t TagRead::getBESize4(const uint8_t* buf)
 {
     size_t size = 0;
@@ -58,6 +68,11 @@ size_t TagRead::getBESize4(const uint8_t* buf)
     return size;
 }
 
+size_t TagRead::getLESize4(const uint8_t* buf)
+{
+    return ((size_t) buf[3] << 24) + ((size_t) buf[2] << 16) + ((size_t) buf[1] << 8) + ((size_t) buf[0]);
+}
+
 size_t TagRead::getBESize4SyncSafe(const uint8_t* buf)
 {
     size_t size = 0;
@@ -68,455 +83,243 @@ size_t TagRead::getBESize4SyncSafe(const uint8_t* buf)
     return size;
 }
 
-FRESULT TagRead::f_read_unsync(FIL* fp, void* buff, UINT btr, UINT* br, bool unsync)
+// read at readPos: served from cacheBuf, refilled by one aligned sector, or bypassed for large remainder
+FRESULT TagRead::bufRead(void* buff, UINT btr, UINT* br)
+{
+    uint8_t* dst = static_cast<uint8_t*>(buff);
+    *br = 0;
+    while (btr > 0) {
+        if (readPos >= cachePos && readPos < cachePos + cacheLen) {
+            UINT n = std::min(static_cast<size_t>(btr), cachePos + cacheLen - readPos);
+            memcpy(dst, &cacheBuf[readPos - cachePos], n);
+            dst += n;
+            btr -= n;
+            *br += n;
+            readPos += n;
+            continue;
+        }
+        FRESULT fr;
+        UINT n;
+        if (btr >= CACHE_SIZE) {
+            if ((fr = file_menu_read(&fil, readPos, dst, btr, &n)) != FR_OK) { return fr; }
+            *br += n;
+            readPos += n;
+            return FR_OK;
+        }
+        cachePos = readPos / CACHE_SIZE * CACHE_SIZE;
+        cacheLen = 0;
+        if ((fr = file_menu_read(&fil, cachePos, cacheBuf, CACHE_SIZE, &n)) != FR_OK) { return fr; }
+        cacheLen = n;
+        if (readPos >= cachePos + cacheLen) { break; } // end of file
+    }
+    return FR_OK;
+}
+
+void TagRead::bufSeek(size_t pos)
 {
-    return f_read(fp, buff, btr, br);
+    readPos = pos;
 }
 
+size_t TagRead::bufTell() const
+{
+    return readPos;
+}
+
+bool TagRead::readAt(size_t pos, void* buff, size_t size)
+{
+    UINT br;
+    bufSeek(pos);
+    return bufRead(buff, size, &br) == FR_OK && br == size;
+}
+
+// fields are read by file_menu_read() (core1 serves them between audio refills), therefore FatFs lock is not held through
 int TagRead::loadFile(const char* filename)
 {
-    if (id3v1) { ID31Free(id3v1); id3v1 = NULL; }
-    if (id3v2) { ID32Free(id3v2); id3v2 = NULL; }
-    clearMP4_ilst();
+    close();
+    clear();
 
     FRESULT fr;
+    file_menu_fs_lock();
 	fr = f_open(&fil, (TCHAR*) filename, FA_READ);
+    file_menu_fs_unlock();
     if (fr != FR_OK) {
         return 1;
     }
+    isOpen = true;
+    cachePos = 0;
+    cacheLen = 0;
+    readPos = 0;
 
-    // try MP4 first (and try ID3 next because ID3 header objects need to be generated)
-    getMP4Box(&fil);
-
-    // try ID3v1 or ID3v2
-    if (GetID3HeadersFull(fil, 1 /* 1: no-debug display, 0: debug display */, id3v1, id3v2) == 0) {
-        f_close(&fil);
-        return 1;
+    // try MP4 first
+    uint8_t buf[8]; // size(4) + type(4)
+    if (readAt(0, buf, sizeof(buf)) && memcmp(&buf[4], "ftyp", 4) == 0) {
+        scanMP4(f_size(&fil), 0);
     }
 
-    // try parsing RIFF WAV
-    riff_t riff;
-    auto chunk_list = findRiff(fil, 0, "RIFF", riff);
+    // try ID3v2 at the head and ID3v1 at the end
+    scanID3v2(0);
+    scanID3v1();
 
-    // try ID3v2 in WAV chunk format
-    if (GetID3v2FromRiffChunk(fil, chunk_list, id3v2)) {
-        f_close(&fil);
-        return 1;
-    }
+    // try parsing RIFF WAV (ID3v2 in "id3 " chunk and LIST INFO chunk)
+    scanRiff();
 
-    // If all failed, try to read LIST chunk
-    if (GetListFromRiffChunk(fil, chunk_list, id3v1)) {
-        f_close(&fil);
-        return 1;
-    }
+    return (numFields > 0 || hasId3v1) ? 1 : 0;
+}
 
-    // No available tags found
+void TagRead::close()
+{
+    if (!isOpen) { return; }
+    file_menu_fs_lock();
     f_close(&fil);
-    return 0;
+    file_menu_fs_unlock();
+    isOpen = false;
 }
 
-int TagRead::GetID3HeadersFull(FIL& infile, int testfail, id31*& id31save, id32*& id32save)
+void TagRead::clear()
 {
-    UINT result;
-    char* input;
-    id31* id31header;
-    id32* id32header;
-    int fail = 0;
-
-    FRESULT fr;
-    UINT br;
-
-    //=============
-    // For ID3(v1)
-    //=============
-    // seek to start of header
-    f_lseek(&infile, f_size(&infile) - sizeof(id31));
-    /*
-    if (result) {
-        printf("Error seeking to header\n");
-        return -1;
-    }
-    */
-  
-    // read in to buffer
-    input = (char*) malloc(sizeof(id31));
-    fr = f_read(&infile, input, sizeof(id31), &br);
-    result = br;
-    if (result != sizeof(id31)) {
-        printf("Read fail: expected %d bytes but got %d\n", sizeof(id31), result);
-        return -1;
-    }
-
-    // now call id3print
+    numFields = 0;
+    id3v2Version = 0;
+    hasId3v1 = false;
+    strPoolUsed = 0;
+}
 
-    int flg = ID31Detect(input, &id31header);
-    // do we win?
-    if (flg) {
-        if (!testfail) {
-            //printf("Valid ID3v1 header detected\n");
-            //ID31Print(id31header);
-        }
-    } else {
-        if (!testfail) {
-            printf("ID3v1 header not found\n");
-        } else {
-            fail=1;
-        }
-    }
-    free(input);
-    id31save = id31header;
+void TagRead::addField(src_t src, const char* id, size_t idLen, uint8_t format, bool isUnsynced, size_t pos, size_t size)
+{
+    if (numFields >= MAX_FIELDS) { return; }
+    tag_field_t& field = fields[numFields++];
+    memset(field.id, 0, sizeof(field.id));
+    memcpy(field.id, id, std::min(idLen, sizeof(field.id)));
+    field.src = static_cast<uint8_t>(src);
+    field.format = format;
+    field.isUnsynced = isUnsynced;
+    field.strOfs = STR_NONE;
+    field.pos = pos;
+    field.size = size;
+}
 
-    //=============
-    // For ID3v2.x
-    //=============
-    id32header=ID32Detect(&infile);
-    if (id32header) {
-        if (!testfail) {
-            //printf("Valid ID3v2 header detected\n");
-            //ID32Print(id32header);
-        }
-    } else {
-        if (!testfail) {
-            printf("ID3v2 header not found\n");
-        } else {
-            fail+=2;
-        }
+tag_field_t* TagRead::findField(src_t src, const char* id, int idx)
+{
+    int count = 0;
+    for (int i = 0; i < numFields; i++) {
+        if (fields[i].src != src || strncmp(fields[i].id, id, sizeof(fields[i].id)) != 0) { continue; }
+        if (idx == count++) { return &fields[i]; }
     }
-    id32save = id32header;
-    return fail;
+    return nullptr;
 }
 
-id32* TagRead::ID32Detect(FIL* infile, const size_t pos)
+int TagRead::countField(src_t src, const char* id)
 {
-    uint8_t* buffer;
-    UINT result;
-    int i = 0;
-    id32* id32header;
-    size_t filepos = pos;
-    int size = 0;
-    id32frame* lastframe = NULL;
-    id322frame* lastframev2 = NULL;
-    bool unsync = false;
-
-    FRESULT fr;
-    UINT br;
-
-    // seek to start
-    f_lseek(infile, filepos);
-    // read in first 10 bytes
-    buffer = (uint8_t*) calloc(1, 11);
-    id32header = (id32*) calloc(1, sizeof(id32));
-    fr = f_read(infile, buffer, 10, &br);
-    result = br;
-
-    //filepos += result;
-    filepos = f_tell(infile);
-    // make sure we have 10 bytes
-    if (result != 10) {
-        printf("ID3v2 read failed, expected 10 bytes, read only %d\n", result);
-        return NULL;
-    }
-    // do the comparison
-    /*
-    An ID3v2 tag can be detected with the following pattern:
-    $49 44 33 yy yy xx zz zz zz zz
-    Where yy is less than $FF, xx is the 'flags' byte and zz is less than $80.
-    */
-    result = 1;
-    for (i = 6; i < 10; i++) {
-        if (buffer[i] >= 0x80) result = 0;
-    }
-    if (buffer[0] == 0x49 && buffer[1] == 0x44 && buffer[2] == 0x33 && buffer[3] < 0xff && buffer[4] < 0xff && result) {
-        // its ID3v2 :D
-        size = getBESize4SyncSafe(&buffer[6]);
-        //printf("Header size: %d\n");
-    } else {
-        // cleanup
-        free(buffer);
-        free(id32header);
-        return NULL;
+    int count = 0;
+    for (int i = 0; i < numFields; i++) {
+        if (fields[i].src == src && strncmp(fields[i].id, id, sizeof(fields[i].id)) == 0) { count++; }
     }
-    // set up header
-    id32header->version[0] = buffer[3];
-    id32header->version[1] = buffer[4];
-    id32header->flags = buffer[5];
-    id32header->size = size;
-    id32header->firstframe = NULL;
+    return count;
+}
 
-    // done with buffer - be sure to free...
-    free(buffer);
+const char* TagRead::id3v2ID(const char* id3v22, const char* id3v23) const
+{
+    return (id3v2Version == 2) ? id3v22 : id3v23;
+}
 
-    // test for flags - die on all for the time being
+// decode text of field body into UTF-8 str ('\0' terminated within size)
+bool TagRead::decodeText(const tag_field_t& field, char* str, size_t size)
+{
+    uint8_t raw[TEXT_READ_LIMIT];
+    size_t len = std::min(field.size, TEXT_READ_LIMIT);
+    bool ok;
+    str[0] = '\0';
+    ok = readAt(field.pos, raw, len);
+    if (!ok) { return false; }
 
-    if ((id32header->flags & 0x7f) != 0) {
-        //printf("Flags set, can't handle :(\n");
-        return NULL;
-    }
-    if ((id32header->flags & (1<<7)) != 0) {
-        //printf("Unsynchronization in flags is set\n");
-        unsync = true;
-    } else {
-        unsync = false;
-    }
-    // depend upon its version
-    if (id32header->version[0] == 2) { // ID3v2.2
-        //printf("Want version 3, have version %d\n", id32header->version[0]);
-        //return NULL;
-        // this code is modified from version 3, ideally we should reuse some
-        while (filepos - 10 < id32header->size + pos) {
-            // make space for new frame
-            id322frame* frame = (id322frame*) calloc(1, sizeof(id322frame));
-            frame->next = NULL;
-            // populate from file
-            fr = f_read_unsync(infile, frame, 6, &br, unsync);
-            result = br;
-            if (result != 6) {
-                printf("Expected to read 6 bytes, only got %d, from point %d in the file\n", result, filepos);
-                // not freeing this time, but we should deconstruct in future
-                return NULL;
-            }
-            // make sure we haven't got a blank tag
-            if (frame->ID[0] == 0) {
+    typedef enum { Bytes = 0, UTF16LE, UTF16BE } encoding_t;
+    encoding_t encoding = Bytes;
+    const uint8_t* text = raw;
+    if (field.src == SrcID3v2) {
+        if (len < 1) { return false; }
+        switch (raw[0]) { // data has no '\0' termination
+            case 0: // ISO-8859-1
+            case 3: // UTF-8 (ID3v2.4 or later only)
+                encoding = Bytes;
                 break;
-            }
-            // update file cursor
-            //filepos += result;
-            filepos = f_tell(infile);
-            // convert size to little endian
-            frame->size = getBESize3(frame->sizebytes);
-            /*
-            // debug
-            buffer = (uint8_t*) calloc(1,4);
-            memcpy(buffer, frame->ID, 3);
-            {
-                printf("Processing frame %s, size %d filepos %d\n", buffer, frame->size, filepos);
-            }
-            free(buffer);
-            */
-            frame->pos = f_tell(infile);
-            if (frame->size < frame_size_limit) {
-                // read in the data
-                frame->data = (char*) calloc(1, frame->size);
-                fr = f_read_unsync(infile, frame->data, frame->size, &br, unsync);
-                result = br;
-                frame->isUnsynced = unsync;
-                frame->hasFullData = true;
-            } else { // give up to get full contents due to size over
-                /*
-                printf("frameID: %c%c%c size over %d\n", frame->ID[0], frame->ID[1], frame->ID[2], frame->size);
-                */
-                frame->data = (char*) calloc(1, frame_start_bytes); // for frame parsing
-                f_read_unsync(infile, frame->data, frame_start_bytes, &br, unsync);
-                if (f_lseek(infile, frame->size - frame_start_bytes) == FR_OK) {
-                    result = frame->size;
-                } else {
-                    result = 0;
-                }
-                frame->isUnsynced = unsync;
-                frame->hasFullData = false;
-            }
-            //filepos += result;
-            filepos = f_tell(infile);
-            if (result != (UINT) frame->size) {
-                printf("Expected to read %d bytes, only got %d\n", frame->size, result);
-                return NULL;
-            }
-            // add to end of queue
-            if (id32header->firstframe == NULL) {
-                id32header->firstframe=(id32frame*)frame;
-            } else {
-                lastframev2->next=frame;
-            }
-            lastframev2=frame;
-            // then loop until we've filled the struct
-        }
-    } else if (id32header->version[0] == 3) { // ID3v2.3
-        // start reading frames
-        while (filepos - 10 < id32header->size + pos) {
-            // make space for new frame
-            id32frame* frame = (id32frame*) calloc(1, sizeof(id32frame));
-            frame->next = NULL;
-            // populate from file
-            fr = f_read_unsync(infile, frame, 10, &br, unsync);
-            result = br;
-            if (result != 10) {
-                printf("Expected to read 10 bytes, only got %d, from point %d in the file\n", result, filepos);
-                // not freeing this time, but we should deconstruct in future
-                return NULL;
-            }
-            // make sure we haven't got a blank tag
-            if (frame->ID[0] == 0) {
+            case 1: // UTF-16 (w/ BOM)
+                encoding = (len >= 3 && raw[1] == 0xfe && raw[2] == 0xff) ? UTF16BE : UTF16LE;
+                text += 2;
+                len -= std::min(len, static_cast<size_t>(2));
                 break;
-            }
-            if((frame->ID[0] & 0xff) == 0xff) {
-                printf("Size is wrong 1:(\n");
-                return NULL;
-
-                // fix size
-                /*
-                printf("fix size?\n");
-                char c = getchar();
-                while(getchar()!= '\n');
-                if(c=='y' || c=='Y'){
-                // kill the frame
-                free(frame);
-                // break the file - this is a trigger for later :P
-                infile->close();
+            case 2: // UTF-16BE (w/o BOM) (ID3v2.4 or later only)
+                encoding = UTF16BE;
                 break;
-                }
-                */
-            }
-            // update file cursor
-            //filepos += result;
-            filepos = f_tell(infile);
-            // convert size to little endian
-            frame->size = getBESize4(frame->sizebytes);
-            /*
-            // debug
-            buffer = (uint8_t*) calloc(1,5);
-            memcpy(buffer, frame->ID, 4);
-            {
-                printf("Processing frame %s size %d filepos %d\n", buffer, frame->size, filepos);
-            }
-            free(buffer);
-            */
-            frame->pos = f_tell(infile);
-            if (frame->size < frame_size_limit) {
-                // read in the data
-                frame->data = (char*) calloc(1, frame->size);
-                fr = f_read_unsync(infile, frame->data, frame->size, &br, unsync);
-                result = br;
-                frame->isUnsynced = unsync;
-                frame->hasFullData = true;
-            } else { // give up to get full contents due to size over
-                /*
-                printf("frameID: %c%c%c%c size over %d\n", frame->ID[0], frame->ID[1], frame->ID[2], frame->ID[3], frame->size);
-                */
-                frame->data = (char*) calloc(1, frame_start_bytes); // for frame parsing
-                f_read_unsync(infile, frame->data, frame_start_bytes, &br, unsync);
-                if (f_lseek(infile, frame->size - frame_start_bytes) == FR_OK) {
-                    result = frame->size;
-                } else {
-                    result = 0;
-                }
-                frame->isUnsynced = unsync;
-                frame->hasFullData = false;
-            }
-            //filepos += result;
-            filepos = f_tell(infile);
-            if (result != (UINT) frame->size) {
-                printf("Expected to read %d bytes, only got %d\n", frame->size, result);
-                return NULL;
-            }
-            // add to end of queue
-            if (id32header->firstframe == NULL) {
-                // read in to buffer
-                id32header->firstframe = frame;
-            } else {
-                lastframe->next = frame;
-            }
-            lastframe = frame;
-            // then loop until we've filled the struct
+            default:
+                return false;
         }
-    } else if (id32header->version[0] == 4) { // ID3v2.4
-        // start reading frames
-        while (filepos - 10 < id32header->size + pos) {
-            // make space for new frame
-            int i;
-            id32frame* frame = (id32frame*) calloc(1, sizeof(id32frame));
-            frame->next = NULL;
-            // populate from file
-            fr = f_read_unsync(infile, frame, 10, &br, unsync);
-            result = br;
-            if (result != 10) {
-                printf("Expected to read 10 bytes, only got %d, from point %d in the file\n", result, filepos);
-                // not freeing this time, but we should deconstruct in future
-                return NULL;
-            }
-            // make sure we haven't got a blank tag
-            if (frame->ID[0] == 0) {
-                free(frame);
+        text++;
+        len -= std::min(len, static_cast<size_t>(1));
+    } else if (field.src == SrcMP4) {
+        switch (field.format) {
+            case reserved: // for track number
+                if (len < 4) { return false; }
+                snprintf(str, size, "%lu", static_cast<unsigned long>(getBESize4(raw)));
+                return true;
+            case UTF8:
+                encoding = Bytes;
                 break;
-            }
-            if((frame->ID[0] & 0xff) == 0xff) {
-                printf("Size is wrong 2:(\n");
-                return NULL;
-
-                // fix size
-                /*
-                printf("fix size?\n");
-                char c = getchar();
-                while(getchar()!= '\n');
-                if(c=='y' || c=='Y'){
-                // kill the frame
-                free(frame);
-                // break the file - this is a trigger for later :P
-                infile->close();
+            case UTF16:
+                encoding = UTF16BE;
                 break;
-                }
-                */
-            }
-            // update file cursor
-            //filepos += result;
-            filepos = f_tell(infile);
-            // convert size to little endian
-            frame->size = getBESize4SyncSafe(frame->sizebytes);
-            /*
-            // debug
-            buffer = (uint8_t*) calloc(1,5);
-            memcpy(buffer, frame->ID, 4);
-            {
-                printf("Processing frame %s size %d filepos %d\n", buffer, frame->size, filepos);
-            }
-            free(buffer);
-            */
-            frame->pos = f_tell(infile);
-            if (frame->size < frame_size_limit) {
-                // read in the data
-                frame->data = (char*) calloc(1, frame->size);
-                fr = f_read_unsync(infile, frame->data, frame->size, &br, unsync);
-                result = br;
-                frame->isUnsynced = unsync;
-                frame->hasFullData = true;
-            } else { // give up to get full contents due to size over
-                frame->data = (char*) calloc(1, frame_start_bytes); // for frame parsing
-                fr = f_read_unsync(infile, frame->data, frame_start_bytes, &br, unsync);
-                result = br;
-                if (f_lseek(infile, frame->size - result) == FR_OK) {
-                    result = frame->size;
-                } else {
-                    result = 0;
-                }
-                frame->isUnsynced = unsync;
-                frame->hasFullData = false;
-            }
-            //filepos += result;
-            filepos = f_tell(infile);
-            if (result != (UINT) frame->size) {
-                printf("Expected to read %d bytes, only got %d\n", frame->size, result);
-                return NULL;
-            }
-            // add to end of queue
-            if (id32header->firstframe == NULL) {
-                // read in to buffer
-                id32header->firstframe = frame;
-            } else {
-                lastframe->next = frame;
-            }
-            lastframe = frame;
-            // then loop until we've filled the struct
+            default:
+                return false;
         }
     }
-    return id32header;
+    if (encoding == Bytes) {
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(text, 0, len));
+        size_t n = std::min((end != nullptr) ? static_cast<size_t>(end - text) : len, size - 1);
+        memcpy(str, text, n);
+        str[n] = '\0';
+    } else {
+        utf16_to_utf8(text, len, encoding == UTF16BE, str, size);
+    }
+    return true;
+}
+
+// get field decoded on the first request (kept in string pool for following requests)
+int TagRead::getFieldUTF8(tag_field_t* field, char* str, size_t size)
+{
+    if (field == nullptr || size == 0) { return 0; }
+    if (field->strOfs != STR_NONE) {
+        const char* pooled = &strPool[field->strOfs];
+        size_t n = strnlen(pooled, size - 1);
+        memcpy(str, pooled, n);
+        str[n] = '\0';
+        return 1;
+    }
+    if (!isOpen || !decodeText(*field, str, size)) { return 0; }
+    size_t len = strlen(str) + 1;
+    if (len <= STR_POOL_SIZE - strPoolUsed) {
+        memcpy(&strPool[strPoolUsed], str, len);
+        field->strOfs = static_cast<uint16_t>(strPoolUsed);
+        strPoolUsed += len;
+    }
+    return 1;
+}
+
+int TagRead::getID3v1Text(const char* text, size_t len, char* str, size_t size)
+{
+    size_t n = strnlen(text, len); // ID3v1 members don't finish with '\0'
+    if (n == 0 || size == 0) { return 0; }
+    n = std::min(n, size - 1);
+    memcpy(str, text, n);
+    str[n] = '\0';
+    return 1;
 }
 
 int TagRead::getUTF8Track(char* str, size_t size)
 {
-    if (GetMP4BoxUTF8("\xa9""trk", str, size)) { return 1; }
-    if (GetMP4BoxUTF8("trkn", str, size)) { return 1; }
-    if (GetID32UTF8("TRK", "TRCK", str, size)) { return 1; }
-    if (strlen(id3v1->title) && size >= 4) { // check titlte because track is unsigned char
-        sprintf(str, "%d", id3v1->tracknum);
+    if (getFieldUTF8(findField(SrcMP4, "\xa9""trk"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcMP4, "trkn"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcID3v2, id3v2ID("TRK", "TRCK")), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcRiffInfo, "IPRT"), str, size)) { return 1; }
+    if (hasId3v1 && id3v1.zero == 0 && id3v1.tracknum != 0 && size >= 4) { // track exists only in ID3v1.1
+        sprintf(str, "%d", id3v1.tracknum);
         return 1;
     }
     return 0;
@@ -524,55 +327,43 @@ int TagRead::getUTF8Track(char* str, size_t size)
 
 int TagRead::getUTF8Title(char* str, size_t size)
 {
-    if (GetMP4BoxUTF8("\xa9""nam", str, size)) { return 1; }
-    if (GetID32UTF8("TT2", "TIT2", str, size)) { return 1; }
-    if (strlen(id3v1->title)) {
-        memset(str, 0, size);
-        strncpy(str, id3v1->title, size - 1);
-        return 1;
-    }
+    if (getFieldUTF8(findField(SrcMP4, "\xa9""nam"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcID3v2, id3v2ID("TT2", "TIT2")), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcRiffInfo, "INAM"), str, size)) { return 1; }
+    if (hasId3v1) { return getID3v1Text(id3v1.title, sizeof(id3v1.title), str, size); }
     return 0;
 }
 
 int TagRead::getUTF8Album(char* str, size_t size)
 {
-    if (GetMP4BoxUTF8("\xa9""alb", str, size)) { return 1; }
-    if (GetID32UTF8("TAL", "TALB", str, size)) { return 1; }
-    if (strlen(id3v1->album)) {
-        memset(str, 0, size);
-        strncpy(str, id3v1->album, size - 1);
-        return 1;
-    }
+    if (getFieldUTF8(findField(SrcMP4, "\xa9""alb"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcID3v2, id3v2ID("TAL", "TALB")), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcRiffInfo, "IPRD"), str, size)) { return 1; }
+    if (hasId3v1) { return getID3v1Text(id3v1.album, sizeof(id3v1.album), str, size); }
     return 0;
 }
 
 int TagRead::getUTF8Artist(char* str, size_t size)
 {
-    if (GetMP4BoxUTF8("\xa9""ART", str, size)) { return 1; }
-    if (GetID32UTF8("TP1", "TPE1", str, size)) { return 1; }
-    if (strlen(id3v1->artist)) {
-        memset(str, 0, size);
-        strncpy(str, id3v1->artist, size - 1);
-        return 1;
-    }
+    if (getFieldUTF8(findField(SrcMP4, "\xa9""ART"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcID3v2, id3v2ID("TP1", "TPE1")), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcRiffInfo, "IART"), str, size)) { return 1; }
+    if (hasId3v1) { return getID3v1Text(id3v1.artist, sizeof(id3v1.artist), str, size); }
     return 0;
 }
 
 int TagRead::getUTF8Year(char* str, size_t size)
 {
-    if (GetMP4BoxUTF8("\xa9""day", str, size)) { return 1; }
-    if (GetID32UTF8("TYE", "TYER", str, size)) { return 1; }
-    if (strlen(id3v1->year)) {
-        memset(str, 0, size);
-        strncpy(str, id3v1->year, size - 1);
-        return 1;
-    }
+    if (getFieldUTF8(findField(SrcMP4, "\xa9""day"), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcID3v2, id3v2ID("TYE", "TYER")), str, size)) { return 1; }
+    if (getFieldUTF8(findField(SrcRiffInfo, "ICRD"), str, size)) { return 1; }
+    if (hasId3v1) { return getID3v1Text(id3v1.year, sizeof(id3v1.year), str, size); }
     return 0;
 }
 
 int TagRead::getPictureCount()
 {
-    return GetMP4TypeCount("covr") + GetID3IDCount("PIC", "APIC");
+    return countField(SrcMP4, "covr") + countField(SrcID3v2, id3v2ID("PIC", "APIC"));
 }
 
 int TagRead::getPicturePos(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size, bool& isUnsynced)
@@ -580,465 +371,194 @@ int TagRead::getPicturePos(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, s
     int i = idx;
 
     // for MP4 Picture
-    if (i < GetMP4TypeCount("covr")) {
+    if (i < countField(SrcMP4, "covr")) {
         getMP4Picture(i, mime, ptype, pos, size);
         isUnsynced = false;
         return (size != 0);
     }
-    i -= GetMP4TypeCount("covr");
+    i -= countField(SrcMP4, "covr");
 
     // for ID3 Picture
-    if (i >= 0 && i < GetID3IDCount("PIC", "APIC")) {
+    if (i >= 0 && i < countField(SrcID3v2, id3v2ID("PIC", "APIC"))) {
         getID32Picture(i, mime, ptype, pos, size, isUnsynced);
         return (size != 0);
     }
-    i -= GetID3IDCount("PIC", "APIC");
 
     return 0;
 }
 
-int TagRead::getID32Picture(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size, bool& isUnsynced)
+// ========================
+// ID3 parsing Start
+// ========================
+void TagRead::scanID3v1()
 {
-    int count = 0;
-    mime = non;
-    ptype = other;
-    size = 0;
-    bool hasFullData = false;
-    if (!id3v2) { return 0; }
-    id32frame* thisframe;
-    int ver = id3v2->version[0];
-    // loop through tags and process
-    thisframe = id3v2->firstframe;
-    while (thisframe != NULL) {
-        if (id3v2->version[0] == 2) { // ID3v2.2
-            id322frame* tframe = (id322frame*) thisframe;
-            if (!strncmp("PIC", tframe->ID, 3) && tframe->data != NULL) {
-                if (idx == count) {
-                    // encoding(1) + mime(3) + ptype(1) + desc(1) + binary
-                    if (tframe->data[0] == 0) { // ISO-8859-1
-                        if (!strncmp("JPG", &tframe->data[1], 3)) {
-                            mime = jpeg;
-                            ptype = static_cast<ptype_t>(tframe->data[1+3]);
-                            if (tframe->data[1+3+1] == 0) {
-                                size = tframe->size - (1+3+1+1);
-                                pos = tframe->pos + (1+3+1+1);
-                            }
-                            isUnsynced = tframe->isUnsynced;
-                            hasFullData = tframe->hasFullData;
-                        } else if (!strncmp("PNG", &tframe->data[1], 3)) {
-                            mime = png;
-                            ptype = static_cast<ptype_t>(tframe->data[1+3]);
-                            if (tframe->data[1+3+1] == 0) {
-                                size = tframe->size - (1+3+1+1);
-                                pos = tframe->pos + (1+3+1+1);
-                            }
-                            isUnsynced = tframe->isUnsynced;
-                            hasFullData = tframe->hasFullData;
-                        }
-                    }
-                    break;
-                }
-                count++;
-            }
-        } else if (id3v2->version[0] == 3) { // ID3v2.3
-            if (!strncmp("APIC", thisframe->ID, 4) && thisframe->data != NULL) {
-                if (idx == count) {
-                    // encoding(1) + mime(\0) + ptype(1) + desc(1) + binary
-                    //if (thisframe->data[0] == 0) {
-                    if (thisframe->data[0] == 0 || thisframe->data[0] == 1) { // normally 'encoding' must be ISO-8859-1 (00h), but found some (01h) examples
-                        if (!strncmp("image/jpeg", &thisframe->data[1], 10)) {
-                            mime = jpeg;
-                            ptype = static_cast<ptype_t>(thisframe->data[1+11]);
-                            if (thisframe->data[1+11+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = thisframe->size - (1+11+1+1);
-                                pos = thisframe->pos + (1+11+1+1);
-                            } else if (thisframe->data[1+11+1+0] == 0xFF && thisframe->data[1+11+1+1] == 0xFE) { // found some illegal files have no 'desc'
-                                size = thisframe->size - (1+11+1);
-                                pos = thisframe->pos + (1+11+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        } else if (!strncmp("image/jpg", &thisframe->data[1], 9)) {
-                            mime = jpeg;
-                            ptype = static_cast<ptype_t>(thisframe->data[1+10]);
-                            if (thisframe->data[1+10+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = thisframe->size - (1+10+1+1);
-                                pos = thisframe->pos + (1+10+1+1);
-                            } else if (thisframe->data[1+10+1+0] == 0xFF && thisframe->data[1+10+1+1] == 0xFE) { // found some illegal files have no 'desc'
-                                size = thisframe->size - (1+10+1);
-                                pos = thisframe->pos + (1+10+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        } else if (!strncmp("image/png", &thisframe->data[1], 9)) {
-                            mime = png;
-                            ptype = static_cast<ptype_t>(thisframe->data[1+10]);
-                            if (thisframe->data[1+10+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = thisframe->size - (1+10+1+1);
-                                pos = thisframe->pos + (1+10+1+1);
-                            } else if (thisframe->data[1+10+1+0] == 0x89 && thisframe->data[1+10+1+1] == 0x50) { // found some illegal files have no 'desc'
-                                size = thisframe->size - (1+10+1);
-                                pos = thisframe->pos + (1+10+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        }
-                    }
-                    break;
-                }
-                count++;
-            }
-        } else if (id3v2->version[0] == 4) { // ID3v2.4
-            if (!strncmp("APIC", thisframe->ID, 4) && thisframe->data != NULL) {
-                size_t frame_size;
-                int ofs;
-                if ((thisframe->flags[1] & 0x1) != 0x00) { // Data length indicator (ID3v2.4)
-                    frame_size = getBESize4SyncSafe((uint8_t*) &thisframe->data[0]); // This is the actual size deducted Unsynchronization 0xFF 0x00 -> 0xFF
-                    ofs = 4;
-                } else {
-                    frame_size = thisframe->size;
-                    ofs = 0;
-                }
-                if (idx == count) {
-                    // encoding(1) + mime(\0) + ptype(1) + desc(1) + binary
-                    //if (thisframe->data[0] == 0) {
-                    if (thisframe->data[ofs+0] == 0 || thisframe->data[ofs+0] == 1) { // normally 'encoding' must be ISO-8859-1 (00h), but found some (01h) examples
-                        if (!strncmp("image/jpeg", &thisframe->data[ofs+1], 10)) {
-                            mime = jpeg;
-                            ptype = static_cast<ptype_t>(thisframe->data[ofs+1+11]);
-                            if (thisframe->data[ofs+1+11+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = frame_size - (1+11+1+1);
-                                pos = thisframe->pos + (ofs+1+11+1+1);
-                            } else if (thisframe->data[ofs+1+11+1+0] == 0xFF && thisframe->data[ofs+1+11+1+1] == 0xFE) { // found some illegal files have no 'desc'
-                                size = frame_size - (1+11+1);
-                                pos = thisframe->pos + (ofs+1+11+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        } else if (!strncmp("image/jpg", &thisframe->data[ofs+1], 9)) {
-                            mime = jpeg;
-                            ptype = static_cast<ptype_t>(thisframe->data[ofs+1+10]);
-                            if (thisframe->data[ofs+1+10+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = frame_size - (1+10+1+1);
-                                pos = thisframe->pos + (ofs+1+10+1+1);
-                            } else if (thisframe->data[ofs+1+10+1+0] == 0xFF && thisframe->data[ofs+1+10+1+1] == 0xFE) { // found some illegal files have no 'desc'
-                                size = frame_size - (1+10+1);
-                                pos = thisframe->pos + (ofs+1+10+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        } else if (!strncmp("image/png", &thisframe->data[ofs+1], 9)) {
-                            mime = png;
-                            ptype = static_cast<ptype_t>(thisframe->data[ofs+1+10]);
-                            if (thisframe->data[ofs+1+10+1] == 0) { // normally 'desc' is needed, but ... (see below case)
-                                size = frame_size - (1+10+1+1);
-                                pos = thisframe->pos + (ofs+1+10+1+1);
-                            } else if (thisframe->data[ofs+1+10+1+0] == 0x89 && thisframe->data[ofs+1+10+1+1] == 0x50) { // found some illegal files have no 'desc'
-                                size = frame_size - (1+10+1);
-                                pos = thisframe->pos + (ofs+1+10+1);
-                            }
-                            isUnsynced = thisframe->isUnsynced;
-                            hasFullData = thisframe->hasFullData;
-                        }
-                    }
-                    break;
-                }
-                count++;
-            }
-        }
-        thisframe = (ver == 2) ? (id32frame*) ((id322frame*) thisframe)->next : thisframe->next;
-    }
-    return (hasFullData == true);
+    if (f_size(&fil) < sizeof(id31)) { return; }
+    if (!readAt(f_size(&fil) - sizeof(id31), &id3v1, sizeof(id31))) { return; }
+    hasId3v1 = (memcmp(id3v1.header, "TAG", 3) == 0);
 }
 
-int TagRead::GetID32UTF8(const char* id3v22, const char* id3v23, char* str, size_t size)
+// record frame positions of ID3v2 tag at pos (only frame headers are read)
+bool TagRead::scanID3v2(size_t pos)
 {
-    int flg = 0;
-    if (!id3v2) { return 0; }
-    id32frame* thisframe;
-    int ver = id3v2->version[0];
-    // loop through tags and process
-    thisframe = id3v2->firstframe;
-    while (thisframe != NULL) {
-        if (id3v2->version[0] == 2) { // ID3v2.2
-            id322frame* tframe = (id322frame*) thisframe;
-            if (!strncmp(id3v22, tframe->ID, 3)) {
-                size_t max_size;
-                switch (tframe->data[0]) { // data has no '\0' termination
-                    case 0: // ISO-8859-1
-                        max_size = (tframe->size - 1 <= size - 1) ? tframe->size - 1 : size - 1;
-                        strncpy(str, &tframe->data[1], max_size);
-                        str[max_size] = '\0';
-                        break;
-                    case 1: { // UTF-16 (w/BOM)
-                        char _str[256*2] = {};
-                        max_size = (tframe->size - 3 <= 256*2-2) ? tframe->size - 3 : 256*2-2;
-                        memcpy(_str, &tframe->data[3], max_size);
-                        std::string utf8_str = utf16_to_utf8((const char16_t*) _str);
-                        max_size = (utf8_str.length() <= size - 1) ? utf8_str.length() : size - 1;
-                        memcpy(str, utf8_str.c_str(), max_size);
-                        str[max_size] = '\0';
-                        break;
-                    }
-                    default:
-                        break;
-                }
-                flg = 1;
-                break;
-            }
-        } else { // if (id3v2->version[0] == 3 || id3v2->version[0] == 4) { // ID3v2.3, ID3v2.4
-            if (!strncmp(id3v23, thisframe->ID, 4)) {
-                size_t max_size;
-                switch (thisframe->data[0]) { // data has no '\0' termination
-                    case 0: // ISO-8859-1
-                    case 3: // UTF-8 (ID3v2.4 or later only)
-                        max_size = (thisframe->size - 1 <= size - 1) ? thisframe->size - 1 : size - 1;
-                        strncpy(str, &thisframe->data[1], max_size);
-                        str[max_size] = '\0';
-                        break;
-                    case 1: // UTF-16 (w/ BOM)
-                    case 2: // UTF-16 (w/o BOM) (ID3v2.4 or later only)
-                    {
-                        char _str[256*2] = {};
-                        max_size = (thisframe->size - 3 <= 256*2-2) ? thisframe->size - 3 : 256*2-2;
-                        memcpy(_str, &thisframe->data[3], max_size);
-                        std::string utf8_str = utf16_to_utf8((const char16_t*) _str);
-                        max_size = (utf8_str.length() <= size - 1) ? utf8_str.length() : size - 1;
-                        memcpy(str, utf8_str.c_str(), max_size);
-                        str[max_size] = '\0';
-                        break;
-                    }
-                    default:
-                        break;
-                }
-                flg = 1;
-                break;
-            }
+    uint8_t buf[10];
+    if (id3v2Version != 0) { return false; }
+    if (!readAt(pos, buf, sizeof(buf))) { return false; }
+    /*
+    An ID3v2 tag can be detected with the following pattern:
+    $49 44 33 yy yy xx zz zz zz zz
+    Where yy is less than $FF, xx is the 'flags' byte and zz is less than $80.
+    */
+    if (buf[0] != 0x49 || buf[1] != 0x44 || buf[2] != 0x33 || buf[3] == 0xff || buf[4] == 0xff) { return false; }
+    for (int i = 6; i < 10; i++) {
+        if (buf[i] >= 0x80) { return false; }
+    }
+    uint8_t version = buf[3];
+    if (version < 2 || version > 4) { return false; }
+    if ((buf[5] & 0x7f) != 0) { return false; } // flags other than Unsynchronization are not supported
+    bool unsync = (buf[5] & (1<<7)) != 0;
+    size_t end_pos = pos + 10 + getBESize4SyncSafe(&buf[6]);
+    size_t hdr_size = (version == 2) ? 6 : 10; // ID(3) + size(3) for ID3v2.2, ID(4) + size(4) + flags(2) otherwise
+    size_t id_len = (version == 2) ? 3 : 4;
+    size_t frame_pos = pos + 10;
+    id3v2Version = version;
+    while (frame_pos + hdr_size <= end_pos) {
+        if (!readAt(frame_pos, buf, hdr_size)) { break; }
+        if (buf[0] == 0) { break; } // padding
+        if (buf[0] == 0xff) { break; } // size is wrong
+        size_t size;
+        uint8_t format = 0;
+        if (version == 2) {
+            size = getBESize3(&buf[3]);
+        } else if (version == 3) {
+            size = getBESize4(&buf[4]);
+            format = buf[9];
+        } else {
+            size = getBESize4SyncSafe(&buf[4]);
+            format = buf[9];
         }
-        thisframe = (ver == 2) ? (id32frame*) ((id322frame*) thisframe)->next : thisframe->next;
-    }
-    return flg;
-}
-
-int TagRead::GetID3IDCount(const char* id3v22, const char* id3v23)
-{
-    int count = 0;
-    if (!id3v2) { return 0; }
-    id32frame* thisframe;
-    int ver = id3v2->version[0];
-    // loop through tags and process
-    thisframe = id3v2->firstframe;
-    while (thisframe != NULL) {
-        if (id3v2->version[0] == 2) { // ID3v2.2
-            id322frame* tframe = (id322frame*) thisframe;
-            if (!strncmp(id3v22, tframe->ID, 3)) {
-                count++;
-            }
-        } else if (id3v2->version[0] == 3) { // ID3v2.3
-            if (!strncmp(id3v23, thisframe->ID, 4)) {
-                count++;
-            }
-        } else if (id3v2->version[0] == 4) { // ID3v2.4
-            if (!strncmp(id3v23, thisframe->ID, 4)) {
-                count++;
-            }
+        frame_pos += hdr_size;
+        if (frame_pos + size < frame_pos || frame_pos + size > f_size(&fil)) { break; }
+        if ((version == 2) ? isListed(ID3V22_FIELDS, buf, id_len) : isListed(ID3V23_FIELDS, buf, id_len)) {
+            addField(SrcID3v2, reinterpret_cast<const char*>(buf), id_len, format, unsync, frame_pos, size);
         }
-        thisframe = (ver == 2) ? (id32frame*) ((id322frame*) thisframe)->next : thisframe->next;
+        frame_pos += size;
     }
-    return count;
+    return true;
 }
 
-void TagRead::ID32Print(id32* id32header)
+int TagRead::getID32Picture(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size, bool& isUnsynced)
 {
-    id32frame* thisframe;
-    int ver = id32header->version[0];
-    // loop through tags and process
-    thisframe = id32header->firstframe;
-    while (thisframe != NULL) {
-        char* buffer;
-        if (id32header->version[0] == 3) {
-            buffer = (char*) calloc(5,1);
-            memcpy(buffer, thisframe->ID, 4);
-            if (!strcmp("TIT2", buffer) || !strcmp("TT2", buffer)) {
-                //printf("TIT2 tag detected\n");
-                printf("Title: %s\n", thisframe->data+1);
-            } else if (!strcmp("TALB", buffer) || !strcmp("TAL", buffer)) {
-                //printf("TALB tag detected\n");
-                printf("Album: %s\n", thisframe->data+1);
-            } else if (!strcmp("TPE1", buffer) || !strcmp("TP1", buffer)) {
-                //printf("TPE1 tag detected\n");
-                printf("Artist: %s\n", thisframe->data+1);
-            }
-            free(buffer);
-        } else if (id32header->version[0] == 2) {
-            id322frame* tframe = (id322frame*) thisframe;
-            buffer = (char*) calloc(4,1);
-            memcpy(buffer, thisframe->ID, 3);
-            if (!strcmp("TIT2", buffer) || !strcmp("TT2", buffer)) {
-                //printf("TIT2 tag detected\n");
-                printf("Title: %s\n", tframe->data+1);
-            } else if (!strcmp("TALB", buffer) || !strcmp("TAL", buffer)) {
-                //printf("TALB tag detected\n");
-                printf("Album: %s\n", tframe->data+1);
-            } else if (!strcmp("TPE1", buffer) || !strcmp("TP1", buffer)) {
-                //printf("TPE1 tag detected\n");
-                printf("Artist: %s\n", tframe->data+1);
-            }
-            free(buffer);
+    mime = non;
+    ptype = other;
+    size = 0;
+    isUnsynced = false;
+    tag_field_t* field = findField(SrcID3v2, id3v2ID("PIC", "APIC"), idx);
+    if (field == nullptr || !isOpen) { return 0; }
+    uint8_t buf[PICTURE_HEADER_SIZE];
+    size_t len = std::min(field->size, PICTURE_HEADER_SIZE);
+    bool ok;
+    ok = readAt(field->pos, buf, len);
+    if (!ok) { return 0; }
+
+    size_t frame_size = field->size;
+    size_t ofs = 0;
+    if (id3v2Version == 4 && (field->format & 0x1) != 0x00) { // Data length indicator (ID3v2.4)
+        if (len < 4) { return 0; }
+        frame_size = getBESize4SyncSafe(buf); // This is the actual size deducted Unsynchronization 0xFF 0x00 -> 0xFF
+        ofs = 4;
+    }
+    const uint8_t* data = &buf[ofs];
+    size_t data_len = len - ofs;
+    size_t i; // position of binary in data
+    mime_t _mime;
+    if (data_len < 6) { return 0; }
+    uint8_t encoding = data[0];
+    if (id3v2Version == 2) {
+        // encoding(1) + format(3) + ptype(1) + desc + binary
+        if (memcmp(&data[1], "JPG", 3) == 0) {
+            _mime = jpeg;
+        } else if (memcmp(&data[1], "PNG", 3) == 0) {
+            _mime = png;
+        } else {
+            return 0;
         }
-        thisframe = (ver == 2) ? (id32frame*) ((id322frame*) thisframe)->next : thisframe->next;
-    }
-}
-
-void TagRead::ID32Free(id32* id32header)
-{
-    if (id32header->version[0] == 3) {
-        id32frame* bonar=id32header->firstframe;
-        while (bonar != NULL) {
-            id32frame* next = bonar->next;
-            free(bonar->data);
-            free(bonar);
-            bonar=next;
+        i = 1 + 3;
+    } else {
+        // encoding(1) + mime('\0') + ptype(1) + desc + binary
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(&data[1], 0, data_len - 1));
+        if (end == nullptr) { return 0; }
+        const char* mime_str = reinterpret_cast<const char*>(&data[1]);
+        if (strcmp(mime_str, "image/jpeg") == 0 || strcmp(mime_str, "image/jpg") == 0) {
+            _mime = jpeg;
+        } else if (strcmp(mime_str, "image/png") == 0) {
+            _mime = png;
+        } else {
+            return 0;
         }
-    } else if (id32header->version[0] == 2) {
-        id322frame* bonar=(id322frame*)id32header->firstframe;
-        while (bonar != NULL) {
-            id322frame* next = bonar->next;
-            free(bonar->data);
-            free(bonar);
-            bonar = next;
+        i = static_cast<size_t>(end - data) + 1;
+    }
+    if (i + 2 >= data_len) { return 0; }
+    ptype_t _ptype = static_cast<ptype_t>(data[i++]);
+    // desc ('\0' terminated in its encoding), found some illegal files have no 'desc'
+    bool noDesc = (_mime == jpeg && data[i] == 0xff && data[i + 1] == 0xd8) || (_mime == png && data[i] == 0x89 && data[i + 1] == 0x50);
+    if (!noDesc) {
+        bool wide = (encoding == 1 || encoding == 2);
+        while (i + (wide ? 1 : 0) < data_len && (data[i] != 0 || (wide && data[i + 1] != 0))) {
+            i += wide ? 2 : 1;
         }
-    }
-    free(id32header);
-}
-
-int TagRead::ID31Detect(char* header, id31** id31header)
-{
-    char test[4];
-    *id31header = (id31*) calloc(sizeof(id31), 1);
-    memcpy(test, header, 3);
-    test[3] = 0;
-    // make sure TAG is present
-    if (!strcmp("TAG", test)) {
-        // successrar
-        memcpy(*id31header, header, sizeof(id31));
-        return 1;
-    }
-    // otherwise fail
-    return 0;
-}
-
-void TagRead::ID31Print(id31* id31header)
-{
-    char* buffer = (char*) calloc(1, 31);
-    memcpy(buffer, id31header->title, 30);
-    printf("Title: %s\n", buffer);
-    memcpy(buffer, id31header->artist, 30);
-    printf("Artist: %s\n", buffer);
-    memcpy(buffer, id31header->album, 30);
-    printf("Album: %s\n", buffer);
-    free(buffer);
+        if (i + (wide ? 1 : 0) >= data_len) { return 0; } // too long desc
+        i += wide ? 2 : 1;
+    }
+    if (frame_size <= i) { return 0; }
+    mime = _mime;
+    ptype = _ptype;
+    size = frame_size - i;
+    pos = field->pos + ofs + i;
+    isUnsynced = field->isUnsynced;
+    return 1;
 }
 
-void TagRead::ID31Free(id31* id31header)
-{
-    free(id31header);
-}
+// ========================
+// ID3 parsing End
+// ========================
 
 // ========================
 // RIFF parsing Start
 // ========================
-bool TagRead::GetID3v2FromRiffChunk(FIL& file, chunk_map_t& chunk_list, id32*& id32save)
-{
-    const auto it = chunk_list.find("id3 ");
-    if (it != chunk_list.end()) {
-        riff_chunk_t& id3_chunk = it->second;
-        id32* id32header = ID32Detect(&fil, id3_chunk.body_pos()); // For ID3v2.x only
-        if (id32header) {
-            id32save = id32header;
-            return true;
+// record ID3v2 in "id3 " chunk and sub chunks of LIST INFO chunk (only chunk headers are read)
+void TagRead::scanRiff()
+{
+    uint8_t buf[12];  // id(4) + size(4) + fmt_id(4)
+    if (!readAt(0, buf, sizeof(buf)) || memcmp(buf, "RIFF", 4) != 0) { return; }
+    size_t end_pos = getLESize4(&buf[4]) + 8;
+    size_t pos = 12;
+    while (pos + 8 <= end_pos) {
+        if (!readAt(pos, buf, 8)) { break; }
+        size_t size = getLESize4(&buf[4]);
+        if (memcmp(buf, "id3 ", 4) == 0) {
+            scanID3v2(pos + 8); // For ID3v2.x only
+        } else if (memcmp(buf, "LIST", 4) == 0 && size >= 4 && readAt(pos + 8, buf, 4) && memcmp(buf, "INFO", 4) == 0) {
+            scanRiffInfo(pos + 12, pos + 8 + size);
         }
+        size_t next = pos + (size + 8 + 1) / 2 * 2;  // keep even byte alighment
+        if (next <= pos) { break; } // size is out of 32bit range
+        pos = next;
     }
-    return false;
 }
 
-bool TagRead::GetListFromRiffChunk(FIL& file, chunk_map_t& chunk_list, id31*& id31save)
+void TagRead::scanRiffInfo(size_t pos, size_t end_pos)
 {
-    const auto it = chunk_list.find("LIST");
-    if (it != chunk_list.end()) {
-        riff_chunk_t& list_chunk = it->second;
-        riff_t riff;
-        auto sub_chunk_list = findRiff(fil, list_chunk.pos, "LIST", riff);
-        if (riff.fmt_id == "INFO") {
-            // copy LIST INFO data to ID3v1 member (note that ID3v1 members don't finish with '\0')
-            std::vector<std::tuple<const char*, char*, size_t>> list_text_table = {
-                {"IART", id31save->artist, 128},
-                {"INAM", id31save->title, 128},
-                {"IPRD", id31save->album, 128},
-                {"ICRD", id31save->year, 4},
-            };
-            for (auto& item : list_text_table) {
-                auto& id = std::get<0>(item);
-                auto& id3_ptr = std::get<1>(item);
-                auto& id3_size = std::get<2>(item);
-                const auto it1 = sub_chunk_list.find(id);
-                if (it1 != sub_chunk_list.end()) {
-                    riff_chunk_t& chunk = it1->second;
-                    std::string s = read<std::string>(fil, chunk.body_pos(), chunk.size);
-                    memset(id3_ptr, 0, id3_size);
-                    strncpy(id3_ptr, s.c_str(), id3_size - 1);
-                }
-            }
-            std::vector<std::pair<const char*, uint8_t*>> list_u8_table = {
-                {"IPRT", &id31save->tracknum},
-                {"IGNR", &id31save->genre},
-            };
-            for (auto& [id, id3_ptr] : list_u8_table) {
-                const auto it1 = sub_chunk_list.find(id);
-                if (it1 != sub_chunk_list.end()) {
-                    riff_chunk_t& chunk = it1->second;
-                    std::string s = read<std::string>(fil, chunk.body_pos(), chunk.size);
-                    if (s.size() > 0 && std::isdigit(s.at(0))) {  // accept both "12" and  "12/20" as 12
-                        *id3_ptr = static_cast<uint8_t>(std::stoi(s));  // stoi stops conversion if non-number appeared
-                    } else {
-                        *id3_ptr = 0;
-                    }
-                }
-            }
-            return true;
+    uint8_t buf[8];  // id(4) + size(4)
+    while (pos + 8 <= end_pos) {
+        if (!readAt(pos, buf, sizeof(buf))) { break; }
+        size_t size = getLESize4(&buf[4]);
+        if (isListed(RIFF_INFO_FIELDS, buf, 4)) {
+            addField(SrcRiffInfo, reinterpret_cast<const char*>(buf), 4, 0, false, pos + 8, size);
         }
+        size_t next = pos + (size + 8 + 1) / 2 * 2;  // keep even byte alighment
+        if (next <= pos) { break; } // size is out of 32bit range
+        pos = next;
     }
-    return false;
-}
-
-bool TagRead::findNextChunk(FIL& file, const size_t& end_pos, size_t& pos, riff_chunk_t& chunk)
-{
-    FRESULT fr;
-    UINT br;
-    chunk.id = read<std::string>(file, pos, 4);
-    chunk.pos = pos;
-    chunk.size = getLESize4(read<std::vector<uint8_t>>(file, pos + 4, 4));
-    pos += (chunk.size + 8 + 1) / 2 * 2;  // keep even byte alighment
-    if (end_pos < pos) { return false; }
-    return true;
-}
-
-TagRead::chunk_map_t TagRead::findRiff(FIL& file, const size_t& pos, const std::string riff_id, riff_t& riff)
-{
-    std::map<std::string, riff_chunk_t> riff_chunk_list;
-    std::string s = read<std::string>(file, pos, 12);
-    if (s.find(riff_id) == 0) {
-        riff.riff_id = riff_id;
-        riff.fmt_id = read<std::string>(file, pos+8, 4);
-        riff.pos = pos;
-        riff.size = getLESize4(read<std::vector<uint8_t>>(file, pos+4, 4));
-        riff_chunk_t riff_chunk;
-        size_t pos = riff.chunk_pos();
-        while (findNextChunk(file, riff.end_pos(), pos, riff_chunk)) {
-            riff_chunk_list[riff_chunk.id] = riff_chunk;
-        }
-    }
-    return riff_chunk_list;
 }
 
 // ========================
@@ -1048,191 +568,57 @@ TagRead::chunk_map_t TagRead::findRiff(FIL& file, const size_t& pos, const std::
 // ========================
 // MP4 parsing Start
 // ========================
-void TagRead::clearMP4_ilst()
-{
-    MP4_ilst_item* mp4_ilst_item = mp4_ilst.first;
-    while (mp4_ilst_item) {
-        if (mp4_ilst_item->data_buf) free(mp4_ilst_item->data_buf);
-        MP4_ilst_item* temp = mp4_ilst_item->next;
-        free(mp4_ilst_item);
-        mp4_ilst_item = temp;
-    }
-    mp4_ilst.first = NULL;
-    mp4_ilst.last = NULL;
-}
-
-int TagRead::findNextMP4Box(FIL* file, size_t end_pos, char type[4], size_t* pos, size_t* size)
-{
-    uint8_t c[8]; // size(4) + type(4)
-    FRESULT fr;
-    UINT br;
-    if (end_pos <= *pos + 8) { return 0; }
-    f_lseek(file, *pos);
-    f_read(file, c, sizeof(c), &br);
-    *size = getBESize4(c);
-    memcpy(type, &c[4], 4);
-    if (*size < 8) { return 0; } // size is out of 32bit range
-    if (*pos > *pos + *size) { return 0; } // size is out of 32bit range
-    *pos += *size;
-    if (end_pos < *pos) { return 0; } // size overflow
-    /*
-    { // DEBUG
-        printf("%c%c%c%c: %lu Byte\n", type[0], type[1], type[2], type[3], *size);
-    }
-    */
-    // for sub container holders
-    if (strncmp(type, "moov", 4) == 0 ||
-        strncmp(type, "trak", 4) == 0 ||
-        strncmp(type, "mdia", 4) == 0 ||
-        strncmp(type, "minf", 4) == 0 ||
-        strncmp(type, "stbl", 4) == 0 ||
-        strncmp(type, "dinf", 4) == 0 ||
-        strncmp(type, "udta", 4) == 0 ||
-        strncmp(type, "ilst", 4) == 0 ||
-        0) {
-        size_t pos_next = *pos - *size + 8;
-        size_t size_next;
-        findNextMP4Box(file, *pos, type, &pos_next, &size_next);
-    } else if (strncmp(type, "meta", 4) == 0) {
-        size_t pos_next = *pos - *size + 8 + 4; // meta is illegal size position somehow
-        size_t size_next;
-        findNextMP4Box(file, *pos, type, &pos_next, &size_next);
-
-    // below are end leaves of optional APPLE item list box
-    } else if (type[0] == 0xa9 || strncmp(type, "covr", 4) == 0 ||strncmp(type, "trkn", 4) == 0) {
+// record data positions of APPLE item list leaves (only box headers are read)
+void TagRead::scanMP4(size_t end_pos, size_t pos)
+{
+    while (pos + 8 < end_pos) {
+        uint8_t c[8]; // size(4) + type(4)
+        if (!readAt(pos, c, sizeof(c))) { return; }
+        size_t size = getBESize4(c);
+        const char* type = reinterpret_cast<const char*>(&c[4]);
+        if (size < 8) { return; } // size is out of 32bit range
+        if (pos > pos + size) { return; } // size is out of 32bit range
+        if (end_pos < pos + size) { return; } // size overflow
         /*
         { // DEBUG
-            printf("%c%c%c%c: %lu Byte\n", type[0], type[1], type[2], type[3], *size);
+            printf("%c%c%c%c: %lu Byte\n", type[0], type[1], type[2], type[3], size);
         }
         */
-        uint8_t data[8];
-        f_lseek(file, *pos - *size + 8);
-        f_read(file, data, sizeof(data), &br);
-        uint32_t data_size = getBESize4(data) - 8 - 8; // - 8 - 8: - (size(4) + 'data'(4)) - (data_type(4) + data_locale(4))
-        if (data[4] == 'd' && data[5] == 'a' && data[6] == 't' && data[7] == 'a') {
-            uint8_t data_type[4];
-            uint8_t data_locale[4];
-            f_read(file, data_type, sizeof(data_type), &br);
-            f_read(file, data_locale, sizeof(data_locale), &br);
-            MP4_ilst_item* mp4_ilst_item = (MP4_ilst_item*) calloc(1, sizeof(MP4_ilst_item));
-            if (mp4_ilst.first == NULL) {
-                mp4_ilst.first = mp4_ilst.last = mp4_ilst_item;
-            } else {
-                mp4_ilst.last->next = mp4_ilst_item;
-                mp4_ilst.last = mp4_ilst.last->next;
-            }
-            mp4_ilst.last = mp4_ilst_item;
-            memcpy(mp4_ilst.last->type, type, 4);
-            mp4_ilst.last->data_type = static_cast<mp4_data_t>(getBESize4(data_type));
-            mp4_ilst.last->data_size = data_size;
-            mp4_ilst.last->pos = f_tell(file);
-            if (data_size < frame_size_limit) {
-                mp4_ilst.last->hasFullData = true;
-                mp4_ilst.last->data_buf = (char*) calloc(1, data_size);
-                f_read(file, mp4_ilst.last->data_buf, data_size, &br);
-            } else {
-                mp4_ilst.last->hasFullData = false;
-                mp4_ilst.last->data_buf = (char*) calloc(1, frame_start_bytes);
-                f_read(file, mp4_ilst.last->data_buf, frame_start_bytes, &br);
+        // for sub container holders
+        if (strncmp(type, "moov", 4) == 0 ||
+            strncmp(type, "trak", 4) == 0 ||
+            strncmp(type, "mdia", 4) == 0 ||
+            strncmp(type, "minf", 4) == 0 ||
+            strncmp(type, "stbl", 4) == 0 ||
+            strncmp(type, "dinf", 4) == 0 ||
+            strncmp(type, "udta", 4) == 0 ||
+            strncmp(type, "ilst", 4) == 0 ||
+            0) {
+            scanMP4(pos + size, pos + 8);
+        } else if (strncmp(type, "meta", 4) == 0) {
+            scanMP4(pos + size, pos + 8 + 4); // meta is illegal size position somehow
+        // below are end leaves of optional APPLE item list box
+        } else if (c[4] == 0xa9 || strncmp(type, "covr", 4) == 0 || strncmp(type, "trkn", 4) == 0) {
+            uint8_t data[16]; // size(4) + 'data'(4) + data_type(4) + data_locale(4)
+            if (readAt(pos + 8, data, sizeof(data)) && memcmp(&data[4], "data", 4) == 0 && getBESize4(data) >= sizeof(data)) {
+                addField(SrcMP4, type, 4, static_cast<uint8_t>(getBESize4(&data[8])), false, pos + 8 + sizeof(data), getBESize4(data) - sizeof(data));
             }
-            mp4_ilst.last->next = NULL;
         }
+        pos += size;
     }
-    // for next leaf
-    findNextMP4Box(file, end_pos, type, pos, size);
-    return 1;
-}
-
-int TagRead::getMP4Box(FIL* file)
-{
-    char type[4];
-    size_t end_pos = f_size(file);
-    size_t pos = 0;
-    size_t size;
-    return findNextMP4Box(file, end_pos, type, &pos, &size);
-}
-
-int TagRead::GetMP4BoxUTF8(const char* mp4_type, char* str, size_t size)
-{
-    MP4_ilst_item* mp4_ilst_item = mp4_ilst.first;
-    size_t max_size;
-
-    while (mp4_ilst_item) {
-        /*
-        { // DEBUG
-            printf("%c%c%c%c: %lu Byte\n", mp4_ilst_item->type[0], mp4_ilst_item->type[1], mp4_ilst_item->type[2], mp4_ilst_item->type[3], mp4_ilst_item->data_size);
-        }
-        */
-        if (memcmp(mp4_ilst_item->type, mp4_type, 4) == 0) {
-            //printf("  matched\n");
-            if (mp4_ilst_item->data_type == reserved) { // for track number
-                uint8_t c[4];
-                memcpy(c, mp4_ilst_item->data_buf, 4);
-                sprintf(str, "%lu", getBESize4(c));
-                return 1;
-            } else if (mp4_ilst_item->data_type == UTF8) {
-                max_size = (mp4_ilst_item->data_size <= size - 1) ? mp4_ilst_item->data_size : size - 1;
-                memcpy(str, mp4_ilst_item->data_buf, max_size);
-                str[max_size] = '\0';
-                return 1;
-            } else if (mp4_ilst_item->data_type == UTF16) {
-                char _str[256*2] = {};
-                max_size = (mp4_ilst_item->data_size - 3 <= 256*2-2) ? mp4_ilst_item->data_size - 3 : 256*2-2;
-                memcpy(_str, &mp4_ilst_item->data_buf[3], max_size);
-                std::string utf8_str = utf16_to_utf8((const char16_t*) _str);
-                max_size = (utf8_str.length() <= size - 1) ? utf8_str.length() : size - 1;
-                memcpy(str, utf8_str.c_str(), max_size);
-                str[max_size] = '\0';
-                return 1;
-            }
-        }
-        mp4_ilst_item = mp4_ilst_item->next;
-    }
-    return 0;
-}
-
-int TagRead::GetMP4TypeCount(const char* mp4_type)
-{
-    int count = 0;
-    MP4_ilst_item* mp4_ilst_item = mp4_ilst.first;
-    while (mp4_ilst_item) {
-        if (memcmp(mp4_ilst_item->type, mp4_type, 4) == 0) { count++; }
-        mp4_ilst_item = mp4_ilst_item->next;
-    }
-    return count;
 }
 
 int TagRead::getMP4Picture(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size)
 {
-    int count = 0;
-    MP4_ilst_item* mp4_ilst_item = mp4_ilst.first;
-    while (mp4_ilst_item) {
-        if (memcmp(mp4_ilst_item->type, "covr", 4) == 0) {
-            if (idx == count++) {
-                mime = (mp4_ilst_item->data_type == JPEG) ? jpeg : (mp4_ilst_item->data_type == PNG) ? png : non;
-                ptype = front_cover; // no info in MP4 'covr'
-                pos = mp4_ilst_item->pos;
-                size = (size_t) mp4_ilst_item->data_size;
-                return 1;
-            }
-        }
-        mp4_ilst_item = mp4_ilst_item->next;
-    }
-    return 0;
+    tag_field_t* field = findField(SrcMP4, "covr", idx);
+    if (field == nullptr) { return 0; }
+    mime = (field->format == JPEG) ? jpeg : (field->format == PNG) ? png : non;
+    ptype = front_cover; // no info in MP4 'covr'
+    pos = field->pos;
+    size = field->size;
+    return 1;
 }
 
 // ========================
 // MP4 parsing End
 // ========================
-
-template <typename T>
-T TagRead::read(FIL& file, const size_t pos, const size_t size)
-{
-    T s;
-    UINT br;
-    std::vector<uint8_t> v(size, 0);
-    f_lseek(&file, pos);
-    f_read(&file, v.data(), v.size(), &br);
-    std::copy(v.begin(), v.end(), std::back_inserter(s));
-    return s;
-}
\ No newline at end of file
@@ -12,59 +12,22 @@
 #pragma once
 
 #include <cstddef>
-#include <map>
-#include <string>
-#include <vector>
+#include <cstdint>
 
 #include "ff.h"
 
-typedef struct _id31 {
+typedef struct _id31 {  // ID3v1 (ID3v1.1) record at the end of file
     char header[3];
-    char title[128];  // 30 for ID3v1
-    char artist[128]; // 30 for ID3v1
-    char album[128];  // 30 for ID3v1
-    char year[4];     // 4 for ID3v1
-    char comment[28]; // 28 for ID3v1
+    char title[30];
+    char artist[30];
+    char album[30];
+    char year[4];
+    char comment[28];
     char zero;
     uint8_t tracknum;
     uint8_t genre;
 } id31;
 
-typedef struct _id32frame {
-    char ID[4];
-    uint8_t sizebytes[4];
-    char flags[2];
-    size_t pos; // position in the file
-    size_t size;
-    char* data;
-    bool hasFullData;
-    bool isUnsynced;
-    struct _id32frame* next;
-} id32frame;
-
-typedef struct _id322frame {
-    char ID[3];
-    uint8_t sizebytes[3];
-    size_t pos; // position in the file
-    size_t size;
-    char* data;
-    bool hasFullData;
-    bool isUnsynced;
-    struct _id322frame* next;
-} id322frame;
-
-typedef struct _id32 {
-    char version[2];
-    char flags;
-    size_t size;
-    id32frame* firstframe;
-} id32;
-
-typedef struct _id32flat {
-    size_t size;
-    char* buffer;
-} id32flat;
-
 typedef enum _mp4_data_t {
     reserved = 0x00000000,
     UTF8 = 0x00000001,
@@ -73,20 +36,16 @@ typedef enum _mp4_data_t {
     PNG = 0x0000000e
 } mp4_data_t;
 
-typedef struct _MP4_ilst_item {
-    char type[4];
-    mp4_data_t data_type;
-    uint32_t data_size;
-    size_t pos; // position in the file
-    char* data_buf;
-    bool hasFullData;
-    struct _MP4_ilst_item* next;
-} MP4_ilst_item;
-
-typedef struct _MP4_ilst {
-    MP4_ilst_item* first;
-    MP4_ilst_item* last;
-} MP4_ilst;
+// tag field found by scan (only location is recorded, contents are decoded on request)
+typedef struct _tag_field_t {
+    char id[4];       // ID3v2 frame ID (3 chars for ID3v2.2), MP4 box type or RIFF INFO ID
+    uint8_t src;      // TagRead::src_t
+    uint8_t format;   // ID3v2: frame format flags, MP4: data type (mp4_data_t)
+    bool isUnsynced;
+    uint16_t strOfs;  // position of decoded string in string pool
+    size_t pos;       // position of field body in the file
+    size_t size;      // size of field body
+} tag_field_t;
 
 typedef enum _mime_t {
     non = 0,
@@ -118,32 +77,13 @@ typedef enum _ptype_t {
     pub_logo = 0x14
 } ptype_t;
 
-typedef struct _riff_t {
-    std::string riff_id;
-    std::string fmt_id;
-    size_t pos;
-    size_t size;
-    size_t chunk_pos() { return pos + 12; }
-    size_t end_pos() { return pos + size + 8; }
-} riff_t;
-
-typedef struct _riff_chunk_t {
-    std::string id;
-    size_t      pos;
-    size_t      size;
-    size_t body_pos() { return pos + 8; }
-    size_t end_pos() { return pos + size + 8; }
-} riff_chunk_t;
-
-const size_t frame_size_limit = 1024;
-const size_t frame_start_bytes = 16;
-
 class TagRead
 {
 public:
     TagRead();
     ~TagRead();
-    int loadFile(const char* filename);
+    int loadFile(const char* filename);  // file is kept open to decode fields on request until close() or next loadFile()
+    void close();
     int getUTF8Track(char* str, size_t size);
     int getUTF8Title(char* str, size_t size);
     int getUTF8Album(char* str, size_t size);
@@ -153,54 +93,59 @@ public:
     int getPicturePos(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size, bool& isUnsynced);
 
 private:
-    using chunk_map_t = std::map<std::string, riff_chunk_t>;
+    typedef enum {
+        SrcID3v2 = 0,
+        SrcMP4,
+        SrcRiffInfo
+    } src_t;
+    static constexpr int MAX_FIELDS = 24;
+    static constexpr size_t STR_POOL_SIZE = 512;
+    static constexpr uint16_t STR_NONE = 0xffff;
+    static constexpr size_t TEXT_READ_LIMIT = 512;  // max bytes of field body to decode as text
+    static constexpr size_t PICTURE_HEADER_SIZE = 32;  // bytes of picture field read to find binary position
 
     FIL fil;
+    bool isOpen;
+
+    // sector cache of fil (tag parsers read small headers through it instead of f_lseek/f_read each)
+    static constexpr size_t CACHE_SIZE = 512;
+    uint8_t cacheBuf[CACHE_SIZE];
+    size_t cachePos;  // file offset of cacheBuf (aligned by CACHE_SIZE)
+    size_t cacheLen;  // valid bytes in cacheBuf (0: empty)
+    size_t readPos;   // file offset of next bufRead()
+    FRESULT bufRead(void* buff, UINT btr, UINT* br);
+    void bufSeek(size_t pos);
+    size_t bufTell() const;
+    bool readAt(size_t pos, void* buff, size_t size);
+
+    tag_field_t fields[MAX_FIELDS];
+    int numFields;
+    uint8_t id3v2Version;  // 0: no ID3v2
+    bool hasId3v1;
+    id31 id3v1;
+    char strPool[STR_POOL_SIZE];  // decoded strings of fields ('\0' terminated)
+    size_t strPoolUsed;
+
+    static size_t getBESize3(const uint8_t* buf);
+    static size_t getBESize4(const uint8_t* buf);
+    static size_t getLESize4(const uint8_t* buf);
+    static size_t getBESize4SyncSafe(const uint8_t* buf);
+
+    void clear();
+    void addField(src_t src, const char* id, size_t idLen, uint8_t format, bool isUnsynced, size_t pos, size_t size);
+    tag_field_t* findField(src_t src, const char* id, int idx = 0);
+    int countField(src_t src, const char* id);
+    bool decodeText(const tag_field_t& field, char* str, size_t size);
+    int getFieldUTF8(tag_field_t* field, char* str, size_t size);
+    int getID3v1Text(const char* text, size_t len, char* str, size_t size);
+    const char* id3v2ID(const char* id3v22, const char* id3v23) const;
+
+    void scanID3v1();
+    bool scanID3v2(size_t pos);
+    void scanMP4(size_t end_pos, size_t pos);
+    void scanRiff();
+    void scanRiffInfo(size_t pos, size_t end_pos);
 
-    id31* id3v1;
-    id32* id3v2;
-
-    size_t getBESize3(const uint8_t* buf);
-    size_t getLESize4(const std::vector<uint8_t>& v);
-    size_t getBESize4(const uint8_t* buf);
-    size_t getBESize4SyncSafe(const uint8_t* buf);
-
-    FRESULT f_read_unsync(FIL* fp, void* buff, UINT btr, UINT* br, bool unsync);
-
-    int GetID3HeadersFull(FIL& infile, int testfail, id31*& id31save, id32*& id32save);
-    id32* ID32Detect(FIL* infile, const size_t pos = 0);
-    int GetID32UTF8(const char* id3v22, const char* id3v23, char* str, size_t size);
-    int GetID3IDCount(const char* id3v22, const char* id3v23);
-    void ID32Print(id32* id32header);
-    void ID32Free(id32* id32header);
     int getID32Picture(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size, bool& isUnsynced);
-
-    int ID31Detect(char* header, id31** id31header);
-    void ID31Print(id31* id31header);
-    void ID31Free(id31* id31header);
-
-    bool GetID3v2FromRiffChunk(FIL& file, chunk_map_t& riff, id32*& id32save);
-    bool GetListFromRiffChunk(FIL& file, chunk_map_t& riff, id31*& id31save);
-    chunk_map_t findRiff(FIL& file, const size_t& pos, const std::string riff_id, riff_t& riff);
-
-    /**
-     * Find next chunk
-     *
-     * @param file is FIL file
-     * @param end_pos is chunk search stop position
-     * @param pos is in: chunk search start position, out: next chunk search start position
-     * @param chunk is  out: riff chunk
-     */
-    bool findNextChunk(FIL& file, const size_t& end_pos, size_t& pos, riff_chunk_t& chunk);
-
-    MP4_ilst mp4_ilst;
-    void clearMP4_ilst();
-    int getMP4Box(FIL* fil);
-    int findNextMP4Box(FIL* fil, size_t end_pos, char chunk_id[4], size_t* pos, size_t* size);
-    int GetMP4BoxUTF8(const char* mp4_type, char* str, size_t size);
-    int GetMP4TypeCount(const char* mp4_type);
     int getMP4Picture(int idx, mime_t& mime, ptype_t& ptype, size_t& pos, size_t& size);
-
-    template <typename T>
-    T read(FIL& file, const size_t pos, const size_t size);
 };
@@ -0,0 +1,386 @@
+/*------------------------------------------------------/
+/ TrackDb
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "TrackDb.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "pico/stdlib.h"
+
+#include "file_menu_FatFs.h"
+#include "PlayFlac.h"
+#include "PlayWav.h"
+
+//#define DEBUG_TRACK_DB
+
+namespace {
+// holds FatFs lock shared with core1 during scope
+struct FsLock {
+    FsLock() { file_menu_fs_lock(); }
+    ~FsLock() { file_menu_fs_unlock(); }
+};
+}
+
+// same extensions as FILE_MENU_TYPE_AUDIO of file_menu (case insensitive)
+static bool isAudioFile(const char* fname)
+{
+    const char* ext = strrchr(fname, '.');
+    if (ext == nullptr) { return false; }
+    return strcasecmp(ext + 1, "wav") == 0 || strcasecmp(ext + 1, "flac") == 0;
+}
+
+// compare len bytes at current position of fp with str
+static bool matchFileStr(FIL* fp, const char* str, size_t len)
+{
+    char buf[32];
+    while (len > 0) {
+        UINT br;
+        UINT btr = (len < sizeof(buf)) ? len : sizeof(buf);
+        if (f_read(fp, buf, btr, &br) != FR_OK || br != btr) { return false; }
+        if (memcmp(buf, str, btr) != 0) { return false; }
+        str += btr;
+        len -= btr;
+    }
+    return true;
+}
+
+//=================================
+// Implementation of TrackDb class
+//=================================
+TrackDb& TrackDb::instance()
+{
+    static TrackDb instance; // Singleton
+    return instance;
+}
+
+bool TrackDb::isReady()
+{
+    if (!loaded) { loadHeader(); }
+    return ready;
+}
+
+bool TrackDb::isBuilding() const
+{
+    return state == Walk;
+}
+
+uint32_t TrackDb::getNumTracks() const
+{
+    return numTracks;
+}
+
+bool TrackDb::loadHeader()
+{
+    FIL fil;
+    idx_header_t hdr;
+    UINT br;
+    FsLock lock;
+    loaded = true;
+    ready = false;
+    numTracks = 0;
+    if (f_open(&fil, TRACKDB_IDX_FILENAME, FA_READ) != FR_OK) { return false; }
+    if (f_read(&fil, &hdr, sizeof(hdr), &br) == FR_OK && br == sizeof(hdr) &&
+        hdr.magic == MAGIC && hdr.version == VERSION &&
+        f_size(&fil) >= sizeof(hdr) + sizeof(uint32_t) * static_cast<FSIZE_t>(hdr.numTracks)) {
+        numTracks = hdr.numTracks;
+        ready = (numTracks > 0);
+    }
+    f_close(&fil);
+    return ready;
+}
+
+bool TrackDb::getTrack(uint32_t id, char* dirPath, size_t dirPathSize, char* name, size_t nameSize, uint32_t* sampFreq, uint32_t* durationMillis)
+{
+    FIL fil;
+    UINT br;
+    uint32_t ofs;
+    track_rec_t track;
+    dir_rec_t dir;
+    bool ok = false;
+    if (!ready || id >= numTracks) { return false; }
+    FsLock lock;
+    if (f_open(&fil, TRACKDB_IDX_FILENAME, FA_READ) != FR_OK) { return false; }
+    ok = f_lseek(&fil, sizeof(idx_header_t) + sizeof(uint32_t) * static_cast<FSIZE_t>(id)) == FR_OK &&
+        f_read(&fil, &ofs, sizeof(ofs), &br) == FR_OK && br == sizeof(ofs);
+    f_close(&fil);
+    if (!ok) { return false; }
+    if (f_open(&fil, TRACKDB_DAT_FILENAME, FA_READ) != FR_OK) { return false; }
+    ok = f_lseek(&fil, ofs) == FR_OK &&
+        f_read(&fil, &track, sizeof(track), &br) == FR_OK && br == sizeof(track) && track.nameLen < nameSize &&
+        f_read(&fil, name, track.nameLen, &br) == FR_OK && br == track.nameLen &&
+        f_lseek(&fil, track.dirOfs) == FR_OK &&
+        f_read(&fil, &dir, sizeof(dir), &br) == FR_OK && br == sizeof(dir) && dir.pathLen < dirPathSize &&
+        f_read(&fil, dirPath, dir.pathLen, &br) == FR_OK && br == dir.pathLen;
+    f_close(&fil);
+    if (!ok) { return false; }
+    name[track.nameLen] = '\0';
+    dirPath[dir.pathLen] = '\0';
+    if (sampFreq != nullptr) { *sampFreq = track.sampFreq; }
+    if (durationMillis != nullptr) { *durationMillis = track.durationMillis; }
+    return true;
+}
+
+uint32_t TrackDb::nextShuffle()
+{
+    if (numTracks == 0) { return 0; }
+    if (shuffleNum != numTracks) {
+        // LCG modulo 2^n visits all values once per period if increment is odd and multiplier is 4k+1
+        shuffleNum = numTracks;
+        shuffleMask = 1;
+        while (shuffleMask < numTracks) { shuffleMask <<= 1; }
+        shuffleMask -= 1;
+        shuffleMul = (static_cast<uint32_t>(rand()) * 4 + 1) & shuffleMask;
+        shuffleInc = (static_cast<uint32_t>(rand()) * 2 + 1) & shuffleMask;
+        shuffleState = static_cast<uint32_t>(rand()) & shuffleMask;
+    }
+    do {
+        shuffleState = (shuffleState * shuffleMul + shuffleInc) & shuffleMask;
+    } while (shuffleState >= numTracks);
+    return shuffleState;
+}
+
+void TrackDb::buildStep(uint32_t budgetUs)
+{
+    if (state == Done) { return; }
+    FsLock lock;
+    if (state == Idle) {
+        if (!loaded) { loadHeader(); }
+        if (!start()) { return; }
+    }
+    uint32_t startUs = time_us_32();
+    do {
+        frame_t& frame = frames[depth - 1];
+        if (f_readdir(&frame.dir, &fno) != FR_OK) { abort(); return; }
+        if (fno.fname[0] == '\0') { // end of directory
+            if (!frame.dirsPhase) {
+                if (!leaveFiles(frame)) { abort(); return; }
+                frame.dirsPhase = true;
+                f_readdir(&frame.dir, nullptr); // rewind to walk sub directories
+                continue;
+            }
+            f_closedir(&frame.dir);
+            depth--;
+            if (depth == 0) {
+                finish();
+                return;
+            }
+            path[frames[depth - 1].pathLen] = '\0';
+            continue;
+        }
+        if (fno.fname[0] == '.' || (fno.fattrib & (AM_HID | AM_SYS))) { continue; }
+        if (!frame.dirsPhase) {
+            if (!(fno.fattrib & AM_DIR) && isAudioFile(fno.fname)) {
+                if (!addTrack(frame)) { abort(); return; }
+            }
+        } else if ((fno.fattrib & AM_DIR) && depth < MAX_DEPTH) {
+            if (appendPath(fno.fname) && !enterDir(fno.fdate, fno.ftime)) { abort(); return; }
+        }
+    } while (time_us_32() - startUs < budgetUs);
+}
+
+void TrackDb::close()
+{
+    if (state == Walk) {
+        FsLock lock;
+        abort();
+    }
+}
+
+bool TrackDb::start()
+{
+    state = Done; // unless started successfully
+    hasOldDat = (f_open(&oldDat, TRACKDB_DAT_FILENAME, FA_READ) == FR_OK);
+    oldCursor = 0;
+    if (f_open(&newDat, DAT_TMP_FILENAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+        if (hasOldDat) { f_close(&oldDat); }
+        return false;
+    }
+    if (f_open(&newIdx, IDX_TMP_FILENAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+        f_close(&newDat);
+        f_unlink(DAT_TMP_FILENAME);
+        if (hasOldDat) { f_close(&oldDat); }
+        return false;
+    }
+    state = Walk;
+    idx_header_t hdr = {MAGIC, VERSION, 0, 0};
+    UINT bw;
+    if (f_write(&newIdx, &hdr, sizeof(hdr), &bw) != FR_OK || bw != sizeof(hdr)) {
+        abort();
+        return false;
+    }
+    newNumTracks = 0;
+    newNumDirs = 0;
+    depth = 0;
+    strncpy(path, "/", sizeof(path));
+    if (!enterDir(0, 0) || depth == 0) {
+        abort();
+        return false;
+    }
+    return true;
+}
+
+void TrackDb::finish()
+{
+    idx_header_t hdr = {MAGIC, VERSION, newNumTracks, newNumDirs};
+    UINT bw;
+    FRESULT fr = f_lseek(&newIdx, 0);
+    if (fr == FR_OK) { fr = f_write(&newIdx, &hdr, sizeof(hdr), &bw); }
+    f_close(&newIdx);
+    f_close(&newDat);
+    if (hasOldDat) { f_close(&oldDat); }
+    if (fr == FR_OK) {
+        f_unlink(TRACKDB_IDX_FILENAME);
+        f_unlink(TRACKDB_DAT_FILENAME);
+        f_rename(DAT_TMP_FILENAME, TRACKDB_DAT_FILENAME);
+        f_rename(IDX_TMP_FILENAME, TRACKDB_IDX_FILENAME);
+        #if FF_USE_CHMOD
+        f_chmod(TRACKDB_DAT_FILENAME, AM_HID, AM_HID);
+        f_chmod(TRACKDB_IDX_FILENAME, AM_HID, AM_HID);
+        #endif // #if FF_USE_CHMOD
+    }
+    loadHeader();
+    shuffleNum = 0;
+    state = Done;
+    printf("TrackDb: %" PRIu32 " tracks in %" PRIu32 " directories\r\n", newNumTracks, newNumDirs);
+}
+
+void TrackDb::abort()
+{
+    for (int i = 0; i < depth; i++) {
+        f_closedir(&frames[i].dir);
+    }
+    depth = 0;
+    f_close(&newIdx);
+    f_close(&newDat);
+    f_unlink(IDX_TMP_FILENAME);
+    f_unlink(DAT_TMP_FILENAME);
+    if (hasOldDat) { f_close(&oldDat); }
+    state = Done;
+    printf("TrackDb: build aborted\r\n");
+}
+
+bool TrackDb::appendPath(const char* name)
+{
+    size_t len = strlen(path);
+    size_t nameLen = strlen(name);
+    size_t sep = (len > 1) ? 1 : 0; // root is "/"
+    if (len + sep + nameLen >= sizeof(path)) { return false; }
+    if (sep) { path[len++] = '/'; }
+    memcpy(&path[len], name, nameLen + 1);
+    return true;
+}
+
+// open directory of path, returns false only if database write failed
+bool TrackDb::enterDir(uint16_t fdate, uint16_t ftime)
+{
+    frame_t& frame = frames[depth];
+    frame.pathLen = static_cast<uint16_t>(strlen(path));
+    frame.fdate = fdate;
+    frame.ftime = ftime;
+    if (f_opendir(&frame.dir, path) != FR_OK) {
+        if (depth > 0) { path[frames[depth - 1].pathLen] = '\0'; }
+        return true; // skip
+    }
+    frame.dirsPhase = false;
+    frame.dirOfs = static_cast<uint32_t>(f_tell(&newDat));
+    frame.numTracks = 0;
+    frame.oldLeft = 0;
+    depth++;
+    dir_rec_t rec = {0, frame.pathLen, fdate, ftime, 0};
+    UINT bw;
+    if (f_write(&newDat, &rec, sizeof(rec), &bw) != FR_OK || bw != sizeof(rec)) { return false; }
+    if (f_write(&newDat, path, frame.pathLen, &bw) != FR_OK || bw != frame.pathLen) { return false; }
+    uint32_t tracksOfs;
+    uint16_t num;
+    if (findOldDir(fdate, ftime, tracksOfs, num)) {
+        frame.oldOfs = tracksOfs;
+        frame.oldLeft = num;
+    }
+    newNumDirs++;
+    return true;
+}
+
+// patch directory record when all tracks are added
+bool TrackDb::leaveFiles(frame_t& frame)
+{
+    FSIZE_t endPos = f_tell(&newDat);
+    dir_rec_t rec = {static_cast<uint32_t>(endPos - frame.dirOfs), frame.pathLen, frame.fdate, frame.ftime, frame.numTracks};
+    UINT bw;
+    if (f_lseek(&newDat, frame.dirOfs) != FR_OK) { return false; }
+    if (f_write(&newDat, &rec, sizeof(rec), &bw) != FR_OK || bw != sizeof(rec)) { return false; }
+    return f_lseek(&newDat, endPos) == FR_OK;
+}
+
+// find directory block of path with the same timestamp in previous database
+bool TrackDb::findOldDir(uint16_t fdate, uint16_t ftime, uint32_t& tracksOfs, uint16_t& num)
+{
+    if (!hasOldDat) { return false; }
+    size_t pathLen = strlen(path);
+    uint32_t pos = oldCursor;
+    while (pos + sizeof(dir_rec_t) <= f_size(&oldDat)) {
+        dir_rec_t rec;
+        UINT br;
+        if (f_lseek(&oldDat, pos) != FR_OK || f_read(&oldDat, &rec, sizeof(rec), &br) != FR_OK || br != sizeof(rec)) { return false; }
+        if (rec.blockSize < sizeof(rec) + rec.pathLen) { return false; } // broken
+        if (rec.pathLen == pathLen && matchFileStr(&oldDat, path, pathLen)) {
+            oldCursor = pos + rec.blockSize;
+            if (rec.fdate != fdate || rec.ftime != ftime) { return false; } // modified
+            tracksOfs = pos + sizeof(rec) + rec.pathLen;
+            num = rec.numTracks;
+            return true;
+        }
+        pos += rec.blockSize;
+    }
+    return false;
+}
+
+// add track of fno in current directory, returns false only if database write failed
+bool TrackDb::addTrack(frame_t& frame)
+{
+    track_rec_t rec = {frame.dirOfs, static_cast<uint32_t>(fno.fsize), 0, 0, static_cast<uint16_t>(strlen(fno.fname)), 0};
+    bool reused = false;
+    if (frame.oldLeft > 0) {
+        track_rec_t old;
+        UINT br;
+        if (f_lseek(&oldDat, frame.oldOfs) == FR_OK && f_read(&oldDat, &old, sizeof(old), &br) == FR_OK && br == sizeof(old) &&
+            old.nameLen == rec.nameLen && old.fsize == rec.fsize && matchFileStr(&oldDat, fno.fname, rec.nameLen)) {
+            rec.sampFreq = old.sampFreq;
+            rec.durationMillis = old.durationMillis;
+            frame.oldOfs += sizeof(old) + old.nameLen;
+            frame.oldLeft--;
+            reused = true;
+        }
+    }
+    if (!reused) {
+        if (!appendPath(fno.fname)) { return true; } // skip
+        FIL fil;
+        bool ok = false;
+        if (f_open(&fil, path, FA_READ) == FR_OK) {
+            ok = PlayWav::probe(&fil, rec.sampFreq, rec.durationMillis);
+            if (!ok) { ok = PlayFlac::probe(&fil, rec.sampFreq, rec.durationMillis); }
+            f_close(&fil);
+        }
+        path[frame.pathLen] = '\0';
+        if (!ok) { return true; } // not playable
+        #ifdef DEBUG_TRACK_DB
+        printf("TrackDb: probed %s %" PRIu32 " Hz %" PRIu32 " ms\r\n", fno.fname, rec.sampFreq, rec.durationMillis);
+        #endif // DEBUG_TRACK_DB
+    }
+    uint32_t ofs = static_cast<uint32_t>(f_tell(&newDat));
+    UINT bw;
+    if (f_write(&newDat, &rec, sizeof(rec), &bw) != FR_OK || bw != sizeof(rec)) { return false; }
+    if (f_write(&newDat, fno.fname, rec.nameLen, &bw) != FR_OK || bw != rec.nameLen) { return false; }
+    if (f_write(&newIdx, &ofs, sizeof(ofs), &bw) != FR_OK || bw != sizeof(ofs)) { return false; }
+    frame.numTracks++;
+    newNumTracks++;
+    return true;
+}
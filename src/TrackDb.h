@@ -0,0 +1,112 @@
+/*------------------------------------------------------/
+/ TrackDb
+/-------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ff.h"
+
+//=================================
+// Interface of TrackDb class
+//=================================
+// Flat database of all WAV and FLAC tracks on the card, identified by track ID
+// (files in root directory: TRACKDB_DAT_FILENAME: records, TRACKDB_IDX_FILENAME: offsets by track ID)
+class TrackDb
+{
+public:
+    static constexpr const char* TRACKDB_DAT_FILENAME = "/.trackdb.dat";
+    static constexpr const char* TRACKDB_IDX_FILENAME = "/.trackdb.idx";
+    static constexpr int MAX_DEPTH = 8;
+    static constexpr size_t PATH_SIZE = 384;
+    static TrackDb& instance(); // Singleton
+    void buildStep(uint32_t budgetUs);  // incremental rebuild in idle time (starts at first call)
+    void close();
+    bool isReady();  // loads header of existing database at first call
+    bool isBuilding() const;
+    uint32_t getNumTracks() const;
+    bool getTrack(uint32_t id, char* dirPath, size_t dirPathSize, char* name, size_t nameSize, uint32_t* sampFreq = nullptr, uint32_t* durationMillis = nullptr);
+    uint32_t nextShuffle();  // each ID appears once per cycle of getNumTracks() calls
+protected:
+    static constexpr uint32_t MAGIC = 0x42445254; // "TRDB"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr const char* DAT_TMP_FILENAME = "/.trackdb.dat.tmp";
+    static constexpr const char* IDX_TMP_FILENAME = "/.trackdb.idx.tmp";
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t numTracks;
+        uint32_t numDirs;
+    } idx_header_t;
+    typedef struct {
+        uint32_t blockSize;  // size of this record + path + track records (sub directories follow as separate blocks)
+        uint16_t pathLen;
+        uint16_t fdate;
+        uint16_t ftime;
+        uint16_t numTracks;
+    } dir_rec_t;
+    typedef struct {
+        uint32_t dirOfs;
+        uint32_t fsize;
+        uint32_t sampFreq;
+        uint32_t durationMillis;
+        uint16_t nameLen;
+        uint16_t reserved;
+    } track_rec_t;
+    typedef enum {
+        Idle = 0,
+        Walk,
+        Done
+    } state_t;
+    typedef struct {
+        DIR dir;
+        uint16_t pathLen;
+        uint16_t fdate;
+        uint16_t ftime;
+        bool dirsPhase;  // false: tracks in this directory, true: sub directories
+        uint32_t dirOfs;
+        uint16_t numTracks;
+        uint32_t oldOfs;   // next track record to reuse in previous database
+        uint16_t oldLeft;  // number of track records left to reuse
+    } frame_t;
+    TrackDb() = default;
+    TrackDb(const TrackDb&) = delete;
+    TrackDb& operator=(const TrackDb&) = delete;
+    state_t state = Idle;
+    bool loaded = false;
+    bool ready = false;
+    uint32_t numTracks = 0;
+    // shuffle (full period LCG over power of 2 range)
+    uint32_t shuffleNum = 0;
+    uint32_t shuffleMask = 0;
+    uint32_t shuffleMul = 1;
+    uint32_t shuffleInc = 1;
+    uint32_t shuffleState = 0;
+    // builder
+    FIL oldDat;
+    bool hasOldDat = false;
+    uint32_t oldCursor = 0;
+    FIL newDat;
+    FIL newIdx;
+    uint32_t newNumTracks = 0;
+    uint32_t newNumDirs = 0;
+    frame_t frames[MAX_DEPTH];
+    int depth = 0;
+    char path[PATH_SIZE];
+    FILINFO fno;
+    bool loadHeader();
+    bool start();
+    void finish();
+    void abort();
+    bool enterDir(uint16_t fdate, uint16_t ftime);
+    bool leaveFiles(frame_t& frame);
+    bool findOldDir(uint16_t fdate, uint16_t ftime, uint32_t& tracksOfs, uint16_t& num);
+    bool addTrack(frame_t& frame);
+    bool appendPath(const char* name);
+};
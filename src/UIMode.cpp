@@ -10,12 +10,16 @@
 
 #include <cstdio>
 #include <cstring>
+#include <strings.h>
 
 #include "pico/stdlib.h"
 
 #include "audio_codec.h"
+#include "boot_sequence.h"
+#include "CoverCache.h"
 #include "file_menu_FatFs.h"
 #include "power_manage.h"
+#include "profiler.h"
 #include "TagRead.h"
 #include "tf_card.h"
 
@@ -29,12 +33,15 @@ TagRead tag;
 // UIMode class instances
 button_action_t UIMode::btn_act;
 button_unit_t UIMode::btn_unit;
+uint16_t UIMode::ticks = 0;
 UIVars* UIMode::vars;
 std::stack<stack_data_t> UIMode::dir_stack;
 UIMode::ExitType UIMode::exitType = UIMode::NoError;
 ConfigMenu& UIMode::cfgMenu = ConfigMenu::instance();
 ConfigParam& UIMode::cfgParam = ConfigParam::instance();
 LcdCanvas* UIMode::lcd = nullptr;  // dynamic instance generation after configureLcd() is needed
+TrackDb& UIMode::trackDb = TrackDb::instance();
+ResumeLog& UIMode::resumeLog = ResumeLog::instance();
 std::array<UIMode*, NUM_UI_MODES> UIMode::ui_mode_ary;
 
 //================================
@@ -54,6 +61,26 @@ void UIMode::initialize(UIVars* vars)
     lcd = &LcdCanvas::instance();
 }
 
+/*static*/
+void UIMode::tick(uint32_t cycleMs)
+{
+    static uint32_t prevMs = 0;
+    static uint32_t remainMs = 0;
+    uint32_t nowMs = to_ms_since_boot(get_absolute_time());
+    remainMs += nowMs - prevMs;
+    prevMs = nowMs;
+    // an update woken early by event adds no tick, a late update (slow previous update) adds no more than its cycle
+    uint32_t maxTicks = cycleMs / UpdateCycleMs;
+    if (remainMs / UpdateCycleMs > maxTicks) {
+        ticks = maxTicks;
+        remainMs = 0;
+    } else {
+        ticks = remainMs / UpdateCycleMs;
+        remainMs %= UpdateCycleMs;
+    }
+}
+
+/*static*/
 UIMode* UIMode::getUIMode(const ui_mode_enm_t& ui_mode_enm)
 {
     return ui_mode_ary.at(ui_mode_enm);
@@ -74,14 +101,28 @@ void UIMode::entry(UIMode* prevMode)
     ui_clear_btn_evt();
 }
 
+// codec by extension of audio file name
+static PlayAudio::audio_codec_t codecOfName(const char* name)
+{
+    const char* ext = strrchr(name, '.');
+    if (ext != nullptr && strcasecmp(ext + 1, "flac") == 0) { return PlayAudio::AUDIO_CODEC_FLAC; }
+    return PlayAudio::AUDIO_CODEC_WAV;
+}
+
+PlayAudio::audio_codec_t UIMode::getAudioCodec(const uint16_t& idx) const
+{
+    if (file_menu_get_type(idx) != FILE_MENU_TYPE_AUDIO) { return PlayAudio::AUDIO_CODEC_NONE; }
+    char name[FF_MAX_LFN];
+    memset(name, 0, sizeof(name));
+    file_menu_get_fname(idx, name, sizeof(name) - 1);
+    return codecOfName(name);
+}
+
 bool UIMode::isAudioFile(const uint16_t& idx) const
 {
-    if (file_menu_match_ext(idx, "wav", 3) ||  file_menu_match_ext(idx, "WAV", 3)) {
-        set_audio_codec(PlayAudio::AUDIO_CODEC_WAV);
-        return true;
-    }
-    set_audio_codec(PlayAudio::AUDIO_CODEC_NONE);
-    return false;
+    PlayAudio::audio_codec_t audio_codec = getAudioCodec(idx);
+    set_audio_codec(audio_codec);
+    return audio_codec != PlayAudio::AUDIO_CODEC_NONE;
 }
 
 const char* UIMode::getName() const
@@ -99,6 +140,50 @@ uint16_t UIMode::getIdleCount() const
     return idle_count;
 }
 
+uint32_t UIMode::getUpdateCycleMs() const
+{
+    return UpdateCycleMs;
+}
+
+bool UIMode::isBacklightLow() const
+{
+    return idle_count >= cfgMenu.get(ConfigMenuId::DISPLAY_TIME_TO_BACKLIGHT_LOW) * OneSec;
+}
+
+bool UIMode::getPlayPath(char* path, size_t size) const
+{
+    memset(path, 0, size);
+    if (file_menu_get_cwd_path(path, size - 1) != FR_OK) { return false; }
+    size_t len = strlen(path);
+    if (path[len-1] != '/') { path[len++] = '/'; }
+    if (len >= size - 1 || file_menu_get_fname(vars->idx_play, &path[len], size - len) != FR_OK || path[size-1] != '\0') {
+        path[0] = '\0'; // too long or not found
+        return false;
+    }
+    return true;
+}
+
+void UIMode::storeCheckpoint(const ui_mode_enm_t& resume_ui_mode, size_t fpos, uint32_t samples_played) const
+{
+    ResumeLog::checkpoint_t cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.playPos = static_cast<uint64_t>(fpos);
+    cp.samplesPlayed = samples_played;
+    cp.uiMode = resume_ui_mode;
+    cp.idxHead = vars->idx_head;
+    cp.idxColumn = vars->idx_column;
+    cp.idxPlay = vars->idx_play;
+    cp.stackCount = dir_stack.size();
+    std::stack<stack_data_t> stack = dir_stack;
+    for (int i = 0; i < ResumeLog::MAX_STACK && !stack.empty(); i++) {
+        cp.stackHead[i] = stack.top().head;
+        cp.stackColumn[i] = stack.top().column;
+        stack.pop();
+    }
+    if (resume_ui_mode == PlayMode) { getPlayPath(cp.playPath, sizeof(cp.playPath)); }
+    resumeLog.store(cp);
+}
+
 //=======================================
 // Implementation of UIInitialMode class
 //=======================================
@@ -115,7 +200,7 @@ UIMode* UIInitialMode::update()
     } else {
         return getUIMode(OpeningMode);
     }
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
@@ -133,9 +218,37 @@ void UIInitialMode::draw() const
 void UIInitialMode::loadFromFlash() const
 {
     // Load Configuration parameters from Flash
+    boot_stage_begin(BOOT_STAGE_CONFIG);
     cfgParam.initialize();
     printf("Raspberry Pi Pico Player ver. %s\r\n", cfgParam.P_CFG_REVISION.get().c_str());
     cfgMenu.scanHookFunc();
+    loadCheckpoint();
+    boot_stage_end(BOOT_STAGE_CONFIG);
+    boot_storage_config_ready();  // Dir Index Cache setting is applied
+}
+
+// resume state checkpointed after the last power off (e.g. battery removed while playing) overrides cfgParam
+void UIInitialMode::loadCheckpoint() const
+{
+    ResumeLog::checkpoint_t cp;
+    resumeLog.initialize();
+    if (!resumeLog.load(cp) || cp.closed) { return; }
+    printf("Resume from checkpoint\r\n");
+    cfgParam.P_CFG_STACK_COUNT.set(cp.stackCount);
+    for (int i = 0; i < cp.stackCount && i < ResumeLog::MAX_STACK; i++) {
+        auto& head_param = (i == 4) ? cfgParam.P_CFG_STACK_HEAD4 : (i == 3) ? cfgParam.P_CFG_STACK_HEAD3 : (i == 2) ? cfgParam.P_CFG_STACK_HEAD2 : (i == 1) ? cfgParam.P_CFG_STACK_HEAD1 : cfgParam.P_CFG_STACK_HEAD0;
+        auto& column_param = (i == 4) ? cfgParam.P_CFG_STACK_COLUMN4 : (i == 3) ? cfgParam.P_CFG_STACK_COLUMN3 : (i == 2) ? cfgParam.P_CFG_STACK_COLUMN2 : (i == 1) ? cfgParam.P_CFG_STACK_COLUMN1 : cfgParam.P_CFG_STACK_COLUMN0;
+        head_param.set(cp.stackHead[i]);
+        column_param.set(cp.stackColumn[i]);
+    }
+    cfgParam.P_CFG_UIMODE.set(cp.uiMode);
+    cfgParam.P_CFG_IDX_HEAD.set(cp.idxHead);
+    cfgParam.P_CFG_IDX_COLUMN.set(cp.idxColumn);
+    cfgParam.P_CFG_IDX_PLAY.set(cp.idxPlay);
+    cfgParam.P_CFG_PLAY_POS.set(cp.playPos);
+    cfgParam.P_CFG_SAMPLES_PLAYED.set(cp.samplesPlayed);
+    cp.playPath[sizeof(cp.playPath) - 1] = '\0';
+    cfgParam.P_CFG_PLAY_PATH.set(std::string(cp.playPath));
 }
 
 //=======================================
@@ -165,13 +278,14 @@ UIMode* UIChargeMode::update()
         #endif // ENABLE_REBOOT_AFTER_WAKEUP
         return getUIMode(OpeningMode);
     }
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
 void UIChargeMode::entry(UIMode* prevMode)
 {
     UIMode::entry(prevMode);
+    boot_storage_wait(nullptr);  // core1 needs to be idle before dormant
     lcd->setMsg("Charging", true);
     pm_enable_button_control(true);  // for wake up
     pm_set_power_keep(false);
@@ -183,6 +297,11 @@ void UIChargeMode::draw() const
     ui_clear_btn_evt();
 }
 
+uint32_t UIChargeMode::getUpdateCycleMs() const
+{
+    return IdleUpdateCycleMs;  // only waits for timeout to dormant
+}
+
 //=======================================
 // Implementation of UIOpeningMode class
 //=======================================
@@ -239,12 +358,47 @@ void UIOpeningMode::restoreFromFlash() const
     }
 }
 
+// start playback from resume snapshot ahead of restoring dir_stack (which sorts every ancestor directory)
+bool UIOpeningMode::resumePlay() const
+{
+    if (static_cast<ui_mode_enm_t>(cfgParam.P_CFG_UIMODE.get()) != PlayMode) { return false; }
+    const std::string& path = cfgParam.P_CFG_PLAY_PATH.get();
+    if (path.empty()) { return false; }
+    PlayAudio* codec = set_audio_codec(codecOfName(path.c_str()));  // snapshot is stored only for audio file
+    codec->play(path.c_str(), static_cast<size_t>(cfgParam.P_CFG_PLAY_POS.get()), cfgParam.P_CFG_SAMPLES_PLAYED.get());
+    if (!codec->isPlaying()) {
+        set_audio_codec(PlayAudio::AUDIO_CODEC_NONE);
+        return false;
+    }
+    printf("Resume %s\r\n", path.c_str());
+    return true;
+}
+
+// keep resumed playback only if restored dir_stack leads to the same file
+void UIOpeningMode::verifyResumed() const
+{
+    char str[FF_MAX_LFN];
+    PlayAudio* codec = get_audio_codec();
+    const char* name = strrchr(cfgParam.P_CFG_PLAY_PATH.get().c_str(), '/');
+    memset(str, 0, sizeof(str));
+    if (vars->init_dest_ui_mode == PlayMode && vars->idx_play < file_menu_get_num()) {
+        file_menu_get_fname(vars->idx_play, str, sizeof(str) - 1);
+    }
+    if (name != nullptr && strcmp(name + 1, str) == 0 && isAudioFile(vars->idx_play)) {
+        vars->resumed = true;
+        return;
+    }
+    printf("Resume mismatch, stopped\r\n");
+    codec->stop();
+    set_audio_codec(PlayAudio::AUDIO_CODEC_NONE);
+}
+
 UIMode* UIOpeningMode::update()
 {
     ui_get_btn_evt(btn_act, btn_unit); // Ignore button event
     if (exitType == FatFsError) {
         return getUIMode(PowerOffMode);
-    } else if (idle_count++ > 1 * OneSec) { // Always transfer to FileViewMode after 1 sec when no error
+    } else if ((idle_count += ticks) > 1 * OneSec) { // Always transfer to FileViewMode after 1 sec when no error
         return getUIMode(FileViewMode);
     }
     return this;
@@ -257,44 +411,60 @@ void UIOpeningMode::entry(UIMode* prevMode)
     sleep_ms(10);
     pm_enable_button_control(true);
 
-    // Particular microsd card needs interval time when reboot, otherwise fails to mount (Samsung PRO Plus)
-    if (pm_is_caused_reboot()) {
-        sleep_ms(1000);
-    }
-    // Mount FAT
-    int count = 0;
-    FRESULT fr;
-    while (true) {
-        fr = file_menu_init(&vars->fs_type);
-        if (fr == FR_OK || count++ > 10) { break; }
-        sleep_ms(10);
-    }
-    if (fr != FR_OK) { // Mount Fail
+    // Mount FAT and open root directory (started on core1 at boot, mounted again after charging as card could be changed)
+    FRESULT fr = (prevMode->getUIModeEnm() == ChargeMode) ? mountStorage() : boot_storage_wait(&vars->fs_type);
+    if (fr != FR_OK && fr != FR_NO_FILE) { // Mount Fail
         exitType = FatFsError;
         lcd->setMsg("No SD Card Found!", true);
         return;
     }
     const char* fs_type_str[5] = {"NOT_MOUNTED", "FAT12", "FAT16", "FAT32", "EXFAT"};
     printf("SD Card File System = %s\r\n", fs_type_str[vars->fs_type]);
-
-    // Open root directory
-    file_menu_open_dir("/");
-    if (file_menu_get_num() <= 1) { // Directory read Fail
+    if (fr == FR_NO_FILE) { // Directory read Fail
         exitType = FatFsError;
         lcd->setMsg("SD Card Read Error!", true);
         return;
     }
+    CoverCache::instance().setEnabled(cfgMenu.get(ConfigMenuId::GENERAL_COVER_ART_CACHE));
     exitType = NoError;
+
+    boot_stage_begin(BOOT_STAGE_AUDIO);
+    audio_codec_init(cfgMenu.get(ConfigMenuId::PLAY_BUFFER_PROFILE) * 1024);  // buffer profile is applied at boot
+    audio_codec_set_dac_enable_func(pm_set_audio_dac_enable);
+    audio_codec_set_background_task(file_menu_prefetch_step);  // index parent and next directory on core1 during playback
+    boot_stage_end(BOOT_STAGE_AUDIO);
+    bool resumed = resumePlay();
+    if (resumed) { pm_set_audio_dac_enable(true); } // I2S DAC Mute Off
+
     // Opening Logo
     lcd->setImageJpeg("logo.jpg");
 
     restoreFromFlash();
-
-    audio_codec_init();
-    audio_codec_set_dac_enable_func(pm_set_audio_dac_enable);
+    if (resumed) { verifyResumed(); }
 
     lcd->switchToOpening();
     pm_set_audio_dac_enable(true); // I2S DAC Mute Off
+    boot_print_stages();
+}
+
+// serial mount and root directory scan (FR_NO_FILE: directory read fail)
+FRESULT UIOpeningMode::mountStorage() const
+{
+    // Particular microsd card needs interval time when reboot, otherwise fails to mount (Samsung PRO Plus)
+    if (pm_is_caused_reboot()) {
+        sleep_ms(1000);
+    }
+    int count = 0;
+    FRESULT fr;
+    while (true) {
+        fr = file_menu_init(&vars->fs_type);
+        if (fr == FR_OK || count++ > 10) { break; }
+        sleep_ms(10);
+    }
+    if (fr != FR_OK) { return fr; }
+    file_menu_set_index_cache(cfgMenu.get(ConfigMenuId::GENERAL_DIR_INDEX_CACHE));
+    file_menu_open_dir("/");
+    return (file_menu_get_num() <= 1) ? FR_NO_FILE : FR_OK;
 }
 
 void UIOpeningMode::draw() const
@@ -317,29 +487,28 @@ UIFileViewMode::UIFileViewMode() : UIMode("UIFileViewMode", FileViewMode)
 
 void UIFileViewMode::listIdxItems()
 {
-    char str[256];
-    memset(str, 0, sizeof(str));
     for (int i = 0; i < vars->num_list_lines; i++) {
         if (vars->idx_head+i >= file_menu_get_num()) {
             lcd->setListItem(i, ""); // delete
             continue;
         }
-        file_menu_get_fname(vars->idx_head+i, str, sizeof(str) - 1);
-        IconIndex_t iconIndex = file_menu_is_dir(vars->idx_head+i) ? IconIndex_t::FOLDER : IconIndex_t::FILE;
-        lcd->setListItem(i, str, iconIndex, (i == vars->idx_column));
+        uint16_t idx = vars->idx_head+i;
+        IconIndex_t iconIndex = file_menu_is_dir(idx) ? IconIndex_t::FOLDER : IconIndex_t::FILE;
+        lcd->writeListItem(i, [idx](char* s, size_t size) {
+            return file_menu_get_fname(idx, s, static_cast<uint16_t>(size)) == FR_OK;
+        }, iconIndex, (i == vars->idx_column));
     }
 }
 
 uint16_t UIFileViewMode::getNumAudioFiles() const
 {
-    uint16_t num_tracks = 0;
-    num_tracks += file_menu_get_ext_num("wav", 3) + file_menu_get_ext_num("WAV", 3);
-    return num_tracks;
+    return file_menu_get_type_num(FILE_MENU_TYPE_AUDIO);
 }
 
 void UIFileViewMode::chdir() const
 {
     stack_data_t item;
+    pm_clock_boost(true); // for directory sorting
     if (vars->idx_head+vars->idx_column == 0) { // upper ("..") dirctory
         if (dir_stack.size() > 0) {
             if (vars->fs_type == FS_EXFAT) { // This is workaround for FatFs known bug for ".." in EXFAT
@@ -382,10 +551,13 @@ void UIFileViewMode::chdir() const
         item.head = vars->idx_head;
         item.column = vars->idx_column;
         dir_stack.push(item);
-        file_menu_ch_dir(vars->idx_head+vars->idx_column);
+        if (file_menu_ch_dir(vars->idx_head+vars->idx_column) == FR_NOT_ENOUGH_CORE) {
+            printf("WARNING: only first %d entries are listed\r\n", file_menu_get_capacity());
+        }
         vars->idx_head = 0;
         vars->idx_column = 0;
     }
+    pm_clock_boost(false);
 }
 
 UIMode* UIFileViewMode::nextPlay()
@@ -405,6 +577,9 @@ UIMode* UIFileViewMode::nextPlay()
         case ConfigMenu::NextPlayAction_t::Random:
             return randomSearch(cfgMenu.get(ConfigMenuId::PLAY_RANDOM_DIR_DEPTH));
             break;
+        case ConfigMenu::NextPlayAction_t::Shuffle:
+            return shuffleSearch();
+            break;
         case ConfigMenu::NextPlayAction_t::Stop:
         default:
             return this;
@@ -507,6 +682,63 @@ UIMode* UIFileViewMode::randomSearch(const uint16_t& depth)
     return getUIPlayMode();
 }
 
+UIMode* UIFileViewMode::shuffleSearch()
+{
+    char dirPath[TrackDb::PATH_SIZE];
+    char name[FF_MAX_LFN+1];
+
+    printf("Shuffle Search\r\n");
+    if (trackDb.isReady()) {
+        for (int retry = 0; retry < 3; retry++) { // track could be removed after database was built
+            uint32_t id = trackDb.nextShuffle();
+            if (trackDb.getTrack(id, dirPath, sizeof(dirPath), name, sizeof(name)) && openTrack(dirPath, name)) {
+                return getUIPlayMode();
+            }
+        }
+    }
+    // database is not built yet
+    return randomSearch(cfgMenu.get(ConfigMenuId::PLAY_RANDOM_DIR_DEPTH));
+}
+
+bool UIFileViewMode::openTrack(const char* dirPath, const char* name)
+{
+    char dirName[FF_MAX_LFN+1];
+    int32_t order;
+    bool dirFound = true;
+    bool found = false;
+
+    pm_clock_boost(true); // for directory sorting
+    while (dir_stack.size()) { dir_stack.pop(); }
+    file_menu_close_dir();
+    file_menu_open_dir("/"); // Root directory
+    const char* ptr = dirPath;
+    while (*ptr != '\0') {
+        if (*ptr == '/') { ptr++; continue; }
+        const char* end = strchr(ptr, '/');
+        size_t len = (end != nullptr) ? end - ptr : strlen(ptr);
+        if (len >= sizeof(dirName)) { dirFound = false; break; }
+        memcpy(dirName, ptr, len);
+        dirName[len] = '\0';
+        ptr += len;
+        order = file_menu_find(dirName);
+        if (order <= 0 || file_menu_is_dir(order) <= 0) { dirFound = false; break; }
+        stack_data_t item = {static_cast<uint16_t>(order), 0};
+        dir_stack.push(item);
+        file_menu_ch_dir(order);
+    }
+    if (dirFound) {
+        order = file_menu_find(name);
+        if (order > 0 && isAudioFile(order)) {
+            vars->idx_head = order;
+            vars->idx_column = 0;
+            vars->idx_play = order;
+            found = true;
+        }
+    }
+    pm_clock_boost(false);
+    return found;
+}
+
 void UIFileViewMode::findFirstAudioTrack() const
 {
     vars->idx_play = 0;
@@ -633,6 +865,7 @@ UIMode* UIFileViewMode::update()
                 listIdxItems();
                 break;
             case button_action_t::PlusLong:
+            case button_action_t::PlusFwd:
                 if (btn_layout.get() == static_cast<uint32_t>(button_layout_t::Horizontal)) {
                     idxFastInc();
                 } else {
@@ -649,6 +882,7 @@ UIMode* UIFileViewMode::update()
                 listIdxItems();
                 break;
             case button_action_t::MinusLong:
+            case button_action_t::MinusRwd:
                 if (btn_layout.get() == static_cast<uint32_t>(button_layout_t::Horizontal)) {
                     idxFastDec();
                 } else {
@@ -684,15 +918,24 @@ UIMode* UIFileViewMode::update()
         return getUIMode(PowerOffMode);
     } else if (idle_count > 5 * OneSec) {
         file_menu_idle(); // for background sort
+        if (!get_audio_codec()->isPlaying()) {
+            resumeLog.maintain();
+            CoverCache::instance().flush();
+        }
+        if (cfgMenu.get(ConfigMenuId::PLAY_NEXT_PLAY_ALBUM) == ConfigMenu::NextPlayAction_t::Shuffle) {
+            trackDb.buildStep(TrackDbBuildBudgetUs); // for background track database build
+        }
     }
     lcd->setBatteryVoltage(pm_get_battery_voltage());
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
 void UIFileViewMode::entry(UIMode* prevMode)
 {
     UIMode::entry(prevMode);
+    if (!get_audio_codec()->isPlaying()) { pm_set_clock_low(true); } // resumed track could be playing at boot
+    if (prevMode->getUIModeEnm() == PlayMode) { storeCheckpoint(FileViewMode, 0, 0); } // playback stopped
     listIdxItems();
     lcd->switchToListView();
 }
@@ -704,6 +947,11 @@ void UIFileViewMode::draw() const
     ui_clear_btn_evt();
 }
 
+uint32_t UIFileViewMode::getUpdateCycleMs() const
+{
+    return (isBacklightLow() && !trackDb.isBuilding()) ? IdleUpdateCycleMs : UpdateCycleMs;
+}
+
 //====================================
 // Implementation of UIPlayMode class
 //====================================
@@ -718,7 +966,14 @@ UIMode* UIPlayMode::update()
     if (ui_get_btn_evt(btn_act, btn_unit)) {
         switch (btn_act) {
             case button_action_t::CenterSingle:
-                codec->pause(!codec->isPaused());
+                if (codec->isPaused()) {
+                    pm_set_clock_low(false);
+                    codec->pause(false);
+                } else {
+                    codec->pause(true);
+                    pm_set_clock_low(true);
+                    checkpointDue = true;
+                }
                 break;
             case button_action_t::CenterDouble:
                 vars->idx_play = 0;
@@ -738,13 +993,25 @@ UIMode* UIPlayMode::update()
             case button_action_t::CenterLongLong:
                 break;
             case button_action_t::PlusSingle:
+            case button_action_t::MinusSingle:
+                volumeAtPush = PlayAudio::getVolume();
+                seekHold = false;
+                if (btn_act == button_action_t::PlusSingle) {
+                    PlayAudio::volumeUp();
+                } else {
+                    PlayAudio::volumeDown();
+                }
+                break;
             case button_action_t::PlusLong:
                 PlayAudio::volumeUp();
                 break;
-            case button_action_t::MinusSingle:
             case button_action_t::MinusLong:
                 PlayAudio::volumeDown();
                 break;
+            case button_action_t::PlusFwd:
+            case button_action_t::MinusRwd:
+                seek(btn_act == button_action_t::PlusFwd);
+                break;
             default:
                 break;
         }
@@ -762,8 +1029,11 @@ UIMode* UIPlayMode::update()
         lcd->setMsg("Bye");
         return getUIMode(PowerOffMode);
     } else if (!codec->isPlaying()) {
+        codec->stop();  // close the track ended by decode stage
+        resumeLog.maintain();  // gap between tracks
         idle_count = 0;
-        while (++vars->idx_play < file_menu_get_num()) {
+        bool shuffle = (cfgMenu.get(ConfigMenuId::PLAY_NEXT_PLAY_ALBUM) == ConfigMenu::NextPlayAction_t::Shuffle);
+        while (!shuffle && ++vars->idx_play < file_menu_get_num()) {
             if (isAudioFile(vars->idx_play)) {
                 play();
                 return this;
@@ -771,55 +1041,55 @@ UIMode* UIPlayMode::update()
         }
         vars->idx_play = 0;
         codec->stop();
-        vars->do_next_play = TimeoutPlay;
+        vars->do_next_play = shuffle ? ImmediatePlay : TimeoutPlay;
         return getUIMode(FileViewMode);
     }
+    if (codec->checkNextSwitched()) {
+        nextSwitched();
+    } else if (!nextQueueTried) {
+        queueNext();
+    }
+    if (codec->isPaused()) { // DAC is disabled while paused
+        resumeLog.maintain();
+        CoverCache::instance().flush();
+    }
+    checkpoint();
+    lcd->stepImage(CoverDecodeBudgetUs);
     lcd->setVolume(PlayAudio::getVolume());
     lcd->setPlayTime(codec->elapsedMillis()/1000, codec->totalMillis()/1000, codec->isPaused());
     float levelL, levelR;
     codec->getLevel(&levelL, &levelR);
     lcd->setAudioLevel(levelL, levelR);
     lcd->setBatteryVoltage(pm_get_battery_voltage());
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
 void UIPlayMode::readTag()
 {
+    PROF_SCOPE("ui", "readTag");
     char str[256];
-    
+
     // Read TAG
-    memset(str, 0, sizeof(str));
-    file_menu_get_fname(vars->idx_play, str, sizeof(str) - 1);
+    file_menu_get_fname(vars->idx_play, str, sizeof(str));
     tag.loadFile(str);
 
-    // copy TAG text
-    if (tag.getUTF8Track(str, sizeof(str) - 1)) {
-        std::string s(str);
-        uint16_t track;
-        if (s.size() > 0 && std::isdigit(s.at(0))) {  // accept both "12" and  "12/20" as 12
-            track = static_cast<uint8_t>(std::stoi(s));  // stoi stops conversion if non-number appeared
-        } else {
-            track = 0;
+    // copy TAG text straight into text boxes of LCD
+    char num[8];
+    uint16_t track = 0;
+    if (tag.getUTF8Track(num, sizeof(num))) {
+        for (const char* p = num; *p >= '0' && *p <= '9'; p++) {  // accept both "12" and  "12/20" as 12
+            track = track * 10 + (*p - '0');
         }
-        sprintf(str, "%d/%d", track, vars->num_tracks);
     } else {
-        uint16_t track = file_menu_get_ext_num_from_max("wav", 3, vars->idx_play + 1) + file_menu_get_ext_num_from_max("WAV", 3, vars->idx_play +1);
-        sprintf(str, "%d/%d", track, vars->num_tracks);
-    }
-    lcd->setTrack(str);
-    if (tag.getUTF8Title(str, sizeof(str) - 1)) {
-        lcd->setTitle(str);
-    } else { // display filename if no TAG
-        file_menu_get_fname(vars->idx_play, str, sizeof(str) - 1);
-        lcd->setTitle(str);
-        /*
-        file_menu_get_fname_UTF16(vars->idx_play, (char16_t*) str, sizeof(str)/2);
-        lcd->setTitle(utf16_to_utf8((const char16_t*) str).c_str(), utf8);
-        */
+        track = file_menu_get_type_num_from_max(FILE_MENU_TYPE_AUDIO, vars->idx_play + 1);
     }
-    if (tag.getUTF8Album(str, sizeof(str) - 1)) lcd->setAlbum(str); else lcd->setAlbum("");
-    if (tag.getUTF8Artist(str, sizeof(str) - 1)) lcd->setArtist(str); else lcd->setArtist("");
+    lcd->setTrack(track, vars->num_tracks);
+    lcd->writeTitle([this](char* s, size_t size) {  // display filename if no TAG
+        return tag.getUTF8Title(s, size) || file_menu_get_fname(vars->idx_play, s, static_cast<uint16_t>(size)) == FR_OK;
+    });
+    lcd->writeAlbum([this](char* s, size_t size) { return tag.getUTF8Album(s, size) != 0; });
+    lcd->writeArtist([this](char* s, size_t size) { return tag.getUTF8Artist(s, size) != 0; });
     //if (tag.getUTF8Year(str, sizeof(str) - 1)) lcd->setYear(str); else lcd->setYear("");
 
     {  // load image from TAG
@@ -830,10 +1100,13 @@ void UIPlayMode::readTag()
         bool isUnsynced;
         if (tag.getPicturePos(0, mime, ptype, pos, size, isUnsynced)) {
             //printf("found coverart mime: %d, ptype: %d, pos: %d, size: %d, isUnsynced: %d\r\n", mime, ptype, (int) pos, size, (int) isUnsynced);
-            if (!isUnsynced && mime == jpeg && size != tagImageSize) {  // Note: judge by size to check if the image is identical to previous
+            if (!isUnsynced && (mime == jpeg || mime == png)) {  // Note: identical image to previous is skipped in stepImage()
                 file_menu_get_fname(vars->idx_play, str, sizeof(str) - 1);
-                lcd->setImageJpeg(str, pos, size);
-                tagImageSize = size;
+                if (mime == png) {
+                    lcd->requestImagePng(str, pos, size);
+                } else {
+                    lcd->requestImageJpeg(str, pos, size);
+                }
                 loadImageFromDir = false;
             }
         }
@@ -843,10 +1116,14 @@ void UIPlayMode::readTag()
         uint16_t idx = 0;
         bool loaded = false;
         while (idx < file_menu_get_num()) {
-            if (file_menu_match_ext(idx, "jpg", 3) || file_menu_match_ext(idx, "JPG", 3) ||
-                file_menu_match_ext(idx, "jpeg", 4) || file_menu_match_ext(idx, "JPEG", 4)) {
+            file_menu_type_t type = file_menu_get_type(idx);
+            if (type == FILE_MENU_TYPE_JPEG || type == FILE_MENU_TYPE_PNG) {
                 file_menu_get_fname(idx, str, sizeof(str) - 1);
-                lcd->setImageJpeg(str);
+                if (type == FILE_MENU_TYPE_PNG) {
+                    lcd->requestImagePng(str);
+                } else {
+                    lcd->requestImageJpeg(str);
+                }
                 loaded = true;
                 break;
             }
@@ -854,7 +1131,7 @@ void UIPlayMode::readTag()
         }
         if (!loaded) { lcd->resetImage(); }
     }
-    return;
+    tag.close();
 }
 
 void UIPlayMode::play()
@@ -866,18 +1143,90 @@ void UIPlayMode::play()
     PlayAudio* codec = get_audio_codec();
     readTag();
     loadImageFromDir = false;
-    codec->play(str, vars->fpos, vars->samples_played);
+    pm_set_clock_low(false); // I2S runs on clk_sys
+    if (!vars->resumed || !codec->isPlaying()) { // otherwise already started from resume snapshot
+        codec->play(str, vars->fpos, vars->samples_played);
+    }
+    vars->resumed = false;
+    if (dir_stack.size() > 0) { file_menu_prefetch(dir_stack.top().head + dir_stack.top().column); }
     lcd->setBitRes(codec->getBitsPerSample());
     lcd->setSampleFreq(codec->getSampFreq());
     vars->fpos = 0;
     vars->samples_played = 0;
+    nextQueueTried = false;
+    checkpointDue = true;
+}
+
+void UIPlayMode::queueNext()
+{
+    // bind next track ahead for gapless playback (not possible if sampling frequency is different)
+    char str[FF_MAX_LFN];
+    nextQueueTried = true;
+    if (cfgMenu.get(ConfigMenuId::PLAY_NEXT_PLAY_ALBUM) == ConfigMenu::NextPlayAction_t::Shuffle) { return; } // next track is not in this directory
+    idx_next = vars->idx_play;
+    while (++idx_next < file_menu_get_num()) {
+        if (getAudioCodec(idx_next) != PlayAudio::AUDIO_CODEC_NONE) {  // codec of current track is kept (next track of other codec is rejected)
+            memset(str, 0, sizeof(str));
+            file_menu_get_fname(idx_next, str, sizeof(str) - 1);
+            get_audio_codec()->queueNext(str);
+            return;
+        }
+    }
+}
+
+void UIPlayMode::nextSwitched()
+{
+    // playing has already moved to next track, follow it only in view
+    char str[FF_MAX_LFN];
+    memset(str, 0, sizeof(str));
+    vars->idx_play = idx_next;
+    file_menu_get_fname(vars->idx_play, str, sizeof(str) - 1);
+    printf("%s\r\n", str);
+    PlayAudio* codec = get_audio_codec();
+    readTag();
+    lcd->setBitRes(codec->getBitsPerSample());
+    lcd->setSampleFreq(codec->getSampFreq());
+    nextQueueTried = false;
+    checkpointDue = true;
+}
+
+// Plus/Minus held over long long push: volume changed by the hold is reverted, then seek by SeekStepMs every SeekRepeatMs
+void UIPlayMode::seek(bool forward)
+{
+    PlayAudio* codec = get_audio_codec();
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    if (!seekHold) {
+        PlayAudio::setVolume(volumeAtPush);
+        seekHold = true;
+    } else if (now_ms - seekMs < SeekRepeatMs) {
+        return;
+    }
+    seekMs = now_ms;
+    uint32_t elapsed = codec->elapsedMillis();
+    uint32_t millis = forward ? elapsed + SeekStepMs : ((elapsed > SeekStepMs) ? elapsed - SeekStepMs : 0);
+    if (codec->seekMillis(millis)) { nextQueueTried = false; } // next track is queued again
+}
+
+// checkpoint at track change, pause and every CheckpointIntervalMs
+// only when read buffer is full so that flash program doesn't starve decode stage
+void UIPlayMode::checkpoint()
+{
+    PlayAudio* codec = get_audio_codec();
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    if (!checkpointDue && now_ms - checkpointMs < CheckpointIntervalMs) { return; }
+    if (!codec->isPlaying() || !codec->isBufferFull()) { return; } // retry in next update
+    size_t fpos;
+    uint32_t samples_played;
+    codec->getCurrentPosition(&fpos, &samples_played);
+    storeCheckpoint(PlayMode, fpos, samples_played);
+    checkpointMs = now_ms;
+    checkpointDue = false;
 }
 
 void UIPlayMode::entry(UIMode* prevMode)
 {
     UIMode::entry(prevMode);
     if (prevMode->getUIModeEnm() != ConfigMode) {
-        tagImageSize = 0;
         loadImageFromDir = true;
         play();
     }
@@ -891,6 +1240,12 @@ void UIPlayMode::draw() const
     ui_clear_btn_evt();
 }
 
+uint32_t UIPlayMode::getUpdateCycleMs() const
+{
+    // level meter and play time don't move while paused
+    return (get_audio_codec()->isPaused() && isBacklightLow()) ? IdleUpdateCycleMs : UpdateCycleMs;
+}
+
 //=======================================
 // Implementation of UIConfigMode class
 //=======================================
@@ -1019,6 +1374,7 @@ UIMode* UIConfigMode::update()
                 break;
             case button_action_t::PlusSingle:
             case button_action_t::PlusLong:
+            case button_action_t::PlusFwd:
                 if (btn_layout.get() == static_cast<uint32_t>(button_layout_t::Horizontal)) {
                     idxInc();
                 } else {
@@ -1028,6 +1384,7 @@ UIMode* UIConfigMode::update()
                 break;
             case button_action_t::MinusSingle:
             case button_action_t::MinusLong:
+            case button_action_t::MinusRwd:
                 if (btn_layout.get() == static_cast<uint32_t>(button_layout_t::Horizontal)) {
                     idxDec();
                 } else {
@@ -1043,7 +1400,7 @@ UIMode* UIConfigMode::update()
     if (idle_count > cfgMenu.get(ConfigMenuId::GENERAL_TIME_TO_LEAVE_CONFIG) * OneSec) {
         return prevMode;
     }
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
@@ -1097,8 +1454,17 @@ void UIPowerOffMode::storeToFlash() const
     cfgParam.P_CFG_PLAY_POS.set(static_cast<uint64_t>(vars->fpos));
     cfgParam.P_CFG_SAMPLES_PLAYED.set(vars->samples_played);
 
+    // resume snapshot: playing file is in current directory
+    char path[FILE_MENU_PATH_SIZE];
+    memset(path, 0, sizeof(path));
+    if (vars->resume_ui_mode == PlayMode) { getPlayPath(path, sizeof(path)); }
+    cfgParam.P_CFG_PLAY_PATH.set(std::string(path));
+
+    CoverCache::instance().flush();  // LRU stamps of cover art shown while playing
+
     // Store Configuration parameters to Flash
     cfgParam.finalize();
+    resumeLog.close();  // checkpoints are older than cfgParam from now
 }
 
 UIMode* UIPowerOffMode::update()
@@ -1110,7 +1476,7 @@ UIMode* UIPowerOffMode::update()
             return getUIMode(ChargeMode);
         }
     }
-    idle_count++;
+    idle_count += ticks;
     return this;
 }
 
@@ -1120,6 +1486,7 @@ void UIPowerOffMode::entry(UIMode* prevMode)
     pm_set_audio_dac_enable(false); // I2S DAC Mute On
     if (exitType != FatFsError) {
         storeToFlash();
+        trackDb.close();
         file_menu_close_dir();
         file_menu_deinit();
         audio_codec_deinit();
@@ -14,6 +14,9 @@
 #include "ConfigParam.h"
 #include "file_menu_FatFs.h"
 #include "LcdCanvas.h"
+#include "PlayAudio.h"
+#include "ResumeLog.h"
+#include "TrackDb.h"
 #include "ui_control.h"
 
 typedef enum {
@@ -46,6 +49,7 @@ struct UIVars
     next_play_type_t next_play_type = RandomPlay;
     size_t fpos = 0;
     uint32_t samples_played = 0;
+    bool resumed = false; // playback of idx_play has been started from resume snapshot
 };
 
 //===========================
@@ -54,13 +58,16 @@ struct UIVars
 class UIMode
 {
 public:
-    static constexpr int UpdateCycleMs = 50; // loop cycle (ms) (= LoopCycleMs value in arduino_main.cpp)
+    static constexpr int UpdateCycleMs = 50; // loop cycle (ms) (= unit of idle_count)
+    static constexpr int IdleUpdateCycleMs = 200; // loop cycle (ms) while nothing moves on dimmed display
     static void initialize(UIVars* vars);
+    static void tick(uint32_t cycleMs);  // convert time since previous update into idle ticks (at most cycleMs)
     static UIMode* getUIMode(const ui_mode_enm_t& ui_mode_enm);
     UIMode(const char* name, const ui_mode_enm_t& ui_mode_enm);
     virtual UIMode* update() = 0;
     virtual void entry(UIMode* prevMode);
     virtual void draw() const = 0;
+    virtual uint32_t getUpdateCycleMs() const;  // UI loop sleeps until then unless an event is notified
     static std::array<UIMode*, NUM_UI_MODES> ui_mode_ary;
     const char* getName() const;
     ui_mode_enm_t getUIModeEnm() const;
@@ -73,15 +80,25 @@ protected:
     } ExitType;
     static constexpr int OneSec = 1000 / UpdateCycleMs; // 1 Sec
     static constexpr int OneMin = 60 * OneSec; // 1 Min
+    static constexpr uint32_t TrackDbBuildBudgetUs = 10000; // time slice of track database build in each update
+    static constexpr uint32_t CoverDecodeBudgetUs = 10000; // time slice of cover art decode in each update
+    static constexpr uint32_t CheckpointIntervalMs = 60000; // resume state checkpoint interval while playing
     static button_action_t btn_act;
     static button_unit_t btn_unit;
+    static uint16_t ticks;  // idle ticks to add to idle_count in this update
     static UIVars* vars;
     static std::stack<stack_data_t> dir_stack;
     static ExitType exitType;
     static ConfigMenu& cfgMenu;
     static ConfigParam& cfgParam;
     static LcdCanvas* lcd;
-    bool isAudioFile(const uint16_t& idx) const;
+    static TrackDb& trackDb;
+    static ResumeLog& resumeLog;
+    PlayAudio::audio_codec_t getAudioCodec(const uint16_t& idx) const;  // AUDIO_CODEC_NONE: not audio file
+    bool isAudioFile(const uint16_t& idx) const;  // also selects codec for the file
+    bool isBacklightLow() const;
+    bool getPlayPath(char* path, size_t size) const;  // absolute path of vars->idx_play in current directory
+    void storeCheckpoint(const ui_mode_enm_t& resume_ui_mode, size_t fpos, uint32_t samples_played) const;
     const char* name;
     UIMode* prevMode = nullptr;
     ui_mode_enm_t ui_mode_enm;
@@ -100,6 +117,7 @@ public:
     void draw() const;
 protected:
     void loadFromFlash() const;
+    void loadCheckpoint() const;
 };
 
 //===================================
@@ -112,6 +130,7 @@ public:
     UIMode* update();
     void entry(UIMode* prevMode);
     void draw() const;
+    uint32_t getUpdateCycleMs() const;
 };
 
 //===================================
@@ -126,6 +145,9 @@ public:
     void draw() const;
 protected:
     void restoreFromFlash() const;
+    FRESULT mountStorage() const;
+    bool resumePlay() const;
+    void verifyResumed() const;
 };
 
 //===================================
@@ -138,6 +160,7 @@ public:
     UIMode* update();
     void entry(UIMode* prevMode);
     void draw() const;
+    uint32_t getUpdateCycleMs() const;
 protected:
     uint16_t* sft_val;
     void listIdxItems();
@@ -146,6 +169,8 @@ protected:
     UIMode* nextPlay();
     UIMode* sequentialSearch(const bool& repeatFlg);
     UIMode* randomSearch(const uint16_t& depth);
+    UIMode* shuffleSearch();
+    bool openTrack(const char* dirPath, const char* name);
     void findFirstAudioTrack() const;
     void idxInc() const;
     void idxDec() const;
@@ -164,10 +189,23 @@ public:
     UIMode* update();
     void entry(UIMode* prevMode);
     void draw() const;
+    uint32_t getUpdateCycleMs() const;
 protected:
-    size_t tagImageSize = 0;
+    static constexpr uint32_t SeekStepMs = 5000; // playing position step of each PlusFwd / MinusRwd event
+    static constexpr uint32_t SeekRepeatMs = 200; // min interval of seeks while Plus/Minus is held
     bool loadImageFromDir = true;
+    uint16_t idx_next = 0;
+    bool nextQueueTried = false;
+    bool checkpointDue = false;
+    uint32_t checkpointMs = 0;
+    uint8_t volumeAtPush = 0; // volume before Plus/Minus push (restored when the hold turns into seek)
+    bool seekHold = false;
+    uint32_t seekMs = 0;
     void play();
+    void seek(bool forward);
+    void queueNext();
+    void nextSwitched();
+    void checkpoint();
     //audio_codec_enm_t getAudioCodec(MutexFsBaseFile* f);
     void readTag();
 };
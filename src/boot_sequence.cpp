@@ -0,0 +1,106 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include "boot_sequence.h"
+
+#include <cstdio>
+
+#include "hardware/sync.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#include "file_menu_FatFs.h"
+#include "power_manage.h"
+
+static const char* stage_names[BOOT_STAGE_NUM] = {"Power", "Wait", "Mount", "Lcd", "Config", "Scan", "Audio"};
+static uint32_t stage_begin_us[BOOT_STAGE_NUM] = {};
+static uint32_t stage_end_us[BOOT_STAGE_NUM] = {};
+
+static volatile bool storage_started = false;
+static volatile bool config_ready = false;
+static volatile bool storage_done = false;
+static FRESULT storage_result = FR_NOT_READY;
+static uint8_t storage_fs_type = 0;
+
+void boot_stage_begin(boot_stage_t stage)
+{
+    stage_begin_us[stage] = time_us_32();
+}
+
+void boot_stage_end(boot_stage_t stage)
+{
+    stage_end_us[stage] = time_us_32();
+}
+
+void boot_print_stages()
+{
+    printf("Boot stages:\r\n");
+    for (int i = 0; i < BOOT_STAGE_NUM; i++) {
+        if (stage_end_us[i] == 0) { continue; }  // not passed
+        printf("  %-6s %5d ms - %5d ms (%d ms)\r\n", stage_names[i],
+            (int) (stage_begin_us[i] / 1000), (int) (stage_end_us[i] / 1000), (int) ((stage_end_us[i] - stage_begin_us[i]) / 1000));
+    }
+}
+
+static void storageCore1Process()
+{
+    flash_safe_execute_core_init();  // no access to flash on core1 (config could be stored by core0)
+
+    boot_stage_begin(BOOT_STAGE_MOUNT);
+    // Particular microsd card needs interval time when reboot, otherwise fails to mount (Samsung PRO Plus)
+    if (pm_is_caused_reboot()) {
+        sleep_ms(1000);
+    }
+    int count = 0;
+    FRESULT fr;
+    while (true) {
+        fr = file_menu_init(&storage_fs_type);
+        if (fr == FR_OK || count++ > 10) { break; }
+        sleep_ms(10);
+    }
+    boot_stage_end(BOOT_STAGE_MOUNT);
+
+    if (fr == FR_OK) {
+        // Dir Index Cache setting is needed before indexing root directory
+        while (!config_ready) {
+            sleep_ms(1);
+        }
+        boot_stage_begin(BOOT_STAGE_SCAN);
+        file_menu_open_dir("/");
+        if (file_menu_get_num() <= 1) { fr = FR_NO_FILE; }  // Directory read Fail
+        boot_stage_end(BOOT_STAGE_SCAN);
+    }
+    storage_result = fr;
+
+    flash_safe_execute_core_deinit();
+    __mem_fence_release();
+    storage_done = true;
+}
+
+void boot_storage_start()
+{
+    if (storage_started) { return; }
+    storage_started = true;
+    multicore_reset_core1();
+    multicore_launch_core1(storageCore1Process);
+}
+
+void boot_storage_config_ready()
+{
+    config_ready = true;
+}
+
+FRESULT boot_storage_wait(uint8_t* fs_type)
+{
+    if (!storage_started) { return FR_NOT_READY; }
+    while (!storage_done) {
+        sleep_ms(1);
+    }
+    __mem_fence_acquire();
+    if (fs_type != nullptr) { *fs_type = storage_fs_type; }
+    return storage_result;
+}
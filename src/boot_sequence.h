@@ -0,0 +1,33 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "ff.h"
+
+// Boot stages in dependency order
+//   core0: Power -> Wait -> Lcd -> Config -> Audio
+//   core1: Mount -> (Config) -> Scan
+//   Audio needs Scan to be finished because ReadBuffer takes over core1
+typedef enum {
+    BOOT_STAGE_POWER = 0,  // clocks and power management
+    BOOT_STAGE_WAIT,  // wait for stable power-on
+    BOOT_STAGE_MOUNT,  // SD card mount (core1)
+    BOOT_STAGE_LCD,  // LCD and UI
+    BOOT_STAGE_CONFIG,  // configuration from flash
+    BOOT_STAGE_SCAN,  // root directory scan (core1)
+    BOOT_STAGE_AUDIO,  // I2S and audio codec
+    BOOT_STAGE_NUM
+} boot_stage_t;
+
+void boot_stage_begin(boot_stage_t stage);
+void boot_stage_end(boot_stage_t stage);
+void boot_print_stages();
+void boot_storage_start();  // launch Mount and Scan on core1
+void boot_storage_config_ready();  // let core1 proceed to Scan
+FRESULT boot_storage_wait(uint8_t* fs_type);  // wait until core1 finishes (fs_type is not set if nullptr)
@@ -12,9 +12,14 @@
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 
+#include "audio_stats.h"
+#include "boot_sequence.h"
 #include "common.h"
+#include "file_menu_FatFs.h"
 #include "lcd.h"
+#include "mem_budget.h"
 #include "power_manage.h"
+#include "profiler.h"
 #include "UIMode.h"
 #include "ui_control.h"
 
@@ -23,7 +28,42 @@ static inline uint32_t _millis(void)
     return to_ms_since_boot(get_absolute_time());
 }
 
+// commands from USB CDC stdio for diagnostics
+//   's': print audio pipeline statistics
+//   'r': reset audio pipeline statistics
+//   'p': print per-stage timing summary (PROFILER_ENABLE build)
+//   't': dump trace ring as Chrome trace JSON and clear it (PROFILER_ENABLE build)
+//   'm': print memory budget map with heap, stack and pool high-water marks
+static void poll_stdio_command()
+{
+    int c = getchar_timeout_us(0);
+    switch (c) {
+        case 's':
+            audio_stats_print();
+            break;
+        case 'r':
+            audio_stats_reset();
+            printf("AudioStats reset\r\n");
+            break;
+        case 'p':
+            profiler_print_summary();
+            break;
+        case 't':
+            profiler_dump_trace();
+            break;
+        case 'm':
+            mem_budget_print();
+            break;
+        default:
+            break;
+    }
+}
+
 int main() {
+    // Paint stacks before any deep call and before core1 is launched
+    mem_budget_init();
+    file_menu_track_budget();
+
     // Call stdio_usb_init() in pw_set_pll_usb_96MHz() for modified code rather than stdio_init_all()
     //stdio_init_all();
 
@@ -31,6 +71,7 @@ int main() {
     // PICO_DEFAULT_LED_PIN: GPIO25
     //    Raspberry Pi Pico: board LED (connected to LCD only)
     //    Waveshare RP2040-LCD-0.96: LCD BLK (pulled-up to 3.3K and connected to driver of backlight)
+    boot_stage_begin(BOOT_STAGE_POWER);
     gpio_init(PICO_DEFAULT_LED_PIN);
     gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_IN);
     board_type_t board_type = gpio_get(PICO_DEFAULT_LED_PIN) ? WAVESHARE_RP2040_LCD_096 : RASPBERRY_PI_PICO;
@@ -45,12 +86,18 @@ int main() {
 
     // Power Manage Init
     pm_init(board_type);
+    boot_stage_end(BOOT_STAGE_POWER);
+
+    // Mount SD card on core1 in parallel with power-on wait, LCD and config
+    boot_storage_start();
 
     // Wait before stable power-on for 750ms
     // to avoid unintended power-on when Headphone plug in
+    boot_stage_begin(BOOT_STAGE_WAIT);
     for (int i = 0; i < 30; i++) {
         sleep_ms(25);
     }
+    boot_stage_end(BOOT_STAGE_WAIT);
     printf("\r\n");
     switch (board_type) {
         case RASPBERRY_PI_PICO:
@@ -73,15 +120,18 @@ int main() {
     ui_init(board_type);
 
     // UI Loop (infinite)
-    const int LoopCycleMs = UIMode::UpdateCycleMs; // loop cycle (50 ms)
+    // sleeps until update cycle of current mode (50 ms, or 200 ms while idle)
+    // button, track end / switch and low battery events wake it up earlier
     while (true) {
         uint32_t time = _millis();
         ui_update();
+        poll_stdio_command();
         time = _millis() - time;
-        if (time < LoopCycleMs) {
-            sleep_ms(LoopCycleMs - time);
+        uint32_t loopCycleMs = ui_get_update_cycle_ms();
+        if (time < loopCycleMs) {
+            ui_wait_event(loopCycleMs - time);
         } else {
-            sleep_ms(1);
+            ui_wait_event(1);
         }
     }
 
@@ -25,6 +25,7 @@
 #include "pico/stdio_usb.h" // use lib/pico_stdio_usb_revised/
 
 #include "ConfigParam.h"
+#include "i2s_audio_init.h"
 #include "ConfigMenu.h"
 #include "lcd_extra.h"
 #include "ui_control.h"
@@ -63,15 +64,22 @@ static constexpr float COEF_B_STATIC_BATT_CHECK = -0.02;
 // flag for active battery check
 static bool _use_active_batt_check = false;
 
-// ADC Timer & frequency
+// ADC Timer (fires only at battery monitor interval)
 static repeating_timer_t timer;
-const int TIMER_BATTERY_CHECK_HZ = 20;
 
 // Battery monitor interval
 constexpr int BATT_CHECK_INTERVAL_SEC = 5;
+constexpr int BATT_CHECK_SETTLE_MS = 50;  // from enabling active battery check circuit to measurement
 constexpr float LOW_BATT_LVL = 2.9;
 static float _battery_voltage = 4.2;
 
+// clk_sys governor (clk_peri is fixed to PLL_USB 96MHz)
+static constexpr uint32_t CLK_SYS_HIGH_MHZ = 96;  // while audio is played
+static constexpr uint32_t CLK_SYS_LOW_MHZ = 48;  // while audio is stopped or paused
+static bool _clock_low = false;  // requested by pm_set_clock_low()
+static int _clock_boost = 0;  // nesting count of pm_clock_boost()
+static uint32_t _clk_sys_mhz = CLK_SYS_HIGH_MHZ;
+
 // for preserving clock configuration
 static uint32_t _scr;
 static uint32_t _sleep_en0;
@@ -85,7 +93,7 @@ static bool _timer_callback_battery_check(repeating_timer_t *rt) {
 static int _timer_init_battery_check()
 {
     // negative timeout means exact delay (rather than delay between callbacks)
-    if (!add_repeating_timer_us(-1000000 / TIMER_BATTERY_CHECK_HZ, _timer_callback_battery_check, nullptr, &timer)) {
+    if (!add_repeating_timer_ms(-1000 * BATT_CHECK_INTERVAL_SEC, _timer_callback_battery_check, nullptr, &timer)) {
         //printf("Failed to add timer\r\n");
         return 0;
     }
@@ -210,24 +218,74 @@ void pm_set_audio_dac_enable(bool flag)
     gpio_put(PIN_AUDIO_DAC_ENABLE, flag);
 }
 
+static void _set_clk_sys(uint32_t mhz)
+{
+    if (_clk_sys_mhz == mhz) { return; }
+    // PLL_USB is kept, only clk_sys divider is changed
+    clock_configure(clk_sys,
+        CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+        96 * MHZ,
+        mhz * MHZ);
+    _clk_sys_mhz = mhz;
+}
+
+static void _update_clk_sys()
+{
+    _set_clk_sys((_clock_low && _clock_boost == 0) ? CLK_SYS_LOW_MHZ : CLK_SYS_HIGH_MHZ);
+}
+
+// I2S (PIO) runs on clk_sys, therefore it is lowered only while audio is not played
+// DAC is disabled until the clock is back and DAC relocks to it
+void pm_set_clock_low(bool flag)
+{
+    if (_clock_low == flag) { return; }
+    _clock_low = flag;
+    if (flag) {
+        pm_set_audio_dac_enable(false);
+        _update_clk_sys();
+    } else {
+        _update_clk_sys();
+        sleep_ms(DAC_RELOCK_MS);
+        pm_set_audio_dac_enable(true);
+    }
+}
+
+// temporarily run at full clock for heavy work such as directory sorting and image decoding
+void pm_clock_boost(bool flag)
+{
+    _clock_boost += flag ? 1 : -1;
+    if (_clock_boost < 0) { _clock_boost = 0; }
+    _update_clk_sys();
+}
+
+static int64_t _alarm_callback_battery_measure(alarm_id_t id, void* user_data)
+{
+    bool was_low = pm_get_low_battery();
+    float voltage = _get_battery_voltage(_use_active_batt_check);
+    if (_use_active_batt_check) {
+        gpio_put(PIN_ACTIVE_BATT_CHECK, 0);
+    }
+    if (_board_type == WAVESHARE_RP2040_LCD_096) {
+        voltage += 0.33;  // Forward voltage of D2 (MBR230LSFT1G)
+    }
+    //printf("Battery Voltage = %7.4f V\r\n", voltage);
+    _battery_voltage = voltage;
+    if (pm_get_low_battery() != was_low) {
+        ui_notify_event();  // UI handles low battery without waiting for its update cycle
+    }
+    return 0; // one shot
+}
+
 void pm_monitor_battery_voltage()
 {
-    static int count = 0;
-    if (_use_active_batt_check && (count % (TIMER_BATTERY_CHECK_HZ*BATT_CHECK_INTERVAL_SEC) == TIMER_BATTERY_CHECK_HZ*BATT_CHECK_INTERVAL_SEC-2)) {
+    if (_use_active_batt_check) {
         // Prepare to check battery voltage
         gpio_put(PIN_ACTIVE_BATT_CHECK, 1);
-    } else if (count % (TIMER_BATTERY_CHECK_HZ*BATT_CHECK_INTERVAL_SEC) == TIMER_BATTERY_CHECK_HZ*BATT_CHECK_INTERVAL_SEC-1) {
-        float voltage = _get_battery_voltage(_use_active_batt_check);
-        if (_use_active_batt_check) {
-            gpio_put(PIN_ACTIVE_BATT_CHECK, 0);
-        }
-        if (_board_type == WAVESHARE_RP2040_LCD_096) {
-            voltage += 0.33;  // Forward voltage of D2 (MBR230LSFT1G)
-        }
-        //printf("Battery Voltage = %7.4f V\r\n", voltage);
-        _battery_voltage = voltage;
+        add_alarm_in_ms(BATT_CHECK_SETTLE_MS, _alarm_callback_battery_measure, nullptr, true);
+    } else {
+        _alarm_callback_battery_measure(0, nullptr);
     }
-    count++;
 }
 
 bool pm_usb_power_detected()
@@ -341,10 +399,13 @@ void pw_set_pll_usb_96MHz()
         CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
         96 * MHZ,
         96 * MHZ);
-    // CLK peri is clocked from clk_sys so need to change clk_peri's freq
+    _clk_sys_mhz = CLK_SYS_HIGH_MHZ;
+    _clock_low = false;
+    _clock_boost = 0;
+    // CLK peri is clocked directly from PLL_USB to keep SPI and UART clocks when clk_sys is lowered
     clock_configure(clk_peri,
         0,
-        CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+        CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
         96 * MHZ,
         96 * MHZ);
     // Reinit uart/usb_cdc now that clk_peri has changed
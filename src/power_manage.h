@@ -20,5 +20,7 @@ bool pm_get_low_battery();
 float pm_get_battery_voltage();
 void pm_enter_dormant_and_wake();
 void pw_set_pll_usb_96MHz();
+void pm_set_clock_low(bool flag);  // lower clk_sys while audio is stopped or paused
+void pm_clock_boost(bool flag);  // true: raise clk_sys temporarily (nestable), false: release
 void pm_reboot();
 bool pm_is_caused_reboot();
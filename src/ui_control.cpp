@@ -11,12 +11,15 @@
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
 #include "pico/stdlib.h"
+#include "pico/sem.h"
 #include "pico/util/queue.h"
 
+#include "boot_sequence.h"
 #include "ConfigMenu.h"
 #include "lcd_extra.h"
 #include "LcdCanvas.h"
 #include "power_manage.h"
+#include "profiler.h"
 #include "UIMode.h"
 
 // SW PIN setting
@@ -25,27 +28,36 @@ static constexpr uint32_t PIN_SW_MINUS = 20;
 
 // ADC Timer
 static repeating_timer_t timer;
-// ADC Timer frequency
-const int TIMER_UI_BUTTON_HZ = 20;
+// ADC Timer frequency (20 ms period still filters contact bounce)
+const int TIMER_UI_BUTTON_HZ = 50;
+static constexpr uint32_t ms_to_btn_ticks(uint32_t ms) { return ms * TIMER_UI_BUTTON_HZ / 1000; }
 
 // Android Headphone Remote Control Pin (GPIO26: ADC0)
 static constexpr uint32_t PIN_HP_BUTTON = 26;
 static constexpr uint32_t ADC_PIN_HP_BUTTON = 0;
 
 // Configuration for button recognition
-static constexpr uint32_t RELEASE_IGNORE_COUNT = 8;
-static constexpr uint32_t LONG_PUSH_COUNT = 10;
-static constexpr uint32_t LONG_LONG_PUSH_COUNT = 30;
-
-static constexpr uint32_t NUM_BTN_HISTORY = 30;
+static constexpr uint32_t RELEASE_IGNORE_COUNT = ms_to_btn_ticks(400);
+static constexpr uint32_t LONG_PUSH_COUNT = ms_to_btn_ticks(500);
+static constexpr uint32_t LONG_LONG_PUSH_COUNT = ms_to_btn_ticks(1500);
+static constexpr uint32_t CLICK_OPEN_COUNT = ms_to_btn_ticks(200);  // open period needed before counting center clicks
+static constexpr uint32_t REPEAT_INTERVAL_MS = 50;  // auto-repeat of Plus/Minus long push (20 events per second regardless of timer frequency)
+static constexpr uint32_t TICK_MS = 1000 / TIMER_UI_BUTTON_HZ;
+
+static constexpr uint32_t NUM_BTN_HISTORY = ms_to_btn_ticks(1500);
 static button_status_t button_prv[NUM_BTN_HISTORY] = {}; // initialized as HP_BUTTON_OPEN
 static uint32_t button_repeat_count = LONG_LONG_PUSH_COUNT; // to ignore first buttton press when power-on
+static uint32_t button_repeat_ms = REPEAT_INTERVAL_MS; // elapsed time of auto-repeat interval in current hold
+static uint32_t button_hold_count = 0; // ticks of Plus/Minus held after long push (repeats turn into Fwd/Rwd at long long push)
 
 static board_type_t _board_type;
 
 static queue_t btn_evt_queue;
 static constexpr int QueueLength = 1;
 
+// UI loop sleeps on this until update cycle of current mode or any event notified
+static semaphore_t ui_event_sem;
+
 UIVars vars;
 UIMode* ui_mode = nullptr;
 
@@ -92,12 +104,12 @@ static int count_center_clicks()
     int i;
     int detected_fall = 0;
     int count = 0;
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < CLICK_OPEN_COUNT; i++) {
         if (button_prv[i] != button_status_t::Open) {
             return 0;
         }
     }
-    for (i = 4; i < NUM_BTN_HISTORY; i++) {
+    for (i = CLICK_OPEN_COUNT; i < NUM_BTN_HISTORY; i++) {
         if (detected_fall == 0 && button_prv[i-1] == button_status_t::Open && button_prv[i] == button_status_t::Center) {
             detected_fall = 1;
         } else if (detected_fall == 1 && button_prv[i-1] == button_status_t::Center && button_prv[i] == button_status_t::Open) {
@@ -120,6 +132,7 @@ static void trigger_event(button_action_t button_action, button_unit_t button_un
     if (!queue_try_add(&btn_evt_queue, &element)) {
         //printf("FIFO was full\n");
     }
+    ui_notify_event();
     return;
 }
 
@@ -153,6 +166,8 @@ static void update_button_action()
             button = button_status_t::Open;
         }
         button_repeat_count = 0;
+        button_repeat_ms = REPEAT_INTERVAL_MS; // first repeat at long push
+        button_hold_count = 0;
         if (button_prv[RELEASE_IGNORE_COUNT] == button_status_t::Center) { // center release
             center_clicks = count_center_clicks(); // must be called once per tick because button_prv[] status has changed
             switch (center_clicks) {
@@ -179,10 +194,18 @@ static void update_button_action()
         if (button == button_status_t::Center) {
             trigger_event(button_action_t::CenterLong, button_unit);
             button_repeat_count++; // only once and step to longer push event
-        } else if (button == button_status_t::D || button == button_status_t::Plus) {
-            trigger_event(button_action_t::PlusLong, button_unit);
-        } else if (button == button_status_t::Minus) {
-            trigger_event(button_action_t::MinusLong, button_unit);
+        } else {
+            bool fwd = button_hold_count >= LONG_LONG_PUSH_COUNT - LONG_PUSH_COUNT;
+            if (!fwd) { button_hold_count++; }
+            button_repeat_ms += TICK_MS;
+            if (button_repeat_ms >= REPEAT_INTERVAL_MS) {
+                button_repeat_ms -= REPEAT_INTERVAL_MS;
+                if (button == button_status_t::D || button == button_status_t::Plus) {
+                    trigger_event(fwd ? button_action_t::PlusFwd : button_action_t::PlusLong, button_unit);
+                } else if (button == button_status_t::Minus) {
+                    trigger_event(fwd ? button_action_t::MinusRwd : button_action_t::MinusLong, button_unit);
+                }
+            }
         }
     } else if (button_repeat_count == LONG_LONG_PUSH_COUNT) { // long long push
         if (button == button_status_t::Center) {
@@ -245,6 +268,21 @@ bool ui_get_btn_evt(button_action_t& btn_act, button_unit_t& btn_unit)
     return false;
 }
 
+void ui_notify_event()
+{
+    sem_release(&ui_event_sem);
+}
+
+void ui_wait_event(uint32_t timeout_ms)
+{
+    sem_acquire_timeout_ms(&ui_event_sem, timeout_ms);
+}
+
+uint32_t ui_get_update_cycle_ms()
+{
+    return ui_mode->getUpdateCycleMs();
+}
+
 void ui_clear_btn_evt()
 {
     // queue doesn't work as intended when removing rest items after removed or poke once
@@ -262,14 +300,18 @@ void ui_clear_btn_evt()
 void ui_init(const board_type_t& board_type)
 {
     _board_type = board_type;
+    boot_stage_begin(BOOT_STAGE_LCD);
     ConfigMenu& cfg = ConfigMenu::instance();
     LcdCanvas::configureLcd(_board_type, cfg.get(ConfigMenuId::DISPLAY_LCD_CONFIG));
     LcdCanvas& lcd = LcdCanvas::instance();  // dynamic instance generation after configureLcd() is needed
     lcd.setRotation(cfg.get(ConfigMenuId::DISPLAY_ROTATION));
     vars.num_list_lines = LCD_H()/16;
+    boot_stage_end(BOOT_STAGE_LCD);
 
     // button event queue
     queue_init(&btn_evt_queue, sizeof(element_t), QueueLength);
+    sem_init(&ui_event_sem, 0, 1);
+    PlayAudio::setEventCallback(ui_notify_event);  // track end and switch to next track
 
     // ADC and Timer setting
     timer_init_ui_button();
@@ -287,12 +329,17 @@ void ui_init(const board_type_t& board_type)
 
 ui_mode_enm_t ui_update()
 {
+    PROF_SCOPE("ui", "ui_update");
     //printf("%s\n", ui_mode->getName());
+    UIMode::tick(ui_mode->getUpdateCycleMs());
+    PROF_BEGIN(updateBegin);
     UIMode* ui_mode_next = ui_mode->update();
+    PROF_END("update", ui_mode->getName(), updateBegin);
     if (ui_mode_next != ui_mode) {
         ui_mode_next->entry(ui_mode);
         ui_mode = ui_mode_next;
     } else {
+        PROF_SCOPE("draw", ui_mode->getName());
         ui_mode->draw();
     }
     return ui_mode->getUIModeEnm();
@@ -301,6 +348,7 @@ ui_mode_enm_t ui_update()
 ui_mode_enm_t ui_force_update(const ui_mode_enm_t& ui_mode_enm)
 {
     //printf("%s\n", ui_mode->getName());
+    UIMode::tick(ui_mode->getUpdateCycleMs());
     ui_mode->update();
     UIMode* ui_mode_next = UIMode::getUIMode(ui_mode_enm);
     if (ui_mode_next != ui_mode) {
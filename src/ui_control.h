@@ -49,6 +49,9 @@ typedef struct element {
 
 bool ui_get_btn_evt(button_action_t& btn_act, button_unit_t& btn_unit);
 void ui_clear_btn_evt();
+void ui_notify_event();  // wake UI loop (callable from IRQ and core1)
+void ui_wait_event(uint32_t timeout_ms);
+uint32_t ui_get_update_cycle_ms();
 
 void ui_init(const board_type_t& board_type);
 ui_mode_enm_t ui_update();
@@ -8,19 +8,52 @@
 
 #include "utf_conv.h"
 
-#include <cassert>
-#include <codecvt>
-#include <locale>
-
 extern "C"{
     int __exidx_start(){ return -1;}
     int __exidx_end(){ return -1; }
 }
 
-std::string utf16_to_utf8(std::u16string const& src)
+// convert UTF-16 byte sequence without heap (only whole characters are stored within size)
+size_t utf16_to_utf8(const uint8_t* src, size_t len, bool bigEndian, char* dst, size_t size)
 {
-    std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> converter;
-    return converter.to_bytes(src);
+    size_t n = 0;
+    if (size == 0) { return 0; }
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint32_t c = bigEndian ? ((src[i] << 8) | src[i + 1]) : ((src[i + 1] << 8) | src[i]);
+        if (c == 0) { break; }
+        if (c >= 0xd800 && c < 0xdc00 && i + 3 < len) { // surrogate pair
+            uint32_t c2 = bigEndian ? ((src[i + 2] << 8) | src[i + 3]) : ((src[i + 3] << 8) | src[i + 2]);
+            if (c2 >= 0xdc00 && c2 < 0xe000) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+                i += 2;
+            }
+        }
+        char buf[4];
+        size_t m;
+        if (c < 0x80) {
+            buf[0] = static_cast<char>(c);
+            m = 1;
+        } else if (c < 0x800) {
+            buf[0] = static_cast<char>(0xc0 | (c >> 6));
+            buf[1] = static_cast<char>(0x80 | (c & 0x3f));
+            m = 2;
+        } else if (c < 0x10000) {
+            buf[0] = static_cast<char>(0xe0 | (c >> 12));
+            buf[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            buf[2] = static_cast<char>(0x80 | (c & 0x3f));
+            m = 3;
+        } else {
+            buf[0] = static_cast<char>(0xf0 | (c >> 18));
+            buf[1] = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+            buf[2] = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            buf[3] = static_cast<char>(0x80 | (c & 0x3f));
+            m = 4;
+        }
+        if (n + m > size - 1) { break; }
+        for (size_t k = 0; k < m; k++) { dst[n++] = buf[k]; }
+    }
+    dst[n] = '\0';
+    return n;
 }
 
 /*
@@ -8,7 +8,9 @@
 
 #pragma once
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
 
-std::string utf16_to_utf8(std::u16string const& src);
+// convert in place into dst of size bytes (e.g. text box buffer), stops at '\0', returns bytes stored except '\0'
+size_t utf16_to_utf8(const uint8_t* src, size_t len, bool bigEndian, char* dst, size_t size);
 //std::string shiftjis_to_utf8(std::string const& src);
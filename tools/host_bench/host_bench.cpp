@@ -0,0 +1,327 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+// Host benchmark of firmware modules on a FAT disk image
+//   directory sort (file_menu), PlayWav / PlayFlac decode, TagRead and ImageFitter
+// Results are printed and optionally written as TSV (kind, name, metric, value),
+// which is given back by -b to report metrics exceeding the baseline by more than -t percent
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <strings.h>
+#include <unistd.h>
+
+#include "audio_stats.h"
+#include "file_menu_FatFs.h"
+#include "host_shim.h"
+#include "ImageFitter.h"
+#include "PlayFlac.h"
+#include "PlayWav.h"
+#include "ReadBuffer.h"
+#include "TagRead.h"
+
+static constexpr uint16_t IMAGE_W = 80;  // ImageBox of 80x160 LCD (default rotation)
+static constexpr uint16_t IMAGE_H = 160;
+static constexpr double DEFAULT_THRESHOLD_PERCENT = 10.0;
+
+typedef struct _entry_t {
+    std::string path;
+    file_menu_type_t type;
+} entry_t;
+
+typedef struct _metric_t {
+    std::string key;  // kind \t name \t metric
+    double value;
+    bool gated;  // compared with baseline (false: depends on thread timing)
+} metric_t;
+
+static std::vector<metric_t> metrics;
+static uint16_t imageBuf[IMAGE_W * IMAGE_H];
+static TagRead tag;
+static PlayWav* playWav = nullptr;
+static PlayFlac* playFlac = nullptr;
+
+static uint64_t nowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static void addMetric(const char* kind, const std::string& name, const char* metric, double value, bool gated = true)
+{
+    metrics.push_back({std::string(kind) + "\t" + name + "\t" + metric, value, gated});
+}
+
+static host_io_stats_t ioDelta(const host_io_stats_t& start)
+{
+    host_io_stats_t now;
+    host_io_stats_get(&now);
+    return {now.f_read_cnt - start.f_read_cnt, now.f_readdir_cnt - start.f_readdir_cnt,
+        now.disk_read_cnt - start.disk_read_cnt, now.disk_read_sectors - start.disk_read_sectors};
+}
+
+static std::string joinPath(const std::string& dir, const char* name)
+{
+    return (!dir.empty() && dir.back() == '/') ? dir + name : dir + "/" + name;
+}
+
+// scan and sort as file_menu_open_dir() then file_menu_full_sort() of UI, collecting files of the directory
+static bool benchSort(const std::string& dir, std::vector<entry_t>& entries)
+{
+    file_menu_bench_t cnt;
+    host_io_stats_t io;
+    host_io_stats_get(&io);
+    file_menu_bench_reset();
+    uint64_t start = nowNs();
+    FRESULT fr = file_menu_open_dir(dir.c_str());
+    uint64_t scanned = nowNs();
+    if (fr != FR_OK && fr != FR_NOT_ENOUGH_CORE) {
+        printf("ERROR: file_menu_open_dir(%s) failed (%d)\n", dir.c_str(), static_cast<int>(fr));
+        return false;
+    }
+    file_menu_full_sort();
+    uint64_t sorted = nowNs();
+    file_menu_bench_get(&cnt);
+    io = ioDelta(io);
+    uint16_t num = file_menu_get_num();
+    double scanMs = (scanned - start) / 1e6;
+    double sortMs = (sorted - scanned) / 1e6;
+    printf("sort   %s: %u entries%s, scan %.2f ms, sort %.2f ms, key cmp %u, name cmp %u, f_stat %u, f_readdir %u, sectors %u\n",
+        dir.c_str(), num, (fr == FR_NOT_ENOUGH_CORE) ? " (truncated)" : "", scanMs, sortMs,
+        cnt.key_cmp_cnt, cnt.name_cmp_cnt, cnt.f_stat_cnt, io.f_readdir_cnt, io.disk_read_sectors);
+    addMetric("sort", dir, "scan_ms", scanMs);
+    addMetric("sort", dir, "sort_ms", sortMs);
+    addMetric("sort", dir, "key_cmp", cnt.key_cmp_cnt);
+    addMetric("sort", dir, "name_cmp", cnt.name_cmp_cnt);
+    addMetric("sort", dir, "f_stat", cnt.f_stat_cnt);
+    addMetric("sort", dir, "f_readdir", io.f_readdir_cnt);
+    addMetric("sort", dir, "sectors", io.disk_read_sectors);
+
+    char name[FF_MAX_LFN + 1];
+    for (uint16_t order = 0; order < num; order++) {
+        file_menu_type_t type = file_menu_get_type(order);
+        if (type == FILE_MENU_TYPE_DIR || type == FILE_MENU_TYPE_OTHER) { continue; }
+        if (file_menu_get_fname(order, name, sizeof(name)) != FR_OK) { continue; }
+        entries.push_back({joinPath(dir, name), type});
+    }
+    return true;
+}
+
+static void benchImage(const std::string& path, bool isPng, size_t pos = 0, size_t size = 0)
+{
+    host_io_stats_t io;
+    host_io_stats_get(&io);
+    imgFit.config(imageBuf, IMAGE_W, IMAGE_H);
+    uint64_t start = nowNs();
+    bool ok = isPng ? imgFit.loadPngFile(path.c_str(), pos, size) : imgFit.loadJpegFile(path.c_str(), pos, size);
+    double ms = (nowNs() - start) / 1e6;
+    io = ioDelta(io);
+    std::string name = (size > 0) ? path + "#" + std::to_string(pos) : path;  // embedded picture
+    if (!ok) {
+        printf("image  %s: not decoded\n", name.c_str());
+        return;
+    }
+    uint16_t w, h;
+    imgFit.getSizeAfterFit(&w, &h);
+    printf("image  %s: %ux%u, %.2f ms, f_read %u\n", name.c_str(), w, h, ms, io.f_read_cnt);
+    addMetric("image", name, "ms", ms);
+    addMetric("image", name, "f_read", io.f_read_cnt);
+}
+
+static void benchTag(const std::string& path)
+{
+    char str[256];
+    host_io_stats_t io;
+    host_io_stats_get(&io);
+    uint64_t start = nowNs();
+    tag.loadFile(path.c_str());
+    tag.getUTF8Track(str, sizeof(str));
+    tag.getUTF8Title(str, sizeof(str));
+    tag.getUTF8Album(str, sizeof(str));
+    tag.getUTF8Artist(str, sizeof(str));
+    double ms = (nowNs() - start) / 1e6;
+    io = ioDelta(io);
+    printf("tag    %s: %.3f ms, f_read %u\n", path.c_str(), ms, io.f_read_cnt);
+    addMetric("tag", path, "ms", ms);
+    addMetric("tag", path, "f_read", io.f_read_cnt);
+
+    mime_t mime;
+    ptype_t ptype;
+    size_t pos;
+    size_t size;
+    bool isUnsynced;
+    bool hasPicture = tag.getPicturePos(0, mime, ptype, pos, size, isUnsynced) && !isUnsynced && (mime == jpeg || mime == png);
+    tag.close();
+    if (hasPicture) { benchImage(path, mime == png, pos, size); }
+}
+
+// decode whole track as fast as possible, time is measured only inside decode stage
+// (decode waits for core1 to refill secondaryBuffer so that instant mute does not dilute the result)
+static void benchDecode(const std::string& path, bool isFlac)
+{
+    PlayAudio* codec = isFlac ? static_cast<PlayAudio*>(playFlac) : static_cast<PlayAudio*>(playWav);
+    void (*decode)() = isFlac ? PlayFlac::decode_func : PlayWav::decode_func;
+    ReadBuffer* rdbuf = ReadBuffer::getInstance();
+    host_io_stats_t io;
+    audio_stats_reset();
+    host_io_stats_get(&io);
+    codec->play(path.c_str());
+    if (!codec->isPlaying()) {
+        printf("decode %s: not supported\n", path.c_str());
+        return;
+    }
+    uint32_t sampFreq = codec->getSampFreq();
+    uint64_t samples = host_audio_samples_given();
+    uint64_t busyNs = 0;
+    while (codec->isPlaying()) {
+        for (int i = 0; i < 1000 && rdbuf->isNearEmpty(); i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        uint64_t start = nowNs();
+        host_irq_run(decode);
+        busyNs += nowNs() - start;
+    }
+    codec->stop();  // close the track ended by decode stage as UI does
+    samples = host_audio_samples_given() - samples;
+    io = ioDelta(io);
+    audio_stats_t stats;
+    audio_stats_get(&stats);
+    double nsPerSample = (samples > 0) ? static_cast<double>(busyNs) / samples : 0.0;
+    printf("decode %s: %u Hz %u bit, %llu samples, %.1f ns/sample, f_read %u, sectors %u, underruns %u\n",
+        path.c_str(), sampFreq, codec->getBitsPerSample(), static_cast<unsigned long long>(samples), nsPerSample,
+        io.f_read_cnt, io.disk_read_sectors, stats.underruns);
+    addMetric("decode", path, "ns_per_sample", nsPerSample);
+    addMetric("decode", path, "f_read", io.f_read_cnt, false);  // read batch adapts to time of f_read
+}
+
+static bool hasExt(const std::string& path, const char* ext)
+{
+    size_t len = strlen(ext);
+    if (path.size() < len) { return false; }
+    return strcasecmp(path.c_str() + path.size() - len, ext) == 0;
+}
+
+static bool writeResults(const char* filename)
+{
+    FILE* fp = fopen(filename, "w");
+    if (fp == nullptr) { return false; }
+    for (const metric_t& m : metrics) {
+        fprintf(fp, "%s\t%.6g\n", m.key.c_str(), m.value);
+    }
+    fclose(fp);
+    return true;
+}
+
+// returns number of gated metrics exceeding baseline by more than threshold (-1: baseline not readable)
+static int compareBaseline(const char* filename, double thresholdPercent)
+{
+    FILE* fp = fopen(filename, "r");
+    if (fp == nullptr) { return -1; }
+    std::map<std::string, double> baseline;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        char* tab = strrchr(line, '\t');
+        if (tab == nullptr) { continue; }
+        *tab = '\0';
+        baseline[line] = atof(tab + 1);
+    }
+    fclose(fp);
+    int regressions = 0;
+    for (const metric_t& m : metrics) {
+        auto it = baseline.find(m.key);
+        if (!m.gated || it == baseline.end()) { continue; }
+        double limit = it->second * (1.0 + thresholdPercent / 100.0);
+        if (m.value > limit && m.value > it->second + 1e-3) {
+            printf("REGRESSION %s: %.6g (baseline %.6g)\n", m.key.c_str(), m.value, it->second);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void usage(const char* prog)
+{
+    printf("usage: %s [-r output_rate] [-q eq_preset] [-o result.tsv] [-b baseline.tsv] [-t percent] image dir...\n", prog);
+    printf("  image: FAT16/FAT32/exFAT disk image (read only)\n");
+    printf("  dir:   absolute directory path in image, whose entries are sorted and whose audio and image files are measured\n");
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t outputRate = 0;
+    uint32_t eqPreset = Equalizer::Off;
+    const char* resultFile = nullptr;
+    const char* baselineFile = nullptr;
+    double thresholdPercent = DEFAULT_THRESHOLD_PERCENT;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:q:o:b:t:h")) != -1) {
+        switch (opt) {
+            case 'r': outputRate = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'q': eqPreset = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'o': resultFile = optarg; break;
+            case 'b': baselineFile = optarg; break;
+            case 't': thresholdPercent = atof(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (host_disk_open(argv[optind]) != 0) {
+        printf("ERROR: cannot open %s\n", argv[optind]);
+        return 2;
+    }
+    uint8_t fsType;
+    if (file_menu_init(&fsType) != FR_OK) {
+        printf("ERROR: no FAT volume in %s\n", argv[optind]);
+        return 2;
+    }
+    file_menu_set_index_cache(0);  // measure sort every time (image is read only anyway)
+
+    PlayAudio::setOutputRate(outputRate);
+    PlayAudio::setEqPreset((eqPreset < Equalizer::NUM_PRESETS) ? static_cast<Equalizer::preset_t>(eqPreset) : Equalizer::Off);
+    PlayAudio::initialize();
+    playWav = new PlayWav();  // launches ReadBuffer on core1 thread, which serves tag and image reads as well
+    playFlac = new PlayFlac();
+
+    for (int i = optind + 1; i < argc; i++) {
+        std::vector<entry_t> entries;
+        if (!benchSort(argv[i], entries)) { continue; }
+        for (const entry_t& e : entries) {
+            if (e.type == FILE_MENU_TYPE_AUDIO) {
+                benchTag(e.path);
+                benchDecode(e.path, hasExt(e.path, ".flac"));
+            } else {
+                benchImage(e.path, e.type == FILE_MENU_TYPE_PNG);
+            }
+        }
+    }
+
+    int result = 0;
+    if (resultFile != nullptr && !writeResults(resultFile)) {
+        printf("ERROR: cannot write %s\n", resultFile);
+        result = 2;
+    }
+    if (baselineFile != nullptr) {
+        int regressions = compareBaseline(baselineFile, thresholdPercent);
+        if (regressions < 0) {
+            printf("ERROR: cannot read %s\n", baselineFile);
+            result = 2;
+        } else {
+            printf("%d regression(s) over %.1f %% of %s\n", regressions, thresholdPercent, baselineFile);
+            if (regressions > 0 && result == 0) { result = 1; }
+        }
+    }
+    fflush(stdout);
+    std::_Exit(result);  // core1 thread stays in ReadBuffer::fillLoop()
+}
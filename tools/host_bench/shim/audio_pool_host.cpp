@@ -0,0 +1,107 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+// Replaces i2s_audio_init.cpp: producer pool without I2S consumer
+// a buffer given by decoder is free again at once, so that each decode call produces one buffer
+
+#include <cstdio>
+
+#include "audio_codec.h"
+#include "i2s_audio_init.h"
+
+#include "host_shim.h"
+
+struct audio_buffer_pool {
+    audio_buffer_t buffers[MAX_PRODUCER_BUFFERS];
+    mem_buffer_t mems[MAX_PRODUCER_BUFFERS];
+    int num;
+    int next;
+};
+
+static audio_buffer_pool_t* _producer_pool = nullptr;
+static int _samples_per_buffer = SAMPLES_PER_BUFFER;
+static int _num_producer_buffers = NUM_PRODUCER_BUFFERS;
+static uint32_t _samp_freq = 44100;
+static uint64_t _samples_given = 0;
+
+audio_buffer_t* take_audio_buffer(audio_buffer_pool_t* ac, bool block)
+{
+    (void) block;
+    audio_buffer_t* buffer = &ac->buffers[ac->next];
+    ac->next = (ac->next + 1) % ac->num;
+    return buffer;
+}
+
+void give_audio_buffer(audio_buffer_pool_t* ac, audio_buffer_t* buffer)
+{
+    (void) ac;
+    _samples_given += buffer->sample_count;
+}
+
+uint64_t host_audio_samples_given(void)
+{
+    return _samples_given;
+}
+
+void i2s_set_buffer_config(int samples_per_buffer, int num_buffers)
+{
+    if (_producer_pool != nullptr) { return; }  // not changeable once the pool is created
+    _samples_per_buffer = samples_per_buffer;
+    _num_producer_buffers = (num_buffers <= MAX_PRODUCER_BUFFERS) ? num_buffers : MAX_PRODUCER_BUFFERS;
+}
+
+int i2s_get_samples_per_buffer()
+{
+    return _samples_per_buffer;
+}
+
+int i2s_get_num_producer_buffers()
+{
+    return _num_producer_buffers;
+}
+
+void i2s_setup(uint32_t samp_freq, audio_buffer_pool_t*& ap)
+{
+    if (_producer_pool == nullptr) { i2s_audio_init(samp_freq); }
+    _samp_freq = samp_freq;
+    ap = _producer_pool;
+}
+
+uint32_t i2s_get_samp_freq()
+{
+    return _samp_freq;
+}
+
+void i2s_audio_init(uint32_t sample_freq)
+{
+    constexpr size_t BYTES_PER_SAMPLE = 8;  // S32 stereo
+    _samp_freq = sample_freq;
+    _producer_pool = new audio_buffer_pool_t();
+    _producer_pool->num = _num_producer_buffers;
+    for (int i = 0; i < _num_producer_buffers; i++) {
+        mem_buffer_t& mem = _producer_pool->mems[i];
+        mem.size = _samples_per_buffer * BYTES_PER_SAMPLE;
+        mem.bytes = new uint8_t[mem.size];
+        _producer_pool->buffers[i].buffer = &mem;
+        _producer_pool->buffers[i].max_sample_count = _samples_per_buffer;
+    }
+}
+
+void i2s_audio_deinit()
+{
+    if (_producer_pool == nullptr) { return; }
+    for (int i = 0; i < _producer_pool->num; i++) {
+        delete[] _producer_pool->mems[i].bytes;
+    }
+    delete _producer_pool;
+    _producer_pool = nullptr;
+}
+
+// DAC is not attached (audio_codec.cpp is not built on host)
+void audio_codec_dac_enable(bool flag)
+{
+    (void) flag;
+}
@@ -0,0 +1,122 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+// FatFs media access on a disk image file instead of SD card (read only, the image is never modified)
+// f_read and f_readdir are wrapped at link (-Wl,--wrap) to be counted together with sector reads
+
+#include <atomic>
+#include <cstdio>
+
+#include "ff.h"
+#include "diskio.h"
+
+#include "host_shim.h"
+
+static constexpr UINT SECTOR_SIZE = 512;
+
+static FILE* _image = nullptr;
+static LBA_t _sector_count = 0;
+static std::atomic<uint32_t> _f_read_cnt{0};
+static std::atomic<uint32_t> _f_readdir_cnt{0};
+static std::atomic<uint32_t> _disk_read_cnt{0};
+static std::atomic<uint32_t> _disk_read_sectors{0};
+
+int host_disk_open(const char* image_path)
+{
+    host_disk_close();
+    _image = fopen(image_path, "rb");
+    if (_image == nullptr) { return -1; }
+    fseeko(_image, 0, SEEK_END);
+    _sector_count = static_cast<LBA_t>(ftello(_image) / SECTOR_SIZE);
+    return 0;
+}
+
+void host_disk_close(void)
+{
+    if (_image == nullptr) { return; }
+    fclose(_image);
+    _image = nullptr;
+}
+
+void host_io_stats_get(host_io_stats_t* stats)
+{
+    stats->f_read_cnt = _f_read_cnt;
+    stats->f_readdir_cnt = _f_readdir_cnt;
+    stats->disk_read_cnt = _disk_read_cnt;
+    stats->disk_read_sectors = _disk_read_sectors;
+}
+
+extern "C" {
+
+FRESULT __real_f_read(FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT __real_f_readdir(DIR* dp, FILINFO* fno);
+
+FRESULT __wrap_f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+    _f_read_cnt++;
+    return __real_f_read(fp, buff, btr, br);
+}
+
+FRESULT __wrap_f_readdir(DIR* dp, FILINFO* fno)
+{
+    _f_readdir_cnt++;
+    return __real_f_readdir(dp, fno);
+}
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return disk_status(pdrv);
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+    if (pdrv != 0) { return STA_NOINIT; }
+    return (_image != nullptr) ? STA_PROTECT : STA_NOINIT;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count)
+{
+    if (pdrv != 0 || _image == nullptr) { return RES_NOTRDY; }
+    if (sector + count > _sector_count) { return RES_PARERR; }
+    _disk_read_cnt++;
+    _disk_read_sectors += count;
+    if (fseeko(_image, static_cast<off_t>(sector) * SECTOR_SIZE, SEEK_SET) != 0) { return RES_ERROR; }
+    return (fread(buff, SECTOR_SIZE, count, _image) == count) ? RES_OK : RES_ERROR;
+}
+
+#if FF_FS_READONLY == 0
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count)
+{
+    return RES_WRPRT;
+}
+#endif // FF_FS_READONLY == 0
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+    if (pdrv != 0 || _image == nullptr) { return RES_NOTRDY; }
+    switch (cmd) {
+        case CTRL_SYNC:
+            return RES_OK;
+        case GET_SECTOR_COUNT:
+            *static_cast<LBA_t*>(buff) = _sector_count;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *static_cast<WORD*>(buff) = SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *static_cast<DWORD*>(buff) = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+DWORD get_fattime(void)
+{
+    return ((DWORD) (2024 - 1980) << 25) | ((DWORD) 1 << 21) | ((DWORD) 1 << 16);
+}
+
+}  // extern "C"
@@ -0,0 +1,23 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include "pico/platform.h"
+
+#define KHZ 1000
+#define MHZ 1000000
+
+enum clock_index {
+    clk_sys = 5
+};
+
+// budgets scaled by clk_sys (e.g. Equalizer bands) are given as while audio is played on device
+static inline uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    (void) clk_index;
+    return 96 * MHZ;
+}
@@ -0,0 +1,32 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+// Host side of the shims (not part of pico-sdk API)
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t f_read_cnt;      // f_read() calls by any module (wrapped at link)
+    uint32_t f_readdir_cnt;   // f_readdir() calls by any module (wrapped at link)
+    uint32_t disk_read_cnt;   // disk_read() calls to the image (= SD card commands)
+    uint32_t disk_read_sectors;
+} host_io_stats_t;
+
+int host_disk_open(const char* image_path);  // returns 0 if the image is opened (read only)
+void host_disk_close(void);
+void host_io_stats_get(host_io_stats_t* stats);  // counters since start (subtract snapshots for an interval)
+void host_irq_run(void (*func)(void));  // call func as if in IRQ handler (__get_current_exception() != 0)
+uint64_t host_audio_samples_given(void);  // samples of producer buffers given by decoders since start
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include "pico/platform.h"
+
+#ifndef PICO_AUDIO_I2S_BUFFER_SAMPLE_LENGTH
+#define PICO_AUDIO_I2S_BUFFER_SAMPLE_LENGTH 1152
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// subset of pico_audio used by decoders
+typedef struct mem_buffer {
+    size_t size;
+    uint8_t* bytes;
+    uint8_t flags;
+} mem_buffer_t;
+
+typedef struct audio_buffer {
+    mem_buffer_t* buffer;
+    uint32_t sample_count;
+    uint32_t max_sample_count;
+} audio_buffer_t;
+
+typedef struct audio_buffer_pool audio_buffer_pool_t;  // buffers are given back as soon as they are given (no consumer)
+
+audio_buffer_t* take_audio_buffer(audio_buffer_pool_t* ac, bool block);
+void give_audio_buffer(audio_buffer_pool_t* ac, audio_buffer_t* buffer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <pthread.h>  // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP needs _GNU_SOURCE (given by CMakeLists.txt)
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int8_t lock_owner_id_t;  // core number as pico-sdk without RTOS
+#define LOCK_INVALID_OWNER_ID ((lock_owner_id_t) -1)
+
+typedef struct {
+    pthread_mutex_t mtx;
+    volatile lock_owner_id_t owner;
+    uint8_t enter_count;
+} recursive_mutex_t;
+
+#define auto_init_recursive_mutex(name) recursive_mutex_t name = { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, LOCK_INVALID_OWNER_ID, 0 }
+
+static inline lock_owner_id_t lock_get_caller_owner_id(void)
+{
+    return (lock_owner_id_t) get_core_num();
+}
+
+static inline void recursive_mutex_enter_blocking(recursive_mutex_t* mtx)
+{
+    pthread_mutex_lock(&mtx->mtx);
+    mtx->owner = lock_get_caller_owner_id();
+    mtx->enter_count++;
+}
+
+static inline bool recursive_mutex_try_enter(recursive_mutex_t* mtx, uint32_t* owner_out)
+{
+    if (pthread_mutex_trylock(&mtx->mtx) != 0) {
+        if (owner_out != NULL) { *owner_out = (uint32_t) mtx->owner; }
+        return false;
+    }
+    mtx->owner = lock_get_caller_owner_id();
+    mtx->enter_count++;
+    return true;
+}
+
+static inline void recursive_mutex_exit(recursive_mutex_t* mtx)
+{
+    if (--mtx->enter_count == 0) { mtx->owner = LOCK_INVALID_OWNER_ID; }
+    pthread_mutex_unlock(&mtx->mtx);
+}
+
+#ifdef __cplusplus
+}
+#endif
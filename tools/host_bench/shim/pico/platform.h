@@ -0,0 +1,32 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+
+typedef unsigned int uint;
+
+uint __get_current_exception(void);  // non-zero only inside host_irq_run()
+uint get_core_num(void);  // 0: main thread, 1: thread launched by multicore_launch_core1()
+
+static inline void tight_loop_contents(void) {}
+
+#ifdef __cplusplus
+}
+#endif
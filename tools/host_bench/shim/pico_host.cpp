@@ -0,0 +1,99 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+#include "host_shim.h"
+
+static const std::chrono::steady_clock::time_point _boot = std::chrono::steady_clock::now();
+
+// event register of core0 (main thread) and core1 (thread launched by multicore_launch_core1())
+static constexpr uint32_t WFE_TIMEOUT_US = 1000;  // bounds a missed event as spurious wake up of WFE on device
+static std::mutex _event_mtx;
+static std::condition_variable _event_cv;
+static bool _event[2];
+static thread_local int _core_num = 0;
+static thread_local uint _exception = 0;
+static bool _core1_launched = false;
+
+uint64_t time_us_64(void)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _boot).count());
+}
+
+uint32_t time_us_32(void)
+{
+    return static_cast<uint32_t>(time_us_64());
+}
+
+void sleep_us(uint64_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void sleep_ms(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint __get_current_exception(void)
+{
+    return _exception;
+}
+
+uint get_core_num(void)
+{
+    return static_cast<uint>(_core_num);
+}
+
+void host_irq_run(void (*func)(void))
+{
+    constexpr uint USER_IRQ_EXCEPTION = 16 + 26;  // first user IRQ of RP2040
+    uint prev = _exception;
+    _exception = USER_IRQ_EXCEPTION;
+    func();
+    _exception = prev;
+}
+
+void __sev(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_event_mtx);
+        _event[0] = true;
+        _event[1] = true;
+    }
+    _event_cv.notify_all();
+}
+
+void __wfe(void)
+{
+    std::unique_lock<std::mutex> lock(_event_mtx);
+    bool& event = _event[_core_num];
+    _event_cv.wait_for(lock, std::chrono::microseconds(WFE_TIMEOUT_US), [&event] { return event; });
+    event = false;
+}
+
+void multicore_reset_core1(void)
+{
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    if (_core1_launched) { return; }
+    _core1_launched = true;
+    std::thread([entry] {
+        _core_num = 1;
+        entry();
+    }).detach();
+}
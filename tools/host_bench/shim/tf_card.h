@@ -0,0 +1,42 @@
+/*------------------------------------------------------/
+/ Copyright (c) 2024, Elehobica
+/ Released under the BSD-2-Clause
+/ refer to https://opensource.org/licenses/BSD-2-Clause
+/------------------------------------------------------*/
+
+#pragma once
+
+#include "pico/stdlib.h"
+
+// SPI configuration of pico_fatfs is accepted and ignored (disk_* functions read the image given to host_disk_open())
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct spi_inst spi_inst_t;
+#define spi0 ((spi_inst_t*) 0)
+
+#define CLK_SLOW_DEFAULT      (100 * KHZ)
+#define PIN_SPI0_MISO_DEFAULT 4
+#define PIN_SPI0_CS_DEFAULT   5
+#define PIN_SPI0_SCK_DEFAULT  2
+#define PIN_SPI0_MOSI_DEFAULT 3
+
+typedef struct {
+    spi_inst_t* spi_inst;
+    uint clk_slow;
+    uint clk_fast;
+    uint pin_miso;
+    uint pin_cs;
+    uint pin_sck;
+    uint pin_mosi;
+    bool pullup;
+} pico_fatfs_spi_config_t;
+
+static inline bool pico_fatfs_set_config(pico_fatfs_spi_config_t* config) { (void) config; return true; }
+static inline int pico_fatfs_reboot_spi(void) { return 1; }
+
+#ifdef __cplusplus
+}
+#endif